@@ -14,6 +14,8 @@ static char *unop_names[] = {
 	"OP_NOT",
 	"OP_BNOT",
 	"OP_IDENT",
+	"OP_CARD",
+	"OP_LENGTH",
 };
 
 static char *binop_names[] = {
@@ -35,6 +37,7 @@ static char *binop_names[] = {
 	"OP_BXOR",
 	"OP_BLSHIFT",
 	"OP_BRSHIFT",
+	"OP_IN",
 };
 
 expr_node *ex_new(void) {
@@ -42,6 +45,7 @@ expr_node *ex_new(void) {
 	assert(res);
 	res->refcnt = 1;
 	res->type = NULL;
+	res->effects = 0;
 	return res;
 }
 
@@ -89,10 +93,38 @@ expr_node *ex_new_setindex(expr_node *object, expr_node *index, expr_node *value
 	return res;
 }
 
+expr_node *ex_new_field(expr_node *object, const char *ident) {
+	expr_node *res = ex_new();
+	res->kind = EX_FIELD;
+	res->field.object = ex_copy(object);
+	res->field.ident = strdup(ident);
+	return res;
+}
+
+expr_node *ex_new_setfield(expr_node *object, const char *ident, expr_node *value) {
+	expr_node *res = ex_new();
+	res->kind = EX_SETFIELD;
+	res->setfield.object = ex_copy(object);
+	res->setfield.ident = strdup(ident);
+	res->setfield.value = ex_copy(value);
+	return res;
+}
+
+expr_node *ex_new_set(vector *items) {
+	expr_node *res = ex_new();
+	res->kind = EX_SET;
+	vec_init(&res->set.items);
+	if(items) {
+		vec_map(items, &res->set.items, (vec_map_f) ex_copy, NULL);
+	}
+	return res;
+}
+
 expr_node *ex_new_call(expr_node *func, vector *params) {
 	expr_node *res = ex_new();
 	res->kind = EX_CALL;
 	res->call.func = ex_copy(func);
+	vec_init(&res->call.params);
 	vec_map(params, &res->call.params, (vec_map_f) ex_copy, NULL);
 	return res;
 }
@@ -128,6 +160,46 @@ expr_node *ex_new_ind(expr_node *lvalue) {
 	return res;
 }
 
+expr_node *ex_new_slice(expr_node *object, expr_node *lbound, expr_node *ubound) {
+	expr_node *res = ex_new();
+	res->kind = EX_SLICE;
+	res->slice.object = ex_copy(object);
+	res->slice.lbound = ex_copy(lbound);
+	res->slice.ubound = ex_copy(ubound);
+	return res;
+}
+
+expr_node *ex_new_setlength(expr_node *object, expr_node *value) {
+	expr_node *res = ex_new();
+	res->kind = EX_SETLENGTH;
+	res->setlength.object = ex_copy(object);
+	res->setlength.value = ex_copy(value);
+	return res;
+}
+
+expr_node *ex_new_deref(expr_node *object) {
+	expr_node *res = ex_new();
+	res->kind = EX_DEREF;
+	res->deref.object = ex_copy(object);
+	return res;
+}
+
+expr_node *ex_new_setderef(expr_node *object, expr_node *value) {
+	expr_node *res = ex_new();
+	res->kind = EX_SETDEREF;
+	res->setderef.object = ex_copy(object);
+	res->setderef.value = ex_copy(value);
+	return res;
+}
+
+/* kind is EX_NEW or EX_DISPOSE */
+expr_node *ex_new_alloc(expr_k kind, expr_node *object) {
+	expr_node *res = ex_new();
+	res->kind = kind;
+	res->alloc.object = ex_copy(object);
+	return res;
+}
+
 void ex_delete(expr_node *ex) {
 	if(!(--ex->refcnt)) {
 		ex_destroy(ex);
@@ -163,9 +235,26 @@ void ex_destroy(expr_node *ex) {
 			ex_delete(ex->setindex.value);
 			break;
 
+		case EX_FIELD:
+			ex_delete(ex->field.object);
+			free(ex->field.ident);
+			break;
+
+		case EX_SETFIELD:
+			ex_delete(ex->setfield.object);
+			free(ex->setfield.ident);
+			ex_delete(ex->setfield.value);
+			break;
+
 		case EX_CALL:
 			ex_delete(ex->call.func);
 			vec_foreach(&ex->call.params, (vec_iter_f) ex_delete, NULL);
+			vec_clear(&ex->call.params);
+			break;
+
+		case EX_SET:
+			vec_foreach(&ex->set.items, (vec_iter_f) ex_delete, NULL);
+			vec_clear(&ex->set.items);
 			break;
 
 		case EX_UNOP:
@@ -185,13 +274,35 @@ void ex_destroy(expr_node *ex) {
 			ex_delete(ex->ind.lvalue);
 			break;
 
+		case EX_SLICE:
+			ex_delete(ex->slice.object);
+			ex_delete(ex->slice.lbound);
+			ex_delete(ex->slice.ubound);
+			break;
+
+		case EX_SETLENGTH:
+			ex_delete(ex->setlength.object);
+			ex_delete(ex->setlength.value);
+			break;
+
+		case EX_DEREF:
+			ex_delete(ex->deref.object);
+			break;
+
+		case EX_SETDEREF:
+			ex_delete(ex->setderef.object);
+			ex_delete(ex->setderef.value);
+			break;
+
+		case EX_NEW:
+		case EX_DISPOSE:
+			ex_delete(ex->alloc.object);
+			break;
+
 		default:
 			assert(0);
 			break;
 	}
-	if(ex->type) {
-		type_delete(ex->type);
-	}
 	free(ex);
 }
 
@@ -234,6 +345,19 @@ void ex_print(FILE *out, int lev, expr_node *ex) {
 			ex_print(out, lev + 2, ex->setindex.value);
 			break;
 
+		case EX_FIELD:
+			wrlev(out, lev, "Field: .%s <%s>", ex->field.ident, type_repr(ex->type));
+			ex_print(out, lev + 1, ex->field.object);
+			break;
+
+		case EX_SETFIELD:
+			wrlev(out, lev, "SetField: .%s <%s>", ex->setfield.ident, type_repr(ex->type));
+			wrlev(out, lev + 1, "object:");
+			ex_print(out, lev + 2, ex->setfield.object);
+			wrlev(out, lev + 1, "value:");
+			ex_print(out, lev + 2, ex->setfield.value);
+			break;
+
 		case EX_CALL:
 			wrlev(out, lev, "Call: <%s>", type_repr(ex->type));
 			wrlev(out, lev + 1, "func:");
@@ -244,6 +368,13 @@ void ex_print(FILE *out, int lev, expr_node *ex) {
 			}
 			break;
 
+		case EX_SET:
+			wrlev(out, lev, "Set: <%s>", type_repr(ex->type));
+			for(i = 0; i < ex->set.items.len; i++) {
+				ex_print(out, lev + 1, vec_get(&ex->set.items, i, expr_node));
+			}
+			break;
+
 		case EX_UNOP:
 			wrlev(out, lev, "Unop: %s <%s>", unop_names[ex->unop.kind], type_repr(ex->type));
 			ex_print(out, lev + 1, ex->unop.expr);
@@ -267,12 +398,226 @@ void ex_print(FILE *out, int lev, expr_node *ex) {
 			ex_print(out, lev + 1, ex->ind.lvalue);
 			break;
 
+		case EX_SLICE:
+			wrlev(out, lev, "Slice: <%s>", type_repr(ex->type));
+			wrlev(out, lev + 1, "object:");
+			ex_print(out, lev + 2, ex->slice.object);
+			wrlev(out, lev + 1, "lbound:");
+			ex_print(out, lev + 2, ex->slice.lbound);
+			wrlev(out, lev + 1, "ubound:");
+			ex_print(out, lev + 2, ex->slice.ubound);
+			break;
+
+		case EX_SETLENGTH:
+			wrlev(out, lev, "SetLength: <%s>", type_repr(ex->type));
+			wrlev(out, lev + 1, "object:");
+			ex_print(out, lev + 2, ex->setlength.object);
+			wrlev(out, lev + 1, "value:");
+			ex_print(out, lev + 2, ex->setlength.value);
+			break;
+
+		case EX_DEREF:
+			wrlev(out, lev, "Deref: <%s>", type_repr(ex->type));
+			ex_print(out, lev + 1, ex->deref.object);
+			break;
+
+		case EX_SETDEREF:
+			wrlev(out, lev, "SetDeref: <%s>", type_repr(ex->type));
+			wrlev(out, lev + 1, "object:");
+			ex_print(out, lev + 2, ex->setderef.object);
+			wrlev(out, lev + 1, "value:");
+			ex_print(out, lev + 2, ex->setderef.value);
+			break;
+
+		case EX_NEW:
+		case EX_DISPOSE:
+			wrlev(out, lev, "%s: <%s>", ex->kind == EX_NEW ? "New" : "Dispose", type_repr(ex->type));
+			ex_print(out, lev + 1, ex->alloc.object);
+			break;
+
 		default:
 			wrlev(out, lev, "!!!UNKOWN EXPR_NODE!!! <%s>", type_repr(ex->type));
 			break;
 	}
 }
 
+void ex_dump(dumper *d, expr_node *ex) {
+	size_t i;
+	if(!ex) {
+		dump_null(d);
+		return;
+	}
+	dump_begin_obj(d);
+	dump_key(d, "type");
+	type_dump(d, ex->type);
+	dump_key(d, "kind");
+	switch(ex->kind) {
+		case EX_LIT:
+			dump_str(d, "lit");
+			dump_key(d, "lit");
+			lit_dump(d, ex->lit.lit);
+			break;
+
+		case EX_REF:
+			dump_str(d, "ref");
+			dump_key(d, "ident");
+			dump_str(d, ex->ref.ident);
+			break;
+
+		case EX_ASSIGN:
+			dump_str(d, "assign");
+			dump_key(d, "ident");
+			dump_str(d, ex->assign.ident);
+			dump_key(d, "value");
+			ex_dump(d, ex->assign.value);
+			break;
+
+		case EX_INDEX:
+			dump_str(d, "index");
+			dump_key(d, "object");
+			ex_dump(d, ex->index.object);
+			dump_key(d, "index");
+			ex_dump(d, ex->index.index);
+			break;
+
+		case EX_SETINDEX:
+			dump_str(d, "setindex");
+			dump_key(d, "object");
+			ex_dump(d, ex->setindex.object);
+			dump_key(d, "index");
+			ex_dump(d, ex->setindex.index);
+			dump_key(d, "value");
+			ex_dump(d, ex->setindex.value);
+			break;
+
+		case EX_FIELD:
+			dump_str(d, "field");
+			dump_key(d, "object");
+			ex_dump(d, ex->field.object);
+			dump_key(d, "ident");
+			dump_str(d, ex->field.ident);
+			break;
+
+		case EX_SETFIELD:
+			dump_str(d, "setfield");
+			dump_key(d, "object");
+			ex_dump(d, ex->setfield.object);
+			dump_key(d, "ident");
+			dump_str(d, ex->setfield.ident);
+			dump_key(d, "value");
+			ex_dump(d, ex->setfield.value);
+			break;
+
+		case EX_CALL:
+			dump_str(d, "call");
+			dump_key(d, "func");
+			ex_dump(d, ex->call.func);
+			dump_key(d, "params");
+			dump_begin_arr(d);
+			for(i = 0; i < ex->call.params.len; i++) {
+				ex_dump(d, vec_get(&ex->call.params, i, expr_node));
+			}
+			dump_end_arr(d);
+			break;
+
+		case EX_SET:
+			dump_str(d, "set");
+			dump_key(d, "items");
+			dump_begin_arr(d);
+			for(i = 0; i < ex->set.items.len; i++) {
+				ex_dump(d, vec_get(&ex->set.items, i, expr_node));
+			}
+			dump_end_arr(d);
+			break;
+
+		case EX_UNOP:
+			dump_str(d, "unop");
+			dump_key(d, "op");
+			dump_str(d, unop_names[ex->unop.kind]);
+			dump_key(d, "expr");
+			ex_dump(d, ex->unop.expr);
+			break;
+
+		case EX_BINOP:
+			dump_str(d, "binop");
+			dump_key(d, "op");
+			dump_str(d, binop_names[ex->binop.kind]);
+			dump_key(d, "left");
+			ex_dump(d, ex->binop.left);
+			dump_key(d, "right");
+			ex_dump(d, ex->binop.right);
+			break;
+
+		case EX_RETURN:
+			dump_str(d, "return");
+			dump_key(d, "value");
+			ex_dump(d, ex->return_.value);
+			break;
+
+		case EX_IND:
+			dump_str(d, "ind");
+			dump_key(d, "lvalue");
+			ex_dump(d, ex->ind.lvalue);
+			break;
+
+		case EX_SLICE:
+			dump_str(d, "slice");
+			dump_key(d, "object");
+			ex_dump(d, ex->slice.object);
+			dump_key(d, "lbound");
+			ex_dump(d, ex->slice.lbound);
+			dump_key(d, "ubound");
+			ex_dump(d, ex->slice.ubound);
+			break;
+
+		case EX_SETLENGTH:
+			dump_str(d, "setlength");
+			dump_key(d, "object");
+			ex_dump(d, ex->setlength.object);
+			dump_key(d, "value");
+			ex_dump(d, ex->setlength.value);
+			break;
+
+		case EX_DEREF:
+			dump_str(d, "deref");
+			dump_key(d, "object");
+			ex_dump(d, ex->deref.object);
+			break;
+
+		case EX_SETDEREF:
+			dump_str(d, "setderef");
+			dump_key(d, "object");
+			ex_dump(d, ex->setderef.object);
+			dump_key(d, "value");
+			ex_dump(d, ex->setderef.value);
+			break;
+
+		case EX_NEW:
+		case EX_DISPOSE:
+			dump_str(d, ex->kind == EX_NEW ? "new" : "dispose");
+			dump_key(d, "object");
+			ex_dump(d, ex->alloc.object);
+			break;
+
+		default:
+			dump_null(d);
+			break;
+	}
+	if(ex->effects) {
+		dump_key(d, "effects");
+		effects_dump(d, ex->effects);
+	}
+	dump_end_obj(d);
+}
+
+void effects_dump(dumper *d, unsigned int effects) {
+	dump_begin_arr(d);
+	if(effects & EFF_READ) dump_str(d, "read");
+	if(effects & EFF_WRITE) dump_str(d, "write");
+	if(effects & EFF_UNKNOWN) dump_str(d, "unknown");
+	dump_end_arr(d);
+}
+
 stmt_node *st_new(void) {
 	stmt_node *res = malloc(sizeof(stmt_node));
 	res->refcnt = 1;
@@ -350,6 +695,7 @@ stmt_node *st_new_compound(vector *stmts) {
 	stmt_node *res = st_new();
 	assert(res);
 	res->kind = ST_COMPOUND;
+	vec_init(&res->compound.stmts);
 	vec_map(stmts, &res->compound.stmts, (vec_map_f) st_copy, NULL);
 	return res;
 }
@@ -378,7 +724,9 @@ void st_destroy(stmt_node *st) {
 		case ST_IF:
 			ex_delete(st->if_.cond);
 			st_delete(st->if_.iftrue);
-			st_delete(st->if_.iffalse);
+			if(st->if_.iffalse) {
+				st_delete(st->if_.iffalse);
+			}
 			break;
 
 		case ST_FOR:
@@ -490,6 +838,92 @@ void st_print(FILE *out, int lev, stmt_node *st) {
 	}
 }
 
+void st_dump(dumper *d, stmt_node *st) {
+	size_t i;
+	if(!st) {
+		dump_null(d);
+		return;
+	}
+	dump_begin_obj(d);
+	dump_key(d, "kind");
+	switch(st->kind) {
+		case ST_EXPR:
+			dump_str(d, "expr");
+			dump_key(d, "expr");
+			ex_dump(d, st->expr.expr);
+			break;
+
+		case ST_WHILE:
+			dump_str(d, "while");
+			dump_key(d, "cond");
+			ex_dump(d, st->while_.cond);
+			dump_key(d, "body");
+			st_dump(d, st->while_.body);
+			break;
+
+		case ST_IF:
+			dump_str(d, "if");
+			dump_key(d, "cond");
+			ex_dump(d, st->if_.cond);
+			dump_key(d, "iftrue");
+			st_dump(d, st->if_.iftrue);
+			dump_key(d, "iffalse");
+			st_dump(d, st->if_.iffalse);
+			break;
+
+		case ST_FOR:
+			dump_str(d, "for");
+			dump_key(d, "init");
+			st_dump(d, st->for_.init);
+			dump_key(d, "cond");
+			ex_dump(d, st->for_.cond);
+			dump_key(d, "post");
+			st_dump(d, st->for_.post);
+			dump_key(d, "body");
+			st_dump(d, st->for_.body);
+			break;
+
+		case ST_ITER:
+			dump_str(d, "iter");
+			dump_key(d, "ident");
+			dump_str(d, st->iter.ident);
+			dump_key(d, "value");
+			ex_dump(d, st->iter.value);
+			dump_key(d, "body");
+			st_dump(d, st->iter.body);
+			break;
+
+		case ST_RANGE:
+			dump_str(d, "range");
+			dump_key(d, "ident");
+			dump_str(d, st->range.ident);
+			dump_key(d, "lbound");
+			ex_dump(d, st->range.lbound);
+			dump_key(d, "ubound");
+			ex_dump(d, st->range.ubound);
+			dump_key(d, "step");
+			ex_dump(d, st->range.step);
+			dump_key(d, "body");
+			st_dump(d, st->range.body);
+			break;
+
+		case ST_COMPOUND:
+			dump_str(d, "compound");
+			dump_key(d, "stmts");
+			dump_begin_arr(d);
+			for(i = 0; i < st->compound.stmts.len; i++) {
+				st_dump(d, vec_get(&st->compound.stmts, i, stmt_node));
+			}
+			dump_end_arr(d);
+			break;
+
+		default:
+			dump_null(d);
+			break;
+	}
+	dump_end_obj(d);
+}
+
 decl_node *decl_new(const char *ident, type *ty) {
 	decl_node *res = malloc(sizeof(decl_node));
 	assert(res);
@@ -501,6 +935,7 @@ decl_node *decl_new(const char *ident, type *ty) {
 	}
 	res->init = NULL;
 	res->kind = DECL_VAR;
+	res->mode = ARG_VALUE;
 	return res;
 }
 
@@ -511,6 +946,12 @@ decl_node *decl_new_init(const char *ident, type *ty, expr_node *init) {
 	return res;
 }
 
+decl_node *decl_new_arg(const char *ident, type *ty, arg_mode_k mode) {
+	decl_node *res = decl_new(ident, ty);
+	res->mode = mode;
+	return res;
+}
+
 decl_node *decl_new_func(const char *ident, type *ty, prog_node *prog) {
 	decl_node *res = decl_new(ident, ty);
 	res->prog = prog_copy(prog);
@@ -531,6 +972,12 @@ decl_node *decl_new_type(const char *ident, type *ty) {
 	return res;
 }
 
+decl_node *decl_new_const(const char *ident, type *ty, expr_node *init) {
+	decl_node *res = decl_new_init(ident, ty, init);
+	res->kind = DECL_CONST;
+	return res;
+}
+
 decl_node *decl_copy(decl_node *decl) {
 	return decl;
 }
@@ -547,19 +994,31 @@ void decl_destroy(decl_node *decl) {
 			break;
 
 		case DECL_VAR:
+		case DECL_CONST:
 			if(decl->init) {
 				ex_delete(decl->init);
 			}
 			break;
 
+		case DECL_TYPE:
+			break;
+
 		default:
 			assert(0);
 	}
 	free(decl->ident);
-	type_delete(decl->type);
+	if(decl->type) {
+		type_delete(decl->type);
+	}
 	free(decl);
 }
 
+static const char *arg_mode_names[] = {
+	[ARG_VALUE] = "",
+	[ARG_VAR] = " (var)",
+	[ARG_CONST] = " (const)",
+};
+
 void decl_print(FILE *out, int lev, decl_node *decl) {
 	if(!decl) {
 		wrlev(out, lev, "(NULL)");
@@ -581,7 +1040,7 @@ void decl_print(FILE *out, int lev, decl_node *decl) {
 			break;
 
 		case DECL_VAR:
-			wrlev(out, lev, "(Decl: %s)", decl->ident);
+			wrlev(out, lev, "(Decl: %s%s)", decl->ident, arg_mode_names[decl->mode]);
 			wrlev(out, lev + 1, "type: %s", type_repr(decl->type));
 			wrlev(out, lev + 1, "init:");
 			ex_print(out, lev + 2, decl->init);
@@ -591,12 +1050,60 @@ void decl_print(FILE *out, int lev, decl_node *decl) {
 			wrlev(out, lev, "(TypeDecl: %s => %s)", decl->ident, type_repr(decl->type));
 			break;
 
+		case DECL_CONST:
+			wrlev(out, lev, "(ConstDecl: %s)", decl->ident);
+			wrlev(out, lev + 1, "type: %s", type_repr(decl->type));
+			wrlev(out, lev + 1, "init:");
+			ex_print(out, lev + 2, decl->init);
+			break;
+
 		default:
 			wrlev(out, lev, "!!!(UNKNOWN DECL_NODE %d)!!!", decl->kind);
 			break;
 	}
 }
 
+void decl_dump(dumper *d, decl_node *decl) {
+	if(!decl) {
+		dump_null(d);
+		return;
+	}
+	dump_begin_obj(d);
+	dump_key(d, "ident");
+	dump_str(d, decl->ident);
+	dump_key(d, "type");
+	type_dump(d, decl->type);
+	dump_key(d, "kind");
+	switch(decl->kind) {
+		case DECL_FUNC:
+		case DECL_PROC:
+			dump_str(d, decl->kind == DECL_FUNC ? "func" : "proc");
+			dump_key(d, "program");
+			prog_dump(d, decl->prog);
+			break;
+
+		case DECL_VAR:
+		case DECL_CONST:
+			dump_str(d, decl->kind == DECL_VAR ? "var" : "const");
+			if(decl->mode != ARG_VALUE) {
+				dump_key(d, "mode");
+				dump_str(d, decl->mode == ARG_VAR ? "var" : "const");
+			}
+			dump_key(d, "init");
+			ex_dump(d, decl->init);
+			break;
+
+		case DECL_TYPE:
+			dump_str(d, "type");
+			break;
+
+		default:
+			dump_null(d);
+			break;
+	}
+	dump_end_obj(d);
+}
+
 prog_node *prog_new(const char *ident, vector *args, vector *decls, type *ret, stmt_node *body) {
 	prog_node *res = malloc(sizeof(prog_node));
 	res->ident = strdup(ident);
@@ -653,3 +1160,31 @@ void prog_print(FILE *out, int lev, prog_node *prog) {
 	wrlev(out, lev + 1, "body:");
 	st_print(out, lev + 2, prog->body);
 }
+
+void prog_dump(dumper *d, prog_node *prog) {
+	size_t i;
+	if(!prog) {
+		dump_null(d);
+		return;
+	}
+	dump_begin_obj(d);
+	dump_key(d, "ident");
+	dump_str(d, prog->ident);
+	dump_key(d, "args");
+	dump_begin_arr(d);
+	for(i = 0; i < prog->args.len; i++) {
+		decl_dump(d, vec_get(&prog->args, i, decl_node));
+	}
+	dump_end_arr(d);
+	dump_key(d, "decls");
+	dump_begin_arr(d);
+	for(i = 0; i < prog->decls.len; i++) {
+		decl_dump(d, vec_get(&prog->decls, i, decl_node));
+	}
+	dump_end_arr(d);
+	dump_key(d, "ret");
+	type_dump(d, prog->ret);
+	dump_key(d, "body");
+	st_dump(d, prog->body);
+	dump_end_obj(d);
+}
@@ -6,6 +6,8 @@
 #include "type.h"
 #include "vector.h"
 #include "lit.h"
+#include "dump.h"
+#include "diag.h"
 
 typedef enum {
 	EX_LIT,
@@ -13,15 +15,30 @@ typedef enum {
 	EX_ASSIGN,
 	EX_INDEX,
 	EX_SETINDEX,
+	EX_FIELD,
+	EX_SETFIELD,
 	EX_CALL,
 	EX_UNOP,
 	EX_BINOP,
 	EX_RETURN,
 	EX_IND,
+	EX_SET,
+	EX_SLICE,
+	EX_SETLENGTH,
+	EX_DEREF,
+	EX_SETDEREF,
+	EX_NEW,
+	EX_DISPOSE,
 } expr_k;
 
 typedef struct _expr_node expr_node;
 
+typedef enum {
+	EFF_READ = 1, /* reads variables */
+	EFF_WRITE = 2, /* writes variables */
+	EFF_UNKNOWN = 4, /* touches memory not attributable to a symbol */
+} effect_k;
+
 typedef struct _lit_expr {
 	literal *lit;
 } lit_expr;
@@ -46,6 +63,17 @@ typedef struct _setindex_expr {
 	expr_node *value;
 } setindex_expr;
 
+typedef struct _field_expr {
+	expr_node *object;
+	char *ident;
+} field_expr;
+
+typedef struct _setfield_expr {
+	expr_node *object;
+	char *ident;
+	expr_node *value;
+} setfield_expr;
+
 typedef struct _call_expr {
 	expr_node *func;
 	vector params; /* of expr_node * */
@@ -56,8 +84,12 @@ typedef enum {
 	OP_NOT,
 	OP_BNOT,
 	OP_IDENT,
+	OP_CARD, /* number of elements set in a bitset */
+	OP_LENGTH, /* of a string or array */
 } unop_k;
 
+#define NUNOPS (OP_LENGTH + 1)
+
 typedef struct _unop_expr {
 	unop_k kind;
 	expr_node *expr;
@@ -82,8 +114,11 @@ typedef enum {
 	OP_BXOR,
 	OP_BLSHIFT,
 	OP_BRSHIFT,
+	OP_IN, /* membership of a set; a character or substring of a string */
 } binop_k;
 
+#define NBINOPS (OP_IN + 1)
+
 typedef struct _binop_expr {
 	binop_k kind;
 	expr_node *left;
@@ -98,21 +133,64 @@ typedef struct _ind_expr {
 	expr_node *lvalue;
 } ind_expr;
 
+/* object[lbound..ubound], half-open like array types: a view of those
+ * elements, where they are */
+typedef struct _slice_expr {
+	expr_node *object;
+	expr_node *lbound;
+	expr_node *ubound;
+} slice_expr;
+
+/* length object := value, resizing a dynamic array */
+typedef struct _setlength_expr {
+	expr_node *object;
+	expr_node *value;
+} setlength_expr;
+
+/* object[], what the pointer object points to */
+typedef struct _deref_expr {
+	expr_node *object;
+} deref_expr;
+
+typedef struct _setderef_expr {
+	expr_node *object;
+	expr_node *value;
+} setderef_expr;
+
+/* new(object) and dispose(object); object is a pointer variable, or an
+ * element or field holding one */
+typedef struct _alloc_expr {
+	expr_node *object;
+} alloc_expr;
+
+typedef struct _set_expr {
+	vector items; /* of expr_node *; ranges are LIT_RANGE literals */
+} set_expr;
+
 typedef struct _expr_node {
 	expr_k kind;
 	type *type;
 	size_t refcnt;
+	unsigned int effects; /* of effect_k, for the whole subtree; set by ef */
 	union {
 		lit_expr lit;
 		ref_expr ref;
 		assign_expr assign;
 		index_expr index;
 		setindex_expr setindex;
+		field_expr field;
+		setfield_expr setfield;
 		call_expr call;
 		unop_expr unop;
 		binop_expr binop;
 		return_expr return_;
 		ind_expr ind;
+		set_expr set;
+		slice_expr slice;
+		setlength_expr setlength;
+		deref_expr deref;
+		setderef_expr setderef;
+		alloc_expr alloc; /* EX_NEW, EX_DISPOSE */
 	};
 } expr_node;
 
@@ -123,14 +201,24 @@ expr_node *ex_new_ref(const char *ident);
 expr_node *ex_new_assign(char *name, expr_node *value);
 expr_node *ex_new_index(expr_node *object, expr_node *index);
 expr_node *ex_new_setindex(expr_node *object, expr_node *index, expr_node *value);
+expr_node *ex_new_field(expr_node *object, const char *ident);
+expr_node *ex_new_setfield(expr_node *object, const char *ident, expr_node *value);
 expr_node *ex_new_call(expr_node *func, vector *params);
 expr_node *ex_new_unop(unop_k kind, expr_node *expr);
 expr_node *ex_new_binop(expr_node *left, binop_k kind, expr_node *right);
 expr_node *ex_new_return(expr_node *);
 expr_node *ex_new_ind(expr_node *);
+expr_node *ex_new_set(vector *items);
+expr_node *ex_new_slice(expr_node *object, expr_node *lbound, expr_node *ubound);
+expr_node *ex_new_setlength(expr_node *object, expr_node *value);
+expr_node *ex_new_deref(expr_node *object);
+expr_node *ex_new_setderef(expr_node *object, expr_node *value);
+expr_node *ex_new_alloc(expr_k kind, expr_node *object);
 void ex_delete(expr_node *ex);
 void ex_destroy(expr_node *ex);
 void ex_print(FILE *, int, expr_node *);
+void ex_dump(dumper *, expr_node *);
+void effects_dump(dumper *, unsigned int);
 
 /*********************************************************************/
 
@@ -215,6 +303,7 @@ void st_compound_append(stmt_node *cmpd, stmt_node *st);
 void st_delete(stmt_node *st);
 void st_destroy(stmt_node *st);
 void st_print(FILE *, int, stmt_node *);
+void st_dump(dumper *, stmt_node *);
 
 /*********************************************************************/
 
@@ -225,12 +314,21 @@ typedef enum {
 	DECL_FUNC,
 	DECL_PROC,
 	DECL_TYPE,
+	DECL_CONST,
 } decl_k;
 
+/* How an argument is passed */
+typedef enum {
+	ARG_VALUE, /* a copy */
+	ARG_VAR, /* the caller's variable itself */
+	ARG_CONST, /* like a value, but read-only; a large one isn't copied */
+} arg_mode_k;
+
 typedef struct _decl_node {
 	char *ident;
 	type *type;
 	decl_k kind;
+	arg_mode_k mode; /* arguments */
 	union {
 		expr_node *init;
 		prog_node *prog;
@@ -247,21 +345,27 @@ typedef struct _prog_node {
 
 typedef struct _ast_root {
 	prog_node *prog;
+	diag_list *diags; /* where the parser reports */
+	int failed; /* the parser gave up; feed it no more tokens */
 } ast_root;
 
 decl_node *decl_new(const char *ident, type *ty);
 decl_node *decl_new_init(const char *ident, type *ty, expr_node *init);
+decl_node *decl_new_arg(const char *ident, type *ty, arg_mode_k mode);
 decl_node *decl_new_func(const char *ident, type *ty, prog_node *prog);
 decl_node *decl_new_proc(const char *ident, type *ty, prog_node *prog);
 decl_node *decl_new_type(const char *ident, type *ty);
+decl_node *decl_new_const(const char *ident, type *ty, expr_node *init);
 decl_node *decl_copy(decl_node *decl);
 void decl_delete(decl_node *decl);
 void decl_destroy(decl_node *decl);
 void decl_print(FILE *, int, decl_node *);
+void decl_dump(dumper *, decl_node *);
 prog_node *prog_new(const char *ident, vector *args, vector *decls, type *ret, stmt_node *body);
 prog_node *prog_copy(prog_node *prog);
 void prog_delete(prog_node *prog);
 void prog_destroy(prog_node *prog);
 void prog_print(FILE *, int, prog_node *);
+void prog_dump(dumper *, prog_node *);
 
 #endif
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "rt_alloc.h"
+
+/* Times the churn escaping variables put on the heap: blocks of 16 to 256
+ * bytes allocated and disposed at random, with up to 4K of them live. Built
+ * twice by `make bench`, once on rt_new/rt_dispose and once on malloc/free
+ * (USE_MALLOC), so the two can be compared on the machine at hand.
+ */
+
+#ifdef USE_MALLOC
+#define NEW(n) malloc(n)
+#define DISPOSE(p, n) free(p)
+#define NAME "malloc"
+#else
+#define NEW(n) rt_new(n)
+#define DISPOSE(p, n) rt_dispose(p, n)
+#define NAME "rt_alloc"
+#endif
+
+#define LIVE 4096
+#define ROUNDS 20000000
+
+static double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int main(void) {
+	static void *live[LIVE];
+	static size_t size[LIVE];
+	unsigned int r = 1;
+	size_t i, j;
+	double t = now();
+	for(i = 0; i < ROUNDS; i++) {
+		r = r * 1103515245 + 12345;
+		j = (r >> 8) % LIVE;
+		if(live[j]) {
+			DISPOSE(live[j], size[j]);
+		}
+		size[j] = 16 + ((r >> 20) & 15) * 16;
+		live[j] = NEW(size[j]);
+		*(size_t *) live[j] = i;
+	}
+	printf("%s: %d new/dispose pairs in %.3f s\n", NAME, ROUNDS, now() - t);
+	for(j = 0; j < LIVE; j++) {
+		if(live[j]) {
+			DISPOSE(live[j], size[j]);
+		}
+	}
+	return 0;
+}
@@ -7,6 +7,16 @@
 #include "ast.h"
 #include "util.h"
 
+const char *num_names[] = {
+	[NUM_WORD] = "word",
+	[NUM_I8] = "i8",
+	[NUM_I16] = "i16",
+	[NUM_I32] = "i32",
+	[NUM_U8] = "u8",
+	[NUM_F32] = "f32",
+	[NUM_F64] = "f64",
+};
+
 block *block_new(block *parent) {
 	block *res = malloc(sizeof(block));
 	if(parent) {
@@ -16,6 +26,7 @@ block *block_new(block *parent) {
 		res->parent = NULL;
 	}
 	res->kind = BLK_ROOT;
+	res->body = 0;
 	vec_init(&res->children);
 	vec_init(&res->instrs);
 	return res;
@@ -39,15 +50,40 @@ block *block_copy(block *blk) {
 	return blk;
 }
 
+/* The read-only data section of blk's tree, created on first use */
+block *block_data(block *blk) {
+	block *sec;
+	size_t i;
+	while(blk->parent) {
+		blk = blk->parent;
+	}
+	for(i = 0; i < blk->children.len; i++) {
+		sec = vec_get(&blk->children, i, block);
+		if(sec->kind == BLK_DATA) {
+			return sec;
+		}
+	}
+	sec = block_new(blk);
+	sec->kind = BLK_DATA;
+	return sec;
+}
+
 void block_emit(block *blk, instr *ins) {
 	vec_insert(&blk->instrs, blk->instrs.len, instr_copy(ins));
 }
 
+void block_insert(block *blk, size_t idx, instr *ins) {
+	vec_insert(&blk->instrs, idx, instr_copy(ins));
+}
+
+/* Moves subblk's instructions to the end of blk; subblk is consumed */
 void block_append(block *blk, block *subblk) {
 	size_t i;
 	for(i = 0; i < subblk->instrs.len; i++) {
 		block_emit(blk, vec_get(&subblk->instrs, i, instr));
 	}
+	vec_clear(&subblk->instrs);
+	block_delete(subblk);
 }
 
 void block_delete(block *blk) {
@@ -55,8 +91,18 @@ void block_delete(block *blk) {
 }
 
 void block_destroy(block *blk) {
+	vec_foreach(&blk->instrs, (vec_iter_f) instr_delete, NULL);
+	vec_clear(&blk->instrs);
+	while(blk->children.len) {
+		block_delete(vec_get(&blk->children, blk->children.len - 1, block));
+	}
+	vec_clear(&blk->children);
+	if(blk->parent) {
+		vec_remove(&blk->parent->children, vec_search(&blk->parent->children, blk));
+	}
 	switch(blk->kind) {
 		case BLK_ROOT:
+		case BLK_DATA:
 			break;
 
 		case BLK_PROG:
@@ -93,6 +139,10 @@ void block_print(FILE *out, int lev, block *blk) {
 			wrlev(out, lev, "-LABEL (%p)-", blk);
 			break;
 
+		case BLK_DATA:
+			wrlev(out, lev, "-DATA (%p)-", blk);
+			break;
+
 		default:
 			wrlev(out, lev, "-!!!UNKNOWN BLOCK %d (%p)!!!-", blk->kind, blk);
 			break;
@@ -105,6 +155,54 @@ void block_print(FILE *out, int lev, block *blk) {
 	}
 }
 
+void block_dump(dumper *d, block *blk) {
+	size_t i;
+	if(!blk) {
+		dump_null(d);
+		return;
+	}
+	dump_begin_obj(d);
+	dump_key(d, "id");
+	dump_ptr(d, blk);
+	dump_key(d, "kind");
+	switch(blk->kind) {
+		case BLK_ROOT:
+			dump_str(d, "root");
+			break;
+
+		case BLK_PROG:
+			dump_str(d, "prog");
+			dump_key(d, "prog");
+			dump_str(d, blk->prog->node->ident);
+			break;
+
+		case BLK_LABEL:
+			dump_str(d, "label");
+			break;
+
+		case BLK_DATA:
+			dump_str(d, "data");
+			break;
+
+		default:
+			dump_null(d);
+			break;
+	}
+	dump_key(d, "instrs");
+	dump_begin_arr(d);
+	for(i = 0; i < blk->instrs.len; i++) {
+		instr_dump(d, vec_get(&blk->instrs, i, instr));
+	}
+	dump_end_arr(d);
+	dump_key(d, "children");
+	dump_begin_arr(d);
+	for(i = 0; i < blk->children.len; i++) {
+		block_dump(d, vec_get(&blk->children, i, block));
+	}
+	dump_end_arr(d);
+	dump_end_obj(d);
+}
+
 char *block_repr(block *blk) {
 	char *res = malloc(sizeof(char) * 32);
 	snprintf(res, 32, "(block %p)", blk);
@@ -116,11 +214,17 @@ instr *instr_new(void) {
 	return res;
 }
 
+/* A word move; see instr_new_set_num */
 instr *instr_new_set(location *loc, location *value) {
+	return instr_new_set_num(loc, NUM_WORD, value);
+}
+
+instr *instr_new_set_num(location *loc, num_k num, location *value) {
 	instr *res = instr_new();
 	res->kind = IN_SET;
 	res->set.loc = loc_copy(loc);
 	res->set.value = loc_copy(value);
+	res->set.num = num;
 	return res;
 }
 
@@ -132,22 +236,53 @@ instr *instr_new_laddr(location *loc, location *value) {
 	return res;
 }
 
+/* Word arithmetic; see instr_new_binop_num */
 instr *instr_new_binop(location *loc, location *left, binop_k kind, location *right) {
+	return instr_new_binop_num(loc, NUM_WORD, left, kind, right);
+}
+
+/* Comparisons read their operands as num and write a word 1 or 0 */
+instr *instr_new_binop_num(location *loc, num_k num, location *left, binop_k kind, location *right) {
 	instr *res = instr_new();
 	res->kind = IN_BINOP;
 	res->binop.left = loc_copy(left);
 	res->binop.kind = kind;
 	res->binop.right = loc_copy(right);
 	res->binop.loc = loc_copy(loc);
+	res->binop.num = num;
 	return res;
 }
 
 instr *instr_new_unop(location *loc, unop_k kind, location *value) {
+	return instr_new_unop_num(loc, NUM_WORD, kind, value);
+}
+
+instr *instr_new_unop_num(location *loc, num_k num, unop_k kind, location *value) {
 	instr *res = instr_new();
 	res->kind = IN_UNOP;
 	res->unop.kind = kind;
 	res->unop.value = loc_copy(value);
 	res->unop.loc = loc_copy(loc);
+	res->unop.num = num;
+	return res;
+}
+
+instr *instr_new_conv(location *loc, num_k to, location *value, num_k from) {
+	instr *res = instr_new();
+	res->kind = IN_CONV;
+	res->conv.to = to;
+	res->conv.value = loc_copy(value);
+	res->conv.from = from;
+	res->conv.loc = loc_copy(loc);
+	return res;
+}
+
+instr *instr_new_copy(location *loc, location *value, size_t size) {
+	instr *res = instr_new();
+	res->kind = IN_COPY;
+	res->copy.loc = loc_copy(loc);
+	res->copy.value = loc_copy(value);
+	res->copy.size = size;
 	return res;
 }
 
@@ -165,57 +300,66 @@ instr *instr_new_pop(location *loc) {
 	return res;
 }
 
-instr *instr_new_call(block *label) {
+instr *instr_new_call(location *target) {
 	instr *res = instr_new();
 	res->kind = IN_CALL;
-	res->call.label = block_copy(label);
+	res->call.target = loc_copy(target);
 	return res;
 }
 
+/* value may be NULL (procedures) */
 instr *instr_new_return(location *value) {
 	instr *res = instr_new();
 	res->kind = IN_RETURN;
-	res->return_.value = loc_copy(value);
+	res->return_.value = value ? loc_copy(value) : NULL;
 	return res;
 }
 
-instr *instr_new_jump(block *label) {
+instr *instr_new_jump(instr *label) {
 	instr *res = instr_new();
 	res->kind = IN_JUMP;
-	res->jump.label = block_copy(label);
+	res->jump.label = label;
 	return res;
 }
 
-instr *instr_new_jumpif(block *label, location *test) {
+instr *instr_new_jumpif(instr *label, location *test) {
 	instr *res = instr_new();
 	res->kind = IN_JUMPIF;
-	res->jumpif.label = block_copy(label);
+	res->jumpif.label = label;
 	res->jumpif.test = loc_copy(test);
 	return res;
 }
 
-vector all_labels;
-unsigned long next_num_label = 0;
+/* The unit's counters for generated names, so they don't depend on what was
+ * compiled before it; see instr_number_names */
+static unsigned long *next_num_label = NULL, *next_num_data = NULL;
+
+void instr_number_names(unsigned long *labels, unsigned long *data) {
+	next_num_label = labels;
+	next_num_data = data;
+}
 
+/* A fresh label; NULL for a generated name */
 instr *instr_new_label(char *label) {
-	instr *res;
-	size_t i;
-	if(label) {
-		for(i = 0; i < all_labels.len; i++) {
-			if(string_equal(label, vec_get(&all_labels, i, instr)->label.name)) {
-				return instr_copy(vec_get(&all_labels, i, instr));
-			}
-		}
-	}
-	res = instr_new();
+	instr *res = instr_new();
 	res->kind = IN_LABEL;
 	if(!label) {
+		assert(next_num_label);
 		res->label.name = malloc(sizeof(char) * 32);
-		snprintf(res->label.name, 32, "__L%ld__", next_num_label++);
+		snprintf(res->label.name, 32, "__L%ld__", (*next_num_label)++);
 	} else {
 		res->label.name = strdup(label);
 	}
-	vec_insert(&all_labels, all_labels.len, res);
+	return res;
+}
+
+instr *instr_new_data(literal *lit) {
+	instr *res = instr_new();
+	assert(next_num_data);
+	res->kind = IN_DATA;
+	res->data.name = malloc(sizeof(char) * 32);
+	snprintf(res->data.name, 32, "__D%ld__", (*next_num_data)++);
+	res->data.lit = lit_materialize(lit);
 	return res;
 }
 
@@ -250,6 +394,16 @@ void instr_destroy(instr *ins) {
 			loc_delete(ins->unop.loc);
 			break;
 
+		case IN_CONV:
+			loc_delete(ins->conv.value);
+			loc_delete(ins->conv.loc);
+			break;
+
+		case IN_COPY:
+			loc_delete(ins->copy.loc);
+			loc_delete(ins->copy.value);
+			break;
+
 		case IN_PUSH:
 			loc_delete(ins->push.value);
 			break;
@@ -259,22 +413,31 @@ void instr_destroy(instr *ins) {
 			break;
 
 		case IN_CALL:
-			block_delete(ins->call.label);
+			loc_delete(ins->call.target);
 			break;
 
 		case IN_RETURN:
-			loc_delete(ins->return_.value);
+			if(ins->return_.value) {
+				loc_delete(ins->return_.value);
+			}
 			break;
 
 		case IN_JUMP:
-			block_delete(ins->jump.label);
 			break;
 
 		case IN_JUMPIF:
-			block_delete(ins->jumpif.label);
 			loc_delete(ins->jumpif.test);
 			break;
 
+		case IN_LABEL:
+			free(ins->label.name);
+			break;
+
+		case IN_DATA:
+			free(ins->data.name);
+			lit_delete(ins->data.lit);
+			break;
+
 		default:
 			assert(0);
 			break;
@@ -289,19 +452,27 @@ void instr_print(FILE *out, int lev, instr *ins) {
 	}
 	switch(ins->kind) {
 		case IN_SET:
-			wrlev(out, lev, ".SET %s <- %s", loc_repr(ins->set.loc), loc_repr(ins->set.value));
+			wrlev(out, lev, ".SET %s %s <- %s", num_names[ins->set.num], loc_repr(ins->set.loc), loc_repr(ins->set.value));
 			break;
 
 		case IN_LADDR:
-			wrlev(out, lev, ".LADDR %s =& %s", loc_repr(ins->laddr.loc), loc_repr(ins->laddr.loc));
+			wrlev(out, lev, ".LADDR %s =& %s", loc_repr(ins->laddr.loc), loc_repr(ins->laddr.value));
 			break;
 
 		case IN_BINOP:
-			wrlev(out, lev, ".BINOP %s = %s %d %s", loc_repr(ins->binop.loc), loc_repr(ins->binop.left), ins->binop.kind, loc_repr(ins->binop.right));
+			wrlev(out, lev, ".BINOP %s %s = %s %d %s", num_names[ins->binop.num], loc_repr(ins->binop.loc), loc_repr(ins->binop.left), ins->binop.kind, loc_repr(ins->binop.right));
 			break;
 
 		case IN_UNOP:
-			wrlev(out, lev, ".UNOP %s = %d %s", loc_repr(ins->unop.loc), ins->unop.kind, loc_repr(ins->unop.value));
+			wrlev(out, lev, ".UNOP %s %s = %d %s", num_names[ins->unop.num], loc_repr(ins->unop.loc), ins->unop.kind, loc_repr(ins->unop.value));
+			break;
+
+		case IN_CONV:
+			wrlev(out, lev, ".CONV %s %s = %s %s", num_names[ins->conv.to], loc_repr(ins->conv.loc), num_names[ins->conv.from], loc_repr(ins->conv.value));
+			break;
+
+		case IN_COPY:
+			wrlev(out, lev, ".COPY %zu %s <- %s", ins->copy.size, loc_repr(ins->copy.loc), loc_repr(ins->copy.value));
 			break;
 
 		case IN_PUSH:
@@ -313,7 +484,7 @@ void instr_print(FILE *out, int lev, instr *ins) {
 			break;
 
 		case IN_CALL:
-			wrlev(out, lev, ".CALL %s", block_repr(ins->call.label));
+			wrlev(out, lev, ".CALL %s", loc_repr(ins->call.target));
 			break;
 
 		case IN_RETURN:
@@ -321,11 +492,20 @@ void instr_print(FILE *out, int lev, instr *ins) {
 			break;
 
 		case IN_JUMP:
-			wrlev(out, lev, ".JUMP %s", block_repr(ins->jump.label));
+			wrlev(out, lev, ".JUMP %s", ins->jump.label->label.name);
 			break;
 
 		case IN_JUMPIF:
-			wrlev(out, lev, ".JUMP %s IF %s", block_repr(ins->jumpif.label), loc_repr(ins->jumpif.test));
+			wrlev(out, lev, ".JUMP %s IF %s", ins->jumpif.label->label.name, loc_repr(ins->jumpif.test));
+			break;
+
+		case IN_LABEL:
+			wrlev(out, lev, "%s:", ins->label.name);
+			break;
+
+		case IN_DATA:
+			wrlev(out, lev, ".DATA %s", ins->data.name);
+			lit_print(out, lev + 1, ins->data.lit);
 			break;
 
 		default:
@@ -333,3 +513,104 @@ void instr_print(FILE *out, int lev, instr *ins) {
 			break;
 	}
 }
+
+void instr_dump(dumper *d, instr *ins) {
+	if(!ins) {
+		dump_null(d);
+		return;
+	}
+	dump_begin_arr(d);
+	switch(ins->kind) {
+		case IN_SET:
+			dump_str(d, "SET");
+			loc_dump(d, ins->set.loc);
+			loc_dump(d, ins->set.value);
+			dump_str(d, num_names[ins->set.num]);
+			break;
+
+		case IN_LADDR:
+			dump_str(d, "LADDR");
+			loc_dump(d, ins->laddr.loc);
+			loc_dump(d, ins->laddr.value);
+			break;
+
+		case IN_BINOP:
+			dump_str(d, "BINOP");
+			loc_dump(d, ins->binop.loc);
+			loc_dump(d, ins->binop.left);
+			dump_int(d, ins->binop.kind);
+			loc_dump(d, ins->binop.right);
+			dump_str(d, num_names[ins->binop.num]);
+			break;
+
+		case IN_UNOP:
+			dump_str(d, "UNOP");
+			loc_dump(d, ins->unop.loc);
+			dump_int(d, ins->unop.kind);
+			loc_dump(d, ins->unop.value);
+			dump_str(d, num_names[ins->unop.num]);
+			break;
+
+		case IN_CONV:
+			dump_str(d, "CONV");
+			loc_dump(d, ins->conv.loc);
+			dump_str(d, num_names[ins->conv.to]);
+			loc_dump(d, ins->conv.value);
+			dump_str(d, num_names[ins->conv.from]);
+			break;
+
+		case IN_COPY:
+			dump_str(d, "COPY");
+			loc_dump(d, ins->copy.loc);
+			loc_dump(d, ins->copy.value);
+			dump_int(d, ins->copy.size);
+			break;
+
+		case IN_PUSH:
+			dump_str(d, "PUSH");
+			loc_dump(d, ins->push.value);
+			break;
+
+		case IN_POP:
+			dump_str(d, "POP");
+			loc_dump(d, ins->pop.loc);
+			break;
+
+		case IN_CALL:
+			dump_str(d, "CALL");
+			loc_dump(d, ins->call.target);
+			break;
+
+		case IN_RETURN:
+			dump_str(d, "RETURN");
+			loc_dump(d, ins->return_.value);
+			break;
+
+		case IN_JUMP:
+			dump_str(d, "JUMP");
+			dump_str(d, ins->jump.label->label.name);
+			break;
+
+		case IN_JUMPIF:
+			dump_str(d, "JUMPIF");
+			dump_str(d, ins->jumpif.label->label.name);
+			loc_dump(d, ins->jumpif.test);
+			break;
+
+		case IN_LABEL:
+			dump_str(d, "LABEL");
+			dump_str(d, ins->label.name);
+			break;
+
+		case IN_DATA:
+			dump_str(d, "DATA");
+			dump_str(d, ins->data.name);
+			lit_dump(d, ins->data.lit);
+			break;
+
+		default:
+			dump_null(d);
+			break;
+	}
+	dump_end_arr(d);
+}
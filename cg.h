@@ -5,14 +5,34 @@
 #include "ast.h"
 #include "sem.h"
 #include "loc.h"
+#include "lit.h"
 
 typedef struct _block block;
 
+/* The machine class of a scalar operand: a whole word (integers as wide as
+ * one, addresses, sizes, anything the IR computes for itself), a narrower
+ * signed integer, an unsigned byte (chars and booleans) or a float. See
+ * ir_num for how a type maps to one.
+ */
+typedef enum {
+	NUM_WORD,
+	NUM_I8,
+	NUM_I16,
+	NUM_I32,
+	NUM_U8,
+	NUM_F32,
+	NUM_F64,
+} num_k;
+
+extern const char *num_names[];
+
 typedef enum {
 	IN_SET,
 	IN_LADDR,
 	IN_BINOP,
 	IN_UNOP,
+	IN_CONV,
+	IN_COPY,
 	IN_PUSH,
 	IN_POP,
 	IN_CALL,
@@ -20,11 +40,17 @@ typedef enum {
 	IN_JUMP,
 	IN_JUMPIF,
 	IN_LABEL,
+	IN_DATA,
 } instr_k;
 
+/* SET, BINOP and UNOP compute in num: memory operands are read and written
+ * that wide, so a narrow variable's neighbours are left alone. Values of
+ * another class are first made this one with CONV.
+ */
 typedef struct _set_instr {
 	location *loc;
 	location *value;
+	num_k num;
 } set_instr;
 
 typedef struct _laddr_instr {
@@ -37,14 +63,37 @@ typedef struct _binop_instr {
 	binop_k kind;
 	location *left;
 	location *right;
+	num_k num;
 } binop_instr;
 
 typedef struct _unop_instr {
 	location *loc;
 	unop_k kind;
 	location *value;
+	num_k num;
 } unop_instr;
 
+/* value, read as from, written to loc as to: integers are sign extended
+ * (zero extended from NUM_U8) or truncated, floats rounded to the nearest,
+ * and floats made integers by truncating toward zero
+ */
+typedef struct _conv_instr {
+	location *loc;
+	num_k to;
+	location *value;
+	num_k from;
+} conv_instr;
+
+/* size bytes from the memory at value to the memory at loc, neither a temp
+ * nor a register: how a record or fixed array, which no register holds,
+ * is assigned or passed whole
+ */
+typedef struct _copy_instr {
+	location *loc;
+	location *value;
+	size_t size;
+} copy_instr;
+
 typedef struct _push_instr {
 	location *value;
 } push_instr;
@@ -54,19 +103,20 @@ typedef struct _pop_instr {
 } pop_instr;
 
 typedef struct _call_instr {
-	block *label;
+	location *target; /* jumps to the target's address */
 } call_instr;
 
 typedef struct _return_instr {
 	location *value;
 } return_instr;
 
+/* Jump targets are IN_LABEL instructions of the same program block (unowned) */
 typedef struct _jump_instr {
-	block *label;
+	struct _instr *label;
 } jump_instr;
 
 typedef struct _jumpif_instr {
-	block *label;
+	struct _instr *label;
 	location *test;
 } jumpif_instr;
 
@@ -74,6 +124,11 @@ typedef struct _label_instr {
 	char *name;
 } label_instr;
 
+typedef struct _data_instr {
+	char *name;
+	literal *lit; /* emitted verbatim as one read-only blob */
+} data_instr;
+
 typedef struct _instr {
 	instr_k kind;
 	union {
@@ -81,6 +136,8 @@ typedef struct _instr {
 		laddr_instr laddr;
 		binop_instr binop;
 		unop_instr unop;
+		conv_instr conv;
+		copy_instr copy;
 		push_instr push;
 		pop_instr pop;
 		call_instr call;
@@ -88,23 +145,32 @@ typedef struct _instr {
 		jump_instr jump;
 		jumpif_instr jumpif;
 		label_instr label;
+		data_instr data;
 	};
 } instr;
 
 instr *instr_new(void);
 instr *instr_new_set(location *loc,location *value);
+instr *instr_new_set_num(location *loc, num_k num, location *value);
 instr *instr_new_laddr(location *loc,location *value);
 instr *instr_new_binop(location *loc,location *left,binop_k kind,location *right);
+instr *instr_new_binop_num(location *loc, num_k num, location *left, binop_k kind, location *right);
 instr *instr_new_unop(location *loc,unop_k kind,location *value);
+instr *instr_new_unop_num(location *loc, num_k num, unop_k kind, location *value);
+instr *instr_new_conv(location *loc, num_k to, location *value, num_k from);
+instr *instr_new_copy(location *loc, location *value, size_t size);
 instr *instr_new_push(location *value);
 instr *instr_new_pop(location *loc);
-instr *instr_new_call(block *label);
+instr *instr_new_call(location *target);
 instr *instr_new_return(location *value);
-instr *instr_new_jump(block *label);
-instr *instr_new_jumpif(block *label,location *test);
+instr *instr_new_jump(instr *label);
+instr *instr_new_jumpif(instr *label,location *test);
+void instr_number_names(unsigned long *labels, unsigned long *data);
 instr *instr_new_label(char *);
+instr *instr_new_data(literal *lit);
 instr *instr_copy(instr *ins);
 void instr_print(FILE *, int, instr *);
+void instr_dump(dumper *, instr *);
 void instr_delete(instr *ins);
 void instr_destroy(instr *ins);
 
@@ -112,6 +178,7 @@ typedef enum {
 	BLK_ROOT,
 	BLK_PROG,
 	BLK_LABEL,
+	BLK_DATA,
 } block_k;
 
 typedef struct _block {
@@ -119,6 +186,7 @@ typedef struct _block {
 	struct _block *parent;
 	vector children; /* of block * */
 	vector instrs; /* of instr * */
+	size_t body; /* BLK_PROG: index of the first instruction after the prologue */
 	union {
 		program *prog;
 		stmt_node *stmt;
@@ -129,7 +197,12 @@ block *block_new(block *parent);
 block *block_new_program(block *parent,program *prog);
 block *block_new_stmt(block *parent,stmt_node *stmt);
 block *block_copy(block *blk);
+block *block_data(block *blk);
+void block_emit(block *blk, instr *ins);
+void block_insert(block *blk, size_t idx, instr *ins);
+void block_append(block *blk, block *subblk);
 void block_print(FILE *, int, block *);
+void block_dump(dumper *, block *);
 char *block_repr(block *);
 void block_delete(block *blk);
 void block_destroy(block *blk);
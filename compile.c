@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tokenizer.h"
+#include "parser.h"
+#include "compile.h"
+
+#include "toknames.c"
+
+extern void *semval;
+
+void *ParseAlloc(void *(*)(size_t));
+void ParseFree(void *, void (*)(void *));
+void Parse(void *, int, void *, ast_root *);
+
+compilation *compile_new(const char *name, unsigned int flags) {
+	compilation *res = malloc(sizeof(compilation));
+	assert(res);
+	res->name = name;
+	res->flags = flags;
+	res->ast.prog = NULL;
+	res->ast.diags = &res->diags;
+	res->ast.failed = 0;
+	res->obj = NULL;
+	diag_init(&res->diags);
+	return res;
+}
+
+/* Parses and runs every pass; returns nonzero if there were errors (see
+ * comp->diags). Syntax errors are recovered from where the grammar allows,
+ * but the passes only run on a clean parse.
+ */
+int compile_file(compilation *comp, FILE *input, pass_dump *dump) {
+	YY_BUFFER_STATE yybuf;
+	void *parser;
+	int token;
+
+	yybuf = yy_create_buffer(input, YY_BUF_SIZE);
+	yy_switch_to_buffer(yybuf);
+	yylineno = 1;
+
+	parser = ParseAlloc(malloc);
+	if(dump && (dump->what & DUMP_TOKENS)) {
+		dump_begin_obj(dump->out);
+		dump_key(dump->out, "tokens");
+		dump_begin_arr(dump->out);
+	}
+	while(!comp->ast.failed && (token = yylex())) {
+		if(dump && (dump->what & DUMP_TOKENS)) {
+			dump_str(dump->out, toknames[token]);
+		}
+		Parse(parser, token, semval, &comp->ast);
+		/* The parser owns the value now; tokens without one (keywords,
+		 * punctuation) leave semval alone, so mustn't pass it again */
+		semval = NULL;
+	}
+	if(dump && (dump->what & DUMP_TOKENS)) {
+		dump_end_arr(dump->out);
+		dump_end_obj(dump->out);
+		dump_newline(dump->out);
+	}
+	if(!comp->ast.failed) {
+		Parse(parser, 0, NULL, &comp->ast);
+	}
+	ParseFree(parser, free);
+	yy_delete_buffer(yybuf);
+
+	if(!comp->ast.prog && !comp->diags.errors) {
+		diag_add(&comp->diags, DIAG_ERROR, "parse", 0, "No program");
+	}
+	if(comp->diags.errors) {
+		return -1;
+	}
+	if(dump && dump->after && !strcmp(dump->after, "all")) {
+		pass_dump_state(dump, "parse", &comp->ast, NULL);
+	}
+
+	comp->obj = obj_new(comp->flags);
+	return pass_do_all(&comp->ast, comp->obj, &comp->diags, dump);
+}
+
+void compile_delete(compilation *comp) {
+	/* Semantic state first; it points into the AST */
+	if(comp->obj) {
+		obj_delete(comp->obj);
+	}
+	if(comp->ast.prog) {
+		prog_delete(comp->ast.prog);
+	}
+	diag_clear(&comp->diags);
+	free(comp);
+}
@@ -0,0 +1,27 @@
+#ifndef COMPILE_H
+#define COMPILE_H
+
+#include <stdio.h>
+
+#include "ast.h"
+#include "sem.h"
+#include "pass.h"
+#include "diag.h"
+
+/* One compilation unit: everything parsing and the passes produce for it,
+ * owned here and released together, so a process can run many of them.
+ */
+
+typedef struct _compilation {
+	const char *name;
+	unsigned int flags; /* of obj_flag_k */
+	ast_root ast;
+	object *obj;
+	diag_list diags;
+} compilation;
+
+compilation *compile_new(const char *name, unsigned int flags);
+int compile_file(compilation *comp, FILE *input, pass_dump *dump);
+void compile_delete(compilation *comp);
+
+#endif
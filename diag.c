@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <assert.h>
+
+#include "diag.h"
+
+void diag_init(diag_list *dl) {
+	vec_init(&dl->items);
+	dl->errors = 0;
+	dl->warnings = 0;
+}
+
+static void diag_destroy(diagnostic *dg, void *unused) {
+	free(dg->msg);
+	free(dg);
+}
+
+void diag_clear(diag_list *dl) {
+	vec_foreach(&dl->items, (vec_iter_f) diag_destroy, NULL);
+	vec_clear(&dl->items);
+	dl->errors = 0;
+	dl->warnings = 0;
+}
+
+void diag_add(diag_list *dl, diag_k kind, const char *stage, int line, const char *fmt, ...) {
+	va_list va;
+	va_start(va, fmt);
+	diag_vadd(dl, kind, stage, line, fmt, va);
+	va_end(va);
+}
+
+void diag_vadd(diag_list *dl, diag_k kind, const char *stage, int line, const char *fmt, va_list va) {
+	diagnostic *dg = malloc(sizeof(diagnostic));
+	va_list vb;
+	int len;
+	assert(dg);
+	dg->kind = kind;
+	dg->stage = stage;
+	dg->line = line;
+	va_copy(vb, va);
+	len = vsnprintf(NULL, 0, fmt, vb);
+	va_end(vb);
+	assert(len >= 0);
+	dg->msg = malloc(len + 1);
+	vsnprintf(dg->msg, len + 1, fmt, va);
+	vec_insert(&dl->items, dl->items.len, dg);
+	if(kind == DIAG_ERROR) {
+		dl->errors++;
+	} else {
+		dl->warnings++;
+	}
+}
+
+void diag_print(FILE *out, const char *name, diag_list *dl) {
+	size_t i;
+	diagnostic *dg;
+	for(i = 0; i < dl->items.len; i++) {
+		dg = vec_get(&dl->items, i, diagnostic);
+		if(dg->line) {
+			fprintf(out, "%s:%d: ", name, dg->line);
+		} else {
+			fprintf(out, "%s: ", name);
+		}
+		switch(dg->kind) {
+			case DIAG_ERROR:
+				fprintf(out, "\x1b[37;41;1mERROR (%s): %s\x1b[m\n", dg->stage, dg->msg);
+				break;
+
+			case DIAG_WARNING:
+				fprintf(out, "\x1b[33;1mWarning (%s): %s\x1b[m\n", dg->stage, dg->msg);
+				break;
+		}
+	}
+}
+
+void diag_dump(dumper *d, diag_list *dl) {
+	size_t i;
+	diagnostic *dg;
+	dump_begin_arr(d);
+	for(i = 0; i < dl->items.len; i++) {
+		dg = vec_get(&dl->items, i, diagnostic);
+		dump_begin_obj(d);
+		dump_key(d, "kind");
+		dump_str(d, dg->kind == DIAG_ERROR ? "error" : "warning");
+		dump_key(d, "stage");
+		dump_str(d, dg->stage);
+		if(dg->line) {
+			dump_key(d, "line");
+			dump_int(d, dg->line);
+		}
+		dump_key(d, "msg");
+		dump_str(d, dg->msg);
+		dump_end_obj(d);
+	}
+	dump_end_arr(d);
+}
@@ -0,0 +1,40 @@
+#ifndef DIAG_H
+#define DIAG_H
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "vector.h"
+#include "dump.h"
+
+/* Diagnostics are collected per compilation rather than printed (and exited
+ * on) where they are found, so one process can compile many units and report
+ * on each of them.
+ */
+
+typedef enum {
+	DIAG_ERROR,
+	DIAG_WARNING,
+} diag_k;
+
+typedef struct _diagnostic {
+	diag_k kind;
+	const char *stage; /* pass key, "parse", ...; static string */
+	int line; /* 0 if unknown */
+	char *msg;
+} diagnostic;
+
+typedef struct _diag_list {
+	vector items; /* of diagnostic * */
+	size_t errors;
+	size_t warnings;
+} diag_list;
+
+void diag_init(diag_list *dl);
+void diag_clear(diag_list *dl);
+void diag_add(diag_list *dl, diag_k kind, const char *stage, int line, const char *fmt, ...);
+void diag_vadd(diag_list *dl, diag_k kind, const char *stage, int line, const char *fmt, va_list va);
+void diag_print(FILE *, const char *name, diag_list *dl);
+void diag_dump(dumper *, diag_list *dl);
+
+#endif
@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "dump.h"
+
+dumper *dump_new(FILE *out) {
+	dumper *res = malloc(sizeof(dumper));
+	assert(res);
+	res->out = out;
+	res->buf = malloc(DUMP_BUF_SZ);
+	assert(res->buf);
+	res->len = 0;
+	res->comma = 0;
+	return res;
+}
+
+void dump_flush(dumper *d) {
+	if(d->len) {
+		fwrite(d->buf, 1, d->len, d->out);
+		d->len = 0;
+	}
+	fflush(d->out);
+}
+
+void dump_delete(dumper *d) {
+	dump_flush(d);
+	free(d->buf);
+	free(d);
+}
+
+void dump_raw(dumper *d, const char *s, size_t len) {
+	if(d->len + len > DUMP_BUF_SZ) {
+		fwrite(d->buf, 1, d->len, d->out);
+		d->len = 0;
+		if(len > DUMP_BUF_SZ) {
+			fwrite(s, 1, len, d->out);
+			return;
+		}
+	}
+	memcpy(d->buf + d->len, s, len);
+	d->len += len;
+}
+
+static void _dump_sep(dumper *d) {
+	if(d->comma) {
+		dump_raw(d, ",", 1);
+	}
+	d->comma = 0;
+}
+
+void dump_begin_obj(dumper *d) {
+	_dump_sep(d);
+	dump_raw(d, "{", 1);
+}
+
+void dump_end_obj(dumper *d) {
+	dump_raw(d, "}", 1);
+	d->comma = 1;
+}
+
+void dump_begin_arr(dumper *d) {
+	_dump_sep(d);
+	dump_raw(d, "[", 1);
+}
+
+void dump_end_arr(dumper *d) {
+	dump_raw(d, "]", 1);
+	d->comma = 1;
+}
+
+void dump_key(dumper *d, const char *key) {
+	dump_str(d, key);
+	dump_raw(d, ":", 1);
+	d->comma = 0;
+}
+
+void dump_str(dumper *d, const char *s) {
+	if(!s) {
+		_dump_sep(d);
+		dump_raw(d, "null", 4);
+		d->comma = 1;
+		return;
+	}
+	dump_strn(d, s, strlen(s));
+}
+
+/* len bytes of s, which may hold NULs */
+void dump_strn(dumper *d, const char *s, size_t len) {
+	const char *run, *end = s + len;
+	char esc[8];
+	_dump_sep(d);
+	dump_raw(d, "\"", 1);
+	run = s;
+	for(; s < end; s++) {
+		if(*s == '"' || *s == '\\' || (unsigned char) *s < 0x20) {
+			dump_raw(d, run, s - run);
+			snprintf(esc, sizeof(esc), "\\u%04x", (unsigned char) *s);
+			dump_raw(d, esc, 6);
+			run = s + 1;
+		}
+	}
+	dump_raw(d, run, s - run);
+	dump_raw(d, "\"", 1);
+	d->comma = 1;
+}
+
+/* For the malloc'd strings handed out by type_repr/loc_repr */
+void dump_str_free(dumper *d, const char *s) {
+	dump_str(d, s);
+	free((char *) s);
+}
+
+void dump_int(dumper *d, long i) {
+	char num[32];
+	_dump_sep(d);
+	dump_raw(d, num, snprintf(num, sizeof(num), "%ld", i));
+	d->comma = 1;
+}
+
+void dump_real(dumper *d, double f) {
+	char num[32];
+	_dump_sep(d);
+	dump_raw(d, num, snprintf(num, sizeof(num), "%.17g", f));
+	d->comma = 1;
+}
+
+void dump_bool(dumper *d, int b) {
+	_dump_sep(d);
+	if(b) {
+		dump_raw(d, "true", 4);
+	} else {
+		dump_raw(d, "false", 5);
+	}
+	d->comma = 1;
+}
+
+void dump_null(dumper *d) {
+	_dump_sep(d);
+	dump_raw(d, "null", 4);
+	d->comma = 1;
+}
+
+void dump_ptr(dumper *d, const void *p) {
+	char num[32];
+	_dump_sep(d);
+	dump_raw(d, num, snprintf(num, sizeof(num), "\"%p\"", p));
+	d->comma = 1;
+}
+
+/* Ends one top-level record (the output is one JSON document per line). */
+void dump_newline(dumper *d) {
+	dump_raw(d, "\n", 1);
+	d->comma = 0;
+}
+
+static const char *dump_names[] = {
+	"ast",
+	"sema",
+	"ir",
+	"tokens",
+};
+
+/* Parses "ast,sema,..." into a mask of dump_k; returns 0 on an unknown name. */
+unsigned int dump_parse_selectors(const char *sel) {
+	unsigned int res = 0;
+	size_t i, len;
+	while(*sel) {
+		len = strcspn(sel, ",");
+		if(len == 3 && !strncmp(sel, "all", 3)) {
+			res |= DUMP_AST | DUMP_SEMA | DUMP_IR | DUMP_TOKENS;
+		} else {
+			for(i = 0; i < sizeof(dump_names) / sizeof(*dump_names); i++) {
+				if(strlen(dump_names[i]) == len && !strncmp(sel, dump_names[i], len)) {
+					res |= 1 << i;
+					break;
+				}
+			}
+			if(i == sizeof(dump_names) / sizeof(*dump_names)) {
+				return 0;
+			}
+		}
+		sel += len;
+		if(*sel) sel++;
+	}
+	return res;
+}
@@ -0,0 +1,48 @@
+#ifndef DUMP_H
+#define DUMP_H
+
+#include <stdio.h>
+
+/* Structured (JSON) dumps of the compiler's internal state. Everything goes
+ * through one large buffer that is only flushed to the FILE when full (or on
+ * request), so a dump costs a memcpy per token rather than a stdio call per
+ * character.
+ */
+
+typedef enum {
+	DUMP_AST = 1,
+	DUMP_SEMA = 2,
+	DUMP_IR = 4,
+	DUMP_TOKENS = 8,
+} dump_k;
+
+#define DUMP_BUF_SZ (1 << 16)
+
+typedef struct _dumper {
+	FILE *out;
+	char *buf;
+	size_t len;
+	int comma; /* a value was just completed; the next one needs a separator */
+} dumper;
+
+dumper *dump_new(FILE *out);
+void dump_flush(dumper *d);
+void dump_delete(dumper *d);
+void dump_raw(dumper *d, const char *s, size_t len);
+void dump_begin_obj(dumper *d);
+void dump_end_obj(dumper *d);
+void dump_begin_arr(dumper *d);
+void dump_end_arr(dumper *d);
+void dump_key(dumper *d, const char *key);
+void dump_str(dumper *d, const char *s);
+void dump_strn(dumper *d, const char *s, size_t len);
+void dump_str_free(dumper *d, const char *s);
+void dump_int(dumper *d, long i);
+void dump_real(dumper *d, double f);
+void dump_bool(dumper *d, int b);
+void dump_null(dumper *d);
+void dump_ptr(dumper *d, const void *p);
+void dump_newline(dumper *d);
+unsigned int dump_parse_selectors(const char *sel);
+
+#endif
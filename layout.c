@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "layout.h"
+#include "util.h"
+
+static const char *const lp64_int_args[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+static const char *const lp64_real_args[] = {"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7"};
+static const char *const lp64_caller_saved[] = {
+	"rax", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11",
+	"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+	"xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15",
+	NULL,
+};
+static const char *const lp64_callee_saved[] = {"rbx", "r12", "r13", "r14", "r15", NULL};
+
+/* x86-64 System V; integer (int64) is a long to match literals, and a
+ * string is an rt_string (see rt_string.h)
+ */
+target target_lp64 = {
+	.name = "lp64",
+	.size = {
+		[TP_CHAR] = 1,
+		[TP_BOOL] = 1,
+		[TP_FUNC] = 8,
+		[TP_STRING] = 32,
+		[TP_PTR] = 8,
+	},
+	.align = {
+		[TP_CHAR] = 1,
+		[TP_BOOL] = 1,
+		[TP_FUNC] = 8,
+		[TP_STRING] = 8,
+		[TP_PTR] = 8,
+	},
+	.word = 8,
+	.stack_align = 16,
+	.red_zone = 128,
+	.arg_regs = {
+		[RC_INT] = 6,
+		[RC_REAL] = 8,
+	},
+	.arg_names = {
+		[RC_INT] = lp64_int_args,
+		[RC_REAL] = lp64_real_args,
+	},
+	.ret_names = {
+		[RC_INT] = "rax",
+		[RC_REAL] = "xmm0",
+	},
+	.caller_saved = lp64_caller_saved,
+	.callee_saved = lp64_callee_saved,
+};
+
+target *target_current = &target_lp64;
+
+size_t layout_round(size_t n, size_t align) {
+	return align ? (n + align - 1) / align * align : n;
+}
+
+/* Laid out like a record whose fields are arrays of ty->size of each of the
+ * element's fields: one column per field, in field order.
+ */
+static ssize_t soa_offset(type *ty, size_t upto, size_t *align) {
+	type *rec = ty->base;
+	ssize_t off = 0, fsz;
+	size_t i, fal;
+	*align = 1;
+	for(i = 0; i < rec->types.len; i++) {
+		fsz = type_size(vec_get(&rec->types, i, type));
+		fal = type_align(vec_get(&rec->types, i, type));
+		*align = max(*align, fal);
+		if(fsz < 0 || off < 0 || ty->size < 0) {
+			off = -1;
+			continue;
+		}
+		off = layout_round(off, fal);
+		if(i == upto) {
+			return off;
+		}
+		off += layout_round(fsz, fal) * ty->size;
+	}
+	return off < 0 ? off : (ssize_t) layout_round(off, *align);
+}
+
+/* Fills the per-type cache; it is keyed on the target it was computed for */
+static void type_layout(type *ty) {
+	ssize_t sz, fsz;
+	size_t al, fal, i;
+	if(ty->layout_target == target_current) {
+		return;
+	}
+	switch(ty->kind) {
+		case TP_ARRAY:
+			if(ty->store == AS_SOA) {
+				sz = soa_offset(ty, ty->base->types.len, &al);
+				break;
+			}
+			/* A descriptor: where the elements are, lbound and length (see
+			 * rt_array.h) */
+			if(type_is_open(ty)) {
+				sz = 3 * target_current->word;
+				al = target_current->word;
+				break;
+			}
+			if(type_is_bitset(ty)) {
+				/* A bit per element, in whole words */
+				sz = ty->size < 0 ? -1 : (ssize_t) layout_round(ty->size, target_current->word * 8) / 8;
+				al = target_current->word;
+				break;
+			}
+			fsz = type_size(ty->base);
+			al = type_align(ty->base);
+			sz = (fsz < 0 || ty->size < 0) ? -1 : (ssize_t) layout_round(fsz, al) * ty->size;
+			break;
+
+		case TP_STRUCT:
+			sz = 0;
+			al = 1;
+			for(i = 0; i < ty->types.len; i++) {
+				fsz = type_size(vec_get(&ty->types, i, type));
+				fal = type_align(vec_get(&ty->types, i, type));
+				al = max(al, fal);
+				if(fsz < 0 || sz < 0) {
+					sz = -1;
+					continue;
+				}
+				sz = layout_round(sz, fal) + fsz;
+			}
+			if(sz >= 0) {
+				sz = layout_round(sz, al);
+			}
+			break;
+
+		case TP_UNION:
+			sz = 0;
+			al = 1;
+			for(i = 0; i < ty->types.len; i++) {
+				fsz = type_size(vec_get(&ty->types, i, type));
+				al = max(al, type_align(vec_get(&ty->types, i, type)));
+				sz = (fsz < 0 || sz < 0) ? -1 : max(sz, fsz);
+			}
+			if(sz >= 0) {
+				sz = layout_round(sz, al);
+			}
+			break;
+
+		case TP_REF:
+			sz = -1;
+			al = 1;
+			break;
+
+		case TP_INT:
+		case TP_REAL:
+			/* Sized: stored in exactly that many bytes, aligned to them */
+			sz = ty->width;
+			al = ty->width;
+			break;
+
+		default:
+			assert(target_current->size[ty->kind]);
+			sz = target_current->size[ty->kind];
+			al = target_current->align[ty->kind];
+			break;
+	}
+	ty->layout_size = sz;
+	ty->layout_align = al;
+	ty->layout_target = target_current;
+}
+
+ssize_t type_size(type *ty) {
+	if(!ty) {
+		return target_current->word;
+	}
+	type_layout(ty);
+	return ty->layout_size;
+}
+
+size_t type_align(type *ty) {
+	if(!ty) {
+		return target_current->word;
+	}
+	type_layout(ty);
+	return ty->layout_align;
+}
+
+/* Where field i starts: within the record, or for an soa array, where
+ * its column starts within the array.
+ */
+ssize_t type_field_offset(type *ty, size_t i) {
+	ssize_t off = 0, fsz;
+	size_t al, j;
+	if(ty->kind == TP_ARRAY) {
+		return soa_offset(ty, i, &al);
+	}
+	if(ty->kind == TP_UNION) {
+		return 0;
+	}
+	for(j = 0; j <= i; j++) {
+		fsz = type_size(vec_get(&ty->types, j, type));
+		if(fsz < 0) {
+			return -1;
+		}
+		off = layout_round(off, type_align(vec_get(&ty->types, j, type)));
+		if(j < i) {
+			off += fsz;
+		}
+	}
+	return off;
+}
+
+int type_reg_class(type *ty) {
+	if(!ty) {
+		return RC_INT;
+	}
+	switch(ty->kind) {
+		case TP_INT:
+		case TP_CHAR:
+		case TP_BOOL:
+		case TP_FUNC:
+		case TP_PTR:
+			return RC_INT;
+
+		case TP_REAL:
+			return RC_REAL;
+
+		default:
+			return -1;
+	}
+}
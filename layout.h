@@ -0,0 +1,50 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stddef.h>
+
+#include "type.h"
+
+/* Scalars travel in registers of one of these classes */
+typedef enum {
+	RC_INT,
+	RC_REAL,
+	RC_NCLASSES,
+} reg_class_k;
+
+/* What layout needs to know about the machine. Sizes and alignments are
+ * given per type_k for the kinds that have a fixed one; integers and reals
+ * take their width, and arrays, records and names are computed from their
+ * parts.
+ */
+typedef struct _target {
+	const char *name;
+	size_t size[TP_NKINDS]; /* 0: computed, not fixed */
+	size_t align[TP_NKINDS];
+	size_t word; /* pointers, display entries and stack slots */
+	size_t stack_align; /* frame sizes are rounded to this */
+	size_t red_zone; /* bytes below SP a leaf may use without moving SP */
+	/* Calling convention: the leading scalar arguments of each class go in
+	 * REG_ARG/REG_FARG 0.., results in REG_RV/REG_FRV; arrays and the rest
+	 * are pushed. The names are the machine registers those map to.
+	 */
+	size_t arg_regs[RC_NCLASSES];
+	const char *const *arg_names[RC_NCLASSES];
+	const char *ret_names[RC_NCLASSES];
+	const char *const *caller_saved; /* NULL-terminated */
+	const char *const *callee_saved; /* NULL-terminated, FP and SP aside */
+} target;
+
+extern target target_lp64;
+extern target *target_current;
+
+/* -1 if unknown (set literals, unresolved names); a NULL type is one word */
+ssize_t type_size(type *ty);
+size_t type_align(type *ty);
+size_t layout_round(size_t n, size_t align);
+/* Offset of field i of a record, or of its column in an soa array of them */
+ssize_t type_field_offset(type *ty, size_t i);
+/* -1 if ty isn't passed in registers */
+int type_reg_class(type *ty);
+
+#endif
@@ -1,11 +1,19 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "lit.h"
 #include "vector.h"
 #include "type.h"
 #include "util.h"
+#include "ast.h"
+
+static long lit_as_long(literal *);
+static double lit_as_double(literal *);
+static int lit_is_scalar(literal *);
 
 literal *lit_new(void) {
 	literal *lit = malloc(sizeof(literal));
@@ -42,36 +50,427 @@ literal *lit_new_char(char cval) {
 	return lit;
 }
 
-literal *lit_new_array(vector *init, type *fallback) {
+literal *lit_new_bool(int bval) {
+	literal *lit = lit_new();
+	lit->kind = LIT_BOOL;
+	lit->type = type_new_bool();
+	lit->bval = !!bval;
+	return lit;
+}
+
+literal *lit_new_nil(void) {
 	literal *lit = lit_new();
+	lit->kind = LIT_NIL;
+	lit->type = type_new_ptr(NULL);
+	return lit;
+}
+
+/* Bytes per element of a packed array of ty, as the target stores them; 0
+ * if ty can't be packed
+ */
+size_t lit_elem_size(type *ty) {
+	switch(ty->kind) {
+		case TP_INT: return ty->width;
+		case TP_REAL: return ty->width;
+		case TP_CHAR: return sizeof(char);
+		default: return 0;
+	}
+}
+
+static void lit_pack(literal *lit, size_t idx, literal *item) {
+	void *data = lit->packed.data;
+	switch(lit->type->base->kind) {
+		case TP_INT:
+			switch(lit->type->base->width) {
+				case 1: ((int8_t *) data)[idx] = lit_as_long(item); break;
+				case 2: ((int16_t *) data)[idx] = lit_as_long(item); break;
+				case 4: ((int32_t *) data)[idx] = lit_as_long(item); break;
+				default: ((long *) data)[idx] = lit_as_long(item); break;
+			}
+			break;
+
+		case TP_REAL:
+			if(lit->type->base->width == sizeof(float)) {
+				((float *) data)[idx] = lit_as_double(item);
+			} else {
+				((double *) data)[idx] = lit_as_double(item);
+			}
+			break;
+
+		case TP_CHAR:
+			((char *) data)[idx] = lit_as_long(item);
+			break;
+
+		default:
+			assert(0);
+			break;
+	}
+}
+
+/* Element idx of a packed array of integers or characters */
+static long lit_packed_long(literal *lit, size_t idx) {
+	void *data = lit->packed.data;
+	if(lit->type->base->kind == TP_CHAR) {
+		return ((char *) data)[idx];
+	}
+	switch(lit->type->base->width) {
+		case 1: return ((int8_t *) data)[idx];
+		case 2: return ((int16_t *) data)[idx];
+		case 4: return ((int32_t *) data)[idx];
+		default: return ((long *) data)[idx];
+	}
+}
+
+/* Element idx of a packed array of reals */
+static double lit_packed_double(literal *lit, size_t idx) {
+	if(lit->type->base->width == sizeof(float)) {
+		return ((float *) lit->packed.data)[idx];
+	}
+	return ((double *) lit->packed.data)[idx];
+}
+
+static literal *lit_new_packed(type *base, size_t len) {
+	literal *lit = lit_new();
+	lit->kind = LIT_PACKED;
+	lit->packed.data = calloc(len ? len : 1, lit_elem_size(base));
+	lit->packed.len = len;
+	lit->type = type_new_array(base, 0, len);
+	return lit;
+}
+
+/* init is a vector of literal *. Arrays whose elements all implicitly cast to
+ * a packable element type are stored as a contiguous native buffer. Without a
+ * fallback the element type is the first item's, so init can't be empty. */
+literal *lit_new_array(vector *init, type *fallback) {
+	literal *lit, *item;
+	size_t i, len = init ? init->len : 0;
+	int packable;
+	if(!fallback) {
+		assert(len > 0);
+		fallback = vec_get(init, 0, literal)->type;
+	}
+	packable = lit_elem_size(fallback) > 0;
+	for(i = 0; packable && i < len; i++) {
+		item = vec_get(init, i, literal);
+		packable = lit_is_scalar(item) && type_can_cast(item->type, fallback) == CAST_IMPLICIT;
+	}
+	if(packable) {
+		lit = lit_new_packed(fallback, len);
+		for(i = 0; i < len; i++) {
+			lit_pack(lit, i, vec_get(init, i, literal));
+		}
+		return lit;
+	}
+	lit = lit_new();
 	lit->kind = LIT_ARRAY;
 	vec_init(&lit->items);
 	if(init) {
 		vec_map(init, &lit->items, (vec_map_f) lit_copy, NULL);
 	}
-	if(!fallback && lit->items.len > 0) {
-		fallback = vec_get(&lit->items, 0, literal)->type;
-	}
-	if(!fallback) {
-		fallback = type_new_int();    /* FIXME */
-	}
 	lit->type = type_new_array(fallback, 0, lit->items.len);
 	return lit;
 }
 
 literal *lit_new_range(long lbound, size_t size) {
 	literal *lit = lit_new();
-	long i;
-	lit->kind = LIT_ARRAY;
-	vec_init(&lit->items);
-	vec_alloc(&lit->items, size);
-	for(i = 0; i < size; i++) {
-		vec_insert(&lit->items, i, lit_new_int(i));
+	lit->kind = LIT_RANGE;
+	lit->range.lbound = lbound;
+	lit->range.size = size;
+	lit->type = type_new_array(type_scalar(TP_INT), lbound, size);
+	return lit;
+}
+
+/* A copy of len bytes of data */
+literal *lit_new_string(const char *data, size_t len) {
+	literal *lit = lit_new();
+	lit->kind = LIT_STRING;
+	lit->packed.data = malloc(len ? len : 1);
+	assert(lit->packed.data);
+	memcpy(lit->packed.data, data, len);
+	lit->packed.len = len;
+	lit->type = type_new_string();
+	return lit;
+}
+
+/* The words of a bitset of nbits, all clear: a packed array of integers */
+literal *lit_new_bits(size_t nbits) {
+	size_t bits = sizeof(long) * CHAR_BIT;
+	return lit_new_packed(type_scalar(TP_INT), (nbits + bits - 1) / bits);
+}
+
+void lit_bits_set(literal *words, size_t i) {
+	size_t bits = sizeof(long) * CHAR_BIT;
+	((unsigned long *) words->packed.data)[i / bits] |= 1UL << i % bits;
+}
+
+int lit_bits_test(literal *words, size_t i) {
+	size_t bits = sizeof(long) * CHAR_BIT;
+	return ((unsigned long *) words->packed.data)[i / bits] >> i % bits & 1;
+}
+
+/* Element count of an array-like literal */
+size_t lit_len(literal *lit) {
+	switch(lit->kind) {
+		case LIT_ARRAY:
+			return lit->items.len;
+
+		case LIT_PACKED:
+		case LIT_STRING:
+			return lit->packed.len;
+
+		case LIT_RANGE:
+			return lit->range.size;
+
+		default:
+			return 0;
+	}
+}
+
+/* A new reference to element idx of an array-like literal */
+literal *lit_item(literal *lit, size_t idx) {
+	switch(lit->kind) {
+		case LIT_ARRAY:
+			return lit_copy(vec_get(&lit->items, idx, literal));
+
+		case LIT_PACKED:
+			switch(lit->type->base->kind) {
+				case TP_INT: return lit_new_scalar(lit->type->base, lit_packed_long(lit, idx), 0);
+				case TP_REAL: return lit_new_scalar(lit->type->base, 0, lit_packed_double(lit, idx));
+				case TP_CHAR: return lit_new_char(lit_packed_long(lit, idx));
+				default: assert(0); return NULL;
+			}
+
+		case LIT_RANGE:
+			return lit_new_int(lit->range.lbound + idx);
+
+		case LIT_STRING:
+			return lit_new_char(((char *) lit->packed.data)[idx]);
+
+		default:
+			assert(0);
+			return NULL;
+	}
+}
+
+/* An equivalent of lit whose elements exist in memory (a new reference). Only
+ * for consumers that genuinely need the storage, like the data section;
+ * everything else should handle LIT_RANGE symbolically. */
+literal *lit_materialize(literal *lit) {
+	literal *res;
+	size_t i;
+	if(lit->kind != LIT_RANGE) {
+		return lit_copy(lit);
+	}
+	res = lit_new_packed(type_scalar(TP_INT), lit->range.size);
+	for(i = 0; i < lit->range.size; i++) {
+		((long *) res->packed.data)[i] = lit->range.lbound + i;
+	}
+	type_delete(res->type);
+	res->type = type_copy(lit->type);
+	return res;
+}
+
+/********** Constant arithmetic (shared by folding and CTFE) **********/
+
+static long lit_as_long(literal *lit) {
+	switch(lit->kind) {
+		case LIT_INT: return lit->ival;
+		case LIT_REAL: return (long) lit->fval;
+		case LIT_CHAR: return lit->cval;
+		case LIT_BOOL: return lit->bval;
+		default: assert(0); return 0;
+	}
+}
+
+static double lit_as_double(literal *lit) {
+	if(lit->kind == LIT_REAL) {
+		return lit->fval;
+	}
+	return lit_as_long(lit);
+}
+
+static int lit_is_scalar(literal *lit) {
+	return lit->kind == LIT_INT || lit->kind == LIT_REAL || lit->kind == LIT_CHAR || lit->kind == LIT_BOOL;
+}
+
+/* ival wrapped to a signed integer of width bytes, as storing it would */
+static long lit_wrap(long ival, size_t width) {
+	int shift = (sizeof(long) - width) * CHAR_BIT;
+	if(width >= sizeof(long)) {
+		return ival;
+	}
+	return (long) ((unsigned long) ival << shift) >> shift;
+}
+
+/* A literal of scalar type ty, from whichever of ival/fval applies; sized
+ * integers and reals are rounded to their width and keep ty.
+ */
+literal *lit_new_scalar(type *ty, long ival, double fval) {
+	literal *lit;
+	switch(ty->kind) {
+		case TP_INT:
+			lit = lit_new_int(lit_wrap(ival, ty->width));
+			break;
+
+		case TP_REAL:
+			lit = lit_new_real(ty->width == sizeof(float) ? (float) fval : fval);
+			break;
+
+		case TP_CHAR: return lit_new_char(ival);
+		case TP_BOOL: return lit_new_bool(ival);
+		default: return NULL;
 	}
-	lit->type = type_new_array(type_new_int(), 0, size);
+	type_delete(lit->type);
+	lit->type = type_copy(ty);
 	return lit;
 }
 
+/* lit converted to scalar type ty, or a packed array to one of another
+ * packable element type (a new reference); other non-scalars are kept
+ */
+literal *lit_cast(literal *lit, type *ty) {
+	literal *res, *item, *elem;
+	size_t i;
+	if(ty && lit->kind == LIT_PACKED && ty->kind == TP_ARRAY && lit_elem_size(ty->base) && !type_equal(ty->base, lit->type->base)) {
+		res = lit_new_packed(ty->base, lit->packed.len);
+		for(i = 0; i < lit->packed.len; i++) {
+			item = lit_item(lit, i);
+			elem = lit_cast(item, ty->base);
+			lit_pack(res, i, elem);
+			lit_delete(item);
+			lit_delete(elem);
+		}
+		return res;
+	}
+	if(!ty || !lit_is_scalar(lit) || !type_is_scalar(ty) || type_equal(ty, lit->type)) {
+		return lit_copy(lit);
+	}
+	return lit_new_scalar(ty, lit_as_long(lit), lit_as_double(lit));
+}
+
+/* Evaluates kind on a constant operand following the typing tables; NULL if
+ * the operation isn't well-defined at compile time. */
+literal *lit_unop(int kind, literal *lit) {
+	type *rty;
+	if(lit->kind == LIT_STRING) {
+		return kind == OP_LENGTH ? lit_new_int(lit->packed.len) : NULL;
+	}
+	if(!lit_is_scalar(lit) || type_can_unop(lit->type, kind) < CAST_UNINTENDED) {
+		return NULL;
+	}
+	rty = type_of_unop(lit->type, kind);
+	switch(kind) {
+		case OP_NEG:
+			return lit_new_scalar(rty, -lit_as_long(lit), -lit_as_double(lit));
+
+		case OP_NOT:
+			return lit_new_bool(!lit_as_long(lit));
+
+		case OP_BNOT:
+			return lit_new_scalar(rty, ~lit_as_long(lit), 0);
+
+		case OP_IDENT:
+			return lit_new_scalar(rty, lit_as_long(lit), lit_as_double(lit));
+
+		default:
+			return NULL;
+	}
+}
+
+/* Concatenation, comparison and search of strings, as the runtime does them */
+static literal *lit_string_binop(literal *left, int kind, literal *right) {
+	literal *res;
+	const char *a = left->packed.data, *b = right->packed.data, *p;
+	size_t alen = left->packed.len, blen = right->packed.len;
+	long c;
+	if(kind == OP_IN) {
+		if(left->kind == LIT_CHAR) {
+			return lit_new_bool(memchr(b, left->cval, blen) != NULL);
+		}
+		for(p = b; alen && p + alen <= b + blen && memcmp(p, a, alen); p++);
+		return lit_new_bool(p + alen <= b + blen);
+	}
+	if(left->kind != LIT_STRING) {
+		return NULL;
+	}
+	c = memcmp(a, b, min(alen, blen));
+	c = c ? c : alen < blen ? -1 : alen > blen;
+	switch(kind) {
+		case OP_ADD:
+			res = lit_new_string(a, alen);
+			res->packed.data = realloc(res->packed.data, alen + blen ? alen + blen : 1);
+			assert(res->packed.data);
+			memcpy((char *) res->packed.data + alen, b, blen);
+			res->packed.len = alen + blen;
+			return res;
+
+		case OP_EQ: return lit_new_bool(!c);
+		case OP_NEQ: return lit_new_bool(c);
+		case OP_LEQ: return lit_new_bool(c <= 0);
+		case OP_GEQ: return lit_new_bool(c >= 0);
+		case OP_LESS: return lit_new_bool(c < 0);
+		case OP_GREATER: return lit_new_bool(c > 0);
+		default: return NULL;
+	}
+}
+
+literal *lit_binop(literal *left, int kind, literal *right) {
+	type *rty, *pty;
+	long a, b;
+	double fa, fb;
+	int real;
+	if(right->kind == LIT_STRING && (left->kind == LIT_STRING || (left->kind == LIT_CHAR && kind == OP_IN))) {
+		return lit_string_binop(left, kind, right);
+	}
+	if(!lit_is_scalar(left) || !lit_is_scalar(right) || type_can_binop(left->type, kind, right->type) < CAST_UNINTENDED) {
+		return NULL;
+	}
+	rty = type_of_binop(left->type, kind, right->type);
+	pty = type_num_promote(left->type, right->type);
+	real = pty->kind == TP_REAL;
+	a = lit_as_long(left);
+	b = lit_as_long(right);
+	fa = lit_as_double(left);
+	fb = lit_as_double(right);
+	switch(kind) {
+		/* Wrapping, as the target would */
+		case OP_ADD: return lit_new_scalar(rty, (long) ((unsigned long) a + b), fa + fb);
+		case OP_SUB: return lit_new_scalar(rty, (long) ((unsigned long) a - b), fa - fb);
+		case OP_MUL: return lit_new_scalar(rty, (long) ((unsigned long) a * b), fa * fb);
+
+		case OP_DIV:
+			if(!real && (!b || (a == LONG_MIN && b == -1))) return NULL;
+			return lit_new_scalar(rty, real ? 0 : a / b, fa / fb);
+
+		case OP_MOD:
+			if(real || !b || (a == LONG_MIN && b == -1)) return NULL;
+			return lit_new_scalar(rty, a % b, 0);
+
+		case OP_EQ: return lit_new_bool(real ? fa == fb : a == b);
+		case OP_NEQ: return lit_new_bool(real ? fa != fb : a != b);
+		case OP_LEQ: return lit_new_bool(real ? fa <= fb : a <= b);
+		case OP_GEQ: return lit_new_bool(real ? fa >= fb : a >= b);
+		case OP_LESS: return lit_new_bool(real ? fa < fb : a < b);
+		case OP_GREATER: return lit_new_bool(real ? fa > fb : a > b);
+		case OP_AND: return lit_new_bool(a && b);
+		case OP_OR: return lit_new_bool(a || b);
+		case OP_BAND: return lit_new_int(a & b);
+		case OP_BOR: return lit_new_int(a | b);
+		case OP_BXOR: return lit_new_int(a ^ b);
+
+		case OP_BLSHIFT:
+			if(b < 0 || b >= 64) return NULL;
+			return lit_new_int((long) ((unsigned long) a << b));
+
+		case OP_BRSHIFT:
+			if(b < 0 || b >= 64) return NULL;
+			return lit_new_int(a >> b);
+
+		default:
+			return NULL;
+	}
+}
+
 void lit_array_append(literal *arr, literal *lit) {
 	vec_insert(&arr->items, arr->items.len, lit_copy(lit));
 }
@@ -86,6 +485,9 @@ void lit_destroy(literal *lit) {
 		case LIT_INT:
 		case LIT_REAL:
 		case LIT_CHAR:
+		case LIT_BOOL:
+		case LIT_RANGE:
+		case LIT_NIL:
 			break;
 
 		case LIT_ARRAY:
@@ -93,6 +495,11 @@ void lit_destroy(literal *lit) {
 			vec_clear(&lit->items);
 			break;
 
+		case LIT_PACKED:
+		case LIT_STRING:
+			free(lit->packed.data);
+			break;
+
 		default:
 			assert(0);
 	}
@@ -119,6 +526,10 @@ void lit_print(FILE *out, int lev, literal *lit) {
 			wrlev(out, lev, "{Character (%s): %c}", type_repr(lit->type), lit->cval);
 			break;
 
+		case LIT_BOOL:
+			wrlev(out, lev, "{Boolean (%s): %s}", type_repr(lit->type), lit->bval ? "true" : "false");
+			break;
+
 		case LIT_ARRAY:
 			wrlev(out, lev, "{Array: %s}", type_repr(lit->type));
 			for(i = 0; i < lit->items.len; i++) {
@@ -126,8 +537,118 @@ void lit_print(FILE *out, int lev, literal *lit) {
 			}
 			break;
 
+		case LIT_PACKED:
+			wrlev(out, lev, "{Packed Array: %s}", type_repr(lit->type));
+			for(i = 0; i < lit->packed.len; i++) {
+				switch(lit->type->base->kind) {
+					case TP_INT:
+						wrlev(out, lev + 1, "%ld", lit_packed_long(lit, i));
+						break;
+
+					case TP_REAL:
+						wrlev(out, lev + 1, "%f", lit_packed_double(lit, i));
+						break;
+
+					case TP_CHAR:
+						wrlev(out, lev + 1, "%c", (char) lit_packed_long(lit, i));
+						break;
+
+					default:
+						break;
+				}
+			}
+			break;
+
+		case LIT_RANGE:
+			wrlev(out, lev, "{Range: %s: %ld..%ld}", type_repr(lit->type), lit->range.lbound, lit->range.lbound + (long) lit->range.size);
+			break;
+
+		case LIT_STRING:
+			wrlev(out, lev, "{String (%s): '%.*s'}", type_repr(lit->type), (int) lit->packed.len, (char *) lit->packed.data);
+			break;
+
+		case LIT_NIL:
+			wrlev(out, lev, "{Nil}");
+			break;
+
 		default:
 			wrlev(out, lev, "!!!{UNKNOWN LITERAL}!!!");
 			break;
 	}
 }
+
+void lit_dump(dumper *d, literal *lit) {
+	size_t i;
+	if(!lit) {
+		dump_null(d);
+		return;
+	}
+	dump_begin_obj(d);
+	dump_key(d, "type");
+	type_dump(d, lit->type);
+	dump_key(d, "value");
+	switch(lit->kind) {
+		case LIT_INT:
+			dump_int(d, lit->ival);
+			break;
+
+		case LIT_REAL:
+			dump_real(d, lit->fval);
+			break;
+
+		case LIT_CHAR:
+			dump_int(d, lit->cval);
+			break;
+
+		case LIT_BOOL:
+			dump_bool(d, lit->bval);
+			break;
+
+		case LIT_ARRAY:
+			dump_begin_arr(d);
+			for(i = 0; i < lit->items.len; i++) {
+				lit_dump(d, vec_get(&lit->items, i, literal));
+			}
+			dump_end_arr(d);
+			break;
+
+		case LIT_PACKED:
+			dump_begin_arr(d);
+			for(i = 0; i < lit->packed.len; i++) {
+				switch(lit->type->base->kind) {
+					case TP_INT:
+					case TP_CHAR:
+						dump_int(d, lit_packed_long(lit, i));
+						break;
+
+					case TP_REAL:
+						dump_real(d, lit_packed_double(lit, i));
+						break;
+
+					default:
+						dump_null(d);
+						break;
+				}
+			}
+			dump_end_arr(d);
+			break;
+
+		case LIT_RANGE:
+			dump_begin_obj(d);
+			dump_key(d, "lbound");
+			dump_int(d, lit->range.lbound);
+			dump_key(d, "size");
+			dump_int(d, lit->range.size);
+			dump_end_obj(d);
+			break;
+
+		case LIT_STRING:
+			dump_strn(d, lit->packed.data, lit->packed.len);
+			break;
+
+		default:
+			dump_null(d);
+			break;
+	}
+	dump_end_obj(d);
+}
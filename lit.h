@@ -6,12 +6,18 @@
 
 #include "type.h"
 #include "vector.h"
+#include "dump.h"
 
 typedef enum {
 	LIT_INT,
 	LIT_REAL,
 	LIT_CHAR,
+	LIT_BOOL,
 	LIT_ARRAY,
+	LIT_PACKED,
+	LIT_RANGE,
+	LIT_STRING,
+	LIT_NIL, /* the pointer to nothing */
 } lit_k;
 
 typedef struct _literal {
@@ -22,7 +28,16 @@ typedef struct _literal {
 		long ival;
 		double fval;
 		char cval;
+		int bval;
 		vector items; /* of literal * */
+		struct {
+			void *data; /* len native values of type->base, see lit_elem_size */
+			size_t len;
+		} packed; /* homogeneous arrays of integer, real or char; a string's bytes */
+		struct {
+			long lbound;
+			size_t size;
+		} range; /* the integers lbound..lbound+size-1, never materialized unless asked */
 	};
 } literal;
 
@@ -31,10 +46,25 @@ literal *lit_copy(literal *lit);
 literal *lit_new_int(long ival);
 literal *lit_new_real(double fval);
 literal *lit_new_char(char cval);
+literal *lit_new_bool(int bval);
+literal *lit_new_nil(void);
 literal *lit_new_array(vector *init, type *fallback);
 literal *lit_new_range(long lbound, size_t size);
+literal *lit_new_string(const char *data, size_t len);
+literal *lit_new_bits(size_t nbits);
+void lit_bits_set(literal *words, size_t i);
+int lit_bits_test(literal *words, size_t i);
+size_t lit_elem_size(type *ty);
+size_t lit_len(literal *lit);
+literal *lit_item(literal *lit, size_t idx);
+literal *lit_materialize(literal *lit);
+literal *lit_new_scalar(type *ty, long ival, double fval);
+literal *lit_cast(literal *lit, type *ty);
+literal *lit_unop(int kind, literal *lit);
+literal *lit_binop(literal *left, int kind, literal *right);
 void lit_delete(literal *lit);
 void lit_destroy(literal *lit);
 void lit_print(FILE *, int, literal *);
+void lit_dump(dumper *, literal *);
 
 #endif
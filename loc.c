@@ -2,9 +2,12 @@
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdarg.h>
 
 #include "loc.h"
+#include "layout.h"
 #include "vector.h"
+#include "util.h"
 
 location *loc_new(void) {
 	location *res = malloc(sizeof(location));
@@ -25,10 +28,13 @@ location *loc_new_mem(ssize_t addr) {
 	return res;
 }
 
+unsigned long next_num_temp = 0;
+
 location *loc_new_temp(void *data) {
 	location *res = loc_new();
 	res->kind = LOC_TEMP;
 	res->temp.data = data;
+	res->temp.num = next_num_temp++;
 	return res;
 }
 
@@ -43,7 +49,7 @@ location *loc_new_off(location *addr, location *amt) {
 	location *res = loc_new();
 	res->kind = LOC_OFF;
 	res->off.addr = loc_copy(addr);
-	res->off.amt = amt;
+	res->off.amt = loc_copy(amt);
 	return res;
 }
 
@@ -56,6 +62,9 @@ location *loc_new_off_vec(location *addr, vector *amts) {
 	prev = addr;
 	for(i = 0; i < amts->len; i++) {
 		res = loc_new_off(prev, vec_get(amts, i, location));
+		if(prev != addr) {
+			loc_delete(prev); /* res holds it now */
+		}
 		prev = res;
 	}
 	return res;
@@ -70,9 +79,14 @@ location *loc_new_stride(location *loc, location *stride) {
 }
 
 location *loc_new_reg(reg_k kind) {
+	return loc_new_reg_num(kind, 0);
+}
+
+location *loc_new_reg_num(reg_k kind, size_t num) {
 	location *res = loc_new();
 	res->kind = LOC_REG;
 	res->reg.kind = kind;
+	res->reg.num = num;
 	return res;
 }
 
@@ -84,6 +98,7 @@ location *loc_new_sym(char *name) {
 }
 
 char *SYNAME_GDISP = "__GLOBAL_DISPLAY_TABLE";
+char *SYNAME_OVERLAY = "__STATIC_FRAME_OVERLAY";
 
 location *loc_new_size(type *ty) {
 	location *res = loc_new();
@@ -93,62 +108,186 @@ location *loc_new_size(type *ty) {
 	return res;
 }
 
+/* Evaluates sizes and strides for the current target and merges constant
+ * offsets, leaving at most one constant displacement on each base. Returns a
+ * new reference; unknown sizes stay symbolic.
+ */
+location *loc_fold(location *loc) {
+	location *a, *b, *res;
+	ssize_t sz;
+	switch(loc->kind) {
+		case LOC_SIZE:
+			sz = type_size(loc->size.type);
+			return sz < 0 ? loc_copy(loc) : loc_new_mem(sz);
+
+		case LOC_IND:
+			a = loc_fold(loc->ind.addr);
+			res = loc_new_ind(a);
+			loc_delete(a);
+			return res;
+
+		case LOC_STRIDE:
+			a = loc_fold(loc->stride.loc);
+			b = loc_fold(loc->stride.stride);
+			if(a->kind == LOC_MEM && b->kind == LOC_MEM) {
+				res = loc_new_mem(a->mem.addr * b->mem.addr);
+			} else {
+				res = loc_new_stride(a, b);
+			}
+			loc_delete(a);
+			loc_delete(b);
+			return res;
+
+		case LOC_OFF:
+			a = loc_fold(loc->off.addr);
+			b = loc_fold(loc->off.amt);
+			if(b->kind == LOC_MEM && !b->mem.addr) {
+				res = loc_copy(a);
+			} else if(a->kind == LOC_MEM && b->kind == LOC_MEM) {
+				res = loc_new_mem(a->mem.addr + b->mem.addr);
+			} else if(a->kind == LOC_OFF && a->off.amt->kind == LOC_MEM && b->kind == LOC_MEM) {
+				sz = a->off.amt->mem.addr + b->mem.addr;
+				loc_delete(b);
+				b = loc_new_mem(sz);
+				res = sz ? loc_new_off(a->off.addr, b) : loc_copy(a->off.addr);
+			} else {
+				res = loc_new_off(a, b);
+			}
+			loc_delete(a);
+			loc_delete(b);
+			return res;
+
+		default:
+			return loc_copy(loc);
+	}
+}
+
+location *loc_new_addr(location *base, location *index, size_t scale, ssize_t disp) {
+	location *res = loc_new();
+	res->kind = LOC_ADDR;
+	res->addr.base = base ? loc_copy(base) : NULL;
+	res->addr.index = index ? loc_copy(index) : NULL;
+	res->addr.scale = index ? scale : 1;
+	res->addr.disp = disp;
+	return res;
+}
+
 #define LREPR_SZ 1024
 
 static const char *REG_NAMES[] = {
 	"FP",
 	"SP",
+	"RV",
+	"FRV",
+	"A",
+	"FA",
 };
 
+/* Appends to a repr being built in buf, which has chars of LREPR_SZ used; what
+ * doesn't fit is cut off */
+static void lrepr_add(char *buf, int *chars, const char *fmt, ...) {
+	va_list va;
+	int n;
+	va_start(va, fmt);
+	n = vsnprintf(buf + *chars, LREPR_SZ - *chars, fmt, va);
+	va_end(va);
+	if(n > 0) {
+		*chars = min(*chars + n, LREPR_SZ - 1);
+	}
+}
+
 char *loc_repr(location *loc) {
-	char lbuffer[LREPR_SZ] = {0};
 	char *lrepr = malloc(sizeof(char) * LREPR_SZ);
-	int chars;
+	char *a, *b;
+	int chars = 0;
+	assert(lrepr);
+	lrepr[0] = 0;
 	if(!loc) {
-		snprintf(lrepr, LREPR_SZ, "NULL");
+		lrepr_add(lrepr, &chars, "NULL");
 		return lrepr;
 	}
 	switch(loc->kind) {
 		case LOC_TEMP:
-			chars = snprintf(lbuffer, LREPR_SZ, "<temp>");
+			lrepr_add(lrepr, &chars, "<temp %lu>", loc->temp.num);
 			break;
 
 		case LOC_MEM:
-			chars = snprintf(lbuffer, LREPR_SZ, "%ld", loc->mem.addr);
+			lrepr_add(lrepr, &chars, "%ld", loc->mem.addr);
 			break;
 
 		case LOC_IND:
-            chars = snprintf(lbuffer, LREPR_SZ, "*(%s)", loc_repr(loc->ind.addr));
+			a = loc_repr(loc->ind.addr);
+			lrepr_add(lrepr, &chars, "*(%s)", a);
+			free(a);
 			break;
 
 		case LOC_OFF:
-			chars = snprintf(lbuffer, LREPR_SZ, "(%s)+(%s)", loc_repr(loc->off.addr), loc_repr(loc->off.amt));
+			a = loc_repr(loc->off.addr);
+			b = loc_repr(loc->off.amt);
+			lrepr_add(lrepr, &chars, "(%s)+(%s)", a, b);
+			free(a);
+			free(b);
 			break;
 
 		case LOC_STRIDE:
-			chars = snprintf(lbuffer, LREPR_SZ, "(%s)*(%s)", loc_repr(loc->stride.loc), loc_repr(loc->stride.stride));
+			a = loc_repr(loc->stride.loc);
+			b = loc_repr(loc->stride.stride);
+			lrepr_add(lrepr, &chars, "(%s)*(%s)", a, b);
+			free(a);
+			free(b);
 			break;
 
 		case LOC_REG:
-			chars = snprintf(lbuffer, LREPR_SZ, "%s", REG_NAMES[loc->reg.kind]);
+			if(loc->reg.kind == REG_ARG || loc->reg.kind == REG_FARG) {
+				lrepr_add(lrepr, &chars, "%s%lu", REG_NAMES[loc->reg.kind], loc->reg.num);
+			} else {
+				lrepr_add(lrepr, &chars, "%s", REG_NAMES[loc->reg.kind]);
+			}
 			break;
 
 		case LOC_SYM:
-			chars = snprintf(lbuffer, LREPR_SZ, "&%s", loc->sym.name);
+			lrepr_add(lrepr, &chars, "&%s", loc->sym.name);
 			break;
 
 		case LOC_SIZE:
-			chars = snprintf(lbuffer, LREPR_SZ, "sizeof(%s)", type_repr(loc->size.type));
+			a = (char *) type_repr(loc->size.type);
+			lrepr_add(lrepr, &chars, "sizeof(%s)", a);
+			free(a);
+			break;
+
+		case LOC_ADDR:
+			lrepr_add(lrepr, &chars, "[");
+			if(loc->addr.base) {
+				a = loc_repr(loc->addr.base);
+				lrepr_add(lrepr, &chars, "%s", a);
+				free(a);
+			}
+			if(loc->addr.index) {
+				a = loc_repr(loc->addr.index);
+				lrepr_add(lrepr, &chars, "%s%s*%zu", loc->addr.base ? " + " : "", a, loc->addr.scale);
+				free(a);
+			}
+			if(loc->addr.disp || (!loc->addr.base && !loc->addr.index)) {
+				lrepr_add(lrepr, &chars, "%s%ld", (loc->addr.base || loc->addr.index) ? (loc->addr.disp < 0 ? " - " : " + ") : "", (loc->addr.base || loc->addr.index) && loc->addr.disp < 0 ? -loc->addr.disp : loc->addr.disp);
+			}
+			lrepr_add(lrepr, &chars, "]");
 			break;
 
 		default:
 			assert(0);
 			break;
 	}
-	memcpy(lrepr, lbuffer, chars + 1);
 	return lrepr;
 }
 
+void loc_dump(dumper *d, location *loc) {
+	if(!loc) {
+		dump_null(d);
+		return;
+	}
+	dump_str_free(d, loc_repr(loc));
+}
+
 void loc_delete(location *loc) {
 	loc->refcnt--;
 	if(loc->refcnt <= 0) {
@@ -170,6 +309,11 @@ void loc_destroy(location *loc) {
 			loc_delete(loc->off.amt);
 			break;
 
+		case LOC_STRIDE:
+			loc_delete(loc->stride.loc);
+			loc_delete(loc->stride.stride);
+			break;
+
 		case LOC_REG:
 			break;
 
@@ -178,7 +322,18 @@ void loc_destroy(location *loc) {
 			break;
 
 		case LOC_SIZE:
-			type_delete(loc->size.type);
+			if(loc->size.type) {
+				type_delete(loc->size.type);
+			}
+			break;
+
+		case LOC_ADDR:
+			if(loc->addr.base) {
+				loc_delete(loc->addr.base);
+			}
+			if(loc->addr.index) {
+				loc_delete(loc->addr.index);
+			}
 			break;
 
 		default:
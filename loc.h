@@ -5,6 +5,7 @@
 
 #include "type.h"
 #include "vector.h"
+#include "dump.h"
 
 typedef enum {
 	LOC_TEMP,
@@ -15,6 +16,7 @@ typedef enum {
 	LOC_REG,
 	LOC_SYM,
 	LOC_SIZE,
+	LOC_ADDR,
 } loc_k;
 
 typedef struct _location location;
@@ -25,6 +27,7 @@ typedef struct _mem_location {
 
 typedef struct _temp_location {
 	void *data;
+	unsigned long num; /* for printing */
 } temp_location;
 
 typedef struct _ind_location {
@@ -41,13 +44,19 @@ typedef struct _stride_location {
 	location *stride;
 } stride_location;
 
+/* Virtual registers; the target maps them to machine ones (see layout.h) */
 typedef enum {
 	REG_FP,
 	REG_SP,
+	REG_RV, /* integer return value */
+	REG_FRV, /* real return value */
+	REG_ARG, /* integer argument num */
+	REG_FARG, /* real argument num */
 } reg_k;
 
 typedef struct _reg_location {
 	reg_k kind;
+	size_t num; /* REG_ARG, REG_FARG */
 } reg_location;
 
 typedef struct _sym_location {
@@ -55,11 +64,23 @@ typedef struct _sym_location {
 } sym_location;
 
 extern char *SYNAME_GDISP;
+extern char *SYNAME_OVERLAY;
 
 typedef struct _size_location {
 	type *type;
 } size_location;
 
+/* Canonical form, one machine addressing mode: the memory at
+ * base + index*scale + disp. base is a register, temp or symbol (whose
+ * address is taken) or NULL; index is a register or temp or NULL.
+ */
+typedef struct _addr_location {
+	location *base;
+	location *index;
+	size_t scale; /* 1, 2, 4 or 8 */
+	ssize_t disp;
+} addr_location;
+
 typedef struct _location {
 	loc_k kind;
 	size_t refcnt;
@@ -72,6 +93,7 @@ typedef struct _location {
 		reg_location reg;
 		sym_location sym;
 		size_location size;
+		addr_location addr;
 	};
 } location;
 
@@ -84,9 +106,13 @@ location *loc_new_off(location *addr, location *amt);
 location *loc_new_off_vec(location *addr, vector *amts);
 location *loc_new_stride(location *loc, location *stride);
 location *loc_new_reg(reg_k);
+location *loc_new_reg_num(reg_k, size_t num);
 location *loc_new_sym(char *);
 location *loc_new_size(type *);
+location *loc_new_addr(location *base, location *index, size_t scale, ssize_t disp);
+location *loc_fold(location *);
 char *loc_repr(location *);
+void loc_dump(dumper *, location *);
 void loc_delete(location *loc);
 void loc_destroy(location *loc);
 
@@ -1,68 +1,83 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include "tokenizer.h"
-#include "parser.h"
-#include "ast.h"
+#include <string.h>
+#include "compile.h"
 #include "pass.h"
+#include "dump.h"
 
-#include "toknames.c"
-
-extern void *semval;
+static int usage(const char *argv0) {
+	fprintf(stderr, "Usage: %s [--lazy] [--dump=ast,sema,ir,tokens] [--dump-after=<pass>|all] [<infile>...]\n\nInput defaults to standard input; several files are compiled one after another, each on its own. Dumps are JSON, one document per line, on standard output.\n--lazy only analyzes procedures reachable from the main program; the rest are just parsed.\n", argv0);
+	return 1;
+}
 
-void *ParseAlloc(void *(*)(size_t));
-void ParseFree(void *, void (*)(void *));
-void Parse(void *, int, void *, ast_root *);
-void ParseTrace(FILE *, char *);
+static int compile_one(const char *name, FILE *input, unsigned int flags, pass_dump *dump) {
+	compilation *comp = compile_new(name, flags);
+	int res = compile_file(comp, input, dump->what ? dump : NULL);
+	diag_print(stderr, name, &comp->diags);
+	if(dump->out) {
+		dump_begin_obj(dump->out);
+		dump_key(dump->out, "unit");
+		dump_str(dump->out, name);
+		dump_key(dump->out, "diagnostics");
+		diag_dump(dump->out, &comp->diags);
+		dump_end_obj(dump->out);
+		dump_newline(dump->out);
+	}
+	compile_delete(comp);
+	return res;
+}
 
 int main(int argc, char **argv) {
-	FILE *input = stdin;
-	YY_BUFFER_STATE yybuf;
-	void *parser;
-	int token;
-	object *obj = NULL;
-	ast_root ast;
-	ast.prog = NULL;
+	FILE *input;
+	int i, nfiles = 0, failed = 0;
+	unsigned int flags = 0;
+	pass_dump dump = {NULL, 0, NULL};
 
-	if(argc > 2) {
-		fprintf(stderr, "Usage: %s [<infile>]\n\nInput defaults to standard input.\n", argv[0]);
-		return 1;
-	}
-	if(argc > 1) {
-		input = fopen(argv[1], "r");
-		if(!input) {
-			fprintf(stderr, "Failed to open input file.\n");
-			return 1;
+	for(i = 1; i < argc; i++) {
+		if(!strncmp(argv[i], "--dump=", 7)) {
+			dump.what = dump_parse_selectors(argv[i] + 7);
+			if(!dump.what) {
+				fprintf(stderr, "Unknown dump selector in %s\n", argv[i]);
+				return usage(argv[0]);
+			}
+		} else if(!strncmp(argv[i], "--dump-after=", 13)) {
+			dump.after = argv[i] + 13;
+			if(strcmp(dump.after, "all") && pass_find(dump.after) < 0) {
+				fprintf(stderr, "Unknown pass %s\n", dump.after);
+				return usage(argv[0]);
+			}
+		} else if(!strcmp(argv[i], "--lazy")) {
+			flags |= OBJ_LAZY;
+		} else if(argv[i][0] == '-' && argv[i][1]) {
+			return usage(argv[0]);
 		}
 	}
-
-	yybuf = yy_create_buffer(input, YY_BUF_SIZE);
-	yy_switch_to_buffer(yybuf);
-
-	parser = ParseAlloc(malloc);
-	ParseTrace(stderr, "parser: ");
-	while((token = yylex())) {
-		fprintf(stderr, " [%s] ", toknames[token]);
-		Parse(parser, token, semval, &ast);
+	if(dump.what) {
+		dump.out = dump_new(stdout);
 	}
-	Parse(parser, 0, NULL, &ast);
-	ParseFree(parser, free);
 
-	if(!ast.prog) {
-		fprintf(stderr, "NULL tree.\n");
-		return 1;
+	for(i = 1; i < argc; i++) {
+		if(argv[i][0] == '-' && argv[i][1]) {
+			continue;
+		}
+		nfiles++;
+		input = fopen(argv[i], "r");
+		if(!input) {
+			fprintf(stderr, "Failed to open input file %s.\n", argv[i]);
+			failed++;
+			continue;
+		}
+		if(compile_one(argv[i], input, flags, &dump)) {
+			failed++;
+		}
+		fclose(input);
 	}
-	fprintf(stderr, "Pre-pass AST:\n");
-	prog_print(stderr, 0, ast.prog);
-
-	obj = pass_do_all(&ast);
-	fprintf(stderr, "Post-pass AST:\n");
-	prog_print(stderr, 0, ast.prog);
-	if(!obj) {
-		fprintf(stderr, "NULL object.\n");
-		return 1;
+	if(!nfiles && compile_one("<stdin>", stdin, flags, &dump)) {
+		failed++;
 	}
-	fprintf(stderr, "Post-pass semantic tree:\n");
-	obj_print(stderr, 0, obj);
 
-	return 0;
+	if(dump.out) {
+		dump_delete(dump.out);
+	}
+	return failed ? 1 : 0;
 }
@@ -1,13 +1,152 @@
 %include {
 #include <stdio.h>
 #include <assert.h>
+#include <string.h>
 
 #include "ast.h"
 #include "vector.h"
 #include "lit.h"
+#include "util.h"
+#include "diag.h"
+
+extern int yylineno;
+extern const char *toknames[];
 
 #define NEW(ty) (malloc(sizeof(ty)))
 #define AS(ty, ex) ((ty *) (ex))
+
+/* Most elements a set type may have room for; its bits are a variable's,
+ * in the frame like any other
+ */
+#define SET_MAX 65536
+
+/* How many elements lb..ub in a type spans (half-open); reversed bounds
+ * are reported and taken as empty
+ */
+static ssize_t bound_span(ast_root *ast, long lb, long ub) {
+	if(ub < lb) {
+		diag_add(ast->diags, DIAG_ERROR, "parse", yylineno, "Bounds %ld..%ld are reversed", lb, ub);
+		return 0;
+	}
+	return ub - lb;
+}
+
+static ssize_t set_span(ast_root *ast, long lb, long ub) {
+	ssize_t n = bound_span(ast, lb, ub);
+	if(n > SET_MAX) {
+		diag_add(ast->diags, DIAG_ERROR, "parse", yylineno, "A set of %ld..%ld has over %d elements", lb, ub, SET_MAX);
+		return SET_MAX;
+	}
+	return n;
+}
+
+/* Frees a list the grammar built, once its items are taken or copied; del
+ * drops the list's own references to them (NULL if they were taken)
+ */
+static void list_free(vector *list, vec_iter_f del) {
+	if(del) {
+		vec_foreach(list, del, NULL);
+	}
+	vec_clear(list);
+	free(list);
+}
+
+/* A literal node for a new literal, whose reference it takes */
+static expr_node *ex_new_lit_owned(literal *lit) {
+	expr_node *res = ex_new_lit(lit);
+	lit_delete(lit);
+	return res;
+}
+
+/* {lb..ub}: half-open like array[lb..ub] types; bounds must be integer literals */
+static expr_node *ex_new_range(ast_root *ast, vector *lbound, expr_node *ubound) {
+	expr_node *lb = lbound->len == 1 ? vec_get(lbound, 0, expr_node) : NULL;
+	long lo = 0, hi = 0;
+	if(lb && lb->kind == EX_LIT && lb->lit.lit->kind == LIT_INT && ubound->kind == EX_LIT && ubound->lit.lit->kind == LIT_INT) {
+		lo = lb->lit.lit->ival;
+		hi = ubound->lit.lit->ival;
+	} else {
+		diag_add(ast->diags, DIAG_ERROR, "parse", yylineno, "Range literal bounds must be integer literals");
+	}
+	list_free(lbound, (vec_iter_f) ex_delete);
+	ex_delete(ubound);
+	return ex_new_lit_owned(lit_new_range(lo, max(hi - lo, 0)));
+}
+
+/* {a, b, ...}: elements must themselves be literals */
+static expr_node *ex_new_array(ast_root *ast, vector *init, type *fallback) {
+	vector items;
+	expr_node *item, *res;
+	size_t i;
+	vec_init(&items);
+	for(i = 0; i < init->len; i++) {
+		item = vec_get(init, i, expr_node);
+		if(item->kind == EX_LIT) {
+			vec_insert(&items, items.len, item->lit.lit);
+		} else {
+			diag_add(ast->diags, DIAG_ERROR, "parse", yylineno, "Array literal elements must be literals");
+		}
+	}
+	if(!fallback && !items.len) {
+		if(!init->len) {
+			diag_add(ast->diags, DIAG_ERROR, "parse", yylineno, "An empty array literal needs an element type, as in {}: integer");
+		}
+		/* Only a placeholder; the error stops compilation */
+		fallback = type_scalar(TP_INT);
+	}
+	res = ex_new_lit_owned(lit_new_array(&items, fallback));
+	vec_clear(&items);
+	list_free(init, (vec_iter_f) ex_delete);
+	return res;
+}
+
+/* lo..hi in a set literal: half-open like ranges, bounds must be integer or
+ * character literals; a character range keeps that element type.
+ */
+static expr_node *ex_new_set_range(ast_root *ast, expr_node *lo, expr_node *hi) {
+	literal *lit;
+	lit_k kind = lo->kind == EX_LIT ? lo->lit.lit->kind : LIT_INT;
+	long a = 0, b = 0;
+	expr_node *res;
+	if(lo->kind == EX_LIT && hi->kind == EX_LIT && hi->lit.lit->kind == kind && (kind == LIT_INT || kind == LIT_CHAR)) {
+		a = kind == LIT_INT ? lo->lit.lit->ival : (unsigned char) lo->lit.lit->cval;
+		b = kind == LIT_INT ? hi->lit.lit->ival : (unsigned char) hi->lit.lit->cval;
+	} else {
+		diag_add(ast->diags, DIAG_ERROR, "parse", yylineno, "Set range bounds must be integer or character literals");
+	}
+	lit = lit_new_range(a, max(b - a, 0));
+	if(kind == LIT_CHAR) {
+		type_delete(lit->type);
+		lit->type = type_new_array(type_new_char(), a, max(b - a, 0));
+	}
+	res = ex_new_lit_owned(lit);
+	ex_delete(lo);
+	ex_delete(hi);
+	return res;
+}
+
+/* Appends "a, b: ty" to a record; rec is NULL for the first group */
+static type *rec_add_fields(ast_root *ast, type *rec, vector *idents, type *ty) {
+	vector none;
+	char *ident;
+	size_t i;
+	if(!rec) {
+		vec_init(&none);
+		rec = type_new_struct(&none, &none);
+	}
+	for(i = 0; i < idents->len; i++) {
+		ident = vec_get(idents, i, char);
+		if(type_field_index(rec, ident) >= 0) {
+			diag_add(ast->diags, DIAG_ERROR, "parse", yylineno, "Duplicate field %s", ident);
+		} else {
+			vec_insert(&rec->names, rec->names.len, strdup(ident));
+			vec_insert(&rec->types, rec->types.len, type_copy(ty));
+		}
+	}
+	list_free(idents, (vec_iter_f) free);
+	type_delete(ty);
+	return rec;
+}
 }
 
 %token_prefix TOK_
@@ -16,10 +155,63 @@
 
 %extra_argument {ast_root *ast}
 
+/* Every action frees what it consumed; these free what a syntax error or
+ * ParseFree throws away instead. A token carries a value only if it has one
+ * (see compile_file), so the rest free NULL.
+ */
+%token_destructor { free($$); }
+%destructor argument_decl { list_free($$, (vec_iter_f) decl_delete); }
+%destructor argument_list { list_free($$, (vec_iter_f) decl_delete); }
+%destructor declarations { list_free($$, (vec_iter_f) decl_delete); }
+%destructor declaration { list_free($$, (vec_iter_f) decl_delete); }
+%destructor argument { decl_delete($$); }
+%destructor ident_list { list_free($$, (vec_iter_f) free); }
+%destructor type { type_delete($$); }
+%destructor dims { type_delete($$); }
+%destructor field_list { type_delete($$); }
+%destructor fields { type_delete($$); }
+%destructor type_list { list_free($$, (vec_iter_f) type_delete); }
+%destructor stmt { st_delete($$); }
+%destructor expr_stmt { st_delete($$); }
+%destructor while_stmt { st_delete($$); }
+%destructor if_stmt { st_delete($$); }
+%destructor for_stmt { st_delete($$); }
+%destructor iter_stmt { st_delete($$); }
+%destructor range_stmt { st_delete($$); }
+%destructor compound_stmt { st_delete($$); }
+%destructor stmt_list { list_free($$, (vec_iter_f) st_delete); }
+%destructor expr { ex_delete($$); }
+%destructor assign_expr { ex_delete($$); }
+%destructor logic_or_expr { ex_delete($$); }
+%destructor logic_and_expr { ex_delete($$); }
+%destructor logic_unop_expr { ex_delete($$); }
+%destructor rel_expr { ex_delete($$); }
+%destructor term_expr { ex_delete($$); }
+%destructor factor_expr { ex_delete($$); }
+%destructor bin_or_expr { ex_delete($$); }
+%destructor bin_and_expr { ex_delete($$); }
+%destructor bin_xor_expr { ex_delete($$); }
+%destructor bin_shift_expr { ex_delete($$); }
+%destructor num_unop_expr { ex_delete($$); }
+%destructor index_expr { ex_delete($$); }
+%destructor indices { ex_delete($$); }
+%destructor call_expr { ex_delete($$); }
+%destructor lit_expr { ex_delete($$); }
+%destructor ind_expr { ex_delete($$); }
+%destructor set_item { ex_delete($$); }
+%destructor ref_expr { ex_delete($$); }
+%destructor toplevel_expr { ex_delete($$); }
+%destructor expr_list { list_free($$, (vec_iter_f) ex_delete); }
+%destructor set_items { list_free($$, (vec_iter_f) ex_delete); }
+
 
 
 object ::= PROGRAM IDENT(ident) argument_decl(args) SEMICOLON declarations(decls) compound_stmt(body) DOT. {
 	ast->prog = prog_new(ident, args, decls, NULL, body);
+	free(ident);
+	list_free(args, NULL);
+	list_free(decls, NULL);
+	st_delete(body);
 }
 
 argument_decl(ret) ::= LPAREN argument_list(args) RPAREN. {
@@ -45,13 +237,30 @@ argument_list(ret) ::= . {
 
 argument(ret) ::= IDENT(ident) COLON type(ty). {
 	ret = decl_new(ident, ty);
+	free(ident);
+	type_delete(ty);
 }
 argument(ret) ::= IDENT(ident). {
-	ret = decl_new(ident, type_new_int());
+	ret = decl_new(ident, type_scalar(TP_INT));
+	free(ident);
+}
+/* A var argument is the caller's variable itself; a const one is read-only,
+ * and passed by address too if it doesn't fit a register (see lay_by_ref)
+ */
+argument(ret) ::= VAR IDENT(ident) COLON type(ty). {
+	ret = decl_new_arg(ident, ty, ARG_VAR);
+	free(ident);
+	type_delete(ty);
+}
+argument(ret) ::= CONST IDENT(ident) COLON type(ty). {
+	ret = decl_new_arg(ident, ty, ARG_CONST);
+	free(ident);
+	type_delete(ty);
 }
 
 declarations(ret) ::= declarations(decls) declaration(decl_set). {
 	vec_append(decl_set, decls);
+	list_free(decl_set, NULL);
 	ret = decls;
 }
 declarations(ret) ::= . {
@@ -63,27 +272,63 @@ declaration(ret) ::= VAR ident_list(idents) COLON type(ty) SEMICOLON. {
 	ret = NEW(vector);
 	vec_init(ret);
 	vec_map(idents, ret, (vec_map_f) decl_new, ty);
+	list_free(idents, (vec_iter_f) free);
+	type_delete(ty);
 }
 declaration(ret) ::= VAR ident_list(idents) COLON type(ty) ASSIGN expr(init) SEMICOLON. {
     size_t i;
 	ret = NEW(vector);
 	vec_init(ret);
 	for(i = 0; i < AS(vector, idents)->len; i++) vec_insert(ret, i, decl_new_init(vec_get(AS(vector, idents), i, char), ty, init));
+	list_free(idents, (vec_iter_f) free);
+	type_delete(ty);
+	ex_delete(init);
 }
 declaration(ret) ::= FUNCTION IDENT(ident) argument_decl(args) COLON type(retty) SEMICOLON declarations(decls) compound_stmt(body) SEMICOLON. {
 	ret = NEW(vector);
 	vec_init(ret);
 	vec_insert(ret, 0, decl_new_func(ident, NULL, prog_new(ident, args, decls, retty, body)));
+	free(ident);
+	list_free(args, NULL);
+	list_free(decls, NULL);
+	type_delete(retty);
+	st_delete(body);
 }
 declaration(ret) ::= PROCEDURE IDENT(ident) argument_decl(args) SEMICOLON declarations(decls) compound_stmt(body) SEMICOLON. {
 	ret = NEW(vector);
 	vec_init(ret);
 	vec_insert(ret, 0, decl_new_proc(ident, NULL, prog_new(ident, args, decls, NULL, body)));
+	free(ident);
+	list_free(args, NULL);
+	list_free(decls, NULL);
+	st_delete(body);
+}
+declaration(ret) ::= CONST IDENT(ident) EQ expr(init) SEMICOLON. {
+	ret = NEW(vector);
+	vec_init(ret);
+	vec_insert(ret, 0, decl_new_const(ident, NULL, init));
+	free(ident);
+	ex_delete(init);
+}
+declaration(ret) ::= CONST IDENT(ident) COLON type(ty) EQ expr(init) SEMICOLON. {
+	ret = NEW(vector);
+	vec_init(ret);
+	vec_insert(ret, 0, decl_new_const(ident, ty, init));
+	free(ident);
+	type_delete(ty);
+	ex_delete(init);
 }
 declaration(ret) ::= TYPE IDENT(ident) ASSIGN type(ty) SEMICOLON. {
 	ret = NEW(vector);
 	vec_init(ret);
 	vec_insert(ret, 0, decl_new_type(ident, ty));
+	free(ident);
+	type_delete(ty);
+}
+/* Recovery: drop a malformed declaration up to its semicolon and carry on */
+declaration(ret) ::= error SEMICOLON. {
+	ret = NEW(vector);
+	vec_init(ret);
 }
 
 ident_list(ret) ::= ident_list(idents) IDENT(ident). {
@@ -105,28 +350,121 @@ type(ret) ::= INTEGER. {
 type(ret) ::= REAL. {
 	ret = type_new_real();
 }
+/* Fixed widths, stored in that many bytes; integer is int64 */
+type(ret) ::= INT8. {
+	ret = type_new_sized(TP_INT, 1);
+}
+type(ret) ::= INT16. {
+	ret = type_new_sized(TP_INT, 2);
+}
+type(ret) ::= INT32. {
+	ret = type_new_sized(TP_INT, 4);
+}
+type(ret) ::= INT64. {
+	ret = type_new_int();
+}
+type(ret) ::= SINGLE. {
+	ret = type_new_sized(TP_REAL, 4);
+}
 type(ret) ::= CHARACTER. {
 	ret = type_new_char();
 }
-type(ret) ::= ARRAY LBRACKET LIT_INTEGER(lbound) DOTDOT LIT_INTEGER(ubound) RBRACKET OF type(base). {
-	ret = type_new_array(base, *AS(long, lbound), *AS(long, ubound) - *AS(long, lbound));
+type(ret) ::= STRING. {
+	ret = type_new_string();
+}
+type(ret) ::= BOOLEAN. {
+	ret = type_new_bool();
+}
+type(ret) ::= ARRAY LBRACKET dims(ty). {
+	ret = ty;
 }
 type(ret) ::= ARRAY LBRACKET LIT_INTEGER(lbound) DOTDOT RBRACKET OF type(base). {
-	ret = type_new_array(base, *AS(long, lbound), -1);
+	ret = type_new_open_array(base, *AS(long, lbound));
+	free(lbound);
+	type_delete(base);
+}
+/* Records stored field by field: one array per field instead of one per record */
+type(ret) ::= SOA ARRAY LBRACKET LIT_INTEGER(lbound) DOTDOT LIT_INTEGER(ubound) RBRACKET OF type(base). {
+	ret = type_new_stored_array(base, *AS(long, lbound), bound_span(ast, *AS(long, lbound), *AS(long, ubound)), AS_SOA);
+	free(lbound);
+	free(ubound);
+	type_delete(base);
+}
+/* Booleans a bit each; whole arrays can be and-ed, or-ed, negated and counted */
+type(ret) ::= PACKED ARRAY LBRACKET LIT_INTEGER(lbound) DOTDOT LIT_INTEGER(ubound) RBRACKET OF type(base). {
+	ret = type_new_stored_array(base, *AS(long, lbound), bound_span(ast, *AS(long, lbound), *AS(long, ubound)), AS_BITS);
+	free(lbound);
+	free(ubound);
+	type_delete(base);
+}
+/* Sets of small ordinals, one bit per possible element */
+type(ret) ::= SET OF LIT_INTEGER(lbound) DOTDOT LIT_INTEGER(ubound). {
+	ret = type_new_stored_array(type_scalar(TP_INT), *AS(long, lbound), set_span(ast, *AS(long, lbound), *AS(long, ubound)), AS_SET);
+	free(lbound);
+	free(ubound);
+}
+type(ret) ::= SET OF LIT_CHAR(lbound) DOTDOT LIT_CHAR(ubound). {
+	ret = type_new_stored_array(type_scalar(TP_CHAR), *AS(unsigned char, lbound), set_span(ast, *AS(unsigned char, lbound), *AS(unsigned char, ubound)), AS_SET);
+	free(lbound);
+	free(ubound);
+}
+type(ret) ::= SET OF CHARACTER. {
+	ret = type_new_stored_array(type_scalar(TP_CHAR), 0, 256, AS_SET);
+}
+type(ret) ::= RECORD field_list(rec) END. {
+	ret = rec;
 }
 type(ret) ::= LPAREN type_list(args) RPAREN ARROW type(retty). {
 	ret = type_new_func(retty, args);
+	type_delete(retty);
+	list_free(args, (vec_iter_f) type_delete);
+}
+/* A pointer; only here is ^ one, in expressions it is exclusive or */
+type(ret) ::= BXOR type(base). {
+	ret = type_new_ptr(base);
+	type_delete(base);
 }
 type(ret) ::= IDENT(ref). {
 	ret = type_new_ref(ref);
+	free(ref);
+}
+
+/* lb..ub, ... ] of base: an array of the rest, so array[1..3, 1..4] of T is
+ * array[1..3] of array[1..4] of T, one contiguous row-major block
+ */
+dims(ret) ::= LIT_INTEGER(lbound) DOTDOT LIT_INTEGER(ubound) RBRACKET OF type(base). {
+	ret = type_new_array(base, *AS(long, lbound), bound_span(ast, *AS(long, lbound), *AS(long, ubound)));
+	free(lbound);
+	free(ubound);
+	type_delete(base);
+}
+dims(ret) ::= LIT_INTEGER(lbound) DOTDOT LIT_INTEGER(ubound) COMMA dims(inner). {
+	ret = type_new_array(inner, *AS(long, lbound), bound_span(ast, *AS(long, lbound), *AS(long, ubound)));
+	free(lbound);
+	free(ubound);
+	type_delete(inner);
+}
+
+field_list(ret) ::= fields(rec). {
+	ret = rec;
+}
+field_list(ret) ::= fields(rec) SEMICOLON. {
+	ret = rec;
+}
+
+fields(ret) ::= ident_list(idents) COLON type(ty). {
+	ret = rec_add_fields(ast, NULL, idents, ty);
+}
+fields(ret) ::= fields(rec) SEMICOLON ident_list(idents) COLON type(ty). {
+	ret = rec_add_fields(ast, rec, idents, ty);
 }
 
 type_list(ret) ::= type_list(types) type(ty). {
-	vec_insert(types, AS(vector, types)->len, type_copy(ty));
+	vec_insert(types, AS(vector, types)->len, ty);
 	ret = types;
 }
 type_list(ret) ::= type_list(types) COMMA type(ty). {
-	vec_insert(types, AS(vector, types)->len, type_copy(ty));
+	vec_insert(types, AS(vector, types)->len, ty);
 	ret = types;
 }
 type_list(ret) ::= . {
@@ -158,47 +496,95 @@ stmt(ret) ::= compound_stmt(stmt). {
 
 expr_stmt(ret) ::= expr(expr). {
 	ret = st_new_expr(expr);
+	ex_delete(expr);
+}
+/* Points object at a new block from the heap, and gives it back */
+expr_stmt(ret) ::= NEW LPAREN index_expr(object) RPAREN. {
+	expr_node *ex = ex_new_alloc(EX_NEW, object);
+	ret = st_new_expr(ex);
+	ex_delete(ex);
+	ex_delete(object);
+}
+expr_stmt(ret) ::= DISPOSE LPAREN index_expr(object) RPAREN. {
+	expr_node *ex = ex_new_alloc(EX_DISPOSE, object);
+	ret = st_new_expr(ex);
+	ex_delete(ex);
+	ex_delete(object);
 }
 
 while_stmt(ret) ::= WHILE expr(cond) DO stmt(body). {
 	ret = st_new_while(cond, body);
+	ex_delete(cond);
+	st_delete(body);
 }
 
 if_stmt(ret) ::= IF expr(cond) THEN stmt(iftrue). {
 	ret = st_new_if(cond, iftrue, NULL);
+	ex_delete(cond);
+	st_delete(iftrue);
 }
 if_stmt(ret) ::= IF expr(cond) THEN stmt(iftrue) ELSE stmt(iffalse). {
 	ret = st_new_if(cond, iftrue, iffalse);
+	ex_delete(cond);
+	st_delete(iftrue);
+	st_delete(iffalse);
 }
 
 for_stmt(ret) ::= FOR LPAREN stmt(init) SEMICOLON expr(cond) SEMICOLON stmt(post) LPAREN DO stmt(body). {
 	ret = st_new_for(init, cond, post, body);
+	st_delete(init);
+	ex_delete(cond);
+	st_delete(post);
+	st_delete(body);
 }
 
 iter_stmt(ret) ::= FOR LPAREN IDENT(ident) IN expr(value) RPAREN DO stmt(body). {
 	ret = st_new_iter(value, ident, body);
+	ex_delete(value);
+	free(ident);
+	st_delete(body);
 }
 iter_stmt(ret) ::= FOR IDENT(ident) IN expr(value) DO stmt(body). {
 	ret = st_new_iter(value, ident, body);
+	ex_delete(value);
+	free(ident);
+	st_delete(body);
 }
 
 range_stmt(ret) ::= FOR LPAREN IDENT(ident) ASSIGN expr(lbound) dotdot_or_to expr(ubound) RPAREN DO stmt(body). {
-	ret = st_new_range(ident, lbound, ubound, ex_new_lit(lit_new_real(1.0)), body);
+	expr_node *step = ex_new_lit_owned(lit_new_real(1.0));
+	ret = st_new_range(ident, lbound, ubound, step, body);
+	free(ident);
+	ex_delete(lbound);
+	ex_delete(ubound);
+	ex_delete(step);
+	st_delete(body);
 }
 range_stmt(ret) ::= FOR IDENT(ident) ASSIGN expr(lbound) dotdot_or_to expr(ubound) DO stmt(body). {
-	ret = st_new_range(ident, lbound, ubound, ex_new_lit(lit_new_real(1.0)), body);
+	expr_node *step = ex_new_lit_owned(lit_new_real(1.0));
+	ret = st_new_range(ident, lbound, ubound, step, body);
+	free(ident);
+	ex_delete(lbound);
+	ex_delete(ubound);
+	ex_delete(step);
+	st_delete(body);
 }
 
 compound_stmt(ret) ::= BEGIN stmt_list(stmts) END. {
 	ret = st_new_compound(stmts);
+	list_free(stmts, (vec_iter_f) st_delete);
 }
 
 stmt_list(ret) ::= stmt_list(stmts) stmt(stmt). {
-	vec_insert(stmts, AS(vector, stmts)->len, st_copy(stmt));
+	vec_insert(stmts, AS(vector, stmts)->len, stmt);
 	ret = stmts;
 }
 stmt_list(ret) ::= stmt_list(stmts) SEMICOLON stmt(stmt). {
-	vec_insert(stmts, AS(vector, stmts)->len, st_copy(stmt));
+	vec_insert(stmts, AS(vector, stmts)->len, stmt);
+	ret = stmts;
+}
+/* Recovery: drop a malformed statement up to the next semicolon */
+stmt_list(ret) ::= stmt_list(stmts) error SEMICOLON. {
 	ret = stmts;
 }
 stmt_list(ret) ::= . {
@@ -211,11 +597,11 @@ expr(ret) ::= assign_expr(expr). {
 }
 
 expr_list(ret) ::= expr_list(exprs) expr(expr). {
-	vec_insert(exprs, AS(vector, exprs)->len, ex_copy(expr));
+	vec_insert(exprs, AS(vector, exprs)->len, expr);
 	ret = exprs;
 }
 expr_list(ret) ::= expr_list(exprs) COMMA expr(expr). {
-	vec_insert(exprs, AS(vector, exprs)->len, ex_copy(expr));
+	vec_insert(exprs, AS(vector, exprs)->len, expr);
 	ret = exprs;
 }
 expr_list(ret) ::= . {
@@ -225,9 +611,25 @@ expr_list(ret) ::= . {
 
 assign_expr(ret) ::= IDENT(ident) ASSIGN assign_expr(expr). {
 	ret = ex_new_assign(ident, expr);
+	free(ident);
+	ex_delete(expr);
 }
 assign_expr(ret) ::= index_expr(expr_index) ASSIGN assign_expr(value). {
-	ret = ex_new_setindex(AS(expr_node, expr_index)->index.object, AS(expr_node, expr_index)->index.index, value);
+	if(AS(expr_node, expr_index)->kind == EX_FIELD) {
+		ret = ex_new_setfield(AS(expr_node, expr_index)->field.object, AS(expr_node, expr_index)->field.ident, value);
+	} else if(AS(expr_node, expr_index)->kind == EX_DEREF) {
+		ret = ex_new_setderef(AS(expr_node, expr_index)->deref.object, value);
+	} else {
+		ret = ex_new_setindex(AS(expr_node, expr_index)->index.object, AS(expr_node, expr_index)->index.index, value);
+	}
+	ex_delete(expr_index);
+	ex_delete(value);
+}
+/* Resizes a dynamic array */
+assign_expr(ret) ::= LENGTH index_expr(object) ASSIGN assign_expr(value). {
+	ret = ex_new_setlength(object, value);
+	ex_delete(object);
+	ex_delete(value);
 }
 assign_expr(ret) ::= logic_or_expr(expr). {
 	ret = expr;
@@ -235,6 +637,8 @@ assign_expr(ret) ::= logic_or_expr(expr). {
 
 logic_or_expr(ret) ::= logic_or_expr(left) OR logic_and_expr(right). {
 	ret = ex_new_binop(left, OP_OR, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 logic_or_expr(ret) ::= logic_and_expr(expr). {
 	ret = expr;
@@ -242,6 +646,8 @@ logic_or_expr(ret) ::= logic_and_expr(expr). {
 
 logic_and_expr(ret) ::= logic_and_expr(left) AND logic_unop_expr(right). {
 	ret = ex_new_binop(left, OP_AND, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 logic_and_expr(ret) ::= logic_unop_expr(expr). {
 	ret = expr;
@@ -249,6 +655,7 @@ logic_and_expr(ret) ::= logic_unop_expr(expr). {
 
 logic_unop_expr(ret) ::= NOT logic_unop_expr(expr). {
 	ret = ex_new_unop(OP_NOT, expr);
+	ex_delete(expr);
 }
 logic_unop_expr(ret) ::= rel_expr(expr). {
 	ret = expr;
@@ -256,21 +663,38 @@ logic_unop_expr(ret) ::= rel_expr(expr). {
 
 rel_expr(ret) ::= rel_expr(left) EQ term_expr(right). {
 	ret = ex_new_binop(left, OP_EQ, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 rel_expr(ret) ::= rel_expr(left) NEQ term_expr(right). {
 	ret = ex_new_binop(left, OP_NEQ, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 rel_expr(ret) ::= rel_expr(left) LEQ term_expr(right). {
 	ret = ex_new_binop(left, OP_LEQ, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 rel_expr(ret) ::= rel_expr(left) GEQ term_expr(right). {
 	ret = ex_new_binop(left, OP_GEQ, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 rel_expr(ret) ::= rel_expr(left) LESS term_expr(right). {
 	ret = ex_new_binop(left, OP_LESS, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 rel_expr(ret) ::= rel_expr(left) GREATER term_expr(right). {
 	ret = ex_new_binop(left, OP_GREATER, right);
+	ex_delete(left);
+	ex_delete(right);
+}
+rel_expr(ret) ::= rel_expr(left) IN term_expr(right). {
+	ret = ex_new_binop(left, OP_IN, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 rel_expr(ret) ::= term_expr(expr). {
 	ret = expr;
@@ -278,9 +702,13 @@ rel_expr(ret) ::= term_expr(expr). {
 
 term_expr(ret) ::= term_expr(left) ADD factor_expr(right). {
 	ret = ex_new_binop(left, OP_ADD, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 term_expr(ret) ::= term_expr(left) SUB factor_expr(right). {
 	ret = ex_new_binop(left, OP_SUB, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 term_expr(ret) ::= factor_expr(expr). {
 	ret = expr;
@@ -288,12 +716,18 @@ term_expr(ret) ::= factor_expr(expr). {
 
 factor_expr(ret) ::= factor_expr(left) MUL bin_or_expr(right). {
 	ret = ex_new_binop(left, OP_MUL, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 factor_expr(ret) ::= factor_expr(left) DIV bin_or_expr(right). {
 	ret = ex_new_binop(left, OP_DIV, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 factor_expr(ret) ::= factor_expr(left) MOD bin_or_expr(right). {
 	ret = ex_new_binop(left, OP_MOD, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 factor_expr(ret) ::= bin_or_expr(expr). {
 	ret = expr;
@@ -301,6 +735,8 @@ factor_expr(ret) ::= bin_or_expr(expr). {
 
 bin_or_expr(ret) ::= bin_or_expr(left) BOR bin_and_expr(right). {
 	ret = ex_new_binop(left, OP_BOR, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 bin_or_expr(ret) ::= bin_and_expr(expr). {
 	ret = expr;
@@ -308,6 +744,8 @@ bin_or_expr(ret) ::= bin_and_expr(expr). {
 
 bin_and_expr(ret) ::= bin_and_expr(left) BAND bin_xor_expr(right). {
 	ret = ex_new_binop(left, OP_BAND, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 bin_and_expr(ret) ::= bin_xor_expr(expr). {
 	ret = expr;
@@ -315,6 +753,8 @@ bin_and_expr(ret) ::= bin_xor_expr(expr). {
 
 bin_xor_expr(ret) ::= bin_xor_expr(left) BXOR bin_shift_expr(right). {
 	ret = ex_new_binop(left, OP_BXOR, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 bin_xor_expr(ret) ::= bin_shift_expr(expr). {
 	ret = expr;
@@ -322,55 +762,127 @@ bin_xor_expr(ret) ::= bin_shift_expr(expr). {
 
 bin_shift_expr(ret) ::= bin_shift_expr(left) BLSHIFT num_unop_expr(right). {
 	ret = ex_new_binop(left, OP_BLSHIFT, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 bin_shift_expr(ret) ::= bin_shift_expr(left) BRSHIFT num_unop_expr(right). {
 	ret = ex_new_binop(left, OP_BRSHIFT, right);
+	ex_delete(left);
+	ex_delete(right);
 }
 bin_shift_expr(ret) ::= num_unop_expr(expr). {
 	ret = expr;
 }
 
+num_unop_expr(ret) ::= CARD num_unop_expr(expr). {
+	ret = ex_new_unop(OP_CARD, expr);
+	ex_delete(expr);
+}
+num_unop_expr(ret) ::= LENGTH num_unop_expr(expr). {
+	ret = ex_new_unop(OP_LENGTH, expr);
+	ex_delete(expr);
+}
 num_unop_expr(ret) ::= BNOT num_unop_expr(expr). {
 	ret = ex_new_unop(OP_BNOT, expr);
+	ex_delete(expr);
 }
 num_unop_expr(ret) ::= SUB num_unop_expr(expr). {
 	ret = ex_new_unop(OP_NEG, expr);
+	ex_delete(expr);
 }
 num_unop_expr(ret) ::= ADD num_unop_expr(expr). {
 	ret = ex_new_unop(OP_IDENT, expr);
+	ex_delete(expr);
 }
-num_unop_expr(ret) ::= index_expr(expr). {
+num_unop_expr(ret) ::= index_expr(expr). [LBRACKET] {
 	ret = expr;
 }
 
-index_expr(ret) ::= index_expr(object) LBRACKET expr(index) RBRACKET. {
-	ret = ex_new_index(object, index);
+index_expr(ret) ::= indices(expr) RBRACKET. {
+	ret = expr;
+}
+index_expr(ret) ::= index_expr(object) LBRACKET expr(lbound) DOTDOT expr(ubound) RBRACKET. {
+	ret = ex_new_slice(object, lbound, ubound);
+	ex_delete(object);
+	ex_delete(lbound);
+	ex_delete(ubound);
+}
+/* What the pointer object points to; Pascal's object^, but ^ is taken */
+index_expr(ret) ::= index_expr(object) LBRACKET RBRACKET. {
+	ret = ex_new_deref(object);
+	ex_delete(object);
+}
+index_expr(ret) ::= index_expr(object) DOT IDENT(ident). {
+	ret = ex_new_field(object, ident);
+	ex_delete(object);
+	free(ident);
 }
 index_expr(ret) ::= call_expr(expr). {
 	ret = expr;
 }
 
+/* a[i, j] is a[i][j] */
+indices(ret) ::= index_expr(object) LBRACKET expr(index). {
+	ret = ex_new_index(object, index);
+	ex_delete(object);
+	ex_delete(index);
+}
+indices(ret) ::= indices(object) COMMA expr(index). {
+	ret = ex_new_index(object, index);
+	ex_delete(object);
+	ex_delete(index);
+}
+
 call_expr(ret) ::= call_expr(func) LPAREN expr_list(params) RPAREN. {
 	ret = ex_new_call(func, params);
+	ex_delete(func);
+	list_free(params, (vec_iter_f) ex_delete);
 }
 call_expr(ret) ::= lit_expr(expr). {
 	ret = expr;
 }
 
 lit_expr(ret) ::= LIT_INTEGER(ival). {
-	ret = ex_new_lit(lit_new_int(*AS(long, ival)));
+	ret = ex_new_lit_owned(lit_new_int(*AS(long, ival)));
+	free(ival);
 }
 lit_expr(ret) ::= LIT_REAL(fval). {
-	ret = ex_new_lit(lit_new_real(*AS(double, fval)));
+	ret = ex_new_lit_owned(lit_new_real(*AS(double, fval)));
+	free(fval);
 }
 lit_expr(ret) ::= LIT_CHAR(cval). {
-	ret = ex_new_lit(lit_new_char(*AS(char, cval)));
+	ret = ex_new_lit_owned(lit_new_char(*AS(char, cval)));
+	free(cval);
+}
+lit_expr(ret) ::= LIT_STRING(sval). {
+	ret = ex_new_lit_owned(lit_new_string(sval, strlen(sval)));
+	free(sval);
+}
+lit_expr(ret) ::= TRUE. {
+	ret = ex_new_lit_owned(lit_new_bool(1));
+}
+lit_expr(ret) ::= FALSE. {
+	ret = ex_new_lit_owned(lit_new_bool(0));
+}
+lit_expr(ret) ::= NIL. {
+	ret = ex_new_lit_owned(lit_new_nil());
 }
 lit_expr(ret) ::= LBRACE expr_list(init) RBRACE COLON type(fallback). {
-	ret = ex_new_lit(lit_new_array(init, fallback));
+	ret = ex_new_array(ast, init, fallback);
+	type_delete(fallback);
+}
+lit_expr(ret) ::= LBRACE expr_list(lbound) DOTDOT expr(ubound) RBRACE. {
+	ret = ex_new_range(ast, lbound, ubound);
 }
 lit_expr(ret) ::= LBRACE expr_list(init) RBRACE. {
-	ret = ex_new_lit(lit_new_array(init, NULL));
+	ret = ex_new_array(ast, init, NULL);
+}
+lit_expr(ret) ::= LBRACKET set_items(items) RBRACKET. {
+	ret = ex_new_set(items);
+	list_free(items, (vec_iter_f) ex_delete);
+}
+lit_expr(ret) ::= LBRACKET RBRACKET. {
+	ret = ex_new_set(NULL);
 }
 lit_expr(ret) ::= ind_expr(expr). {
 	ret = expr;
@@ -378,16 +890,35 @@ lit_expr(ret) ::= ind_expr(expr). {
 
 ind_expr(ret) ::= INDIRECT ind_expr(ind). {
 	ret = ex_new_ind(ind);
+	ex_delete(ind);
 }
 ind_expr(ret) ::= ref_expr(expr). {
 	ret = expr;
 }
 
+set_items(ret) ::= set_items(items) COMMA set_item(item). {
+	vec_insert(items, AS(vector, items)->len, item);
+	ret = items;
+}
+set_items(ret) ::= set_item(item). {
+	ret = NEW(vector);
+	vec_init(ret);
+	vec_insert(ret, 0, item);
+}
+
+set_item(ret) ::= expr(item). {
+	ret = item;
+}
+set_item(ret) ::= expr(lo) DOTDOT expr(hi). {
+	ret = ex_new_set_range(ast, lo, hi);
+}
+
 dotdot_or_to ::= DOTDOT.
 dotdot_or_to ::= TO.
 
 ref_expr(ret) ::= IDENT(ident). {
 	ret = ex_new_ref(ident);
+	free(ident);
 }
 ref_expr(ret) ::= toplevel_expr(expr). {
 	ret = expr;
@@ -399,10 +930,21 @@ toplevel_expr(ret) ::= LPAREN expr(expr) RPAREN. {
 
 
 
-%parse_accept {
-	fprintf(stderr, "Syntax check OK\n");
+%syntax_error {
+	const char *name = toknames[yymajor];
+	if(!strncmp(name, "TOK_", 4)) {
+		name += 4;
+	}
+	diag_add(ast->diags, DIAG_ERROR, "parse", yylineno, "Syntax error at %s", yymajor ? name : "end of input");
 }
 
 %parse_failure {
-	fprintf(stderr, "Syntax check BAD\n");
+	ast->failed = 1;
+	diag_add(ast->diags, DIAG_ERROR, "parse", yylineno, "Can't recover from syntax errors");
 }
+
+/* Statements needn't be separated (see stmt_list), so a [1] could also be
+ * a followed by the set literal [1]. It is always an index: where an
+ * index_expr could end, a LBRACKET after it is shifted (see num_unop_expr).
+ */
+%right LBRACKET.
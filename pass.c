@@ -1,4 +1,6 @@
 #include <stdarg.h>
+#include <limits.h>
+#include <setjmp.h>
 #include <assert.h>
 
 #include "pass.h"
@@ -7,60 +9,189 @@
 
 #define ASSURE(x) ({int __test = (x); if(__test<0) return __test; __test;})
 
+#define NPASSES (sizeof(passes) / sizeof(*passes))
+
 pass passes[] = {
-	{stb_pass, NULL, "Semantic Tree Builder"},
-    {tr_pass, NULL, "Type Resolution/Checking"},
-	{lr_pass, NULL, "Location Resolution"},
+	{stb_pass, NULL, "Semantic Tree Builder", "stb"},
+	{tr_pass, NULL, "Type Resolution/Checking", "tr"},
+	{ctfe_pass, NULL, "Compile-Time Evaluation", "ctfe"},
+	{cf_pass, NULL, "Constant Folding", "cf"},
+	{ef_pass, NULL, "Effect Analysis", "ef"},
+	{sf_pass, NULL, "Static Frames", "sf"},
+	{cap_pass, NULL, "Capture Analysis", "cap"},
+	{esc_pass, NULL, "Escape Analysis", "esc"},
+	{lr_pass, NULL, "Location Resolution", "lr"},
+	{lay_pass, NULL, "Frame Layout", "lay"},
+	{ir_pass, NULL, "IR Generation", "ir"},
+	{am_pass, NULL, "Address Modes", "am"},
 };
 
-object *pass_do_all(ast_root *ast) {
+ssize_t pass_find(const char *key) {
+	size_t i;
+	for(i = 0; i < NPASSES; i++) {
+		if(string_equal(key, passes[i].key)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int pass_dump_wanted(pass_dump *dump, size_t i) {
+	if(!(dump->what & (DUMP_AST | DUMP_SEMA | DUMP_IR))) {
+		return 0;
+	}
+	if(!dump->after) {
+		return i == NPASSES - 1;
+	}
+	return string_equal(dump->after, "all") || string_equal(dump->after, passes[i].key);
+}
+
+/* One JSON document per line: {"pass": key, "ast": ..., "sema": ..., "ir": ...} */
+void pass_dump_state(pass_dump *dump, const char *key, ast_root *ast, object *obj) {
+	dumper *d = dump->out;
+	dump_begin_obj(d);
+	dump_key(d, "pass");
+	dump_str(d, key);
+	if(dump->what & DUMP_AST) {
+		dump_key(d, "ast");
+		prog_dump(d, ast->prog);
+	}
+	if(dump->what & DUMP_SEMA) {
+		dump_key(d, "sema");
+		obj_dump(d, obj);
+	}
+	if(dump->what & DUMP_IR) {
+		dump_key(d, "ir");
+		block_dump(d, obj ? obj->block : NULL);
+	}
+	dump_end_obj(d);
+	dump_newline(d);
+}
+
+/* Where pass_error/pass_warning report while pass_do_all runs */
+static diag_list *pass_diags = NULL;
+static const char *pass_key = NULL;
+static jmp_buf pass_abort;
+
+typedef struct _pass_release {
+	void (*fn)(void *);
+	void *arg;
+} pass_release;
+
+static vector pass_releases; /* of pass_release *, in the order deferred */
+
+/* Has fn(arg) run when the current pass ends, whether it returns or
+ * pass_error abandons it, whose longjmp skips the pass's own cleanup. arg
+ * mustn't be on the pass's stack, which is gone by then.
+ */
+void pass_defer(void (*fn)(void *), void *arg) {
+	pass_release *rel = malloc(sizeof(pass_release));
+	assert(rel);
+	rel->fn = fn;
+	rel->arg = arg;
+	vec_insert(&pass_releases, pass_releases.len, rel);
+}
+
+/* Runs what the pass deferred, last first */
+static void pass_release_all(void) {
+	pass_release *rel;
+	while(pass_releases.len) {
+		rel = vec_remove(&pass_releases, pass_releases.len - 1);
+		rel->fn(rel->arg);
+		free(rel);
+	}
+	vec_clear(&pass_releases);
+}
+
+/* type_repr(ty) for a diagnostic, freed when the pass ends */
+const char *pass_repr(type *ty) {
+	char *res = (char *) type_repr(ty);
+	pass_defer(free, res);
+	return res;
+}
+
+int pass_do_all(ast_root *ast, object *obj, diag_list *diags, pass_dump *dump) {
 	size_t i;
 	int res;
-	object *obj = obj_new();
-	for(i = 0; i < (sizeof(passes) / sizeof(*passes)); i++) {
+	pass_diags = diags;
+	for(i = 0; i < NPASSES; i++) {
+		pass_key = passes[i].key;
+		if(setjmp(pass_abort)) {
+			/* pass_error: the pass can't go on, and nothing after it can run on its half-built state */
+			pass_release_all();
+			break;
+		}
 		res = passes[i].run(ast, obj);
-#ifndef NDEBUG
-		fprintf(stderr, "\x1b[34;1m==== PASS %ld (%s) =====\x1b[m\n", i, passes[i].name);
-		prog_print(stderr, 0, ast->prog);
-		obj_print(stderr, 0, obj);
-#endif
+		pass_release_all();
+		if(dump && pass_dump_wanted(dump, i)) {
+			pass_dump_state(dump, passes[i].key, ast, obj);
+		}
 		if(res) {
 			if(passes[i].print) {
 				passes[i].print(res);
 			} else {
-				fprintf(stderr, "\x1b[37;41;1mPass %ld failed with code %d\x1b[m\n", i, res);
-				exit(1);
+				diag_add(diags, DIAG_ERROR, pass_key, 0, "%s failed with code %d", passes[i].name, res);
 			}
 		}
+		/* Recoverable errors still let the rest of the pass run, but not the next one */
+		if(diags->errors) {
+			break;
+		}
 	}
-	return obj;
+	pass_diags = NULL;
+	pass_key = NULL;
+	return diags->errors ? -1 : 0;
 }
 
+/* Records an error and abandons the current pass */
 void pass_error(const char *fmt, ...) {
 	va_list va;
 	va_start(va, fmt);
-    pass_verror(fmt, va);
+	pass_verror(fmt, va);
 	va_end(va);
 }
 
 void pass_verror(const char *fmt, va_list va) {
-	fputs("\x1b[37;41;1mERROR: ", stderr);
-	vfprintf(stderr, fmt, va);
-	fputs("\x1b[m\n", stderr);
-	exit(1);
+	pass_vrecord(fmt, va);
+	if(!pass_diags) {
+		exit(1);
+	}
+	longjmp(pass_abort, 1);
+}
+
+/* Records an error but lets the pass continue, so one run reports as much as it can */
+void pass_record(const char *fmt, ...) {
+	va_list va;
+	va_start(va, fmt);
+	pass_vrecord(fmt, va);
+	va_end(va);
+}
+
+void pass_vrecord(const char *fmt, va_list va) {
+	if(!pass_diags) {
+		fputs("\x1b[37;41;1mERROR: ", stderr);
+		vfprintf(stderr, fmt, va);
+		fputs("\x1b[m\n", stderr);
+		return;
+	}
+	diag_vadd(pass_diags, DIAG_ERROR, pass_key, 0, fmt, va);
 }
 
 void pass_warning(const char *fmt, ...) {
 	va_list va;
 	va_start(va, fmt);
-    pass_vwarning(fmt, va);
+	pass_vwarning(fmt, va);
 	va_end(va);
 }
 
 void pass_vwarning(const char *fmt, va_list va) {
-	fputs("\x1b[33;1mWarning: ", stderr);
-	vfprintf(stderr, fmt, va);
-	fputs("\x1b[m\n", stderr);
+	if(!pass_diags) {
+		fputs("\x1b[33;1mWarning: ", stderr);
+		vfprintf(stderr, fmt, va);
+		fputs("\x1b[m\n", stderr);
+		return;
+	}
+	diag_vadd(pass_diags, DIAG_WARNING, pass_key, 0, fmt, va);
 }
 
 /********** SEMANTIC TREE BUILDER **********/
@@ -68,16 +199,214 @@ void pass_vwarning(const char *fmt, va_list va) {
 int stb_pass(ast_root *ast, object *obj) {
 	program *prog = program_new(ast->prog, scope_new_root());
 	obj_set_root_prog(obj, prog);
-	return stb_visit_prog(ast->prog, prog);
+	program_delete(prog); /* obj holds it now, even if a pass_error cuts us short */
+	if(obj->flags & OBJ_LAZY) {
+		stb_reach_prog(prog);
+	} else {
+		stb_visit_all(prog);
+	}
+	return 0;
 }
 
+/* Builds the scope of one program; nested programs only get their signatures */
 int stb_visit_prog(prog_node *node, program *prog) {
 	/* scope_add_name(prog->scope, sym_new_prog(node->ident, stb_resolve_prog_type(node, prog->scope), NULL, prog)); */
+	prog->reached = 1;
 	ASSURE(vec_test(&node->args, (vec_test_f) stb_test_decl, prog));
 	ASSURE(vec_test(&node->decls, (vec_test_f) stb_test_decl, prog));
     return stb_test_stmt(prog, node->body);
 }
 
+void stb_visit_all(program *prog) {
+	size_t i;
+	symbol *sym;
+	stb_visit_prog(prog->node, prog);
+	for(i = 0; i < prog->scope->names.len; i++) {
+		sym = vec_get(&prog->scope->names, i, symbol);
+		if(sym->kind == SYM_PROG) {
+			stb_visit_all(sym->init.prog);
+		}
+	}
+}
+
+/* Lazy mode: builds prog, then whatever its initializers and body refer to */
+void stb_reach_prog(program *prog) {
+	size_t i;
+	decl_node *decl;
+	stb_visit_prog(prog->node, prog);
+	for(i = 0; i < prog->node->decls.len; i++) {
+		decl = vec_get(&prog->node->decls, i, decl_node);
+		if(decl->kind == DECL_VAR || decl->kind == DECL_CONST) {
+			stb_reach_expr(prog, decl->init);
+		}
+	}
+	stb_reach_stmt(prog, prog->node->body);
+}
+
+void stb_reach_stmt(program *prog, stmt_node *st) {
+	size_t i;
+	if(!st) {
+		return;
+	}
+	switch(st->kind) {
+		case ST_EXPR:
+			stb_reach_expr(prog, st->expr.expr);
+			break;
+
+		case ST_WHILE:
+			stb_reach_expr(prog, st->while_.cond);
+			stb_reach_stmt(prog, st->while_.body);
+			break;
+
+		case ST_IF:
+			stb_reach_expr(prog, st->if_.cond);
+			stb_reach_stmt(prog, st->if_.iftrue);
+			stb_reach_stmt(prog, st->if_.iffalse);
+			break;
+
+		case ST_FOR:
+			stb_reach_stmt(prog, st->for_.init);
+			stb_reach_expr(prog, st->for_.cond);
+			stb_reach_stmt(prog, st->for_.post);
+			stb_reach_stmt(prog, st->for_.body);
+			break;
+
+		case ST_ITER:
+			stb_reach_expr(prog, st->iter.value);
+			stb_reach_stmt(prog, st->iter.body);
+			break;
+
+		case ST_RANGE:
+			stb_reach_expr(prog, st->range.lbound);
+			stb_reach_expr(prog, st->range.ubound);
+			stb_reach_expr(prog, st->range.step);
+			stb_reach_stmt(prog, st->range.body);
+			break;
+
+		case ST_COMPOUND:
+			for(i = 0; i < st->compound.stmts.len; i++) {
+				stb_reach_stmt(prog, vec_get(&st->compound.stmts, i, stmt_node));
+			}
+			break;
+
+		default:
+			assert(0);
+	}
+}
+
+void stb_reach_expr(program *prog, expr_node *ex) {
+	size_t i;
+	symbol *sym;
+	if(!ex) {
+		return;
+	}
+	switch(ex->kind) {
+		case EX_LIT:
+			break;
+
+		case EX_REF:
+			sym = scope_resolve_name(prog->scope, ex->ref.ident);
+			if(sym && sym->kind == SYM_PROG && !sym->init.prog->reached) {
+				stb_reach_prog(sym->init.prog);
+			}
+			break;
+
+		case EX_ASSIGN:
+			stb_reach_expr(prog, ex->assign.value);
+			break;
+
+		case EX_INDEX:
+			stb_reach_expr(prog, ex->index.object);
+			stb_reach_expr(prog, ex->index.index);
+			break;
+
+		case EX_SETINDEX:
+			stb_reach_expr(prog, ex->setindex.object);
+			stb_reach_expr(prog, ex->setindex.index);
+			stb_reach_expr(prog, ex->setindex.value);
+			break;
+
+		case EX_FIELD:
+			stb_reach_expr(prog, ex->field.object);
+			break;
+
+		case EX_SETFIELD:
+			stb_reach_expr(prog, ex->setfield.object);
+			stb_reach_expr(prog, ex->setfield.value);
+			break;
+
+		case EX_CALL:
+			stb_reach_expr(prog, ex->call.func);
+			for(i = 0; i < ex->call.params.len; i++) {
+				stb_reach_expr(prog, vec_get(&ex->call.params, i, expr_node));
+			}
+			break;
+
+		case EX_UNOP:
+			stb_reach_expr(prog, ex->unop.expr);
+			break;
+
+		case EX_BINOP:
+			stb_reach_expr(prog, ex->binop.left);
+			stb_reach_expr(prog, ex->binop.right);
+			break;
+
+		case EX_RETURN:
+			stb_reach_expr(prog, ex->return_.value);
+			break;
+
+		case EX_IND:
+			stb_reach_expr(prog, ex->ind.lvalue);
+			break;
+
+		case EX_SLICE:
+			stb_reach_expr(prog, ex->slice.object);
+			stb_reach_expr(prog, ex->slice.lbound);
+			stb_reach_expr(prog, ex->slice.ubound);
+			break;
+
+		case EX_SETLENGTH:
+			stb_reach_expr(prog, ex->setlength.object);
+			stb_reach_expr(prog, ex->setlength.value);
+			break;
+
+		case EX_DEREF:
+			stb_reach_expr(prog, ex->deref.object);
+			break;
+
+		case EX_SETDEREF:
+			stb_reach_expr(prog, ex->setderef.object);
+			stb_reach_expr(prog, ex->setderef.value);
+			break;
+
+		case EX_NEW:
+		case EX_DISPOSE:
+			stb_reach_expr(prog, ex->alloc.object);
+			break;
+
+		case EX_SET:
+			for(i = 0; i < ex->set.items.len; i++) {
+				stb_reach_expr(prog, vec_get(&ex->set.items, i, expr_node));
+			}
+			break;
+
+		default:
+			assert(0);
+	}
+}
+
+/* stb_resolve_type for a type another one holds, which gives up its reference
+ * to ty for one to the result
+ */
+static type *stb_resolve_held(type *ty, scope *sco) {
+	type *res = stb_resolve_type(ty, sco);
+	if(res != ty) {
+		type_copy(res);
+		type_delete(ty);
+	}
+	return res;
+}
+
 type *stb_resolve_type(type *ty, scope *sco) {
 	symbol *res;
 	size_t i;
@@ -91,19 +420,35 @@ type *stb_resolve_type(type *ty, scope *sco) {
 			return res->type;
 
 		case TP_ARRAY:
-			ty->base = stb_resolve_type(ty->base, sco);
+			ty->base = stb_resolve_held(ty->base, sco);
+			if(ty->store == AS_SOA && (!ty->base || ty->base->kind != TP_STRUCT)) {
+				pass_warning("soa array of %s isn't of records; stored as usual", pass_repr(ty->base));
+				ty->store = AS_PLAIN;
+			}
+			if(ty->store == AS_BITS && (!ty->base || ty->base->kind != TP_BOOL)) {
+				pass_warning("packed array of %s isn't of booleans; stored as usual", pass_repr(ty->base));
+				ty->store = AS_PLAIN;
+			}
 			break;
 
 		case TP_FUNC:
-			ty->ret = stb_resolve_type(ty->ret, sco);
+			ty->ret = stb_resolve_held(ty->ret, sco);
 			for(i = 0; i < ty->args.len; i++) {
-				vec_set(&ty->args, i, stb_resolve_type(vec_get(&ty->args, i, type), sco));
+				vec_set(&ty->args, i, stb_resolve_held(vec_get(&ty->args, i, type), sco));
 			}
 			break;
 
 		case TP_STRUCT: case TP_UNION:
 			for(i = 0; i < ty->types.len; i++) {
-				vec_set(&ty->types, i, stb_resolve_type(vec_get(&ty->types, i, type), sco));
+				vec_set(&ty->types, i, stb_resolve_held(vec_get(&ty->types, i, type), sco));
+			}
+			break;
+
+		/* A named pointee stays a name until followed, so a record can
+		 * point to its own type */
+		case TP_PTR:
+			if(ty->base && ty->base->kind != TP_REF) {
+				ty->base = stb_resolve_held(ty->base, sco);
 			}
 			break;
 
@@ -116,21 +461,25 @@ type *stb_resolve_type(type *ty, scope *sco) {
 type *stb_resolve_prog_type(prog_node *prog, scope *sco) {
 	vector params;
 	size_t i;
+	type *res;
 	vec_init(&params);
 	for(i = 0; i < prog->args.len; i++) {
 		vec_insert(&params, params.len, stb_resolve_type(vec_get(&prog->args, i, decl_node)->type, sco));
 	}
-	return type_new_func(stb_resolve_type(prog->ret, sco), &params);
+	res = type_new_func(stb_resolve_type(prog->ret, sco), &params);
+	vec_clear(&params);
+	return res;
 }
 
 int stb_test_decl(program *prog, decl_node *decl, vector *decls, size_t idx) {
 	program *subprog = NULL;
+	int replaced = 0;
 	switch(decl->kind) {
 		case DECL_VAR:
 			if(decl->init) {
-				scope_add_name(prog->scope, sym_new_data_init(decl->ident, stb_resolve_type(decl->type, prog->scope), NULL, decl->init));
+				replaced = scope_add_name(prog->scope, sym_new_data_init(decl->ident, stb_resolve_type(decl->type, prog->scope), NULL, decl->init));
 			} else {
-				scope_add_name(prog->scope, sym_new_data(decl->ident, stb_resolve_type(decl->type, prog->scope), NULL));
+				replaced = scope_add_name(prog->scope, sym_new_data(decl->ident, stb_resolve_type(decl->type, prog->scope), NULL));
 			}
 			break;
 
@@ -138,14 +487,21 @@ int stb_test_decl(program *prog, decl_node *decl, vector *decls, size_t idx) {
 		case DECL_PROC:
 			decl->type = stb_resolve_prog_type(decl->prog, prog->scope);
 			subprog = program_new(decl->prog, scope_new(prog->scope));
-			scope_add_name(prog->scope, sym_new_prog(decl->ident, decl->type, NULL, subprog));
-			stb_visit_prog(decl->prog, subprog);
+			replaced = scope_add_name(prog->scope, sym_new_prog(decl->ident, decl->type, NULL, subprog));
+			program_delete(subprog);
 			break;
 
 		case DECL_TYPE:
-			scope_add_type(prog->scope, sym_new_type(decl->ident, decl->type));
+			replaced = scope_add_type(prog->scope, sym_new_type(decl->ident, stb_resolve_type(decl->type, prog->scope)));
+			break;
+
+		case DECL_CONST:
+			replaced = scope_add_name(prog->scope, sym_new_const(decl->ident, stb_resolve_type(decl->type, prog->scope), decl->init));
 			break;
 	}
+	if(replaced) {
+		pass_warning("%s redeclared in %s", decl->ident, prog->node->ident);
+	}
 	return 0;
 }
 
@@ -174,15 +530,89 @@ int stb_test_stmt(program *prog, stmt_node *st) {
 
 /********** Type Resolution **********/
 
+/* Only builds the (allocating) diagnostic when the cast isn't implicit */
+#define TR_CHECK_CAST(kind, ...) ({cast_k __kind = (kind); if(__kind < CAST_IMPLICIT) tr_check_cast(__kind, __VA_ARGS__);})
+
+/* The argument types of a call, shown as a procedure's */
+static const char *tr_args_repr(vector *ptypes) {
+	type *ty = type_new_func(NULL, ptypes);
+	const char *res = pass_repr(ty);
+	type_delete(ty);
+	return res;
+}
+
 int tr_pass(ast_root *ast, object *obj) {
 	return tr_visit_prog(obj->root_prog);
 }
 
+/* Whether ty is or contains a string */
+static int tr_is_string(type *ty) {
+	return ty->kind == TP_STRING;
+}
+
+/* Whether ty is, or has an element or field that is, of a type that is */
+static int tr_holds(type *ty, int (*is)(type *)) {
+	size_t i;
+	if(!ty) {
+		return 0;
+	}
+	if(is(ty)) {
+		return 1;
+	}
+	switch(ty->kind) {
+		case TP_ARRAY:
+			return tr_holds(ty->base, is);
+
+		case TP_STRUCT:
+		case TP_UNION:
+			for(i = 0; i < ty->types.len; i++) {
+				if(tr_holds(vec_get(&ty->types, i, type), is)) {
+					return 1;
+				}
+			}
+			return 0;
+
+		default:
+			return 0;
+	}
+}
+
 int tr_visit_prog(program *prog) {
 	size_t i;
+	symbol *sym;
+	type *ty;
+	/* A string's bytes, and a dynamic array's elements, are set up and
+	 * released with the variable or argument that holds it (see
+	 * ir_make_prologue), so nothing else may. A result comes back in a
+	 * register, so it can't be a record or array either.
+	 */
+	ty = stb_resolve_type(prog->node->ret, prog->scope);
+	if(tr_holds(ty, tr_is_string) || tr_holds(ty, type_is_open) || type_reg_class(ty) < 0) {
+		pass_record("Function %s can't return %s", prog->node->ident, pass_repr(ty));
+	}
+	for(i = prog->scope->names.len; i-- > 0;) {
+		sym = vec_get(&prog->scope->names, i, symbol);
+		ty = sym->kind == SYM_DATA ? stb_resolve_type(sym->type, prog->scope) : NULL;
+		if(ty && !tr_is_string(ty) && tr_holds(ty, tr_is_string)) {
+			pass_record("%s of type %s holds strings; only variables and arguments can", sym->ident, pass_repr(ty));
+		} else if(ty && !type_is_open(ty) && tr_holds(ty, type_is_open)) {
+			pass_record("%s of type %s holds open arrays; only variables and arguments can", sym->ident, pass_repr(ty));
+		}
+	}
+	/* Initializers first, in declaration order (names are kept newest first) */
+	for(i = prog->scope->names.len; i-- > 0;) {
+		sym = vec_get(&prog->scope->names, i, symbol);
+		if((sym->kind != SYM_DATA && sym->kind != SYM_CONST) || !sym->init.expr) continue;
+		tr_visit_expr(sym->init.expr, prog->scope);
+		if(!sym->type) {
+			sym->type = type_copy(sym->init.expr->type);
+		} else {
+			TR_CHECK_CAST(type_can_cast(sym->init.expr->type, sym->type), "Initialize %s of type %s with %s", sym->ident, pass_repr(sym->type), pass_repr(sym->init.expr->type));
+		}
+	}
 	tr_visit_stmt(prog->node->body, prog->scope);
 	for(i = 0; i < prog->scope->names.len; i++) {
-		if(vec_get(&prog->scope->names, i, symbol)->kind == SYM_PROG) {
+		if(vec_get(&prog->scope->names, i, symbol)->kind == SYM_PROG && vec_get(&prog->scope->names, i, symbol)->init.prog->reached) {
 			tr_visit_prog(vec_get(&prog->scope->names, i, symbol)->init.prog);
 		}
 	}
@@ -193,14 +623,25 @@ void tr_check_cast(cast_k kind, const char *fmt, ...) {
     va_list va;
     va_start(va, fmt);
     if(kind <= CAST_EXPLICIT) {
-        pass_verror(fmt, va);
-    }
-    if(kind <= CAST_UNINTENDED) {
+        pass_vrecord(fmt, va);
+    } else if(kind <= CAST_UNINTENDED) {
         pass_vwarning(fmt, va);
     }
     va_end(va);
 }
 
+static int lay_is_arg(program *prog, symbol *sym);
+static arg_mode_k lay_arg_mode(program *prog, symbol *sym);
+static int lay_by_ref(program *prog, size_t i);
+static int lay_is_ref(program *prog, symbol *sym);
+
+/* sym is set by a loop */
+static void tr_check_counter(symbol *sym) {
+	if(sym->kind == SYM_DATA && sym->scope->prog && lay_arg_mode(sym->scope->prog, sym) == ARG_CONST) {
+		pass_record("Const argument %s used as a loop counter", sym->ident);
+	}
+}
+
 void tr_visit_stmt(stmt_node *st, scope *sco) {
 	size_t i;
     symbol *sym;
@@ -215,14 +656,14 @@ void tr_visit_stmt(stmt_node *st, scope *sco) {
 		case ST_WHILE:
 			tr_visit_expr(st->while_.cond, sco);
 			tr_visit_stmt(st->while_.body, sco);
-            tr_check_cast(type_can_cast(st->while_.cond->type, type_new_bool()), "%s as while condition", type_repr(st->while_.cond->type));
+            TR_CHECK_CAST(type_can_cast(st->while_.cond->type, type_scalar(TP_BOOL)), "%s as while condition", pass_repr(st->while_.cond->type));
 			break;
 
 		case ST_IF:
 			tr_visit_expr(st->if_.cond, sco);
 			tr_visit_stmt(st->if_.iftrue, sco);
 			tr_visit_stmt(st->if_.iffalse, sco);
-            tr_check_cast(type_can_cast(st->if_.cond->type, type_new_bool()), "%s as if condition", type_repr(st->if_.cond->type));
+            TR_CHECK_CAST(type_can_cast(st->if_.cond->type, type_scalar(TP_BOOL)), "%s as if condition", pass_repr(st->if_.cond->type));
 			break;
 
 		case ST_FOR:
@@ -230,16 +671,17 @@ void tr_visit_stmt(stmt_node *st, scope *sco) {
 			tr_visit_expr(st->for_.cond, sco);
 			tr_visit_stmt(st->for_.post, sco);
 			tr_visit_stmt(st->for_.body, sco);
-            tr_check_cast(type_can_cast(st->for_.cond->type, type_new_bool()), "%s as for condition", type_repr(st->for_.cond->type));
+            TR_CHECK_CAST(type_can_cast(st->for_.cond->type, type_scalar(TP_BOOL)), "%s as for condition", pass_repr(st->for_.cond->type));
 			break;
 
 		case ST_ITER:
 			tr_visit_expr(st->iter.value, sco);
 			tr_visit_stmt(st->iter.body, sco);
-            tr_check_cast(type_can_iter(st->iter.value->type), "Iter over %s", type_repr(st->iter.value->type));
+            TR_CHECK_CAST(type_can_iter(st->iter.value->type), "Iter over %s", pass_repr(st->iter.value->type));
             sym = scope_resolve_name(sco, st->iter.ident);
             if(!sym) pass_error("Unknown symbol %s", st->iter.ident);
-            tr_check_cast(type_can_cast(sym->type, type_new_int()), "Iter using %s variable", type_repr(sym->type));
+			tr_check_counter(sym);
+            TR_CHECK_CAST(type_can_cast(sym->type, type_scalar(TP_INT)), "Iter using %s variable", pass_repr(sym->type));
 			break;
 
 		case ST_RANGE:
@@ -247,12 +689,13 @@ void tr_visit_stmt(stmt_node *st, scope *sco) {
 			tr_visit_expr(st->range.ubound, sco);
 			tr_visit_expr(st->range.step, sco);
 			tr_visit_stmt(st->range.body, sco);
-            tr_check_cast(type_can_cast(st->range.lbound->type, type_new_real()), "%s as lower range bound", type_repr(st->range.lbound->type));
-            tr_check_cast(type_can_cast(st->range.ubound->type, type_new_real()), "%s as upper range bound", type_repr(st->range.ubound->type));
-            tr_check_cast(type_can_cast(st->range.step->type, type_new_real()), "%s as range step", type_repr(st->range.step->type));
+            TR_CHECK_CAST(type_can_cast(st->range.lbound->type, type_scalar(TP_REAL)), "%s as lower range bound", pass_repr(st->range.lbound->type));
+            TR_CHECK_CAST(type_can_cast(st->range.ubound->type, type_scalar(TP_REAL)), "%s as upper range bound", pass_repr(st->range.ubound->type));
+            TR_CHECK_CAST(type_can_cast(st->range.step->type, type_scalar(TP_REAL)), "%s as range step", pass_repr(st->range.step->type));
             sym = scope_resolve_name(sco, st->range.ident);
             if(!sym) pass_error("Unknown symbol %s", st->range.ident);
-            tr_check_cast(type_can_cast(sym->type, type_new_real()), "Range using %s variable", type_repr(sym->type));
+			tr_check_counter(sym);
+            TR_CHECK_CAST(type_can_cast(sym->type, type_scalar(TP_REAL)), "Range using %s variable", pass_repr(sym->type));
 			break;
 
 		case ST_COMPOUND:
@@ -266,354 +709,5714 @@ void tr_visit_stmt(stmt_node *st, scope *sco) {
 	}
 }
 
-void tr_visit_expr(expr_node *ex, scope *sco) {
-	size_t i;
-	symbol *sym = NULL;
-    vector ptypes;
-	expr_node *temp;
-	scope *lsco;
-	if(!ex) {
-		return;
-	}
-	switch(ex->kind) {
-		case EX_LIT:
-			ex->type = stb_resolve_type(ex->lit.lit->type, sco);
-			break;
-
-		case EX_REF:
-			sym = scope_resolve_name(sco, ex->ref.ident);
-			if(!sym) {
-				pass_error("Unknown symbol %s", ex->ref.ident);
-			}
-			ex->type = stb_resolve_type(sym->type, sco);
-			break;
-
-		case EX_ASSIGN:
-			tr_visit_expr(ex->assign.value, sco);
-			lsco = sco;
-			while(lsco) {
-				if(string_equal(ex->assign.ident, lsco->prog->node->ident)) {
-					sym = scope_resolve_name(sco, lsco->prog->node->ident);
-					if(!sym) {
-						pass_error("Could not resolve function %s when identifying return (BUG)", lsco->prog->node->ident);
-					}
-					if(!sym->type->kind == TP_FUNC) {
-						pass_error("Program scope for %s not a function type (instead %s) (BUG)", lsco->prog->node->ident, type_repr(sym->type));
-					}
-					if(type_can_cast(ex->assign.value->type, sym->type->ret) >= CAST_UNINTENDED) {
-						temp = ex->assign.value;
-						ex->kind = EX_RETURN;
-						ex->return_.value = temp;
-						ex->type = stb_resolve_type(temp->type, sco);
-						return;
-					}
-				}
-				lsco = lsco->parent;
-			}
-            sym = scope_resolve_name(sco, ex->assign.ident);
-            if(!sym) {
-                pass_error("Unknown symbol %s", ex->assign.ident);
-            }
-            tr_check_cast(type_can_cast(ex->assign.value->type, sym->type), "Assign %s to var %s of type %s", type_repr(ex->assign.value->type), ex->assign.ident, type_repr(sym->type));
-			ex->type = ex->assign.value->type;
-			break;
-
-		case EX_INDEX:
-			tr_visit_expr(ex->index.object, sco);
-			tr_visit_expr(ex->index.index, sco);
-            tr_check_cast(type_can_index(ex->index.object->type, ex->index.index->type), "Index %s by %s", type_repr(ex->index.object->type), type_repr(ex->index.index->type));
-            ex->type = type_of_index(ex->index.object->type, ex->index.index->type);
-			break;
-
-		case EX_SETINDEX:
-			tr_visit_expr(ex->setindex.object, sco);
-			tr_visit_expr(ex->setindex.index, sco);
-			tr_visit_expr(ex->setindex.value, sco);
-            tr_check_cast(type_can_setindex(ex->setindex.object->type, ex->setindex.index->type, ex->setindex.value->type), "Set index of %s by %s to %s", type_repr(ex->setindex.object->type), type_repr(ex->setindex.index->type), type_repr(ex->setindex.value->type));
-            ex->type = ex->setindex.value->type;
-			break;
+static void tr_visit_index(expr_node *ex, scope *sco) {
+	tr_visit_expr(ex->index.object, sco);
+	tr_visit_expr(ex->index.index, sco);
+	TR_CHECK_CAST(type_can_index(ex->index.object->type, ex->index.index->type), "Index %s by %s", pass_repr(ex->index.object->type), pass_repr(ex->index.index->type));
+	ex->type = type_copy(type_of_index(ex->index.object->type, ex->index.index->type));
+}
 
-		case EX_CALL:
-			tr_visit_expr(ex->call.func, sco);
-            vec_init(&ptypes);
-			for(i = 0; i < ex->call.params.len; i++) {
-				tr_visit_expr(vec_get(&ex->call.params, i, expr_node), sco);
-                vec_insert(&ptypes, ptypes.len, vec_get(&ex->call.params, i, expr_node)->type);
-			}
-            tr_check_cast(type_can_call(ex->call.func->type, &ptypes), "Call %s with args %s", type_repr(ex->call.func->type), type_repr(type_new_func(NULL, &ptypes)));
-            ex->type = type_of_call(ex->call.func->type, &ptypes);
-			break;
+static int tr_is_soa(type *ty) {
+	return ty && ty->kind == TP_ARRAY && ty->store == AS_SOA;
+}
 
-		case EX_UNOP:
-			tr_visit_expr(ex->unop.expr, sco);
-            tr_check_cast(type_can_unop(ex->unop.expr->type, ex->unop.kind), "Unop %d on %s", ex->unop.kind, type_repr(ex->unop.expr->type));
-            ex->type = type_of_unop(ex->unop.expr->type, ex->unop.kind);
+/* The values lo..hi (half-open) of a constant set element */
+static int tr_set_bounds(expr_node *item, long *lo, long *hi) {
+	if(item->kind != EX_LIT) {
+		return 0;
+	}
+	switch(item->lit.lit->kind) {
+		case LIT_INT:
+			*lo = item->lit.lit->ival;
 			break;
 
-		case EX_BINOP:
-			tr_visit_expr(ex->binop.left, sco);
-			tr_visit_expr(ex->binop.right, sco);
-            tr_check_cast(type_can_binop(ex->binop.left->type, ex->binop.kind, ex->binop.right->type), "Binop %d on %s and %s", ex->binop.kind, type_repr(ex->binop.left->type), type_repr(ex->binop.right->type));
-            ex->type = type_of_binop(ex->binop.left->type, ex->binop.kind, ex->binop.right->type);
+		case LIT_CHAR:
+			*lo = (unsigned char) item->lit.lit->cval;
 			break;
 
-		case EX_IND:
-			tr_visit_expr(ex->ind.lvalue, sco);
-			ex->type = type_new_array(ex->ind.lvalue->type, 0, -1);
-			break;
+		case LIT_RANGE:
+			*lo = item->lit.lit->range.lbound;
+			*hi = *lo + item->lit.lit->range.size;
+			return 1;
 
 		default:
-			assert(0);
+			return 0;
 	}
+	*hi = *lo + 1;
+	return 1;
+}
+
+static int tr_is_set_op(expr_node *ex) {
+	if(!type_is_set(ex->type)) {
+		return 0;
+	}
+	if(ex->kind == EX_UNOP) {
+		return ex->unop.kind == OP_NOT;
+	}
+	return ex->kind == EX_BINOP && (ex->binop.kind == OP_ADD || ex->binop.kind == OP_SUB || ex->binop.kind == OP_MUL || ex->binop.kind == OP_AND || ex->binop.kind == OP_OR);
+}
+
+/* Built only from set literals; consts additionally has every element
+ * constant, and cf folds those into a literal of their words.
+ */
+static int tr_is_set_lit(expr_node *ex, int consts) {
+	size_t i;
+	long lo, hi;
+	if(ex->kind == EX_SET) {
+		for(i = 0; consts && i < ex->set.items.len; i++) {
+			if(!tr_set_bounds(vec_get(&ex->set.items, i, expr_node), &lo, &hi)) {
+				return 0;
+			}
+		}
+		return !consts || ex->type->size >= 0;
+	}
+	if(!tr_is_set_op(ex)) {
+		return 0;
+	}
+	if(ex->kind == EX_UNOP) {
+		return tr_is_set_lit(ex->unop.expr, consts);
+	}
+	return tr_is_set_lit(ex->binop.left, consts) && tr_is_set_lit(ex->binop.right, consts);
+}
+
+/* and/or/not over whole bitsets, and set union, difference, intersection
+ * and construction; they're computed into the array they're assigned to (or
+ * counted) a word at a time, never into a temporary. Constant sets aren't:
+ * they're folded.
+ */
+static int tr_is_bitwise(expr_node *ex) {
+	if(!type_is_bitset(ex->type) || tr_is_set_lit(ex, 1)) {
+		return 0;
+	}
+	return ex->kind == EX_SET || tr_is_set_op(ex) || (ex->kind == EX_UNOP && ex->unop.kind == OP_NOT) || (ex->kind == EX_BINOP && (ex->binop.kind == OP_AND || ex->binop.kind == OP_OR));
+}
+
+/* Its items' element type, spanning the constant ones; unsized if any
+ * isn't constant, until a context gives it a type (tr_coerce_set).
+ */
+static void tr_visit_set(expr_node *ex, scope *sco) {
+	expr_node *item;
+	type *ity, *base = NULL;
+	long lo = 0, hi = 0, a, b;
+	int sized = 1, any = 0;
+	size_t i;
+	for(i = 0; i < ex->set.items.len; i++) {
+		item = vec_get(&ex->set.items, i, expr_node);
+		tr_visit_expr(item, sco);
+		ity = item->type->kind == TP_ARRAY ? item->type->base : item->type;
+		if(ity->kind != TP_INT && ity->kind != TP_CHAR) {
+			pass_record("Set element of type %s", pass_repr(ity));
+			continue;
+		}
+		if(base && base->kind != ity->kind) {
+			pass_record("Set of %s with an element of type %s", pass_repr(base), pass_repr(ity));
+			continue;
+		}
+		base = ity;
+		if(!tr_set_bounds(item, &a, &b)) {
+			sized = 0;
+		} else if(a < b) {
+			lo = any ? min(lo, a) : a;
+			hi = any ? max(hi, b) : b;
+			any = 1;
+		}
+	}
+	ex->type = type_new_stored_array(base ? base : type_scalar(TP_INT), lo, sized ? hi - lo : -1, AS_SET);
+}
+
+/* Retypes a set built from literals to the set type to that its context
+ * expects; constant elements it can't hold are dropped with a warning.
+ */
+static void tr_coerce_set(expr_node *ex, type *to) {
+	expr_node *item;
+	long lo, hi;
+	size_t i;
+	if(!type_is_set(to) || !type_is_set(ex->type) || !tr_is_set_lit(ex, 0) || type_equal(ex->type, to)) {
+		return;
+	}
+	/* [] is a set of anything */
+	if(ex->type->base->kind != to->base->kind && !(ex->kind == EX_SET && !ex->set.items.len)) {
+		return;
+	}
+	switch(ex->kind) {
+		case EX_SET:
+			for(i = 0; to->size >= 0 && i < ex->set.items.len; i++) {
+				item = vec_get(&ex->set.items, i, expr_node);
+				if(tr_set_bounds(item, &lo, &hi) && lo < hi && (lo < to->lbound || hi > to->lbound + to->size)) {
+					if(hi == lo + 1) {
+						pass_warning("Set element %ld is not in %s", lo, pass_repr(to));
+					} else {
+						pass_warning("Set elements %ld..%ld are not all in %s", lo, hi, pass_repr(to));
+					}
+				}
+			}
+			break;
+
+		case EX_UNOP:
+			tr_coerce_set(ex->unop.expr, to);
+			break;
+
+		default:
+			tr_coerce_set(ex->binop.left, to);
+			tr_coerce_set(ex->binop.right, to);
+			break;
+	}
+	type_delete(ex->type);
+	ex->type = type_copy(to);
+}
+
+/* A packed array literal as one of the narrower element type of to, or
+ * NULL if an element wouldn't survive the trip
+ */
+static literal *tr_narrow_array(literal *lit, type *to) {
+	literal *res, *a, *b;
+	size_t i;
+	int same = 1;
+	if(lit->kind != LIT_PACKED || to->kind != TP_ARRAY || to->store != AS_PLAIN || !type_is_scalar(to->base)) {
+		return NULL;
+	}
+	if(lit->type->base->kind != to->base->kind || lit->type->base->width <= to->base->width) {
+		return NULL;
+	}
+	res = lit_cast(lit, to);
+	for(i = 0; same && to->base->kind == TP_INT && i < lit_len(lit); i++) {
+		a = lit_item(lit, i);
+		b = lit_item(res, i);
+		same = a->ival == b->ival;
+		lit_delete(a);
+		lit_delete(b);
+	}
+	if(!same) {
+		lit_delete(res);
+		return NULL;
+	}
+	type_delete(res->type);
+	res->type = type_new_array(to->base, lit->type->lbound, lit->type->size);
+	return res;
+}
+
+static int tr_coerce_num(expr_node *ex, type *to);
+
+/* An operand of constant arithmetic tr_coerce_num narrows; a variable isn't
+ * one, even a narrow one, since the arithmetic around it is done in words
+ */
+static int tr_coerce_const(expr_node *ex, type *to) {
+	return (ex->kind == EX_LIT || ex->kind == EX_UNOP || ex->kind == EX_BINOP) && tr_coerce_num(ex, to);
+}
+
+/* Lets constants that fit be stored in, or combined with, narrower integers
+ * and singles without a warning: literals take the narrower type, as do
+ * negations and arithmetic made only of them, and packed array literals
+ * are repacked. Returns whether ex is now no wider than to.
+ */
+static int tr_coerce_num(expr_node *ex, type *to) {
+	literal *lit;
+	if(!to || !ex->type) {
+		return 0;
+	}
+	if(ex->kind == EX_LIT && (lit = tr_narrow_array(ex->lit.lit, to))) {
+		lit_delete(ex->lit.lit);
+		ex->lit.lit = lit;
+		type_delete(ex->type);
+		ex->type = type_copy(lit->type);
+		return 1;
+	}
+	if(ex->type->kind != to->kind || (to->kind != TP_INT && to->kind != TP_REAL)) {
+		return 0;
+	}
+	if(ex->type->width <= to->width) {
+		return 1;
+	}
+	switch(ex->kind) {
+		case EX_LIT:
+			lit = lit_cast(ex->lit.lit, to);
+			if(to->kind == TP_INT && lit->ival != ex->lit.lit->ival) {
+				lit_delete(lit);
+				return 0;
+			}
+			lit_delete(ex->lit.lit);
+			ex->lit.lit = lit;
+			break;
+
+		case EX_UNOP:
+			if((ex->unop.kind != OP_NEG && ex->unop.kind != OP_IDENT) || !tr_coerce_const(ex->unop.expr, to)) {
+				return 0;
+			}
+			break;
+
+		case EX_BINOP:
+			switch(ex->binop.kind) {
+				case OP_ADD:
+				case OP_SUB:
+				case OP_MUL:
+				case OP_DIV:
+				case OP_MOD:
+				case OP_BAND:
+				case OP_BOR:
+				case OP_BXOR:
+					break;
+
+				default:
+					return 0;
+			}
+			if(!tr_coerce_const(ex->binop.left, to) || !tr_coerce_const(ex->binop.right, to)) {
+				return 0;
+			}
+			break;
+
+		default:
+			return 0;
+	}
+	type_delete(ex->type);
+	ex->type = type_copy(to);
+	return 1;
+}
+
+/* A character literal where a string is expected is one of length 1 */
+static void tr_coerce_str(expr_node *ex, type *to) {
+	literal *lit;
+	if(!to || to->kind != TP_STRING || ex->kind != EX_LIT || ex->lit.lit->kind != LIT_CHAR) {
+		return;
+	}
+	lit = lit_new_string(&ex->lit.lit->cval, 1);
+	lit_delete(ex->lit.lit);
+	ex->lit.lit = lit;
+	type_delete(ex->type);
+	ex->type = type_copy(lit->type);
+}
+
+/* ex where a value of type to is expected */
+static void tr_coerce(expr_node *ex, type *to) {
+	tr_coerce_set(ex, to);
+	tr_coerce_num(ex, to);
+	tr_coerce_str(ex, to);
+}
+
+/* Concatenations are built straight into the string they're assigned to,
+ * all parts at once (see ir_str_assign); cf folds those of literals.
+ */
+static int tr_is_str_op(expr_node *ex) {
+	return ex->type && ex->type->kind == TP_STRING && ex->kind == EX_BINOP && ex->binop.kind == OP_ADD;
+}
+
+static int tr_is_str_lit(expr_node *ex) {
+	if(tr_is_str_op(ex)) {
+		return tr_is_str_lit(ex->binop.left) && tr_is_str_lit(ex->binop.right);
+	}
+	return ex->kind == EX_LIT;
+}
+
+static int tr_is_concat(expr_node *ex) {
+	return tr_is_str_op(ex) && !tr_is_str_lit(ex);
+}
+
+/* Literal operands of a set operation take the other's type, or when both
+ * are literals, one spanning both.
+ */
+static void tr_unify_sets(expr_node *left, expr_node *right) {
+	int llit = tr_is_set_lit(left, 0), rlit = tr_is_set_lit(right, 0);
+	type *lt = left->type, *rt = right->type, *span;
+	long lo, hi;
+	if(!type_is_set(lt) || !type_is_set(rt) || type_equal(lt, rt) || !(llit || rlit)) {
+		return;
+	}
+	if(!rlit || lt->size < 0) {
+		tr_coerce_set(left, rt);
+	} else if(!llit || rt->size < 0) {
+		tr_coerce_set(right, lt);
+	} else {
+		/* An empty span doesn't widen the other */
+		lo = !lt->size ? rt->lbound : !rt->size ? lt->lbound : min(lt->lbound, rt->lbound);
+		hi = !lt->size ? rt->lbound + rt->size : !rt->size ? lt->lbound + lt->size : max(lt->lbound + lt->size, rt->lbound + rt->size);
+		span = type_new_stored_array(lt->size ? lt->base : rt->base, lo, hi - lo, AS_SET);
+		tr_coerce_set(left, span);
+		tr_coerce_set(right, span);
+		type_delete(span);
+	}
+}
+
+static void tr_visit_value(expr_node *ex, scope *sco, int whole);
+
+/* The type of field ident of object; an element of an soa array is only
+ * ever reached through its fields, so it's typed here and nowhere else.
+ */
+static type *tr_field(expr_node *object, const char *ident, scope *sco) {
+	type *rty;
+	ssize_t i;
+	if(object->kind == EX_INDEX) {
+		tr_visit_index(object, sco);
+	} else {
+		tr_visit_expr(object, sco);
+	}
+	rty = stb_resolve_type(object->type, sco);
+	if((i = type_field_index(rty, ident)) < 0) {
+		pass_error("No field %s in %s", ident, pass_repr(rty));
+	}
+	return vec_get(&rty->types, i, type);
+}
+
+/* A variable of open array type that isn't an argument owns its elements */
+static int tr_is_dynamic(expr_node *ex, scope *sco) {
+	symbol *sym;
+	if(ex->kind != EX_REF || !type_is_open(ex->type)) {
+		return 0;
+	}
+	sym = scope_resolve_name(sco, ex->ref.ident);
+	return sym && sym->kind == SYM_DATA && sym->scope->prog && !lay_is_arg(sym->scope->prog, sym);
+}
+
+/* The const argument a store into ex, or through a view made from it,
+ * would land in; NULL if none
+ */
+static symbol *tr_const_root(expr_node *ex, scope *sco) {
+	symbol *sym;
+	for(;;) {
+		switch(ex->kind) {
+			case EX_INDEX:
+				ex = ex->index.object;
+				break;
+
+			case EX_FIELD:
+				ex = ex->field.object;
+				break;
+
+			case EX_SLICE:
+				ex = ex->slice.object;
+				break;
+
+			case EX_IND:
+				ex = ex->ind.lvalue;
+				break;
+
+			case EX_REF:
+				sym = scope_resolve_name(sco, ex->ref.ident);
+				return sym && sym->kind == SYM_DATA && sym->scope->prog && lay_arg_mode(sym->scope->prog, sym) == ARG_CONST ? sym : NULL;
+
+			default:
+				return NULL;
+		}
+	}
+}
+
+/* Whether ex is a variable, or an element or field of one, with an address
+ * to pass by reference; elements of views are in memory too
+ */
+static int tr_is_lvalue(expr_node *ex, scope *sco) {
+	symbol *sym;
+	type *ty;
+	switch(ex->kind) {
+		case EX_REF:
+			sym = scope_resolve_name(sco, ex->ref.ident);
+			return sym && sym->kind == SYM_DATA;
+
+		case EX_INDEX:
+			ty = stb_resolve_type(ex->index.object->type, sco);
+			if(!ty || ty->kind != TP_ARRAY || ty->store != AS_PLAIN) {
+				return 0;
+			}
+			return type_is_open(ty) || tr_is_lvalue(ex->index.object, sco);
+
+		case EX_FIELD:
+			return tr_is_lvalue(ex->field.object, sco);
+
+		case EX_DEREF:
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+
+/* What a pointer of type pty points to. The heap block is released only
+ * by dispose, so it can't hold what a variable must set up and release
+ * (strings, dynamic arrays) or a view that could outlive its array.
+ */
+static type *tr_pointee(type *pty, scope *sco) {
+	type *ty = stb_resolve_type(pty, sco);
+	if(!ty || ty->kind != TP_PTR || !ty->base) {
+		pass_error("%s isn't a pointer", pass_repr(pty));
+	}
+	ty = stb_resolve_type(ty->base, sco);
+	if(tr_holds(ty, tr_is_string)) {
+		pass_record("%s holds strings; only variables and arguments can", pass_repr(pty));
+	} else if(tr_holds(ty, type_is_open)) {
+		pass_record("%s holds open arrays; only variables and arguments can", pass_repr(pty));
+	}
+	return ty;
+}
+
+/* Whether calling prog takes the address of any of its arguments */
+static int tr_takes_refs(program *prog) {
+	size_t i;
+	for(i = 0; i < prog->node->args.len; i++) {
+		if(lay_by_ref(prog, i)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* type_equal, and arrays (also inside arrays and records) have the same
+ * bounds: what a var argument's frame layout and range checks assume
+ */
+static int tr_same_type(type *a, type *b) {
+	size_t i;
+	if(!type_equal(a, b)) {
+		return 0;
+	}
+	if(!a) {
+		return 1;
+	}
+	switch(a->kind) {
+		case TP_ARRAY:
+			return a->lbound == b->lbound && a->size == b->size && tr_same_type(a->base, b->base);
+
+		case TP_STRUCT: case TP_UNION:
+			for(i = 0; i < a->types.len; i++) {
+				if(!tr_same_type(vec_get(&a->types, i, type), vec_get(&b->types, i, type))) {
+					return 0;
+				}
+			}
+			return 1;
+
+		default:
+			return 1;
+	}
+}
+
+/* param is given for argument i of prog. A var argument is the caller's
+ * variable, so it takes one of exactly its type; a const one passed by
+ * address takes a variable too. Neither a var argument nor a view that
+ * isn't const may be made of a const argument.
+ */
+static void tr_visit_arg(program *prog, size_t i, expr_node *param, scope *sco) {
+	decl_node *decl = vec_get(&prog->node->args, i, decl_node);
+	type *ty = stb_resolve_type(decl->type, prog->scope);
+	symbol *root = tr_const_root(param, sco);
+	if(lay_by_ref(prog, i) && !tr_is_lvalue(param, sco)) {
+		pass_record("Argument %s of %s is passed by reference, so it takes a variable", decl->ident, prog->node->ident);
+	}
+	if(decl->mode == ARG_VAR && !type_is_open(ty) && !tr_same_type(stb_resolve_type(param->type, sco), ty)) {
+		pass_record("Var argument %s of %s is %s, not %s", decl->ident, prog->node->ident, pass_repr(ty), pass_repr(param->type));
+	}
+	if(root && (decl->mode == ARG_VAR || (decl->mode == ARG_VALUE && type_is_open(ty)))) {
+		pass_record("Const argument %s can't be passed for %s of %s, which may change it", root->ident, decl->ident, prog->node->ident);
+	}
+}
+
+void tr_visit_expr(expr_node *ex, scope *sco) {
+	tr_visit_value(ex, sco, 0);
+}
+
+/* whole: ex may be a bitwise operation on bitsets */
+static void tr_visit_value(expr_node *ex, scope *sco, int whole) {
+	size_t i;
+	symbol *sym = NULL, *croot;
+	type *ftype;
+    vector ptypes;
+	expr_node *temp;
+	scope *lsco;
+	int bitwise;
+	if(!ex) {
+		return;
+	}
+	switch(ex->kind) {
+		case EX_LIT:
+			ex->type = type_copy(stb_resolve_type(ex->lit.lit->type, sco));
+			break;
+
+		case EX_REF:
+			sym = scope_resolve_name(sco, ex->ref.ident);
+			if(!sym) {
+				pass_error("Unknown symbol %s", ex->ref.ident);
+			}
+			if(sym->kind == SYM_PROG && tr_takes_refs(sym->init.prog)) {
+				pass_record("%s takes arguments by reference, so it can only be called by name", sym->ident);
+			}
+			ex->type = type_copy(stb_resolve_type(sym->type, sco));
+			break;
+
+		case EX_ASSIGN:
+			tr_visit_value(ex->assign.value, sco, 1);
+			lsco = sco;
+			while(lsco) {
+				if(string_equal(ex->assign.ident, lsco->prog->node->ident)) {
+					sym = scope_resolve_name(sco, lsco->prog->node->ident);
+					if(!sym) {
+						pass_error("Could not resolve function %s when identifying return (BUG)", lsco->prog->node->ident);
+					}
+					if(!sym->type->kind == TP_FUNC) {
+						pass_error("Program scope for %s not a function type (instead %s) (BUG)", lsco->prog->node->ident, pass_repr(sym->type));
+					}
+					tr_coerce(ex->assign.value, sym->type->ret);
+					if(type_can_cast(ex->assign.value->type, sym->type->ret) >= CAST_UNINTENDED) {
+						if(tr_is_bitwise(ex->assign.value)) {
+							pass_record("%s can only be assigned to a variable or counted", pass_repr(ex->assign.value->type));
+						}
+						temp = ex->assign.value;
+						free(ex->assign.ident);
+						ex->kind = EX_RETURN;
+						ex->return_.value = temp;
+						ex->type = type_copy(stb_resolve_type(temp->type, sco));
+						return;
+					}
+				}
+				lsco = lsco->parent;
+			}
+            sym = scope_resolve_name(sco, ex->assign.ident);
+            if(!sym) {
+                pass_error("Unknown symbol %s", ex->assign.ident);
+            }
+			if(sym->kind == SYM_DATA && sym->scope->prog && lay_arg_mode(sym->scope->prog, sym) == ARG_CONST) {
+				pass_record("Assign to const argument %s", sym->ident);
+			} else if(sym->kind == SYM_DATA && sym->scope->prog && lay_is_arg(sym->scope->prog, sym) && type_is_open(sym->type) && (croot = tr_const_root(ex->assign.value, sco))) {
+				pass_record("Open argument %s can't be made a view of const argument %s", sym->ident, croot->ident);
+			}
+			tr_coerce(ex->assign.value, sym->type);
+            TR_CHECK_CAST(type_can_cast(ex->assign.value->type, sym->type), "Assign %s to var %s of type %s", pass_repr(ex->assign.value->type), ex->assign.ident, pass_repr(sym->type));
+			ex->type = type_copy(ex->assign.value->type);
+			break;
+
+		case EX_INDEX:
+			tr_visit_index(ex, sco);
+			if(tr_is_soa(ex->index.object->type)) {
+				pass_record("Elements of %s are only accessible by field", pass_repr(ex->index.object->type));
+			}
+			break;
+
+		case EX_SETINDEX:
+			tr_visit_expr(ex->setindex.object, sco);
+			tr_visit_expr(ex->setindex.index, sco);
+			tr_visit_expr(ex->setindex.value, sco);
+			ftype = stb_resolve_type(ex->setindex.object->type, sco);
+			if(ftype && ftype->kind == TP_ARRAY) {
+				tr_coerce(ex->setindex.value, ftype->base);
+			}
+            TR_CHECK_CAST(type_can_setindex(ex->setindex.object->type, ex->setindex.index->type, ex->setindex.value->type), "Set index of %s by %s to %s", pass_repr(ex->setindex.object->type), pass_repr(ex->setindex.index->type), pass_repr(ex->setindex.value->type));
+			if((croot = tr_const_root(ex->setindex.object, sco))) {
+				pass_record("Set index of const argument %s", croot->ident);
+			}
+            ex->type = type_copy(ex->setindex.value->type);
+			if(tr_is_soa(ex->setindex.object->type)) {
+				pass_record("Elements of %s are only accessible by field", pass_repr(ex->setindex.object->type));
+			}
+			break;
+
+		case EX_FIELD:
+			ex->type = type_copy(tr_field(ex->field.object, ex->field.ident, sco));
+			break;
+
+		case EX_SETFIELD:
+			ftype = tr_field(ex->setfield.object, ex->setfield.ident, sco);
+			tr_visit_expr(ex->setfield.value, sco);
+			tr_coerce(ex->setfield.value, ftype);
+			TR_CHECK_CAST(type_can_cast(ex->setfield.value->type, ftype), "Set field %s of %s to %s", ex->setfield.ident, pass_repr(ex->setfield.object->type), pass_repr(ex->setfield.value->type));
+			if((croot = tr_const_root(ex->setfield.object, sco))) {
+				pass_record("Set field %s of const argument %s", ex->setfield.ident, croot->ident);
+			}
+			ex->type = type_copy(ex->setfield.value->type);
+			break;
+
+		case EX_CALL:
+			/* Calling by name isn't using the program as a value */
+			sym = ex->call.func->kind == EX_REF ? scope_resolve_name(sco, ex->call.func->ref.ident) : NULL;
+			if(sym && sym->kind == SYM_PROG) {
+				ex->call.func->type = type_copy(stb_resolve_type(sym->type, sco));
+			} else {
+				sym = NULL;
+				tr_visit_expr(ex->call.func, sco);
+			}
+			ftype = stb_resolve_type(ex->call.func->type, sco);
+			for(i = 0; i < ex->call.params.len; i++) {
+				tr_visit_expr(vec_get(&ex->call.params, i, expr_node), sco);
+				if(ftype && ftype->kind == TP_FUNC && i < ftype->args.len) {
+					tr_coerce(vec_get(&ex->call.params, i, expr_node), vec_get(&ftype->args, i, type));
+				}
+				if(sym && i < sym->init.prog->node->args.len) {
+					tr_visit_arg(sym->init.prog, i, vec_get(&ex->call.params, i, expr_node), sco);
+				} else if(ftype && ftype->kind == TP_FUNC && i < ftype->args.len && type_is_open(stb_resolve_type(vec_get(&ftype->args, i, type), sco)) && (croot = tr_const_root(vec_get(&ex->call.params, i, expr_node), sco))) {
+					pass_record("Const argument %s can't be passed through a value, which may change it", croot->ident);
+				}
+			}
+			/* Only now: a bad argument abandons the pass, which would leak ptypes */
+			vec_init(&ptypes);
+			for(i = 0; i < ex->call.params.len; i++) {
+				vec_insert(&ptypes, ptypes.len, vec_get(&ex->call.params, i, expr_node)->type);
+			}
+            TR_CHECK_CAST(type_can_call(ex->call.func->type, &ptypes), "Call %s with args %s", pass_repr(ex->call.func->type), tr_args_repr(&ptypes));
+            ex->type = type_copy(type_of_call(ex->call.func->type, &ptypes));
+            vec_clear(&ptypes);
+			break;
+
+		case EX_UNOP:
+			bitwise = ex->unop.kind == OP_NOT || ex->unop.kind == OP_CARD;
+			tr_visit_value(ex->unop.expr, sco, bitwise);
+            TR_CHECK_CAST(type_can_unop(ex->unop.expr->type, ex->unop.kind), "Unop %d on %s", ex->unop.kind, pass_repr(ex->unop.expr->type));
+            ex->type = type_copy(type_of_unop(ex->unop.expr->type, ex->unop.kind));
+			if(ex->unop.kind == OP_CARD && type_is_set(ex->unop.expr->type) && ex->unop.expr->type->size < 0) {
+				pass_record("Can't count %s without its bounds", pass_repr(ex->unop.expr->type));
+			}
+			break;
+
+		case EX_BINOP:
+			switch(ex->binop.kind) {
+				case OP_AND:
+				case OP_OR:
+				case OP_ADD:
+				case OP_SUB:
+				case OP_MUL:
+					tr_visit_value(ex->binop.left, sco, 1);
+					tr_visit_value(ex->binop.right, sco, 1);
+					tr_unify_sets(ex->binop.left, ex->binop.right);
+					break;
+
+				case OP_IN:
+					/* A literal is tested element by element instead */
+					tr_visit_expr(ex->binop.left, sco);
+					tr_visit_value(ex->binop.right, sco, ex->binop.right->kind == EX_SET);
+					break;
+
+				default:
+					tr_visit_expr(ex->binop.left, sco);
+					tr_visit_expr(ex->binop.right, sco);
+					break;
+			}
+			tr_coerce_num(ex->binop.right, ex->binop.left->type);
+			tr_coerce_num(ex->binop.left, ex->binop.right->type);
+			if(ex->binop.kind != OP_IN) {
+				tr_coerce_str(ex->binop.right, ex->binop.left->type);
+				tr_coerce_str(ex->binop.left, ex->binop.right->type);
+			}
+            TR_CHECK_CAST(type_can_binop(ex->binop.left->type, ex->binop.kind, ex->binop.right->type), "Binop %d on %s and %s", ex->binop.kind, pass_repr(ex->binop.left->type), pass_repr(ex->binop.right->type));
+            ex->type = type_copy(type_of_binop(ex->binop.left->type, ex->binop.kind, ex->binop.right->type));
+			break;
+
+		case EX_IND:
+			tr_visit_expr(ex->ind.lvalue, sco);
+			if(ex->ind.lvalue->kind == EX_INDEX && type_is_bitset(ex->ind.lvalue->index.object->type)) {
+				pass_record("Elements of %s have no address", pass_repr(ex->ind.lvalue->index.object->type));
+			}
+			ex->type = type_new_open_array(ex->ind.lvalue->type, 0);
+			break;
+
+		case EX_SLICE:
+			tr_visit_expr(ex->slice.object, sco);
+			tr_visit_expr(ex->slice.lbound, sco);
+			tr_visit_expr(ex->slice.ubound, sco);
+			ftype = stb_resolve_type(ex->slice.object->type, sco);
+			if(!ftype || ftype->kind != TP_ARRAY || ftype->store != AS_PLAIN) {
+				pass_error("Can't slice %s", pass_repr(ex->slice.object->type));
+			}
+			TR_CHECK_CAST(type_can_cast(ex->slice.lbound->type, type_scalar(TP_INT)), "%s as lower slice bound", pass_repr(ex->slice.lbound->type));
+			TR_CHECK_CAST(type_can_cast(ex->slice.ubound->type, type_scalar(TP_INT)), "%s as upper slice bound", pass_repr(ex->slice.ubound->type));
+			ex->type = type_new_open_array(ftype->base, ftype->lbound);
+			break;
+
+		case EX_SETLENGTH:
+			tr_visit_expr(ex->setlength.object, sco);
+			tr_visit_expr(ex->setlength.value, sco);
+			if(!tr_is_dynamic(ex->setlength.object, sco)) {
+				pass_record("Only dynamic array variables can be resized, not %s", pass_repr(ex->setlength.object->type));
+			}
+			TR_CHECK_CAST(type_can_cast(ex->setlength.value->type, type_scalar(TP_INT)), "Resize to %s elements", pass_repr(ex->setlength.value->type));
+			ex->type = type_copy(ex->setlength.value->type);
+			break;
+
+		case EX_DEREF:
+			tr_visit_expr(ex->deref.object, sco);
+			ex->type = type_copy(tr_pointee(ex->deref.object->type, sco));
+			break;
+
+		case EX_SETDEREF:
+			tr_visit_expr(ex->setderef.object, sco);
+			tr_visit_value(ex->setderef.value, sco, 1);
+			ftype = tr_pointee(ex->setderef.object->type, sco);
+			tr_coerce(ex->setderef.value, ftype);
+			TR_CHECK_CAST(type_can_cast(ex->setderef.value->type, ftype), "Store %s through %s", pass_repr(ex->setderef.value->type), pass_repr(ex->setderef.object->type));
+			ex->type = type_copy(ex->setderef.value->type);
+			break;
+
+		case EX_NEW:
+		case EX_DISPOSE:
+			tr_visit_expr(ex->alloc.object, sco);
+			tr_pointee(ex->alloc.object->type, sco);
+			if(!tr_is_lvalue(ex->alloc.object, sco)) {
+				pass_record("%s needs a pointer variable", ex->kind == EX_NEW ? "new" : "dispose");
+			} else if((croot = tr_const_root(ex->alloc.object, sco))) {
+				pass_record("%s of const argument %s", ex->kind == EX_NEW ? "new" : "dispose", croot->ident);
+			}
+			ex->type = type_copy(ex->alloc.object->type);
+			break;
+
+		case EX_SET:
+			tr_visit_set(ex, sco);
+			break;
+
+		default:
+			assert(0);
+	}
+	if(!whole && tr_is_bitwise(ex)) {
+		pass_record("%s can only be assigned to a variable or counted", pass_repr(ex->type));
+	} else if(!whole && tr_is_concat(ex)) {
+		pass_record("Concatenation can only be assigned to a variable");
+	}
+}
+
+/********** Constant Folding **********/
+
+int cf_pass(ast_root *ast, object *obj) {
+	cf_visit_prog(obj->root_prog, &obj->folded);
+	return 0;
+}
+
+void cf_visit_prog(program *prog, size_t *folded) {
+	size_t i;
+	cf_visit_stmt(prog->node->body, folded);
+	for(i = 0; i < prog->scope->names.len; i++) {
+		if(vec_get(&prog->scope->names, i, symbol)->kind == SYM_PROG && vec_get(&prog->scope->names, i, symbol)->init.prog->reached) {
+			cf_visit_prog(vec_get(&prog->scope->names, i, symbol)->init.prog, folded);
+		}
+	}
+}
+
+void cf_visit_stmt(stmt_node *st, size_t *folded) {
+	size_t i;
+	if(!st) {
+		return;
+	}
+	switch(st->kind) {
+		case ST_EXPR:
+			st->expr.expr = cf_visit_expr(st->expr.expr, folded);
+			break;
+
+		case ST_WHILE:
+			st->while_.cond = cf_visit_expr(st->while_.cond, folded);
+			cf_visit_stmt(st->while_.body, folded);
+			break;
+
+		case ST_IF:
+			st->if_.cond = cf_visit_expr(st->if_.cond, folded);
+			cf_visit_stmt(st->if_.iftrue, folded);
+			cf_visit_stmt(st->if_.iffalse, folded);
+			break;
+
+		case ST_FOR:
+			cf_visit_stmt(st->for_.init, folded);
+			st->for_.cond = cf_visit_expr(st->for_.cond, folded);
+			cf_visit_stmt(st->for_.post, folded);
+			cf_visit_stmt(st->for_.body, folded);
+			break;
+
+		case ST_ITER:
+			st->iter.value = cf_visit_expr(st->iter.value, folded);
+			cf_visit_stmt(st->iter.body, folded);
+			break;
+
+		case ST_RANGE:
+			st->range.lbound = cf_visit_expr(st->range.lbound, folded);
+			st->range.ubound = cf_visit_expr(st->range.ubound, folded);
+			st->range.step = cf_visit_expr(st->range.step, folded);
+			cf_visit_stmt(st->range.body, folded);
+			break;
+
+		case ST_COMPOUND:
+			for(i = 0; i < st->compound.stmts.len; i++) {
+				cf_visit_stmt(vec_get(&st->compound.stmts, i, stmt_node), folded);
+			}
+			break;
+
+		default:
+			assert(0);
+	}
+}
+
+/* Whether evaluating ex can be skipped entirely (no calls or stores) */
+int cf_is_pure(expr_node *ex) {
+	size_t i;
+	switch(ex->kind) {
+		case EX_LIT:
+		case EX_REF:
+			return 1;
+
+		case EX_INDEX:
+			return cf_is_pure(ex->index.object) && cf_is_pure(ex->index.index);
+
+		case EX_FIELD:
+			return cf_is_pure(ex->field.object);
+
+		case EX_DEREF:
+			return cf_is_pure(ex->deref.object);
+
+		case EX_UNOP:
+			return cf_is_pure(ex->unop.expr);
+
+		case EX_BINOP:
+			return cf_is_pure(ex->binop.left) && cf_is_pure(ex->binop.right);
+
+		case EX_SET:
+			for(i = 0; i < ex->set.items.len; i++) {
+				if(!cf_is_pure(vec_get(&ex->set.items, i, expr_node))) {
+					return 0;
+				}
+			}
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+
+static int cf_is_int_lit(expr_node *ex, long val) {
+	return ex->kind == EX_LIT && ex->lit.lit->kind == LIT_INT && ex->lit.lit->ival == val;
+}
+
+static int cf_is_int(expr_node *ex) {
+	return ex->type && ex->type->kind == TP_INT;
+}
+
+static int cf_same_type(expr_node *ex, expr_node *of) {
+	return type_equal(ex->type, of->type);
+}
+
+/* Drops ex in favor of with (which the caller must hold a reference to) */
+static expr_node *cf_replace(expr_node *ex, expr_node *with, size_t *folded) {
+	with = ex_copy(with);
+	ex_delete(ex);
+	(*folded)++;
+	return with;
+}
+
+static expr_node *cf_replace_lit(expr_node *ex, literal *lit, size_t *folded) {
+	expr_node *res = ex_new_lit(lit);
+	res->type = type_copy(lit->type);
+	lit_delete(lit);
+	ex = cf_replace(ex, res, folded);
+	ex_delete(res);
+	return ex;
+}
+
+/* A folded set is a literal of its words (lit_new_bits), typed by the node */
+static int cf_is_set(expr_node *ex) {
+	return ex->kind == EX_LIT && ex->lit.lit->kind == LIT_PACKED && type_is_set(ex->type);
+}
+
+static expr_node *cf_replace_set(expr_node *ex, literal *words, size_t *folded) {
+	expr_node *res = ex_new_lit(words);
+	res->type = type_copy(ex->type);
+	lit_delete(words);
+	ex = cf_replace(ex, res, folded);
+	ex_delete(res);
+	return ex;
+}
+
+/* The words of a set literal's constant elements; those it can't hold are
+ * left out, as tr warned.
+ */
+static literal *cf_set_words(expr_node *ex) {
+	literal *words = lit_new_bits(ex->type->size);
+	long lo, hi, v;
+	size_t i;
+	for(i = 0; i < ex->set.items.len; i++) {
+		if(!tr_set_bounds(vec_get(&ex->set.items, i, expr_node), &lo, &hi)) {
+			continue;
+		}
+		for(v = max(lo, ex->type->lbound); v < min(hi, ex->type->lbound + ex->type->size); v++) {
+			lit_bits_set(words, v - ex->type->lbound);
+		}
+	}
+	return words;
+}
+
+/* kind on folded sets of type ty, or their complement if r is NULL; NULL
+ * if it isn't a set operation
+ */
+static literal *cf_set_op(int kind, literal *l, literal *r, type *ty) {
+	literal *words = lit_new_bits(ty->size);
+	unsigned long *a = l->packed.data, *b = r ? r->packed.data : NULL, *res = words->packed.data;
+	size_t i, n = words->packed.len, bits = sizeof(long) * CHAR_BIT;
+	for(i = 0; i < n; i++) {
+		if(!b) {
+			res[i] = ~a[i];
+			continue;
+		}
+		switch(kind) {
+			case OP_ADD: case OP_OR: res[i] = a[i] | b[i]; break;
+			case OP_MUL: case OP_AND: res[i] = a[i] & b[i]; break;
+			case OP_SUB: res[i] = a[i] & ~b[i]; break;
+			default: lit_delete(words); return NULL;
+		}
+	}
+	if(n && ty->size % bits) {
+		res[n - 1] &= (1UL << ty->size % bits) - 1;
+	}
+	return words;
+}
+
+/* Returns the node that should take ex's place (possibly ex itself). */
+expr_node *cf_visit_expr(expr_node *ex, size_t *folded) {
+	size_t i;
+	long lo, hi;
+	int all;
+	literal *lit;
+	expr_node *l, *r;
+	if(!ex) {
+		return NULL;
+	}
+	switch(ex->kind) {
+		case EX_LIT:
+		case EX_REF:
+			break;
+
+		case EX_ASSIGN:
+			ex->assign.value = cf_visit_expr(ex->assign.value, folded);
+			break;
+
+		case EX_INDEX:
+			ex->index.object = cf_visit_expr(ex->index.object, folded);
+			ex->index.index = cf_visit_expr(ex->index.index, folded);
+			break;
+
+		case EX_SETINDEX:
+			ex->setindex.object = cf_visit_expr(ex->setindex.object, folded);
+			ex->setindex.index = cf_visit_expr(ex->setindex.index, folded);
+			ex->setindex.value = cf_visit_expr(ex->setindex.value, folded);
+			break;
+
+		case EX_FIELD:
+			ex->field.object = cf_visit_expr(ex->field.object, folded);
+			break;
+
+		case EX_SETFIELD:
+			ex->setfield.object = cf_visit_expr(ex->setfield.object, folded);
+			ex->setfield.value = cf_visit_expr(ex->setfield.value, folded);
+			break;
+
+		case EX_CALL:
+			for(i = 0; i < ex->call.params.len; i++) {
+				vec_set(&ex->call.params, i, cf_visit_expr(vec_get(&ex->call.params, i, expr_node), folded));
+			}
+			break;
+
+		case EX_UNOP:
+			ex->unop.expr = l = cf_visit_expr(ex->unop.expr, folded);
+			if(l->kind == EX_LIT && (lit = lit_unop(ex->unop.kind, l->lit.lit))) {
+				return cf_replace_lit(ex, lit, folded);
+			}
+			if(cf_is_set(l) && ex->unop.kind == OP_CARD) {
+				for(i = 0, lo = 0; i < (size_t) l->type->size; i++) {
+					lo += lit_bits_test(l->lit.lit, i);
+				}
+				return cf_replace_lit(ex, lit_new_int(lo), folded);
+			}
+			if(cf_is_set(l) && type_is_set(ex->type) && ex->unop.kind == OP_NOT) {
+				lit = cf_set_op(ex->unop.kind, l->lit.lit, NULL, ex->type);
+				return cf_replace_set(ex, lit, folded);
+			}
+			if(ex->unop.kind == OP_IDENT) {
+				return cf_replace(ex, l, folded);
+			}
+			/* --x, not not x, ~~x, when that doesn't change the type */
+			if(l->kind == EX_UNOP && l->unop.kind == ex->unop.kind && type_equal(l->unop.expr->type, ex->type)) {
+				if(ex->unop.kind == OP_NEG || (ex->unop.kind == OP_NOT && ex->type->kind == TP_BOOL) || (ex->unop.kind == OP_BNOT && ex->type->kind == TP_INT)) {
+					return cf_replace(ex, l->unop.expr, folded);
+				}
+			}
+			break;
+
+		case EX_BINOP:
+			ex->binop.left = l = cf_visit_expr(ex->binop.left, folded);
+			ex->binop.right = r = cf_visit_expr(ex->binop.right, folded);
+			if(l->kind == EX_LIT && r->kind == EX_LIT && (lit = lit_binop(l->lit.lit, ex->binop.kind, r->lit.lit))) {
+				return cf_replace_lit(ex, lit, folded);
+			}
+			if(cf_is_set(l) && cf_is_set(r) && type_is_set(ex->type) && (lit = cf_set_op(ex->binop.kind, l->lit.lit, r->lit.lit, ex->type))) {
+				return cf_replace_set(ex, lit, folded);
+			}
+			if(ex->binop.kind == OP_IN && cf_is_set(r) && tr_set_bounds(l, &lo, &hi) && hi == lo + 1) {
+				lo -= r->type->lbound;
+				return cf_replace_lit(ex, lit_new_bool(lo >= 0 && lo < r->type->size && lit_bits_test(r->lit.lit, lo)), folded);
+			}
+			if(!cf_is_int(ex) || !cf_is_int(l) || !cf_is_int(r)) {
+				break;
+			}
+			/* An identity only holds when the kept operand already has the
+			 * node's type; a promoted narrow operand must keep its binop */
+			switch(ex->binop.kind) {
+				case OP_ADD:
+					if(cf_is_int_lit(r, 0) && cf_same_type(l, ex)) return cf_replace(ex, l, folded);
+					if(cf_is_int_lit(l, 0) && cf_same_type(r, ex)) return cf_replace(ex, r, folded);
+					break;
+
+				case OP_SUB:
+					if(cf_is_int_lit(r, 0) && cf_same_type(l, ex)) return cf_replace(ex, l, folded);
+					break;
+
+				case OP_MUL:
+					if(cf_is_int_lit(r, 1) && cf_same_type(l, ex)) return cf_replace(ex, l, folded);
+					if(cf_is_int_lit(l, 1) && cf_same_type(r, ex)) return cf_replace(ex, r, folded);
+					if(cf_is_int_lit(r, 0) && cf_is_pure(l)) return cf_replace_lit(ex, lit_cast(r->lit.lit, ex->type), folded);
+					if(cf_is_int_lit(l, 0) && cf_is_pure(r)) return cf_replace_lit(ex, lit_cast(l->lit.lit, ex->type), folded);
+					break;
+
+				default:
+					break;
+			}
+			break;
+
+		case EX_RETURN:
+			ex->return_.value = cf_visit_expr(ex->return_.value, folded);
+			break;
+
+		case EX_IND:
+			break;
+
+		case EX_SLICE:
+			ex->slice.object = cf_visit_expr(ex->slice.object, folded);
+			ex->slice.lbound = cf_visit_expr(ex->slice.lbound, folded);
+			ex->slice.ubound = cf_visit_expr(ex->slice.ubound, folded);
+			break;
+
+		case EX_SETLENGTH:
+			ex->setlength.object = cf_visit_expr(ex->setlength.object, folded);
+			ex->setlength.value = cf_visit_expr(ex->setlength.value, folded);
+			break;
+
+		case EX_DEREF:
+			ex->deref.object = cf_visit_expr(ex->deref.object, folded);
+			break;
+
+		case EX_SETDEREF:
+			ex->setderef.object = cf_visit_expr(ex->setderef.object, folded);
+			ex->setderef.value = cf_visit_expr(ex->setderef.value, folded);
+			break;
+
+		case EX_NEW:
+		case EX_DISPOSE:
+			ex->alloc.object = cf_visit_expr(ex->alloc.object, folded);
+			break;
+
+		case EX_SET:
+			for(i = 0, all = 1; i < ex->set.items.len; i++) {
+				vec_set(&ex->set.items, i, l = cf_visit_expr(vec_get(&ex->set.items, i, expr_node), folded));
+				all = all && tr_set_bounds(l, &lo, &hi);
+			}
+			if(all && ex->type->size >= 0) {
+				return cf_replace_set(ex, cf_set_words(ex), folded);
+			}
+			break;
+
+		default:
+			assert(0);
+	}
+	return ex;
+}
+
+/********** Compile-Time Evaluation **********/
+
+/* An interpreter over the typed AST. Anything it can't prove free of outside
+ * effects (reading or writing non-local variables, stores through arrays or
+ * pointers, unbounded work) makes evaluation fail, and the code is left alone. */
+
+typedef struct _ctfe_frame {
+	scope *scope; /* locals are the data symbols bound directly here */
+	vector syms; /* of symbol * */
+	vector vals; /* of literal *, parallel to syms */
+	type *rtype;
+	literal *ret;
+} ctfe_frame;
+
+typedef struct _ctfe_state {
+	size_t steps;
+	size_t depth;
+	ctfe_frame *frame; /* NULL outside of any call */
+	vector pending; /* of symbol *, consts under evaluation */
+	char why[128];
+} ctfe_state;
+
+static literal *ctfe_expr(ctfe_state *, expr_node *, scope *);
+static int ctfe_stmt(ctfe_state *, stmt_node *, scope *);
+
+static void ctfe_state_init(ctfe_state *cs) {
+	cs->steps = 0;
+	cs->depth = 0;
+	cs->frame = NULL;
+	vec_init(&cs->pending);
+	cs->why[0] = 0;
+}
+
+static void *ctfe_fail(ctfe_state *cs, const char *fmt, ...) {
+	va_list va;
+	if(!cs->why[0]) {
+		va_start(va, fmt);
+		vsnprintf(cs->why, sizeof(cs->why), fmt, va);
+		va_end(va);
+	}
+	return NULL;
+}
+
+static int ctfe_step(ctfe_state *cs) {
+	if(++cs->steps > CTFE_MAX_STEPS) {
+		ctfe_fail(cs, "more than %d steps", CTFE_MAX_STEPS);
+		return 0;
+	}
+	return 1;
+}
+
+static ssize_t ctfe_local(ctfe_state *cs, symbol *sym) {
+	size_t i;
+	if(!cs->frame || sym->scope != cs->frame->scope) {
+		return -1;
+	}
+	for(i = 0; i < cs->frame->syms.len; i++) {
+		if(vec_get(&cs->frame->syms, i, symbol) == sym) {
+			return i;
+		}
+	}
+	vec_insert(&cs->frame->syms, i, sym);
+	vec_insert(&cs->frame->vals, i, NULL);
+	return i;
+}
+
+/* Takes the reference to val */
+static int ctfe_store(ctfe_state *cs, symbol *sym, literal *val) {
+	ssize_t idx = ctfe_local(cs, sym);
+	literal *old;
+	if(idx < 0) {
+		lit_delete(val);
+		ctfe_fail(cs, "writes non-local %s", sym->ident);
+		return 0;
+	}
+	old = vec_get(&cs->frame->vals, idx, literal);
+	if(old) {
+		lit_delete(old);
+	}
+	vec_set(&cs->frame->vals, idx, lit_cast(val, sym->type));
+	lit_delete(val);
+	return 1;
+}
+
+static int ctfe_truth(literal *lit) {
+	literal *b = lit_cast(lit, type_scalar(TP_BOOL));
+	int res = b->kind == LIT_BOOL && b->bval;
+	lit_delete(b);
+	lit_delete(lit);
+	return res;
+}
+
+static literal *ctfe_const(ctfe_state *cs, symbol *sym) {
+	literal *res;
+	ctfe_frame *frame;
+	size_t i;
+	if(sym->value) {
+		return lit_copy(sym->value);
+	}
+	for(i = 0; i < cs->pending.len; i++) {
+		if(vec_get(&cs->pending, i, symbol) == sym) {
+			return ctfe_fail(cs, "const %s depends on itself", sym->ident);
+		}
+	}
+	vec_insert(&cs->pending, cs->pending.len, sym);
+	frame = cs->frame;
+	cs->frame = NULL;
+	res = ctfe_expr(cs, sym->init.expr, sym->scope);
+	cs->frame = frame;
+	vec_remove(&cs->pending, cs->pending.len - 1);
+	if(!res) {
+		return NULL;
+	}
+	sym->value = lit_cast(res, sym->type);
+	lit_delete(res);
+	return lit_copy(sym->value);
+}
+
+static literal *ctfe_call(ctfe_state *cs, expr_node *ex, scope *sco) {
+	symbol *fsym, *sym;
+	program *prog;
+	ctfe_frame frame, *caller;
+	decl_node *decl;
+	literal *val, *res = NULL;
+	vector args;
+	size_t i;
+	int ok = 1;
+	if(ex->call.func->kind != EX_REF || !(fsym = scope_resolve_name(sco, ex->call.func->ref.ident)) || fsym->kind != SYM_PROG) {
+		return ctfe_fail(cs, "calls something other than a procedure");
+	}
+	prog = fsym->init.prog;
+	for(i = 0; i < prog->node->args.len; i++) {
+		if(vec_get(&prog->node->args, i, decl_node)->mode == ARG_VAR) {
+			return ctfe_fail(cs, "passes %s by reference", vec_get(&prog->node->args, i, decl_node)->ident);
+		}
+	}
+	if(cs->depth >= CTFE_MAX_DEPTH) {
+		return ctfe_fail(cs, "recursion deeper than %d", CTFE_MAX_DEPTH);
+	}
+	vec_init(&args);
+	for(i = 0; ok && i < ex->call.params.len; i++) {
+		val = ctfe_expr(cs, vec_get(&ex->call.params, i, expr_node), sco);
+		if(!val) {
+			ok = 0;
+			break;
+		}
+		vec_insert(&args, args.len, val);
+	}
+	frame.scope = prog->scope;
+	vec_init(&frame.syms);
+	vec_init(&frame.vals);
+	frame.rtype = fsym->type->ret;
+	frame.ret = NULL;
+	caller = cs->frame;
+	cs->frame = &frame;
+	cs->depth++;
+	for(i = 0; ok && i < prog->node->args.len; i++) {
+		sym = scope_resolve_name(prog->scope, vec_get(&prog->node->args, i, decl_node)->ident);
+		ok = i < args.len && ctfe_store(cs, sym, lit_copy(vec_get(&args, i, literal)));
+	}
+	for(i = 0; ok && i < prog->node->decls.len; i++) {
+		decl = vec_get(&prog->node->decls, i, decl_node);
+		if(decl->kind != DECL_VAR || !decl->init) continue;
+		sym = scope_resolve_name(prog->scope, decl->ident);
+		ok = (val = ctfe_expr(cs, decl->init, prog->scope)) && ctfe_store(cs, sym, val);
+	}
+	if(ok && ctfe_stmt(cs, prog->node->body, prog->scope)) {
+		res = frame.ret ? lit_copy(frame.ret) : ctfe_fail(cs, "%s returns no value", fsym->ident);
+	}
+	cs->depth--;
+	cs->frame = caller;
+	for(i = 0; i < frame.vals.len; i++) {
+		if(vec_get(&frame.vals, i, literal)) {
+			lit_delete(vec_get(&frame.vals, i, literal));
+		}
+	}
+	vec_clear(&frame.syms);
+	vec_clear(&frame.vals);
+	if(frame.ret) {
+		lit_delete(frame.ret);
+	}
+	vec_foreach(&args, (vec_iter_f) lit_delete, NULL);
+	vec_clear(&args);
+	return res;
+}
+
+static literal *ctfe_expr(ctfe_state *cs, expr_node *ex, scope *sco) {
+	literal *a, *b, *res;
+	symbol *sym;
+	ssize_t idx;
+	long i;
+	if(!ctfe_step(cs)) {
+		return NULL;
+	}
+	switch(ex->kind) {
+		case EX_LIT:
+			return lit_copy(ex->lit.lit);
+
+		case EX_REF:
+			sym = scope_resolve_name(sco, ex->ref.ident);
+			if(sym && sym->kind == SYM_CONST) {
+				return ctfe_const(cs, sym);
+			}
+			if(!sym || sym->kind != SYM_DATA || (idx = ctfe_local(cs, sym)) < 0) {
+				return ctfe_fail(cs, "reads non-constant %s", ex->ref.ident);
+			}
+			if(!(a = vec_get(&cs->frame->vals, idx, literal))) {
+				return ctfe_fail(cs, "reads %s before it is set", ex->ref.ident);
+			}
+			return lit_copy(a);
+
+		case EX_ASSIGN:
+			if(!(a = ctfe_expr(cs, ex->assign.value, sco))) {
+				return NULL;
+			}
+			sym = scope_resolve_name(sco, ex->assign.ident);
+			if(!sym || !ctfe_store(cs, sym, lit_copy(a))) {
+				lit_delete(a);
+				return ctfe_fail(cs, "writes non-local %s", ex->assign.ident);
+			}
+			return a;
+
+		case EX_RETURN:
+			if(!cs->frame || !(a = ctfe_expr(cs, ex->return_.value, sco))) {
+				return ctfe_fail(cs, "returns outside of a call");
+			}
+			if(cs->frame->ret) {
+				lit_delete(cs->frame->ret);
+			}
+			cs->frame->ret = lit_cast(a, cs->frame->rtype);
+			return a;
+
+		case EX_INDEX:
+			if(!(a = ctfe_expr(cs, ex->index.object, sco))) {
+				return NULL;
+			}
+			if(!(b = ctfe_expr(cs, ex->index.index, sco))) {
+				lit_delete(a);
+				return NULL;
+			}
+			res = NULL;
+			if(b->kind == LIT_INT && (a->type->kind == TP_ARRAY || a->kind == LIT_STRING)) {
+				/* Strings count from 1 */
+				i = b->ival - (a->kind == LIT_STRING ? 1 : a->type->lbound);
+				if(i >= 0 && i < lit_len(a)) {
+					res = lit_item(a, i);
+				}
+			}
+			lit_delete(a);
+			lit_delete(b);
+			return res ? res : ctfe_fail(cs, "indexes out of range");
+
+		case EX_FIELD:
+			return ctfe_fail(cs, "reads field %s of a record", ex->field.ident);
+
+		case EX_SET:
+			return ctfe_fail(cs, "builds a set");
+
+		case EX_SLICE:
+			return ctfe_fail(cs, "takes a slice");
+
+		case EX_SETLENGTH:
+			return ctfe_fail(cs, "resizes an array");
+
+		case EX_DEREF:
+			return ctfe_fail(cs, "follows a pointer");
+
+		case EX_NEW:
+		case EX_DISPOSE:
+			return ctfe_fail(cs, "uses the heap");
+
+		case EX_CALL:
+			return ctfe_call(cs, ex, sco);
+
+		case EX_UNOP:
+			if(!(a = ctfe_expr(cs, ex->unop.expr, sco))) {
+				return NULL;
+			}
+			res = lit_unop(ex->unop.kind, a);
+			lit_delete(a);
+			return res ? res : ctfe_fail(cs, "unop %d is not constant", ex->unop.kind);
+
+		case EX_BINOP:
+			if(!(a = ctfe_expr(cs, ex->binop.left, sco))) {
+				return NULL;
+			}
+			if(!(b = ctfe_expr(cs, ex->binop.right, sco))) {
+				lit_delete(a);
+				return NULL;
+			}
+			res = lit_binop(a, ex->binop.kind, b);
+			lit_delete(a);
+			lit_delete(b);
+			return res ? res : ctfe_fail(cs, "binop %d is not constant", ex->binop.kind);
+
+		default:
+			return ctfe_fail(cs, "stores through an array or pointer");
+	}
+}
+
+static int ctfe_stmt(ctfe_state *cs, stmt_node *st, scope *sco) {
+	literal *a, *b, *c, *v, *t;
+	symbol *sym;
+	size_t i;
+	if(!st) {
+		return 1;
+	}
+	if(!ctfe_step(cs)) {
+		return 0;
+	}
+	switch(st->kind) {
+		case ST_EXPR:
+			if(!(a = ctfe_expr(cs, st->expr.expr, sco))) {
+				return 0;
+			}
+			lit_delete(a);
+			return 1;
+
+		case ST_WHILE:
+			while(1) {
+				if(!ctfe_step(cs) || !(a = ctfe_expr(cs, st->while_.cond, sco))) {
+					return 0;
+				}
+				if(!ctfe_truth(a)) {
+					return 1;
+				}
+				if(!ctfe_stmt(cs, st->while_.body, sco)) {
+					return 0;
+				}
+			}
+
+		case ST_IF:
+			if(!(a = ctfe_expr(cs, st->if_.cond, sco))) {
+				return 0;
+			}
+			return ctfe_stmt(cs, ctfe_truth(a) ? st->if_.iftrue : st->if_.iffalse, sco);
+
+		case ST_FOR:
+			if(!ctfe_stmt(cs, st->for_.init, sco)) {
+				return 0;
+			}
+			while(1) {
+				if(!ctfe_step(cs) || !(a = ctfe_expr(cs, st->for_.cond, sco))) {
+					return 0;
+				}
+				if(!ctfe_truth(a)) {
+					return 1;
+				}
+				if(!ctfe_stmt(cs, st->for_.body, sco) || !ctfe_stmt(cs, st->for_.post, sco)) {
+					return 0;
+				}
+			}
+
+		case ST_ITER:
+			/* Like the lowering, this walks the indices; the value itself isn't needed */
+			sym = scope_resolve_name(sco, st->iter.ident);
+			for(i = 0; (ssize_t) i < st->iter.value->type->size; i++) {
+				if(!ctfe_step(cs) || !ctfe_store(cs, sym, lit_new_int(st->iter.value->type->lbound + i)) || !ctfe_stmt(cs, st->iter.body, sco)) {
+					return 0;
+				}
+			}
+			return 1;
+
+		case ST_RANGE:
+			sym = scope_resolve_name(sco, st->range.ident);
+			a = ctfe_expr(cs, st->range.lbound, sco);
+			b = a ? ctfe_expr(cs, st->range.ubound, sco) : NULL;
+			c = b ? ctfe_expr(cs, st->range.step, sco) : NULL;
+			v = a ? lit_copy(a) : NULL;
+			while(c) {
+				if(!(t = lit_binop(v, OP_GREATER, b))) {
+					ctfe_fail(cs, "range bounds are not scalar");
+					break;
+				}
+				if(ctfe_truth(t) || !ctfe_step(cs) || !ctfe_store(cs, sym, lit_copy(v)) || !ctfe_stmt(cs, st->range.body, sco)) {
+					break;
+				}
+				t = lit_binop(v, OP_ADD, c);
+				lit_delete(v);
+				v = t;
+			}
+			if(a) lit_delete(a);
+			if(b) lit_delete(b);
+			if(v) lit_delete(v);
+			if(!c) {
+				return 0;
+			}
+			lit_delete(c);
+			return !cs->why[0];
+
+		case ST_COMPOUND:
+			for(i = 0; i < st->compound.stmts.len; i++) {
+				if(!ctfe_stmt(cs, vec_get(&st->compound.stmts, i, stmt_node), sco)) {
+					return 0;
+				}
+			}
+			return 1;
+
+		default:
+			assert(0);
+			return 0;
+	}
+}
+
+/* The value of ex as a literal, or NULL if it can't be computed at compile time */
+literal *ctfe_eval(expr_node *ex, scope *sco) {
+	ctfe_state cs;
+	literal *res;
+	ctfe_state_init(&cs);
+	res = ctfe_expr(&cs, ex, sco);
+	vec_clear(&cs.pending);
+	return res;
+}
+
+int ctfe_pass(ast_root *ast, object *obj) {
+	ctfe_visit_prog(obj->root_prog, &obj->folded);
+	return 0;
+}
+
+void ctfe_visit_prog(program *prog, size_t *folded) {
+	size_t i;
+	symbol *sym;
+	literal *lit;
+	ctfe_state cs;
+	for(i = prog->scope->names.len; i-- > 0;) {
+		sym = vec_get(&prog->scope->names, i, symbol);
+		switch(sym->kind) {
+			case SYM_CONST:
+				ctfe_state_init(&cs);
+				lit = ctfe_const(&cs, sym);
+				vec_clear(&cs.pending);
+				if(!lit) {
+					pass_error("Can't evaluate const %s at compile time: %s", sym->ident, cs.why);
+				}
+				lit_delete(lit);
+				break;
+
+			case SYM_DATA:
+				/* Bake initializers in rather than computing them at startup */
+				if(sym->init.expr && sym->init.expr->kind != EX_LIT && (lit = ctfe_eval(sym->init.expr, prog->scope))) {
+					sym->init.expr = cf_replace_lit(sym->init.expr, lit_cast(lit, sym->type), folded);
+					lit_delete(lit);
+				}
+				break;
+
+			default:
+				break;
+		}
+	}
+	ctfe_visit_stmt(prog->node->body, prog->scope, folded);
+	for(i = 0; i < prog->scope->names.len; i++) {
+		if(vec_get(&prog->scope->names, i, symbol)->kind == SYM_PROG && vec_get(&prog->scope->names, i, symbol)->init.prog->reached) {
+			ctfe_visit_prog(vec_get(&prog->scope->names, i, symbol)->init.prog, folded);
+		}
+	}
+}
+
+void ctfe_visit_stmt(stmt_node *st, scope *sco, size_t *folded) {
+	size_t i;
+	if(!st) {
+		return;
+	}
+	switch(st->kind) {
+		case ST_EXPR:
+			st->expr.expr = ctfe_visit_expr(st->expr.expr, sco, folded);
+			break;
+
+		case ST_WHILE:
+			st->while_.cond = ctfe_visit_expr(st->while_.cond, sco, folded);
+			ctfe_visit_stmt(st->while_.body, sco, folded);
+			break;
+
+		case ST_IF:
+			st->if_.cond = ctfe_visit_expr(st->if_.cond, sco, folded);
+			ctfe_visit_stmt(st->if_.iftrue, sco, folded);
+			ctfe_visit_stmt(st->if_.iffalse, sco, folded);
+			break;
+
+		case ST_FOR:
+			ctfe_visit_stmt(st->for_.init, sco, folded);
+			st->for_.cond = ctfe_visit_expr(st->for_.cond, sco, folded);
+			ctfe_visit_stmt(st->for_.post, sco, folded);
+			ctfe_visit_stmt(st->for_.body, sco, folded);
+			break;
+
+		case ST_ITER:
+			st->iter.value = ctfe_visit_expr(st->iter.value, sco, folded);
+			ctfe_visit_stmt(st->iter.body, sco, folded);
+			break;
+
+		case ST_RANGE:
+			st->range.lbound = ctfe_visit_expr(st->range.lbound, sco, folded);
+			st->range.ubound = ctfe_visit_expr(st->range.ubound, sco, folded);
+			st->range.step = ctfe_visit_expr(st->range.step, sco, folded);
+			ctfe_visit_stmt(st->range.body, sco, folded);
+			break;
+
+		case ST_COMPOUND:
+			for(i = 0; i < st->compound.stmts.len; i++) {
+				ctfe_visit_stmt(vec_get(&st->compound.stmts, i, stmt_node), sco, folded);
+			}
+			break;
+
+		default:
+			assert(0);
+	}
+}
+
+/* Replaces references to consts, and calls that evaluate, with literals.
+ * Returns the node that should take ex's place (possibly ex itself). */
+expr_node *ctfe_visit_expr(expr_node *ex, scope *sco, size_t *folded) {
+	size_t i;
+	symbol *sym;
+	literal *lit;
+	if(!ex) {
+		return NULL;
+	}
+	switch(ex->kind) {
+		case EX_LIT:
+		case EX_IND:
+			break;
+
+		case EX_REF:
+			sym = scope_resolve_name(sco, ex->ref.ident);
+			if(sym && sym->kind == SYM_CONST && sym->value) {
+				return cf_replace_lit(ex, lit_copy(sym->value), folded);
+			}
+			break;
+
+		case EX_ASSIGN:
+			ex->assign.value = ctfe_visit_expr(ex->assign.value, sco, folded);
+			break;
+
+		case EX_INDEX:
+			ex->index.object = ctfe_visit_expr(ex->index.object, sco, folded);
+			ex->index.index = ctfe_visit_expr(ex->index.index, sco, folded);
+			break;
+
+		case EX_SETINDEX:
+			ex->setindex.object = ctfe_visit_expr(ex->setindex.object, sco, folded);
+			ex->setindex.index = ctfe_visit_expr(ex->setindex.index, sco, folded);
+			ex->setindex.value = ctfe_visit_expr(ex->setindex.value, sco, folded);
+			break;
+
+		case EX_FIELD:
+			ex->field.object = ctfe_visit_expr(ex->field.object, sco, folded);
+			break;
+
+		case EX_SETFIELD:
+			ex->setfield.object = ctfe_visit_expr(ex->setfield.object, sco, folded);
+			ex->setfield.value = ctfe_visit_expr(ex->setfield.value, sco, folded);
+			break;
+
+		case EX_CALL:
+			for(i = 0; i < ex->call.params.len; i++) {
+				vec_set(&ex->call.params, i, ctfe_visit_expr(vec_get(&ex->call.params, i, expr_node), sco, folded));
+			}
+			if(ex->type && (lit = ctfe_eval(ex, sco))) {
+				expr_node *res = cf_replace_lit(ex, lit_cast(lit, ex->type), folded);
+				lit_delete(lit);
+				return res;
+			}
+			break;
+
+		case EX_UNOP:
+			ex->unop.expr = ctfe_visit_expr(ex->unop.expr, sco, folded);
+			break;
+
+		case EX_BINOP:
+			ex->binop.left = ctfe_visit_expr(ex->binop.left, sco, folded);
+			ex->binop.right = ctfe_visit_expr(ex->binop.right, sco, folded);
+			break;
+
+		case EX_RETURN:
+			ex->return_.value = ctfe_visit_expr(ex->return_.value, sco, folded);
+			break;
+
+		case EX_SET:
+			for(i = 0; i < ex->set.items.len; i++) {
+				vec_set(&ex->set.items, i, ctfe_visit_expr(vec_get(&ex->set.items, i, expr_node), sco, folded));
+			}
+			break;
+
+		case EX_SLICE:
+			ex->slice.object = ctfe_visit_expr(ex->slice.object, sco, folded);
+			ex->slice.lbound = ctfe_visit_expr(ex->slice.lbound, sco, folded);
+			ex->slice.ubound = ctfe_visit_expr(ex->slice.ubound, sco, folded);
+			break;
+
+		case EX_SETLENGTH:
+			ex->setlength.object = ctfe_visit_expr(ex->setlength.object, sco, folded);
+			ex->setlength.value = ctfe_visit_expr(ex->setlength.value, sco, folded);
+			break;
+
+		case EX_DEREF:
+			ex->deref.object = ctfe_visit_expr(ex->deref.object, sco, folded);
+			break;
+
+		case EX_SETDEREF:
+			ex->setderef.object = ctfe_visit_expr(ex->setderef.object, sco, folded);
+			ex->setderef.value = ctfe_visit_expr(ex->setderef.value, sco, folded);
+			break;
+
+		case EX_NEW:
+		case EX_DISPOSE:
+			ex->alloc.object = ctfe_visit_expr(ex->alloc.object, sco, folded);
+			break;
+
+		default:
+			assert(0);
+	}
+	return ex;
+}
+
+/********** Effect Analysis **********/
+
+/* Classifies every reached procedure by the nonlocal data a call to it may
+ * read or write, directly or through its callees, and annotates each
+ * expression with what evaluating it may do. Something is nonlocal to a
+ * procedure when it isn't bound in that procedure's own scope. A procedure
+ * referenced other than by calling it escapes. */
+
+int ef_pass(ast_root *ast, object *obj) {
+	vector syms; /* of symbol * (SYM_PROG) */
+	effect root;
+	size_t i, j;
+	int changed = 1;
+	symbol *sym;
+	vec_init(&syms);
+	root.kind = 0;
+	vec_init(&root.reads);
+	vec_init(&root.writes);
+	ef_visit_prog(obj->root_prog, &root, &syms);
+	/* Callee effects, to a fixed point (the sets only grow) */
+	while(changed) {
+		changed = 0;
+		for(i = 0; i < syms.len; i++) {
+			sym = vec_get(&syms, i, symbol);
+			for(j = 0; j < sym->init.prog->callees.len; j++) {
+				changed |= ef_merge(sym->init.prog, &sym->effect, &vec_get(&sym->init.prog->callees, j, symbol)->effect);
+			}
+		}
+	}
+	/* Now that callees are final, annotate expressions */
+	ef_visit_stmt(obj->root_prog->node->body, obj->root_prog, NULL);
+	for(i = 0; i < syms.len; i++) {
+		sym = vec_get(&syms, i, symbol);
+		ef_visit_stmt(sym->init.prog->node->body, sym->init.prog, NULL);
+	}
+	vec_clear(&syms);
+	vec_clear(&root.reads);
+	vec_clear(&root.writes);
+	return 0;
+}
+
+static int ef_add(vector *syms, symbol *sym) {
+	size_t i;
+	for(i = 0; i < syms->len; i++) {
+		if(vec_get(syms, i, symbol) == sym) {
+			return 0;
+		}
+	}
+	vec_insert(syms, syms->len, sym);
+	return 1;
+}
+
+/* Folds the callee's effects into prog's (eff), dropping prog's own locals */
+int ef_merge(program *prog, effect *eff, effect *callee) {
+	size_t i;
+	symbol *sym;
+	int changed = 0;
+	if((eff->kind | (callee->kind & EFF_UNKNOWN)) != eff->kind) {
+		eff->kind |= callee->kind & EFF_UNKNOWN;
+		changed = 1;
+	}
+	for(i = 0; i < callee->reads.len; i++) {
+		sym = vec_get(&callee->reads, i, symbol);
+		if(sym->scope != prog->scope && ef_add(&eff->reads, sym)) {
+			eff->kind |= EFF_READ;
+			changed = 1;
+		}
+	}
+	for(i = 0; i < callee->writes.len; i++) {
+		sym = vec_get(&callee->writes, i, symbol);
+		if(sym->scope != prog->scope && ef_add(&eff->writes, sym)) {
+			eff->kind |= EFF_WRITE;
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
+static void ef_access(program *prog, effect *eff, const char *ident, effect_k kind) {
+	symbol *sym = scope_resolve_name(prog->scope, ident);
+	if(!eff || !sym || sym->kind != SYM_DATA || sym->scope == prog->scope) {
+		return;
+	}
+	if(ef_add(kind == EFF_READ ? &eff->reads : &eff->writes, sym)) {
+		eff->kind |= kind;
+	}
+}
+
+/* Direct effects of prog into eff; collects the reached SYM_PROGs below it */
+void ef_visit_prog(program *prog, effect *eff, vector *syms) {
+	size_t i;
+	symbol *sym;
+	vec_clear(&prog->callees);
+	for(i = 0; i < prog->scope->names.len; i++) {
+		sym = vec_get(&prog->scope->names, i, symbol);
+		if(sym->kind == SYM_DATA && sym->init.expr) {
+			ef_visit_expr(sym->init.expr, prog, eff);
+		}
+	}
+	ef_visit_stmt(prog->node->body, prog, eff);
+	for(i = 0; i < prog->scope->names.len; i++) {
+		sym = vec_get(&prog->scope->names, i, symbol);
+		if(sym->kind == SYM_PROG && sym->init.prog->reached) {
+			vec_insert(syms, syms->len, sym);
+			ef_visit_prog(sym->init.prog, &sym->effect, syms);
+		}
+	}
+}
+
+void ef_visit_stmt(stmt_node *st, program *prog, effect *eff) {
+	size_t i;
+	if(!st) {
+		return;
+	}
+	switch(st->kind) {
+		case ST_EXPR:
+			ef_visit_expr(st->expr.expr, prog, eff);
+			break;
+
+		case ST_WHILE:
+			ef_visit_expr(st->while_.cond, prog, eff);
+			ef_visit_stmt(st->while_.body, prog, eff);
+			break;
+
+		case ST_IF:
+			ef_visit_expr(st->if_.cond, prog, eff);
+			ef_visit_stmt(st->if_.iftrue, prog, eff);
+			ef_visit_stmt(st->if_.iffalse, prog, eff);
+			break;
+
+		case ST_FOR:
+			ef_visit_stmt(st->for_.init, prog, eff);
+			ef_visit_expr(st->for_.cond, prog, eff);
+			ef_visit_stmt(st->for_.post, prog, eff);
+			ef_visit_stmt(st->for_.body, prog, eff);
+			break;
+
+		case ST_ITER:
+			ef_access(prog, eff, st->iter.ident, EFF_WRITE);
+			ef_visit_expr(st->iter.value, prog, eff);
+			ef_visit_stmt(st->iter.body, prog, eff);
+			break;
+
+		case ST_RANGE:
+			ef_access(prog, eff, st->range.ident, EFF_WRITE);
+			ef_visit_expr(st->range.lbound, prog, eff);
+			ef_visit_expr(st->range.ubound, prog, eff);
+			ef_visit_expr(st->range.step, prog, eff);
+			ef_visit_stmt(st->range.body, prog, eff);
+			break;
+
+		case ST_COMPOUND:
+			for(i = 0; i < st->compound.stmts.len; i++) {
+				ef_visit_stmt(vec_get(&st->compound.stmts, i, stmt_node), prog, eff);
+			}
+			break;
+
+		default:
+			assert(0);
+	}
+}
+
+/* Whether ident, seen from prog, is an argument passed by reference */
+static int ef_is_ref(program *prog, const char *ident) {
+	symbol *sym = scope_resolve_name(prog->scope, ident);
+	return sym && sym->kind == SYM_DATA && sym->scope->prog && lay_is_ref(sym->scope->prog, sym);
+}
+
+/* The variable a store into an element or field of ex lands in, NULL if it
+ * goes through a reference (open arrays and slices are views, and var and
+ * const arguments addresses).
+ */
+static expr_node *ef_stored(expr_node *ex, program *prog) {
+	while(ex->kind == EX_INDEX || ex->kind == EX_FIELD) {
+		if(ex->kind == EX_FIELD) {
+			ex = ex->field.object;
+		} else if(type_is_open(ex->index.object->type)) {
+			return NULL;
+		} else {
+			ex = ex->index.object;
+		}
+	}
+	return ex->kind == EX_REF && !ef_is_ref(prog, ex->ref.ident) ? ex : NULL;
+}
+
+/* Sets ex->effects; with eff, also records prog's nonlocal accesses and callees */
+void ef_visit_expr(expr_node *ex, program *prog, effect *eff) {
+	size_t i;
+	symbol *sym;
+	expr_node *param, *root;
+	if(!ex) {
+		return;
+	}
+	switch(ex->kind) {
+		case EX_LIT:
+			ex->effects = 0;
+			break;
+
+		case EX_REF:
+			sym = scope_resolve_name(prog->scope, ex->ref.ident);
+			ex->effects = sym && sym->kind == SYM_DATA ? EFF_READ : 0;
+			if(sym && sym->kind == SYM_PROG) {
+				sym->init.prog->escapes = 1;
+			}
+			if(ef_is_ref(prog, ex->ref.ident)) {
+				ex->effects |= EFF_UNKNOWN;
+			}
+			ef_access(prog, eff, ex->ref.ident, EFF_READ);
+			break;
+
+		case EX_ASSIGN:
+			ef_visit_expr(ex->assign.value, prog, eff);
+			ex->effects = ex->assign.value->effects | EFF_WRITE;
+			if(ef_is_ref(prog, ex->assign.ident)) {
+				ex->effects |= EFF_UNKNOWN;
+				if(eff) eff->kind |= EFF_WRITE | EFF_UNKNOWN;
+			}
+			ef_access(prog, eff, ex->assign.ident, EFF_WRITE);
+			break;
+
+		case EX_INDEX:
+			ef_visit_expr(ex->index.object, prog, eff);
+			ef_visit_expr(ex->index.index, prog, eff);
+			ex->effects = ex->index.object->effects | ex->index.index->effects;
+			break;
+
+		case EX_SETINDEX:
+			ef_visit_expr(ex->setindex.object, prog, eff);
+			ef_visit_expr(ex->setindex.index, prog, eff);
+			ef_visit_expr(ex->setindex.value, prog, eff);
+			ex->effects = ex->setindex.object->effects | ex->setindex.index->effects | ex->setindex.value->effects | EFF_WRITE;
+			if((root = ef_stored(ex->setindex.object, prog))) {
+				ef_access(prog, eff, root->ref.ident, EFF_WRITE);
+			} else {
+				ex->effects |= EFF_UNKNOWN;
+				if(eff) eff->kind |= EFF_WRITE | EFF_UNKNOWN;
+			}
+			break;
+
+		case EX_FIELD:
+			ef_visit_expr(ex->field.object, prog, eff);
+			ex->effects = ex->field.object->effects;
+			break;
+
+		case EX_SETFIELD:
+			ef_visit_expr(ex->setfield.object, prog, eff);
+			ef_visit_expr(ex->setfield.value, prog, eff);
+			ex->effects = ex->setfield.object->effects | ex->setfield.value->effects | EFF_WRITE;
+			if((root = ef_stored(ex->setfield.object, prog))) {
+				ef_access(prog, eff, root->ref.ident, EFF_WRITE);
+			} else {
+				ex->effects |= EFF_UNKNOWN;
+				if(eff) eff->kind |= EFF_WRITE | EFF_UNKNOWN;
+			}
+			break;
+
+		case EX_CALL:
+			/* Calling by name isn't taking the address */
+			sym = ex->call.func->kind == EX_REF ? scope_resolve_name(prog->scope, ex->call.func->ref.ident) : NULL;
+			if(sym && sym->kind == SYM_PROG) {
+				ex->call.func->effects = 0;
+			} else {
+				ef_visit_expr(ex->call.func, prog, eff);
+			}
+			ex->effects = ex->call.func->effects;
+			for(i = 0; i < ex->call.params.len; i++) {
+				param = vec_get(&ex->call.params, i, expr_node);
+				ef_visit_expr(param, prog, eff);
+				ex->effects |= param->effects;
+				/* Passing by reference takes the address, like @ */
+				if(sym && sym->kind == SYM_PROG && i < sym->init.prog->node->args.len && lay_by_ref(sym->init.prog, i)) {
+					ex->effects |= EFF_READ | EFF_UNKNOWN;
+					if(eff) eff->kind |= EFF_READ | EFF_UNKNOWN;
+					if(vec_get(&sym->init.prog->node->args, i, decl_node)->mode == ARG_VAR && (root = ef_stored(param, prog))) {
+						ex->effects |= EFF_WRITE;
+						ef_access(prog, eff, root->ref.ident, EFF_WRITE);
+					}
+				}
+			}
+			if(sym && sym->kind == SYM_PROG) {
+				ex->effects |= sym->effect.kind;
+				if(eff) ef_add(&prog->callees, sym);
+			} else {
+				ex->effects |= EFF_READ | EFF_WRITE | EFF_UNKNOWN;
+				if(eff) eff->kind |= EFF_READ | EFF_WRITE | EFF_UNKNOWN;
+			}
+			break;
+
+		case EX_UNOP:
+			ef_visit_expr(ex->unop.expr, prog, eff);
+			ex->effects = ex->unop.expr->effects;
+			break;
+
+		case EX_BINOP:
+			ef_visit_expr(ex->binop.left, prog, eff);
+			ef_visit_expr(ex->binop.right, prog, eff);
+			ex->effects = ex->binop.left->effects | ex->binop.right->effects;
+			break;
+
+		case EX_RETURN:
+			/* The result slot is in the callee's own frame */
+			ef_visit_expr(ex->return_.value, prog, eff);
+			ex->effects = ex->return_.value->effects | EFF_WRITE;
+			break;
+
+		case EX_IND:
+			ef_visit_expr(ex->ind.lvalue, prog, eff);
+			ex->effects = ex->ind.lvalue->effects | EFF_READ | EFF_UNKNOWN;
+			if(eff) eff->kind |= EFF_READ | EFF_UNKNOWN;
+			break;
+
+		case EX_SLICE:
+			/* Like taking an address: what is done through the view isn't
+			 * attributed to the variable */
+			ef_visit_expr(ex->slice.object, prog, eff);
+			ef_visit_expr(ex->slice.lbound, prog, eff);
+			ef_visit_expr(ex->slice.ubound, prog, eff);
+			ex->effects = ex->slice.object->effects | ex->slice.lbound->effects | ex->slice.ubound->effects | EFF_READ | EFF_UNKNOWN;
+			if(eff) eff->kind |= EFF_READ | EFF_UNKNOWN;
+			break;
+
+		case EX_SETLENGTH:
+			ef_visit_expr(ex->setlength.object, prog, eff);
+			ef_visit_expr(ex->setlength.value, prog, eff);
+			ex->effects = ex->setlength.object->effects | ex->setlength.value->effects | EFF_WRITE;
+			if(ex->setlength.object->kind == EX_REF) {
+				ef_access(prog, eff, ex->setlength.object->ref.ident, EFF_WRITE);
+			}
+			break;
+
+		/* The heap is reached by no name */
+		case EX_DEREF:
+			ef_visit_expr(ex->deref.object, prog, eff);
+			ex->effects = ex->deref.object->effects | EFF_READ | EFF_UNKNOWN;
+			if(eff) eff->kind |= EFF_READ | EFF_UNKNOWN;
+			break;
+
+		case EX_SETDEREF:
+			ef_visit_expr(ex->setderef.object, prog, eff);
+			ef_visit_expr(ex->setderef.value, prog, eff);
+			ex->effects = ex->setderef.object->effects | ex->setderef.value->effects | EFF_WRITE | EFF_UNKNOWN;
+			if(eff) eff->kind |= EFF_WRITE | EFF_UNKNOWN;
+			break;
+
+		case EX_NEW:
+			ef_visit_expr(ex->alloc.object, prog, eff);
+			ex->effects = ex->alloc.object->effects | EFF_WRITE;
+			if((root = ef_stored(ex->alloc.object, prog))) {
+				ef_access(prog, eff, root->ref.ident, EFF_WRITE);
+			} else {
+				ex->effects |= EFF_UNKNOWN;
+				if(eff) eff->kind |= EFF_WRITE | EFF_UNKNOWN;
+			}
+			break;
+
+		case EX_DISPOSE:
+			ef_visit_expr(ex->alloc.object, prog, eff);
+			ex->effects = ex->alloc.object->effects | EFF_WRITE | EFF_UNKNOWN;
+			if(eff) eff->kind |= EFF_WRITE | EFF_UNKNOWN;
+			break;
+
+		case EX_SET:
+			ex->effects = 0;
+			for(i = 0; i < ex->set.items.len; i++) {
+				param = vec_get(&ex->set.items, i, expr_node);
+				ef_visit_expr(param, prog, eff);
+				ex->effects |= param->effects;
+			}
+			break;
+
+		default:
+			assert(0);
+	}
+}
+
+/********** Static Frames **********/
+
+/* Builds the call graph of the reached programs and finds its strongly
+ * connected components (Tarjan). A program in no cycle is never active twice
+ * at once, so, Fortran-style, its frame can be static: lay puts it in an
+ * overlay shared by all such frames, where it need only avoid the frames of
+ * what may be active beneath it. A call through a value may enter any
+ * escaped program; those keep their stack frames, since such a caller can't
+ * tell where to store their arguments. So does one that takes an aggregate
+ * by value: arguments to a static frame wait until all are evaluated (see
+ * ir_call), and an aggregate has nowhere to wait.
+ */
+
+typedef struct _sf_state {
+	vector progs; /* of program * (unowned), reached */
+	vector effs; /* of effect *, by position in progs; NULL for the root */
+	size_t *index; /* by position in progs, in visiting order from 1; 0 until visited */
+	size_t *low;
+	vector stack; /* of program * (unowned), visited and in no component yet */
+	size_t next;
+	size_t sccs;
+	vector *order; /* the object's progs */
+} sf_state;
+
+static void sf_collect(sf_state *st, program *prog, effect *eff) {
+	size_t i;
+	symbol *sym;
+	vec_insert(&st->progs, st->progs.len, prog);
+	vec_insert(&st->effs, st->effs.len, eff);
+	for(i = 0; i < prog->scope->names.len; i++) {
+		sym = vec_get(&prog->scope->names, i, symbol);
+		if(sym->kind == SYM_PROG && sym->init.prog->reached) {
+			sf_collect(st, sym->init.prog, &sym->effect);
+		}
+	}
+}
+
+/* Direct callees, and every escaped program if it may call through a
+ * value; ef doesn't keep the root's effects, so the root is assumed to
+ * have unknown ones and to call every escaped program
+ */
+static void sf_edges(sf_state *st, size_t v) {
+	program *prog = vec_get(&st->progs, v, program), *callee;
+	effect *eff = vec_get(&st->effs, v, effect);
+	size_t i;
+	vec_clear(&prog->calls);
+	for(i = 0; i < prog->callees.len; i++) {
+		callee = vec_get(&prog->callees, i, symbol)->init.prog;
+		if(vec_search(&prog->calls, callee) < 0) {
+			vec_insert(&prog->calls, prog->calls.len, callee);
+		}
+	}
+	if(eff && !(eff->kind & EFF_UNKNOWN)) {
+		return;
+	}
+	for(i = 0; i < st->progs.len; i++) {
+		callee = vec_get(&st->progs, i, program);
+		if(callee->escapes && vec_search(&prog->calls, callee) < 0) {
+			vec_insert(&prog->calls, prog->calls.len, callee);
+		}
+	}
+}
+
+static int sf_by_value(program *prog) {
+	size_t i;
+	symbol *sym;
+	type *ty;
+	for(i = 0; i < prog->node->args.len; i++) {
+		sym = scope_resolve_name(prog->scope, vec_get(&prog->node->args, i, decl_node)->ident);
+		ty = sym ? stb_resolve_type(sym->type, prog->scope) : NULL;
+		if(ty && !lay_by_ref(prog, i) && type_size(ty) >= 0 && type_reg_class(ty) < 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Components complete callees first, so each is put in front of the order */
+static void sf_connect(sf_state *st, size_t v) {
+	program *prog = vec_get(&st->progs, v, program), *w;
+	size_t i, n;
+	ssize_t u;
+	int recursive;
+	st->index[v] = st->low[v] = ++st->next;
+	vec_insert(&st->stack, st->stack.len, prog);
+	for(i = 0; i < prog->calls.len; i++) {
+		u = vec_search(&st->progs, vec_get(&prog->calls, i));
+		if(u < 0) {
+			pass_error("%s calls unreached %s (BUG)", prog->node->ident, vec_get(&prog->calls, i, program)->node->ident);
+		}
+		if(!st->index[u]) {
+			sf_connect(st, u);
+			st->low[v] = min(st->low[v], st->low[u]);
+		} else if(vec_search(&st->stack, vec_get(&st->progs, u)) >= 0) {
+			st->low[v] = min(st->low[v], st->index[u]);
+		}
+	}
+	if(st->low[v] != st->index[v]) {
+		return;
+	}
+	n = st->order->len;
+	do {
+		w = vec_remove(&st->stack, st->stack.len - 1);
+		w->scc = st->sccs;
+		vec_insert(st->order, 0, w);
+	} while(w != prog);
+	recursive = st->order->len - n > 1 || vec_search(&prog->calls, prog) >= 0;
+	for(i = 0; i < st->order->len - n; i++) {
+		w = vec_get(st->order, i, program);
+		w->recursive = recursive;
+		w->static_frame = !recursive && !w->escapes && !sf_by_value(w);
+	}
+	st->sccs++;
+}
+
+/* Releases sf's state; deferred, since a pass_error in sf_connect leaves it */
+static void sf_free_state(sf_state *st) {
+	free(st->index);
+	free(st->low);
+	vec_clear(&st->progs);
+	vec_clear(&st->effs);
+	vec_clear(&st->stack);
+	free(st);
+}
+
+int sf_pass(ast_root *ast, object *obj) {
+	sf_state *st = malloc(sizeof(sf_state));
+	size_t i;
+	assert(st);
+	vec_init(&st->progs);
+	vec_init(&st->effs);
+	vec_init(&st->stack);
+	st->index = st->low = NULL;
+	pass_defer((void (*)(void *)) sf_free_state, st);
+	sf_collect(st, obj->root_prog, NULL);
+	for(i = 0; i < st->progs.len; i++) {
+		sf_edges(st, i);
+	}
+	st->index = calloc(st->progs.len, sizeof(size_t));
+	st->low = calloc(st->progs.len, sizeof(size_t));
+	assert(st->index && st->low);
+	st->next = 0;
+	st->sccs = 0;
+	st->order = &obj->progs;
+	vec_clear(&obj->progs);
+	for(i = 0; i < st->progs.len; i++) {
+		if(!st->index[i]) {
+			sf_connect(st, i);
+		}
+	}
+	return 0;
+}
+
+/********** Capture Analysis **********/
+
+/* Decides how each reached procedure gets at the enclosing frames it uses,
+ * instead of having every procedure maintain and read the global display:
+ * CAP_NONE when it uses none; CAP_LINK or CAP_LIFT, whichever cap_choose
+ * estimates cheaper; CAP_DISPLAY when its address is taken, since callers
+ * through a value can't supply hidden arguments. A procedure maintains its
+ * display entry only if a CAP_DISPLAY one reads it. Static frames (see sf)
+ * are at fixed addresses, so they are never captured.
+ */
+
+typedef struct _cap_info {
+	symbol *sym; /* SYM_PROG; NULL for the root */
+	program *prog;
+	vector direct; /* of program * (unowned), enclosing frames the body uses */
+	size_t uses; /* accesses to enclosing data */
+} cap_info;
+
+static int cap_add(vector *v, void *x) {
+	if(vec_search(v, x) >= 0) {
+		return 0;
+	}
+	vec_insert(v, v->len, x);
+	return 1;
+}
+
+/* The program prog is declared in */
+static program *cap_parent(program *prog) {
+	scope *sco;
+	for(sco = prog->scope->parent; sco && !sco->prog; sco = sco->parent);
+	return sco ? sco->prog : NULL;
+}
+
+static program *cap_owner(symbol *sym) {
+	return sym->scope ? sym->scope->prog : NULL;
+}
+
+/* Levels from prog up to the enclosing outer */
+static size_t cap_depth(program *prog, program *outer) {
+	size_t d;
+	for(d = 0; prog && prog != outer; prog = cap_parent(prog), d++);
+	return d;
+}
+
+static void cap_collect(program *prog, symbol *psym, vector *infos) {
+	size_t i;
+	symbol *sym;
+	cap_info *info = malloc(sizeof(cap_info));
+	assert(info);
+	info->sym = psym;
+	info->prog = prog;
+	vec_init(&info->direct);
+	info->uses = 0;
+	vec_insert(infos, infos->len, info);
+	for(i = 0; i < prog->scope->names.len; i++) {
+		sym = vec_get(&prog->scope->names, i, symbol);
+		if(sym->kind == SYM_PROG && sym->init.prog->reached) {
+			cap_collect(sym->init.prog, sym, infos);
+		}
+	}
+}
+
+static void cap_use(cap_info *info, const char *ident) {
+	symbol *sym = scope_resolve_name(info->prog->scope, ident);
+	program *owner;
+	if(!sym || sym->kind != SYM_DATA || !(owner = cap_owner(sym)) || owner == info->prog || owner->static_frame) {
+		return;
+	}
+	cap_add(&info->direct, owner);
+	info->uses++;
+}
+
+static void cap_visit_expr(expr_node *ex, cap_info *info, vector *infos);
+
+static void cap_visit_stmt(stmt_node *st, cap_info *info, vector *infos) {
+	size_t i;
+	if(!st) {
+		return;
+	}
+	switch(st->kind) {
+		case ST_EXPR:
+			cap_visit_expr(st->expr.expr, info, infos);
+			break;
+
+		case ST_WHILE:
+			cap_visit_expr(st->while_.cond, info, infos);
+			cap_visit_stmt(st->while_.body, info, infos);
+			break;
+
+		case ST_IF:
+			cap_visit_expr(st->if_.cond, info, infos);
+			cap_visit_stmt(st->if_.iftrue, info, infos);
+			cap_visit_stmt(st->if_.iffalse, info, infos);
+			break;
+
+		case ST_FOR:
+			cap_visit_stmt(st->for_.init, info, infos);
+			cap_visit_expr(st->for_.cond, info, infos);
+			cap_visit_stmt(st->for_.post, info, infos);
+			cap_visit_stmt(st->for_.body, info, infos);
+			break;
+
+		case ST_ITER:
+			cap_use(info, st->iter.ident);
+			cap_visit_expr(st->iter.value, info, infos);
+			cap_visit_stmt(st->iter.body, info, infos);
+			break;
+
+		case ST_RANGE:
+			cap_use(info, st->range.ident);
+			cap_visit_expr(st->range.lbound, info, infos);
+			cap_visit_expr(st->range.ubound, info, infos);
+			cap_visit_expr(st->range.step, info, infos);
+			cap_visit_stmt(st->range.body, info, infos);
+			break;
+
+		case ST_COMPOUND:
+			for(i = 0; i < st->compound.stmts.len; i++) {
+				cap_visit_stmt(vec_get(&st->compound.stmts, i, stmt_node), info, infos);
+			}
+			break;
+
+		default:
+			assert(0);
+	}
+}
+
+static void cap_visit_expr(expr_node *ex, cap_info *info, vector *infos) {
+	size_t i;
+	symbol *sym;
+	if(!ex) {
+		return;
+	}
+	switch(ex->kind) {
+		case EX_LIT:
+			break;
+
+		case EX_REF:
+			cap_use(info, ex->ref.ident);
+			break;
+
+		case EX_ASSIGN:
+			cap_use(info, ex->assign.ident);
+			cap_visit_expr(ex->assign.value, info, infos);
+			break;
+
+		case EX_INDEX:
+			cap_visit_expr(ex->index.object, info, infos);
+			cap_visit_expr(ex->index.index, info, infos);
+			break;
+
+		case EX_SETINDEX:
+			cap_visit_expr(ex->setindex.object, info, infos);
+			cap_visit_expr(ex->setindex.index, info, infos);
+			cap_visit_expr(ex->setindex.value, info, infos);
+			break;
+
+		case EX_FIELD:
+			cap_visit_expr(ex->field.object, info, infos);
+			break;
+
+		case EX_SETFIELD:
+			cap_visit_expr(ex->setfield.object, info, infos);
+			cap_visit_expr(ex->setfield.value, info, infos);
+			break;
+
+		case EX_CALL:
+			/* Calling by name isn't taking the address */
+			sym = ex->call.func->kind == EX_REF ? scope_resolve_name(info->prog->scope, ex->call.func->ref.ident) : NULL;
+			if(!sym || sym->kind != SYM_PROG) {
+				cap_visit_expr(ex->call.func, info, infos);
+			}
+			for(i = 0; i < ex->call.params.len; i++) {
+				cap_visit_expr(vec_get(&ex->call.params, i, expr_node), info, infos);
+			}
+			break;
+
+		case EX_UNOP:
+			cap_visit_expr(ex->unop.expr, info, infos);
+			break;
+
+		case EX_BINOP:
+			cap_visit_expr(ex->binop.left, info, infos);
+			cap_visit_expr(ex->binop.right, info, infos);
+			break;
+
+		case EX_RETURN:
+			cap_visit_expr(ex->return_.value, info, infos);
+			break;
+
+		case EX_IND:
+			cap_visit_expr(ex->ind.lvalue, info, infos);
+			break;
+
+		case EX_SLICE:
+			cap_visit_expr(ex->slice.object, info, infos);
+			cap_visit_expr(ex->slice.lbound, info, infos);
+			cap_visit_expr(ex->slice.ubound, info, infos);
+			break;
+
+		case EX_SETLENGTH:
+			cap_visit_expr(ex->setlength.object, info, infos);
+			cap_visit_expr(ex->setlength.value, info, infos);
+			break;
+
+		case EX_DEREF:
+			cap_visit_expr(ex->deref.object, info, infos);
+			break;
+
+		case EX_SETDEREF:
+			cap_visit_expr(ex->setderef.object, info, infos);
+			cap_visit_expr(ex->setderef.value, info, infos);
+			break;
+
+		case EX_NEW:
+		case EX_DISPOSE:
+			cap_visit_expr(ex->alloc.object, info, infos);
+			break;
+
+		case EX_SET:
+			for(i = 0; i < ex->set.items.len; i++) {
+				cap_visit_expr(vec_get(&ex->set.items, i, expr_node), info, infos);
+			}
+			break;
+
+		default:
+			assert(0);
+	}
+}
+
+/* Per activation, a static link costs its push plus one load per level
+ * walked up to the farthest frame; lifting costs a push per captured
+ * variable (ef's nonlocal reads and writes, which include what callees
+ * need) plus a load of the address at each use. Ties go to the link.
+ */
+static void cap_choose(cap_info *info) {
+	program *prog = info->prog, *owner;
+	effect *eff;
+	vector *syms[2];
+	size_t i, j, depth = 0;
+	symbol *sym;
+	vec_clear(&prog->lifted);
+	prog->capture = CAP_NONE;
+	if(!info->sym) {
+		return;
+	}
+	if(prog->escapes) {
+		prog->capture = CAP_DISPLAY;
+		return;
+	}
+	eff = &info->sym->effect;
+	syms[0] = &eff->reads;
+	syms[1] = &eff->writes;
+	for(i = 0; i < 2; i++) {
+		for(j = 0; j < syms[i]->len; j++) {
+			sym = vec_get(syms[i], j, symbol);
+			if(!(owner = cap_owner(sym)) || owner == prog || owner->static_frame) {
+				continue;
+			}
+			cap_add(&prog->lifted, sym);
+			depth = max(depth, cap_depth(prog, owner));
+		}
+	}
+	if(!prog->lifted.len && !info->direct.len) {
+		return;
+	}
+	if(prog->lifted.len + info->uses < 1 + depth) {
+		prog->capture = CAP_LIFT;
+	} else {
+		prog->capture = CAP_LINK;
+		vec_clear(&prog->lifted);
+	}
+}
+
+/* The enclosing frames each program must find the base of, for the current
+ * choices: its own accesses (unless lifted), its callees' hidden arguments,
+ * and, for a link, whatever its children's chains walk through it to reach.
+ */
+static void cap_reach(vector *infos) {
+	size_t i, j, k;
+	int changed = 1;
+	cap_info *info;
+	program *prog, *callee, *parent, *owner;
+	for(i = 0; i < infos->len; i++) {
+		vec_clear(&vec_get(infos, i, cap_info)->prog->reaches);
+	}
+	while(changed) {
+		changed = 0;
+		for(i = 0; i < infos->len; i++) {
+			info = vec_get(infos, i, cap_info);
+			prog = info->prog;
+			if(prog->capture == CAP_LINK || prog->capture == CAP_DISPLAY) {
+				for(j = 0; j < info->direct.len; j++) {
+					changed |= cap_add(&prog->reaches, vec_get(&info->direct, j));
+				}
+			}
+			for(j = 0; j < prog->callees.len; j++) {
+				callee = vec_get(&prog->callees, j, symbol)->init.prog;
+				parent = cap_parent(callee);
+				if(callee->capture == CAP_LINK && parent != prog && !parent->static_frame) {
+					changed |= cap_add(&prog->reaches, parent);
+				}
+				if(callee->capture == CAP_LIFT && prog->capture != CAP_LIFT) {
+					for(k = 0; k < callee->lifted.len; k++) {
+						owner = cap_owner(vec_get(&callee->lifted, k, symbol));
+						if(owner != prog) {
+							changed |= cap_add(&prog->reaches, owner);
+						}
+					}
+				}
+			}
+			parent = cap_parent(prog);
+			if(prog->capture == CAP_LINK) {
+				for(j = 0; j < prog->reaches.len; j++) {
+					if(vec_get(&prog->reaches, j) != parent) {
+						changed |= cap_add(&parent->reaches, vec_get(&prog->reaches, j));
+					}
+				}
+			}
+		}
+	}
+}
+
+int cap_pass(ast_root *ast, object *obj) {
+	vector infos; /* of cap_info * */
+	size_t i, j;
+	int changed = 1;
+	cap_info *info;
+	program *prog;
+	vec_init(&infos);
+	cap_collect(obj->root_prog, NULL, &infos);
+	for(i = 0; i < infos.len; i++) {
+		info = vec_get(&infos, i, cap_info);
+		for(j = 0; j < info->prog->scope->names.len; j++) {
+			if(vec_get(&info->prog->scope->names, j, symbol)->kind == SYM_DATA) {
+				cap_visit_expr(vec_get(&info->prog->scope->names, j, symbol)->init.expr, info, &infos);
+			}
+		}
+		cap_visit_stmt(info->prog->node->body, info, &infos);
+	}
+	for(i = 0; i < infos.len; i++) {
+		cap_choose(vec_get(&infos, i, cap_info));
+	}
+	/* Something that must find a frame base can't do without a link; the
+	 * choices only ever move to CAP_LINK, so this ends.
+	 */
+	while(changed) {
+		changed = 0;
+		cap_reach(&infos);
+		for(i = 0; i < infos.len; i++) {
+			prog = vec_get(&infos, i, cap_info)->prog;
+			if((prog->capture == CAP_NONE || prog->capture == CAP_LIFT) && prog->reaches.len) {
+				prog->capture = CAP_LINK;
+				vec_clear(&prog->lifted);
+				changed = 1;
+			}
+		}
+	}
+	for(i = 0; i < infos.len; i++) {
+		vec_get(&infos, i, cap_info)->prog->display = 0;
+	}
+	for(i = 0; i < infos.len; i++) {
+		prog = vec_get(&infos, i, cap_info)->prog;
+		if(prog->capture == CAP_DISPLAY) {
+			for(j = 0; j < prog->reaches.len; j++) {
+				vec_get(&prog->reaches, j, program)->display = 1;
+			}
+		}
+	}
+	for(i = 0; i < infos.len; i++) {
+		info = vec_get(&infos, i, cap_info);
+		vec_clear(&info->direct);
+		free(info);
+	}
+	vec_clear(&infos);
+	return 0;
+}
+
+/********** Escape Analysis **********/
+
+/* Finds the variables whose address may outlive their frame, so that just
+ * those are put on the heap (see lay and ir); the rest stay in the stack or
+ * static frame. An address is only ever held as a view (see rt_array.h):
+ * @x, a slice of x or x passed for an open parameter, and a view is only
+ * stored in an open argument. A var or const argument passed by address
+ * (see lay_by_ref) is followed like an open one. One of x escapes when it is assigned to an
+ * argument of a program x's owner is nested in, passed in a call through a
+ * value, or goes to an open argument that escapes itself. The root's
+ * variables live as long as the program, so they never move; arguments
+ * stay where their caller put them.
+ */
+
+typedef struct _esc_state {
+	vector from; /* of symbol * (unowned): a view of from[i] may be */
+	vector to; /* of symbol * (unowned): stored in open argument to[i] */
+	vector escaping; /* of symbol * (unowned) */
+} esc_state;
+
+/* Whether outer encloses inner, at any depth */
+static int esc_encloses(program *outer, program *inner) {
+	for(inner = inner ? cap_parent(inner) : NULL; inner; inner = cap_parent(inner)) {
+		if(inner == outer) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* The variable whose storage a view made from ex shows; NULL for literals */
+static symbol *esc_root(expr_node *ex, program *prog) {
+	symbol *sym;
+	for(;;) {
+		switch(ex->kind) {
+			case EX_INDEX:
+				ex = ex->index.object;
+				break;
+
+			case EX_FIELD:
+				ex = ex->field.object;
+				break;
+
+			case EX_SLICE:
+				ex = ex->slice.object;
+				break;
+
+			case EX_IND:
+				ex = ex->ind.lvalue;
+				break;
+
+			case EX_REF:
+				sym = scope_resolve_name(prog->scope, ex->ref.ident);
+				return sym && sym->kind == SYM_DATA ? sym : NULL;
+
+			default:
+				return NULL;
+		}
+	}
+}
+
+/* A view made from ex is stored in arg, an open argument (NULL if unknown).
+ * Heap storage is never freed (see esc_pass), so a local stored straight
+ * into an enclosing program's argument is refused rather than moved there.
+ */
+static void esc_flow(esc_state *es, expr_node *ex, symbol *arg, program *prog) {
+	symbol *root = esc_root(ex, prog);
+	program *owner;
+	if(!root) {
+		return;
+	}
+	owner = cap_owner(root);
+	if(arg && esc_encloses(cap_owner(arg), owner) && !lay_is_arg(owner, root)) {
+		pass_record("A view of %s, local to %s, can't be stored in argument %s of %s, which outlives it", root->ident, owner->node->ident, arg->ident, cap_owner(arg)->node->ident);
+		return;
+	}
+	if(!arg || esc_encloses(cap_owner(arg), owner)) {
+		cap_add(&es->escaping, root);
+		return;
+	}
+	vec_insert(&es->from, es->from.len, root);
+	vec_insert(&es->to, es->to.len, arg);
+}
+
+static void esc_visit_expr(esc_state *es, expr_node *ex, program *prog);
+
+static void esc_visit_stmt(esc_state *es, stmt_node *st, program *prog) {
+	size_t i;
+	if(!st) {
+		return;
+	}
+	switch(st->kind) {
+		case ST_EXPR:
+			esc_visit_expr(es, st->expr.expr, prog);
+			break;
+
+		case ST_WHILE:
+			esc_visit_expr(es, st->while_.cond, prog);
+			esc_visit_stmt(es, st->while_.body, prog);
+			break;
+
+		case ST_IF:
+			esc_visit_expr(es, st->if_.cond, prog);
+			esc_visit_stmt(es, st->if_.iftrue, prog);
+			esc_visit_stmt(es, st->if_.iffalse, prog);
+			break;
+
+		case ST_FOR:
+			esc_visit_stmt(es, st->for_.init, prog);
+			esc_visit_expr(es, st->for_.cond, prog);
+			esc_visit_stmt(es, st->for_.post, prog);
+			esc_visit_stmt(es, st->for_.body, prog);
+			break;
+
+		case ST_ITER:
+			esc_visit_expr(es, st->iter.value, prog);
+			esc_visit_stmt(es, st->iter.body, prog);
+			break;
+
+		case ST_RANGE:
+			esc_visit_expr(es, st->range.lbound, prog);
+			esc_visit_expr(es, st->range.ubound, prog);
+			esc_visit_expr(es, st->range.step, prog);
+			esc_visit_stmt(es, st->range.body, prog);
+			break;
+
+		case ST_COMPOUND:
+			for(i = 0; i < st->compound.stmts.len; i++) {
+				esc_visit_stmt(es, vec_get(&st->compound.stmts, i, stmt_node), prog);
+			}
+			break;
+
+		default:
+			assert(0);
+	}
+}
+
+/* The sinks are assignments to open arguments, which rebind them, and the
+ * open parameters of calls; assigning to a dynamic array copies.
+ */
+static void esc_visit_expr(esc_state *es, expr_node *ex, program *prog) {
+	size_t i;
+	symbol *sym;
+	program *callee = NULL;
+	type *fty;
+	decl_node *decl;
+	if(!ex) {
+		return;
+	}
+	switch(ex->kind) {
+		case EX_LIT:
+		case EX_REF:
+			break;
+
+		case EX_ASSIGN:
+			sym = scope_resolve_name(prog->scope, ex->assign.ident);
+			if(sym && sym->kind == SYM_DATA && type_is_open(stb_resolve_type(sym->type, prog->scope)) && lay_is_arg(cap_owner(sym), sym)) {
+				esc_flow(es, ex->assign.value, sym, prog);
+			}
+			esc_visit_expr(es, ex->assign.value, prog);
+			break;
+
+		case EX_INDEX:
+			esc_visit_expr(es, ex->index.object, prog);
+			esc_visit_expr(es, ex->index.index, prog);
+			break;
+
+		case EX_SETINDEX:
+			esc_visit_expr(es, ex->setindex.object, prog);
+			esc_visit_expr(es, ex->setindex.index, prog);
+			esc_visit_expr(es, ex->setindex.value, prog);
+			break;
+
+		case EX_FIELD:
+			esc_visit_expr(es, ex->field.object, prog);
+			break;
+
+		case EX_SETFIELD:
+			esc_visit_expr(es, ex->setfield.object, prog);
+			esc_visit_expr(es, ex->setfield.value, prog);
+			break;
+
+		case EX_CALL:
+			sym = ex->call.func->kind == EX_REF ? scope_resolve_name(prog->scope, ex->call.func->ref.ident) : NULL;
+			if(sym && sym->kind == SYM_PROG) {
+				callee = sym->init.prog;
+			} else {
+				esc_visit_expr(es, ex->call.func, prog);
+			}
+			fty = stb_resolve_type(ex->call.func->type, prog->scope);
+			for(i = 0; i < ex->call.params.len; i++) {
+				decl = callee && i < callee->node->args.len ? vec_get(&callee->node->args, i, decl_node) : NULL;
+				if((fty && fty->kind == TP_FUNC && i < fty->args.len && type_is_open(stb_resolve_type(vec_get(&fty->args, i, type), prog->scope))) || (decl && lay_by_ref(callee, i))) {
+					esc_flow(es, vec_get(&ex->call.params, i, expr_node), decl ? scope_resolve_name(callee->scope, decl->ident) : NULL, prog);
+				}
+				esc_visit_expr(es, vec_get(&ex->call.params, i, expr_node), prog);
+			}
+			break;
+
+		case EX_UNOP:
+			esc_visit_expr(es, ex->unop.expr, prog);
+			break;
+
+		case EX_BINOP:
+			esc_visit_expr(es, ex->binop.left, prog);
+			esc_visit_expr(es, ex->binop.right, prog);
+			break;
+
+		case EX_RETURN:
+			esc_visit_expr(es, ex->return_.value, prog);
+			break;
+
+		case EX_IND:
+			esc_visit_expr(es, ex->ind.lvalue, prog);
+			break;
+
+		case EX_SLICE:
+			esc_visit_expr(es, ex->slice.object, prog);
+			esc_visit_expr(es, ex->slice.lbound, prog);
+			esc_visit_expr(es, ex->slice.ubound, prog);
+			break;
+
+		case EX_SETLENGTH:
+			esc_visit_expr(es, ex->setlength.object, prog);
+			esc_visit_expr(es, ex->setlength.value, prog);
+			break;
+
+		/* The heap holds no views (see tr_pointee), so nothing flows there */
+		case EX_DEREF:
+			esc_visit_expr(es, ex->deref.object, prog);
+			break;
+
+		case EX_SETDEREF:
+			esc_visit_expr(es, ex->setderef.object, prog);
+			esc_visit_expr(es, ex->setderef.value, prog);
+			break;
+
+		case EX_NEW:
+		case EX_DISPOSE:
+			esc_visit_expr(es, ex->alloc.object, prog);
+			break;
+
+		case EX_SET:
+			for(i = 0; i < ex->set.items.len; i++) {
+				esc_visit_expr(es, vec_get(&ex->set.items, i, expr_node), prog);
+			}
+			break;
+
+		default:
+			assert(0);
+	}
+}
+
+/* Whether sym, a variable of prog, is placed on the heap */
+static int esc_on_heap(program *prog, symbol *sym) {
+	return sym->kind == SYM_DATA && cap_parent(prog) && !lay_is_arg(prog, sym) && vec_search(&prog->escaping, sym) >= 0;
+}
+
+int esc_pass(ast_root *ast, object *obj) {
+	esc_state es;
+	size_t i, j;
+	int changed = 1;
+	program *prog;
+	symbol *sym;
+	vec_init(&es.from);
+	vec_init(&es.to);
+	vec_init(&es.escaping);
+	for(i = 0; i < obj->progs.len; i++) {
+		prog = vec_get(&obj->progs, i, program);
+		vec_clear(&prog->escaping);
+		for(j = 0; j < prog->scope->names.len; j++) {
+			sym = vec_get(&prog->scope->names, j, symbol);
+			if(sym->kind == SYM_DATA) {
+				esc_visit_expr(&es, sym->init.expr, prog);
+			}
+		}
+		esc_visit_stmt(&es, prog->node->body, prog);
+	}
+	/* What is stored in an escaping argument escapes too */
+	while(changed) {
+		changed = 0;
+		for(i = 0; i < es.from.len; i++) {
+			if(vec_search(&es.escaping, vec_get(&es.to, i)) >= 0) {
+				changed |= cap_add(&es.escaping, vec_get(&es.from, i));
+			}
+		}
+	}
+	for(i = 0; i < es.escaping.len; i++) {
+		sym = vec_get(&es.escaping, i, symbol);
+		if((prog = cap_owner(sym))) {
+			vec_insert(&prog->escaping, prog->escaping.len, sym);
+		}
+	}
+	/* Each activation allocates its escaping locals and none frees them.
+	 * Only a program sf couldn't prove is never active twice at once may
+	 * pile them up without bound, so those are the ones worth a warning */
+	for(i = 0; i < es.escaping.len; i++) {
+		sym = vec_get(&es.escaping, i, symbol);
+		if((prog = cap_owner(sym)) && esc_on_heap(prog, sym) && !prog->static_frame) {
+			pass_warning("%s escapes %s, which has no static frame; each call leaves it on the heap for good", sym->ident, prog->node->ident);
+		}
+	}
+	vec_clear(&es.from);
+	vec_clear(&es.to);
+	vec_clear(&es.escaping);
+	return 0;
+}
+
+/********** Location Resolution **********/
+
+/* loc * n; takes loc's reference */
+static location *lr_new_stride(location *loc, ssize_t n) {
+	location *k = loc_new_mem(n), *res = loc_new_stride(loc, k);
+	loc_delete(loc);
+	loc_delete(k);
+	return res;
 }
 
-/********** Location Resolution **********/
-
 int lr_pass(ast_root *ast, object *obj) {
 	size_t gdidx = 0;
+	type *ty;
+	location *loc;
 	lr_visit_prog(obj->root_prog, &gdidx);
-	scope_add_name(obj->root_prog->scope, sym_new_data(SYNAME_GDISP, type_new_array(type_new_int(), 0, gdidx), loc_new_sym(SYNAME_GDISP)));
+	ty = type_new_array(type_scalar(TP_INT), 0, gdidx);
+	loc = loc_new_sym(SYNAME_GDISP);
+	scope_add_name(obj->root_prog->scope, sym_new_data(SYNAME_GDISP, ty, loc));
+	type_delete(ty);
+	loc_delete(loc);
+	return 0;
+}
+
+void lr_visit_prog(program *prog, size_t *gdidx) {
+	size_t i;
+	vector amts;
+	location *gdentry, *gdbase, *fp;
+	vec_init(&amts);
+	prog->gdidx = (*gdidx)++;
+	gdentry = lr_calc_gdentry(prog->gdidx);
+	gdbase = loc_new_ind(gdentry);
+	loc_delete(gdentry);
+	fp = loc_new_reg(REG_FP);
+	vec_insert(&amts, 0, lr_new_stride(loc_new_size(NULL), 2)); /* For ret addr + pushed FP */
+	for(i = 0; i < prog->node->args.len; i++) {
+		symbol *sym = scope_resolve_name(prog->scope, vec_get(&prog->node->args, i, decl_node)->ident);
+		if(!sym) {
+			pass_error("Couldn't resolve argument %s (BUG)", vec_get(&prog->node->args, i, decl_node)->ident);
+		}
+		sym->loc = loc_new_off_vec(fp, &amts);
+		vec_insert(&amts, amts.len, loc_new_size(lay_by_ref(prog, i) ? NULL : sym->type));
+	}
+	vec_foreach(&amts, (vec_iter_f) loc_delete, NULL);
+	vec_clear(&amts);
+	for(i = 0; i < prog->node->decls.len; i++) {
+		decl_node *decl = vec_get(&prog->node->decls, i, decl_node);
+		symbol *sym = scope_resolve_name(prog->scope, decl->ident);
+		if(decl->kind == DECL_TYPE) continue;
+		if(!sym) {
+			pass_error("Couldn't resolve declaration %s (BUG)", decl->ident);
+		}
+		switch(sym->kind) {
+			case SYM_PROG:
+				sym->loc = loc_new_sym(sym->init.prog->node->ident);
+				if(sym->init.prog->reached) {
+					lr_visit_prog(sym->init.prog, gdidx);
+				}
+				break;
+
+			case SYM_DATA:
+				vec_insert(&amts, amts.len, lr_new_stride(loc_new_size(sym->type), -1));
+				sym->loc = loc_new_off_vec(gdbase, &amts);
+				break;
+
+			case SYM_TYPE:
+			case SYM_CONST:
+				break;
+
+			default:
+				assert(0);
+				break;
+		}
+	}
+	vec_foreach(&amts, (vec_iter_f) loc_delete, NULL);
+	vec_clear(&amts);
+	loc_delete(gdbase);
+	loc_delete(fp);
+}
+
+location *lr_calc_gdentry(size_t idx) {
+	location *gdisp = loc_new_sym(SYNAME_GDISP), *k = loc_new_mem(idx), *word = loc_new_size(NULL), *amt, *res;
+	amt = loc_new_stride(k, word);
+	res = loc_new_off(gdisp, amt);
+	loc_delete(gdisp);
+	loc_delete(k);
+	loc_delete(word);
+	loc_delete(amt);
+	return res;
+}
+
+/********** Frame Layout **********/
+
+/* Turns lr's symbolic locations into base + constant displacement for
+ * target_current. Arguments keep their push order, each in a whole stack
+ * slot above the saved FP and return address; locals go below the frame base
+ * sorted by decreasing alignment, which packs them without padding. A static
+ * frame (see sf) has the same shape, minus the return address and saved FP,
+ * at a fixed place in the overlay: programs are laid out callers first, and
+ * each static frame goes above every static frame that may be active beneath
+ * it, the highest of which tops tracks per component. A variable on the heap
+ * keeps just its address in the frame, and is reached through it.
+ */
+
+static effect *lay_effect(program *);
+
+int lay_pass(ast_root *ast, object *obj) {
+	symbol *sym;
+	type *ty;
+	location *loc;
+	program *prog, *callee;
+	size_t i, j, top, *tops = calloc(obj->progs.len, sizeof(size_t));
+	assert(tops || !obj->progs.len);
+	obj->overlay = 0;
+	for(i = 0; i < obj->progs.len; i++) {
+		prog = vec_get(&obj->progs, i, program);
+		top = tops[prog->scc];
+		if(prog->static_frame) {
+			prog->static_off = layout_round(top, target_current->stack_align);
+		}
+		lay_visit_prog(prog, lay_effect(prog));
+		if(prog->static_frame) {
+			top = prog->static_off + prog->frame_size + prog->args_size;
+			obj->overlay = max(obj->overlay, top);
+		}
+		for(j = 0; j < prog->calls.len; j++) {
+			callee = vec_get(&prog->calls, j, program);
+			tops[callee->scc] = max(tops[callee->scc], top);
+		}
+	}
+	free(tops);
+	ty = type_new_array(type_scalar(TP_CHAR), 0, obj->overlay);
+	loc = loc_new_sym(SYNAME_OVERLAY);
+	scope_add_name(obj->root_prog->scope, sym_new_data(SYNAME_OVERLAY, ty, loc));
+	type_delete(ty);
+	loc_delete(loc);
+	sym = scope_resolve_name(obj->root_prog->scope, SYNAME_GDISP);
+	if(sym && sym->loc) {
+		loc = loc_fold(sym->loc);
+		loc_delete(sym->loc);
+		sym->loc = loc;
+	}
+	return 0;
+}
+
+/* Where sym is among prog's arguments, -1 if it isn't one */
+static ssize_t lay_arg_index(program *prog, symbol *sym) {
+	size_t i;
+	for(i = 0; i < prog->node->args.len; i++) {
+		if(string_equal(vec_get(&prog->node->args, i, decl_node)->ident, sym->ident)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int lay_is_arg(program *prog, symbol *sym) {
+	return lay_arg_index(prog, sym) >= 0;
+}
+
+/* ARG_VALUE for anything but a var or const argument */
+static arg_mode_k lay_arg_mode(program *prog, symbol *sym) {
+	ssize_t i = lay_arg_index(prog, sym);
+	return i < 0 ? ARG_VALUE : vec_get(&prog->node->args, i, decl_node)->mode;
+}
+
+/* Whether argument i of prog arrives as the address of the caller's
+ * variable: a var one, or a const one too big for a register. An open
+ * array is a view already, and a const string is passed as one, its bytes
+ * not copied (see ir_make_prologue).
+ */
+static int lay_by_ref(program *prog, size_t i) {
+	decl_node *decl = vec_get(&prog->node->args, i, decl_node);
+	type *ty = stb_resolve_type(decl->type, prog->scope);
+	if(decl->mode == ARG_VALUE || type_is_open(ty)) {
+		return 0;
+	}
+	return decl->mode == ARG_VAR || (ty->kind != TP_STRING && type_reg_class(ty) < 0);
+}
+
+static int lay_is_ref(program *prog, symbol *sym) {
+	ssize_t i = lay_arg_index(prog, sym);
+	return i >= 0 && lay_by_ref(prog, i);
+}
+
+/* What argument i of prog travels as: a word when by reference */
+static type *lay_arg_type(program *prog, size_t i) {
+	if(lay_by_ref(prog, i)) {
+		return type_scalar(TP_INT);
+	}
+	return stb_resolve_type(vec_get(&prog->node->args, i, decl_node)->type, prog->scope);
+}
+
+/* Anything still unsized takes a word */
+static size_t lay_size(type *ty) {
+	ssize_t sz = type_size(ty);
+	return sz < 0 ? target_current->word : sz;
+}
+
+static size_t lay_align(type *ty) {
+	return type_size(ty) < 0 ? target_current->word : type_align(ty);
+}
+
+/* prog's effect, kept on its symbol; NULL for the root */
+static effect *lay_effect(program *prog) {
+	program *parent = cap_parent(prog);
+	symbol *sym;
+	size_t i;
+	for(i = 0; parent && i < parent->scope->names.len; i++) {
+		sym = vec_get(&parent->scope->names, i, symbol);
+		if(sym->kind == SYM_PROG && sym->init.prog == prog) {
+			return &sym->effect;
+		}
+	}
+	return NULL;
+}
+
+/* The frame base: the display entry's value, FP - word when the entry is
+ * saved there and FP otherwise (see am); for a static frame, a fixed
+ * address, right above its locals
+ */
+static location *lay_base(program *prog) {
+	location *gdentry, *ind, *res, *overlay, *amt;
+	if(prog->static_frame) {
+		overlay = loc_new_sym(SYNAME_OVERLAY);
+		amt = loc_new_mem(prog->static_off + prog->frame_size);
+		res = loc_new_off(overlay, amt);
+		loc_delete(overlay);
+		loc_delete(amt);
+		return res;
+	}
+	gdentry = lr_calc_gdentry(prog->gdidx);
+	ind = loc_new_ind(gdentry);
+	res = loc_fold(ind);
+	loc_delete(gdentry);
+	loc_delete(ind);
+	return res;
+}
+
+/* Offset from the frame base of hidden argument k (static link or lifted
+ * address); they sit below the declared arguments, above the return address
+ */
+static size_t lay_hidden(program *prog, size_t k) {
+	if(prog->static_frame) {
+		return k * target_current->word;
+	}
+	return ((prog->display ? 3 : 2) + k) * target_current->word;
+}
+
+/* The register the next argument of type ty travels in, given how many of
+ * each class are taken already (used), or NULL if it is pushed
+ */
+static location *lay_arg_reg(type *ty, size_t *used) {
+	int rc = type_reg_class(ty);
+	if(rc < 0 || used[rc] >= target_current->arg_regs[rc]) {
+		return NULL;
+	}
+	return loc_new_reg_num(rc == RC_REAL ? REG_FARG : REG_ARG, used[rc]++);
+}
+
+static reg_k lay_ret_reg(type *ty) {
+	return type_reg_class(ty) == RC_REAL ? REG_FRV : REG_RV;
+}
+
+/* Whether a program nested in prog, at any depth, may touch sym */
+static int lay_is_captured(program *prog, symbol *sym) {
+	size_t i;
+	symbol *sub;
+	for(i = 0; i < prog->scope->names.len; i++) {
+		sub = vec_get(&prog->scope->names, i, symbol);
+		if(sub->kind != SYM_PROG || !sub->init.prog->reached) {
+			continue;
+		}
+		if(vec_search(&sub->effect.reads, sym) >= 0 || vec_search(&sub->effect.writes, sym) >= 0 || lay_is_captured(sub->init.prog, sym)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* A variable on the heap (see esc) takes a word of the frame, its address,
+ * as does an argument passed by reference
+ */
+static size_t lay_local_size(program *prog, symbol *sym) {
+	return esc_on_heap(prog, sym) || lay_is_ref(prog, sym) ? target_current->word : lay_size(sym->type);
+}
+
+static size_t lay_local_align(program *prog, symbol *sym) {
+	return esc_on_heap(prog, sym) || lay_is_ref(prog, sym) ? target_current->word : lay_align(sym->type);
+}
+
+/* Into locals, keeping it sorted by decreasing alignment (stable) */
+static void lay_add_local(program *prog, vector *locals, symbol *sym) {
+	size_t j;
+	for(j = locals->len; j > 0 && lay_local_align(prog, vec_get(locals, j - 1, symbol)) < lay_local_align(prog, sym); j--);
+	vec_insert(locals, j, sym);
+}
+
+static void lay_set_loc(symbol *sym, location *base, ssize_t disp) {
+	location *amt = loc_new_mem(disp);
+	if(sym->loc) {
+		loc_delete(sym->loc);
+	}
+	sym->loc = disp ? loc_new_off(base, amt) : loc_copy(base);
+	loc_delete(amt);
+}
+
+/* eff is prog's effect, NULL for the root. Scalar arguments that arrive in
+ * registers (see lay_arg_reg) live in temps, unless a nested program may
+ * touch them or their address may be taken (unknown effects), in which case
+ * the prologue stores them in the frame like locals. Arguments passed by
+ * reference (see lay_by_ref) are placed like a word, the address, and
+ * reached through it. The frame is sized before anything is placed, since a
+ * static frame's base depends on it.
+ */
+void lay_visit_prog(program *prog, effect *eff) {
+	size_t i, off, word = target_current->word, used[RC_NCLASSES] = {0};
+	vector locals, stacked;
+	symbol *sym, *result = NULL;
+	location *base, *reg, *slot;
+	type *ret;
+	if(!prog->reached) {
+		return;
+	}
+
+	/* Declaration order (names are newest first), then a stable sort by
+	 * alignment. A scalar function result is kept in a temp; any other
+	 * result slot goes first, carried by a scratch symbol that is in no scope.
+	 */
+	vec_init(&locals);
+	vec_init(&stacked);
+	if(prog->result) {
+		loc_delete(prog->result);
+		prog->result = NULL;
+	}
+	if(prog->node->ret) {
+		ret = stb_resolve_type(prog->node->ret, prog->scope);
+		if(type_reg_class(ret) >= 0) {
+			prog->result = loc_new_temp(NULL);
+		} else {
+			result = sym_new_data(prog->node->ident, ret, NULL);
+			vec_insert(&locals, 0, result);
+		}
+	}
+	for(i = prog->scope->names.len; i-- > 0;) {
+		sym = vec_get(&prog->scope->names, i, symbol);
+		if(sym->kind != SYM_DATA || lay_is_arg(prog, sym) || string_equal(sym->ident, SYNAME_GDISP)) {
+			continue;
+		}
+		lay_add_local(prog, &locals, sym);
+	}
+	for(i = 0; i < prog->node->args.len; i++) {
+		sym = scope_resolve_name(prog->scope, vec_get(&prog->node->args, i, decl_node)->ident);
+		if(!sym) {
+			pass_error("Couldn't resolve argument %s (BUG)", vec_get(&prog->node->args, i, decl_node)->ident);
+		}
+		if(!(reg = lay_arg_reg(lay_arg_type(prog, i), used))) {
+			vec_insert(&stacked, stacked.len, sym);
+			continue;
+		}
+		loc_delete(reg);
+		if(!eff || (eff->kind & EFF_UNKNOWN) || lay_is_captured(prog, sym)) {
+			lay_add_local(prog, &locals, sym);
+		} else {
+			if(sym->loc) {
+				loc_delete(sym->loc);
+			}
+			sym->loc = loc_new_temp(NULL);
+		}
+	}
+	off = 0;
+	for(i = 0; i < locals.len; i++) {
+		sym = vec_get(&locals, i, symbol);
+		off = layout_round(off + lay_local_size(prog, sym), lay_local_align(prog, sym));
+	}
+	prog->frame_size = layout_round(off, target_current->stack_align);
+
+	/* Everything is relative to the frame base, so nested programs can reach
+	 * it; am turns the program's own accesses back into FP. Static frames
+	 * are at fixed addresses already.
+	 */
+	base = lay_base(prog);
+	off = 0;
+	for(i = 0; i < locals.len; i++) {
+		sym = vec_get(&locals, i, symbol);
+		off = layout_round(off + lay_local_size(prog, sym), lay_local_align(prog, sym));
+		lay_set_loc(sym, base, -(ssize_t) off);
+		if(esc_on_heap(prog, sym)) {
+			slot = sym->loc;
+			sym->loc = loc_new_ind(slot);
+			loc_delete(slot);
+		}
+	}
+	off = lay_hidden(prog, prog->capture == CAP_LINK ? 1 : prog->capture == CAP_LIFT ? prog->lifted.len : 0);
+	for(i = 0; i < stacked.len; i++) {
+		sym = vec_get(&stacked, i, symbol);
+		lay_set_loc(sym, base, off);
+		off += lay_is_ref(prog, sym) ? word : layout_round(lay_size(sym->type), word);
+	}
+	prog->args_size = off - lay_hidden(prog, 0);
+	/* Wherever it was put, a by-reference argument's slot holds an address */
+	for(i = 0; i < prog->node->args.len; i++) {
+		if(lay_by_ref(prog, i)) {
+			sym = scope_resolve_name(prog->scope, vec_get(&prog->node->args, i, decl_node)->ident);
+			slot = sym->loc;
+			sym->loc = loc_new_ind(slot);
+			loc_delete(slot);
+		}
+	}
+	loc_delete(base);
+	vec_clear(&locals);
+	vec_clear(&stacked);
+	if(result) {
+		prog->result = loc_copy(result->loc);
+		sym_delete(result);
+	}
+}
+
+/********** Intermediate Representation Generation **********/
+
+int ir_pass(ast_root *ast, object *obj) {
+	block *root = block_new(NULL), *blk;
+	size_t i;
+	instr_number_names(&obj->labels, &obj->data);
+	ir_visit_prog(obj->root_prog, root);
+	instr_number_names(NULL, NULL);
+	obj->block = block_copy(root);
+	obj->frameless = 0;
+	for(i = 0; i < root->children.len; i++) {
+		blk = vec_get(&root->children, i, block);
+		if(blk->kind == BLK_PROG && blk->prog->frameless) {
+			obj->frameless++;
+		}
+	}
 	return 0;
 }
 
-void lr_visit_prog(program *prog, size_t *gdidx) {
+static location *ir_addr(location *loc, block *blk);
+static location *ir_imm(long n, block *blk);
+static location *ir_lit(literal *lit, block *blk);
+static location *ir_binop(location *left, binop_k kind, location *right, block *blk);
+static location *ir_rt_call(char *name, size_t n, location **args, int ret, block *blk);
+static void ir_str_assign(location *dst, expr_node *value, block *blk, scope *sco);
+static void ir_arr_view(expr_node *ex, location **ptr, location **lb, location **len, block *blk, scope *sco);
+static void ir_arr_init(symbol *sym, scope *sco, block *blk);
+
+/* Whether sym is a string variable or argument of prog */
+static int ir_is_string(program *prog, symbol *sym) {
+	type *ty;
+	if(sym->kind != SYM_DATA) {
+		return 0;
+	}
+	ty = stb_resolve_type(sym->type, prog->scope);
+	return ty && ty->kind == TP_STRING;
+}
+
+/* Whether sym is a dynamic array variable of prog, which owns its elements */
+static int ir_is_dynamic(program *prog, symbol *sym) {
+	return sym->kind == SYM_DATA && type_is_open(stb_resolve_type(sym->type, prog->scope)) && !lay_is_arg(prog, sym);
+}
+
+/* A leaf makes no calls, so nothing runs on top of it and SP stays put for
+ * its whole body. Unless something reads its display entry, it can then do
+ * without a frame: its frame base is SP - word (as if FP had been pushed) and
+ * its locals, if they fit, sit in the red zone below SP.
+ */
+static int ir_is_frameless(program *prog, block *body) {
+	size_t i;
+	symbol *sym;
+	if(prog->static_frame || prog->display || (prog->frame_size && prog->frame_size + target_current->word > target_current->red_zone)) {
+		return 0;
+	}
+	for(i = 0; i < body->instrs.len; i++) {
+		if(vec_get(&body->instrs, i, instr)->kind == IN_CALL) {
+			return 0;
+		}
+	}
+	/* Its prologue or epilogue calls the runtime for them */
+	for(i = 0; i < prog->scope->names.len; i++) {
+		sym = vec_get(&prog->scope->names, i, symbol);
+		if(ir_is_string(prog, sym) || ir_is_dynamic(prog, sym) || esc_on_heap(prog, sym)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Each reached program becomes one flat BLK_PROG under the root */
+block *ir_visit_prog(program *prog, block *superblk) {
+	size_t i;
+	symbol *sym;
+	block *blk = block_new_program(superblk, prog), *body;
+	body = ir_visit_stmt(prog->node->body, blk, prog->scope);
+	prog->frameless = ir_is_frameless(prog, body);
+	block_emit(blk, instr_new_label(prog->node->ident));
+	block_append(blk, ir_make_prologue(prog, blk));
+	blk->body = blk->instrs.len;
+	block_append(blk, body);
+	block_append(blk, ir_make_epilogue(prog, blk));
+	for(i = prog->scope->names.len; i-- > 0;) {
+		sym = vec_get(&prog->scope->names, i, symbol);
+		if(sym->kind == SYM_PROG && sym->init.prog->reached) {
+			ir_visit_prog(sym->init.prog, superblk);
+		}
+	}
+	return blk;
+}
+
+/* base+disp as a new reference */
+static location *ir_off(location *base, ssize_t disp) {
+	location *amt, *res;
+	if(!disp) {
+		return loc_copy(base);
+	}
+	amt = loc_new_mem(disp);
+	res = loc_new_off(base, amt);
+	loc_delete(amt);
+	return res;
+}
+
+/* A temp holding the value at loc, read as num; a temp already holds one */
+static location *ir_load(location *loc, num_k num, block *blk) {
+	location *ta;
+	if(loc->kind == LOC_TEMP) {
+		return loc_copy(loc);
+	}
+	ta = loc_new_temp(NULL);
+	block_emit(blk, instr_new_set_num(ta, num, loc));
+	return ta;
+}
+
+/* A temp holding the word at loc */
+static location *ir_value(location *loc, block *blk) {
+	return ir_load(loc, NUM_WORD, blk);
+}
+
+/* How a value of type ty is stored and computed (see num_k); integer is as
+ * wide as a word (see layout.c)
+ */
+static num_k ir_num(type *ty) {
+	switch(ty ? ty->kind : TP_FUNC) {
+		case TP_INT:
+			switch(ty->width) {
+				case 1:
+					return NUM_I8;
+				case 2:
+					return NUM_I16;
+				case 4:
+					return NUM_I32;
+				default:
+					return NUM_WORD;
+			}
+
+		case TP_REAL:
+			return ty->width == 4 ? NUM_F32 : NUM_F64;
+
+		case TP_CHAR:
+		case TP_BOOL:
+			return NUM_U8;
+
+		default:
+			return NUM_WORD;
+	}
+}
+
+/* loc, a value of type from, as one of type to. tr lets scalars be cast
+ * implicitly (or with a warning) wherever a value is expected, and this is
+ * where that becomes code: a temp holding the converted value, or loc
+ * itself (a new reference) when both are stored alike.
+ */
+static location *ir_conv(location *loc, type *from, type *to, block *blk, scope *sco) {
+	location *res;
+	num_k nf, nt;
+	from = stb_resolve_type(from, sco);
+	to = stb_resolve_type(to, sco);
+	if(!type_is_scalar(from) || !type_is_scalar(to) || (nf = ir_num(from)) == (nt = ir_num(to))) {
+		return loc_copy(loc);
+	}
+	res = loc_new_temp(NULL);
+	block_emit(blk, instr_new_conv(res, nt, loc, nf));
+	return res;
+}
+
+/* ex evaluated at the end of blk, as a value of type to; literals are
+ * converted here and now
+ */
+static location *ir_visit_as(expr_node *ex, type *to, block *blk, scope *sco) {
+	ir_ev_res x;
+	literal *lit;
+	location *res;
+	type *rto = stb_resolve_type(to, sco);
+	if(ex->kind == EX_LIT && type_is_scalar(stb_resolve_type(ex->type, sco)) && type_is_scalar(rto)) {
+		lit = lit_cast(ex->lit.lit, rto);
+		res = ir_lit(lit, blk);
+		lit_delete(lit);
+		return res;
+	}
+	x = ir_visit_expr(ex, blk, sco);
+	block_append(blk, x.block);
+	res = ir_conv(x.loc, ex->type, to, blk, sco);
+	loc_delete(x.loc);
+	return res;
+}
+
+/* A temp holding scalar ex as a word, for the IR's own arithmetic */
+static location *ir_visit_word(expr_node *ex, block *blk, scope *sco) {
+	location *ta = ir_visit_as(ex, type_scalar(TP_INT), blk, sco), *res = ir_value(ta, blk);
+	loc_delete(ta);
+	return res;
+}
+
+/* Stores val, a value of type ty, at loc: a SET in ty's class, or a COPY of
+ * its bytes for a record or fixed array, which no register holds
+ */
+static void ir_store(location *loc, type *ty, location *val, block *blk, scope *sco) {
+	ty = stb_resolve_type(ty, sco);
+	if(type_reg_class(ty) < 0) {
+		block_emit(blk, instr_new_copy(loc, val, lay_size(ty)));
+	} else {
+		block_emit(blk, instr_new_set_num(loc, ir_num(ty), val));
+	}
+}
+
+/* Where sym is, seen from code in sco: a lifted variable through the
+ * address in its hidden argument, anything else where lay put it
+ */
+static location *ir_sym_loc(symbol *sym, scope *sco) {
+	program *prog;
+	location *base, *slot, *res;
+	size_t k;
+	for(; sco && !sco->prog; sco = sco->parent);
+	prog = sco ? sco->prog : NULL;
+	for(k = 0; prog && prog->capture == CAP_LIFT && k < prog->lifted.len; k++) {
+		if(vec_get(&prog->lifted, k, symbol) == sym) {
+			base = lay_base(prog);
+			slot = ir_off(base, lay_hidden(prog, k));
+			res = loc_new_ind(slot);
+			loc_delete(base);
+			loc_delete(slot);
+			return res;
+		}
+	}
+	return loc_copy(sym->loc);
+}
+
+/* The frame base is just below the saved FP, where the old display entry is
+ * saved if this program maintains its own. A static frame needs neither:
+ * its callers store its stack arguments in place (see ir_call). String
+ * variables start out empty in their inline bytes, or as their initializer,
+ * and string arguments take a copy of the caller's bytes, unless var or
+ * const: those are the caller's. Dynamic arrays
+ * start out empty, with no storage, or as their initializer. Variables that
+ * escape (see esc) get their storage from rt_new (see rt_alloc.h) before
+ * any of that, uninitialized like the frame.
+ */
+block *ir_make_prologue(program *prog, block *pblk) {
+	block *blk = block_new(pblk);
+	location *gdentry = lr_calc_gdentry(prog->gdidx);
+	location *fp = loc_new_reg(REG_FP), *sp = loc_new_reg(REG_SP), *frame, *reg, *ta, *small, *len, *size;
+	size_t i, used[RC_NCLASSES] = {0};
+	symbol *sym;
+	if(!prog->frameless && !prog->static_frame) {
+		block_emit(blk, instr_new_push(fp));
+		block_emit(blk, instr_new_set(fp, sp));
+		if(prog->display) {
+			block_emit(blk, instr_new_push(gdentry));
+			block_emit(blk, instr_new_set(gdentry, sp));
+		}
+		if(prog->frame_size) {
+			frame = ir_off(sp, -(ssize_t) prog->frame_size);
+			block_emit(blk, instr_new_laddr(sp, frame));
+			loc_delete(frame);
+		}
+	}
+	/* Register arguments to wherever lay put them */
+	for(i = 0; i < prog->node->args.len; i++) {
+		sym = scope_resolve_name(prog->scope, vec_get(&prog->node->args, i, decl_node)->ident);
+		if((reg = lay_arg_reg(lay_arg_type(prog, i), used))) {
+			if(lay_by_ref(prog, i)) {
+				block_emit(blk, instr_new_set(sym->loc->ind.addr, reg));
+			} else {
+				block_emit(blk, instr_new_set_num(sym->loc, ir_num(lay_arg_type(prog, i)), reg));
+			}
+			loc_delete(reg);
+		}
+	}
+	for(i = prog->scope->names.len; i-- > 0;) {
+		sym = vec_get(&prog->scope->names, i, symbol);
+		if(esc_on_heap(prog, sym)) {
+			size = ir_imm(lay_size(stb_resolve_type(sym->type, prog->scope)), blk);
+			ta = ir_rt_call("rt_new", 1, &size, 1, blk);
+			block_emit(blk, instr_new_set(sym->loc->ind.addr, ta));
+			loc_delete(size);
+			loc_delete(ta);
+		}
+	}
+	for(i = prog->scope->names.len; i-- > 0;) {
+		sym = vec_get(&prog->scope->names, i, symbol);
+		if(ir_is_dynamic(prog, sym)) {
+			ir_arr_init(sym, prog->scope, blk);
+			continue;
+		}
+		if(!ir_is_string(prog, sym)) {
+			continue;
+		}
+		if(lay_is_arg(prog, sym)) {
+			if(lay_arg_mode(prog, sym) == ARG_VALUE) {
+				ta = ir_addr(sym->loc, blk);
+				ir_rt_call("rt_str_own", 1, &ta, 0, blk);
+				loc_delete(ta);
+			}
+			continue;
+		}
+		small = ir_off(sym->loc, 2 * target_current->word);
+		ta = ir_addr(small, blk);
+		block_emit(blk, instr_new_set(sym->loc, ta));
+		loc_delete(ta);
+		loc_delete(small);
+		len = ir_off(sym->loc, target_current->word);
+		ta = ir_imm(0, blk);
+		block_emit(blk, instr_new_set(len, ta));
+		loc_delete(ta);
+		loc_delete(len);
+		if(sym->init.expr) {
+			ir_str_assign(sym->loc, sym->init.expr, blk, prog->scope);
+		}
+	}
+	loc_delete(gdentry);
+	loc_delete(fp);
+	loc_delete(sp);
+	return blk;
+}
+
+/* Strings and dynamic arrays are released first, since that takes calls.
+ * Not those that escape: a view may still show their storage, so it stays,
+ * like the variable itself, for the rest of the run (a documented
+ * restriction, see LANGUAGE.md). Nor var and const string arguments, which
+ * are the caller's.
+ */
+block *ir_make_epilogue(program *prog, block *pblk) {
+	block *blk = block_new(pblk);
+	location *gdentry = lr_calc_gdentry(prog->gdidx);
+	location *fp = loc_new_reg(REG_FP), *sp = loc_new_reg(REG_SP), *rv, *ta;
+	symbol *sym;
+	size_t i;
+	for(i = 0; i < prog->scope->names.len; i++) {
+		sym = vec_get(&prog->scope->names, i, symbol);
+		if((ir_is_string(prog, sym) || ir_is_dynamic(prog, sym)) && !esc_on_heap(prog, sym) && lay_arg_mode(prog, sym) == ARG_VALUE) {
+			ta = ir_addr(sym->loc, blk);
+			ir_rt_call(ir_is_string(prog, sym) ? "rt_str_free" : "rt_arr_free", 1, &ta, 0, blk);
+			loc_delete(ta);
+		}
+	}
+	rv = loc_new_reg(prog->node->ret ? lay_ret_reg(stb_resolve_type(prog->node->ret, prog->scope)) : REG_RV);
+	if(prog->result) {
+		block_emit(blk, instr_new_set_num(rv, ir_num(stb_resolve_type(prog->node->ret, prog->scope)), prog->result));
+	}
+	if(prog->frameless || prog->static_frame) {
+		/* Nothing to undo */
+	} else if(prog->display) {
+		block_emit(blk, instr_new_set(sp, gdentry));
+		block_emit(blk, instr_new_pop(gdentry));
+	} else {
+		block_emit(blk, instr_new_set(sp, fp));
+	}
+	if(!prog->frameless && !prog->static_frame) {
+		block_emit(blk, instr_new_pop(fp));
+	}
+	block_emit(blk, instr_new_return(prog->result ? rv : NULL));
+	loc_delete(gdentry);
+	loc_delete(fp);
+	loc_delete(sp);
+	loc_delete(rv);
+	return blk;
+}
+
+block *ir_visit_stmt(stmt_node *st, block *pblk, scope *sco) {
+	size_t i;
+	block *blk = block_new(pblk), *a, *b, *c;
+	ir_ev_res x, y, z;
+	instr *la, *lb;
+	location *ta, *tb, *tc, *td;
+	symbol *sa;
+	num_k num;
+	switch(st->kind) {
+		case ST_EXPR:
+			x = ir_visit_expr(st->expr.expr, blk, sco);
+			block_append(blk, x.block);
+			if(x.loc) {
+				loc_delete(x.loc);
+			}
+			break;
+
+		case ST_WHILE:
+			la = instr_new_label(NULL);
+			lb = instr_new_label(NULL);
+			block_emit(blk, la);
+			x = ir_visit_expr(st->while_.cond, blk, sco);
+			block_append(blk, x.block);
+			ta = loc_new_temp(NULL);
+			block_emit(blk, instr_new_unop_num(ta, NUM_U8, OP_NOT, x.loc));
+			block_emit(blk, instr_new_jumpif(lb, ta));
+			loc_delete(ta);
+			loc_delete(x.loc);
+			a = ir_visit_stmt(st->while_.body, blk, sco);
+			block_append(blk, a);
+			block_emit(blk, instr_new_jump(la));
+			block_emit(blk, lb);
+			break;
+
+		case ST_IF:
+			x = ir_visit_expr(st->if_.cond, blk, sco);
+			la = instr_new_label(NULL);
+			block_append(blk, x.block);
+			ta = loc_new_temp(NULL);
+			block_emit(blk, instr_new_unop_num(ta, NUM_U8, OP_NOT, x.loc));
+			block_emit(blk, instr_new_jumpif(la, ta));
+			loc_delete(ta);
+			loc_delete(x.loc);
+			a = ir_visit_stmt(st->if_.iftrue, blk, sco);
+			block_append(blk, a);
+			if(st->if_.iffalse) {
+				lb = instr_new_label(NULL);
+				block_emit(blk, instr_new_jump(lb));
+				block_emit(blk, la);
+				b = ir_visit_stmt(st->if_.iffalse, blk, sco);
+				block_append(blk, b);
+				block_emit(blk, lb);
+			} else {
+				block_emit(blk, la);
+			}
+			break;
+
+		case ST_FOR:
+			a = ir_visit_stmt(st->for_.init, blk, sco);
+			block_append(blk, a);
+			la = instr_new_label(NULL);
+			lb = instr_new_label(NULL);
+			block_emit(blk, lb);
+			x = ir_visit_expr(st->for_.cond, blk, sco);
+			block_append(blk, x.block);
+			ta = loc_new_temp(NULL);
+			block_emit(blk, instr_new_unop_num(ta, NUM_U8, OP_NOT, x.loc));
+			block_emit(blk, instr_new_jumpif(la, ta));
+			loc_delete(ta);
+			loc_delete(x.loc);
+			b = ir_visit_stmt(st->for_.body, blk, sco);
+			block_append(blk, b);
+			c = ir_visit_stmt(st->for_.post, blk, sco);
+			block_append(blk, c);
+			block_emit(blk, instr_new_jump(lb));
+			block_emit(blk, la);
+			break;
+
+		case ST_ITER:
+			/* Ranges are iterated from their bounds; never materialize them */
+			if(!(st->iter.value->kind == EX_LIT && st->iter.value->lit.lit->kind == LIT_RANGE)) {
+				x = ir_visit_expr(st->iter.value, blk, sco);
+				block_append(blk, x.block);
+				loc_delete(x.loc);
+			}
+			ta = ir_imm(st->iter.value->type->lbound, blk);
+			tb = ir_imm(st->iter.value->type->lbound + st->iter.value->type->size, blk);
+			tc = loc_new_temp(NULL);
+			la = instr_new_label(NULL);
+			lb = instr_new_label(NULL);
+			block_emit(blk, la);
+			block_emit(blk, instr_new_binop(tc, ta, OP_GEQ, tb));
+			block_emit(blk, instr_new_jumpif(lb, tc));
+			loc_delete(tb);
+			loc_delete(tc);
+			sa = scope_resolve_name(sco, st->iter.ident);
+			tb = ir_sym_loc(sa, sco);
+			tc = ir_conv(ta, type_scalar(TP_INT), sa->type, blk, sco);
+			block_emit(blk, instr_new_set_num(tb, ir_num(stb_resolve_type(sa->type, sco)), tc));
+			loc_delete(tb);
+			loc_delete(tc);
+			a = ir_visit_stmt(st->iter.body, blk, sco);
+			block_append(blk, a);
+			tb = ir_off(ta, 1);
+			block_emit(blk, instr_new_laddr(ta, tb));
+			block_emit(blk, instr_new_jump(la));
+			block_emit(blk, lb);
+			loc_delete(ta);
+			loc_delete(tb);
+			break;
+
+		case ST_RANGE:
+			/* Counted in the variable's type */
+			sa = scope_resolve_name(sco, st->range.ident);
+			num = ir_num(stb_resolve_type(sa->type, sco));
+			x.loc = ir_visit_as(st->range.lbound, sa->type, blk, sco);
+			y.loc = ir_visit_as(st->range.ubound, sa->type, blk, sco);
+			z.loc = ir_visit_as(st->range.step, sa->type, blk, sco);
+			ta = loc_new_temp(NULL);
+			tb = loc_new_temp(NULL);
+			tc = loc_new_temp(NULL);
+			td = loc_new_temp(NULL);
+			block_emit(blk, instr_new_set_num(ta, num, x.loc));
+			block_emit(blk, instr_new_set_num(tb, num, y.loc));
+			block_emit(blk, instr_new_set_num(tc, num, z.loc));
+			loc_delete(x.loc);
+			loc_delete(y.loc);
+			loc_delete(z.loc);
+			la = instr_new_label(NULL);
+			lb = instr_new_label(NULL);
+			block_emit(blk, la);
+			block_emit(blk, instr_new_binop_num(td, num, ta, OP_GREATER, tb));
+			block_emit(blk, instr_new_jumpif(lb, td));
+			loc_delete(tb);
+			loc_delete(td);
+			tb = ir_sym_loc(sa, sco);
+			block_emit(blk, instr_new_set_num(tb, num, ta));
+			loc_delete(tb);
+			a = ir_visit_stmt(st->range.body, blk, sco);
+			block_append(blk, a);
+			block_emit(blk, instr_new_binop_num(ta, num, ta, OP_ADD, tc));
+			block_emit(blk, instr_new_jump(la));
+			block_emit(blk, lb);
+			loc_delete(ta);
+			loc_delete(tc);
+			break;
+
+		case ST_COMPOUND:
+			for(i = 0; i < st->compound.stmts.len; i++) {
+				a = ir_visit_stmt(vec_get(&st->compound.stmts, i, stmt_node), blk, sco);
+				block_append(blk, a);
+			}
+			break;
+
+		default:
+			assert(0);
+			break;
+	}
+	return blk;
+}
+
+static location *ir_lit(literal *lit, block *blk) {
+	instr *ia;
+	switch(lit->kind) {
+		case LIT_INT:
+		case LIT_CHAR:
+		case LIT_BOOL:
+			/* Immediates: the address of mem(n) is n */
+			return ir_imm(lit->kind == LIT_INT ? lit->ival : lit->kind == LIT_CHAR ? lit->cval : lit->bval, blk);
+
+		case LIT_NIL:
+			return ir_imm(0, blk);
+
+		default:
+			/* Reals and arrays live in the data section, arrays as one packed blob */
+			ia = instr_new_data(lit);
+			block_emit(block_data(blk), ia);
+			return loc_new_sym(ia->data.name);
+	}
+}
+
+/* base + (index - lbound) * size, left for am to fold into one operand */
+static location *ir_index_at(location *base, expr_node *index, ssize_t lbound, ssize_t size, block *blk, scope *sco) {
+	location *val, *idx, *esz, *amt, *off, *res;
+	if(index->kind == EX_LIT && index->lit.lit->kind == LIT_INT) {
+		return ir_off(base, (index->lit.lit->ival - lbound) * size);
+	}
+	val = ir_visit_as(index, type_scalar(TP_INT), blk, sco);
+	idx = ir_value(val, blk);
+	esz = loc_new_mem(size);
+	amt = loc_new_stride(idx, esz);
+	off = loc_new_off(base, amt);
+	res = ir_off(off, -lbound * size);
+	loc_delete(val);
+	loc_delete(idx);
+	loc_delete(esz);
+	loc_delete(amt);
+	loc_delete(off);
+	return res;
+}
+
+/* Does ex pick a row of a multi-dimensional array, one array nested in
+ * another's block? A row read or assigned whole is just its part of the
+ * block, and ir_store copies all of it like any other array.
+ */
+static int ir_is_row(expr_node *ex, scope *sco) {
+	type *aty, *rty;
+	if(ex->kind != EX_INDEX) {
+		return 0;
+	}
+	aty = stb_resolve_type(ex->index.object->type, sco);
+	rty = stb_resolve_type(ex->type, sco);
+	return aty->kind == TP_ARRAY && aty->store == AS_PLAIN && !aty->open &&
+		rty->kind == TP_ARRAY && rty->store == AS_PLAIN && !rty->open;
+}
+
+/* m[i][j]... is one row-major block indexed by ((i - lb) * n + j - lb)...,
+ * by Horner's rule over the rows object picks. Returns the block's
+ * address; the element's index in it is *lin + *clin, *lin being a temp,
+ * or NULL while every index so far is constant.
+ */
+static location *ir_index_lin(expr_node *object, expr_node *index, location **lin, long *clin, block *blk, scope *sco) {
+	ir_ev_res x;
+	type *aty = stb_resolve_type(object->type, sco);
+	location *base, *idx, *ta;
+	if(ir_is_row(object, sco)) {
+		base = ir_index_lin(object->index.object, object->index.index, lin, clin, blk, sco);
+		*clin *= aty->size;
+		if(*lin) {
+			ta = ir_imm(aty->size, blk);
+			idx = ir_binop(*lin, OP_MUL, ta, blk);
+			loc_delete(ta);
+			loc_delete(*lin);
+			*lin = idx;
+		}
+	} else {
+		x = ir_visit_expr(object, blk, sco);
+		block_append(blk, x.block);
+		base = x.loc;
+		*lin = NULL;
+		*clin = 0;
+	}
+	*clin -= aty->lbound;
+	if(index->kind == EX_LIT && index->lit.lit->kind == LIT_INT) {
+		*clin += index->lit.lit->ival;
+		return base;
+	}
+	ta = ir_visit_as(index, type_scalar(TP_INT), blk, sco);
+	if(*lin) {
+		idx = ir_binop(*lin, OP_ADD, ta, blk);
+		loc_delete(*lin);
+	} else {
+		idx = ir_value(ta, blk);
+	}
+	loc_delete(ta);
+	*lin = idx;
+	return base;
+}
+
+/* object[index]; the elements of open arrays are where their descriptor
+ * points, as are string bytes
+ */
+static location *ir_index(expr_node *object, expr_node *index, block *blk, scope *sco) {
+	ir_ev_res x;
+	type *aty = stb_resolve_type(object->type, sco);
+	location *base, *res, *ptr, *lb, *idx, *rel, *amt, *esz, *lin;
+	long clin;
+	if(aty->kind != TP_ARRAY && aty->kind != TP_STRING) {
+		pass_error("Can't index %s (BUG)", pass_repr(aty));
+	}
+	/* lbound is only known from the descriptor: ptr + (index - lb) * size */
+	if(type_is_open(aty)) {
+		ir_arr_view(object, &ptr, &lb, NULL, blk, sco);
+		idx = ir_visit_as(index, type_scalar(TP_INT), blk, sco);
+		rel = ir_binop(idx, OP_SUB, lb, blk);
+		esz = loc_new_mem(lay_size(stb_resolve_type(aty->base, sco)));
+		amt = loc_new_stride(rel, esz);
+		base = loc_new_ind(ptr);
+		res = loc_new_off(base, amt);
+		loc_delete(idx);
+		loc_delete(ptr);
+		loc_delete(lb);
+		loc_delete(rel);
+		loc_delete(esz);
+		loc_delete(amt);
+		loc_delete(base);
+		return res;
+	}
+	/* One address for all the indices of a multi-dimensional array: the
+	 * innermost steps a single element */
+	if(ir_is_row(object, sco)) {
+		base = ir_index_lin(object, index, &lin, &clin, blk, sco);
+		esz = loc_new_mem(lay_size(stb_resolve_type(aty->base, sco)));
+		if(lin) {
+			amt = loc_new_stride(lin, esz);
+			ptr = loc_new_off(base, amt);
+			res = ir_off(ptr, clin * esz->mem.addr);
+			loc_delete(lin);
+			loc_delete(amt);
+			loc_delete(ptr);
+		} else {
+			res = ir_off(base, clin * esz->mem.addr);
+		}
+		loc_delete(base);
+		loc_delete(esz);
+		return res;
+	}
+	x = ir_visit_expr(object, blk, sco);
+	block_append(blk, x.block);
+	/* A string's bytes are where its first word points, from 1 */
+	if(aty->kind == TP_STRING) {
+		base = loc_new_ind(x.loc);
+		loc_delete(x.loc);
+		res = ir_index_at(base, index, 1, 1, blk, sco);
+		loc_delete(base);
+		return res;
+	}
+	res = ir_index_at(x.loc, index, aty->lbound, lay_size(stb_resolve_type(aty->base, sco)), blk, sco);
+	loc_delete(x.loc);
+	return res;
+}
+
+/* object.ident is the record plus the field's offset. A field of an soa
+ * element is instead indexed in that field's column, whose elements are
+ * just the field.
+ */
+static location *ir_field(expr_node *object, const char *ident, block *blk, scope *sco) {
+	ir_ev_res x;
+	type *rty, *aty = NULL, *fty;
+	location *base, *res;
+	ssize_t i;
+	if(object->kind == EX_INDEX) {
+		aty = stb_resolve_type(object->index.object->type, sco);
+		if(aty->kind != TP_ARRAY || aty->store != AS_SOA) {
+			aty = NULL;
+		}
+	}
+	rty = stb_resolve_type(aty ? aty->base : object->type, sco);
+	if((i = type_field_index(rty, ident)) < 0) {
+		pass_error("No field %s in %s (BUG)", ident, pass_repr(rty));
+	}
+	if(!aty) {
+		x = ir_visit_expr(object, blk, sco);
+		block_append(blk, x.block);
+		res = ir_off(x.loc, type_field_offset(rty, i));
+		loc_delete(x.loc);
+		return res;
+	}
+	fty = stb_resolve_type(vec_get(&rty->types, i, type), sco);
+	x = ir_visit_expr(object->index.object, blk, sco);
+	block_append(blk, x.block);
+	base = ir_off(x.loc, type_field_offset(aty, i));
+	res = ir_index_at(base, object->index.index, aty->lbound, layout_round(lay_size(fty), lay_align(fty)), blk, sco);
+	loc_delete(x.loc);
+	loc_delete(base);
+	return res;
+}
+
+/* The type of field ident of object's record */
+static type *ir_field_type(expr_node *object, const char *ident, scope *sco) {
+	type *rty = stb_resolve_type(object->type, sco);
+	ssize_t i = type_field_index(rty, ident);
+	return i < 0 ? NULL : vec_get(&rty->types, i, type);
+}
+
+/* The type scalar operands of ex are converted to before it's done: the
+ * result's for arithmetic, their promotion for comparisons, and NULL (as
+ * they are) for the logical and set operators
+ */
+static type *ir_binop_type(expr_node *ex, scope *sco) {
+	type *lty = stb_resolve_type(ex->binop.left->type, sco), *rty = stb_resolve_type(ex->binop.right->type, sco);
+	switch(ex->binop.kind) {
+		case OP_EQ:
+		case OP_NEQ:
+		case OP_LESS:
+		case OP_GREATER:
+		case OP_LEQ:
+		case OP_GEQ:
+			return type_is_scalar(lty) && type_is_scalar(rty) ? type_num_promote(lty, rty) : NULL;
+
+		case OP_AND:
+		case OP_OR:
+		case OP_IN:
+			return NULL;
+
+		default:
+			return ex->type;
+	}
+}
+
+/* A temp holding the constant n */
+static location *ir_imm(long n, block *blk) {
+	location *ta = loc_new_temp(NULL), *imm = loc_new_mem(n);
+	block_emit(blk, instr_new_laddr(ta, imm));
+	loc_delete(imm);
+	return ta;
+}
+
+/* A temp holding left kind right */
+static location *ir_binop(location *left, binop_k kind, location *right, block *blk) {
+	location *ta = loc_new_temp(NULL);
+	block_emit(blk, instr_new_binop(ta, left, kind, right));
+	return ta;
+}
+
+/* Word w (a location, or the constant cw if NULL) of the words at base */
+static location *ir_word_at(location *base, location *w, size_t cw) {
+	location *wsz, *amt, *res;
+	if(!w) {
+		return ir_off(base, cw * target_current->word);
+	}
+	wsz = loc_new_mem(target_current->word);
+	amt = loc_new_stride(w, wsz);
+	res = loc_new_off(base, amt);
+	loc_delete(wsz);
+	loc_delete(amt);
+	return res;
+}
+
+/* Element i of a bitset is bit (i - lbound) % bits of word (i - lbound) /
+ * bits, bits being those in a word. Returns the word; *bit is a temp with
+ * the bit's position, or NULL when that is the constant *cbit.
+ */
+static location *ir_bit_word(expr_node *object, expr_node *index, location **bit, long *cbit, block *blk, scope *sco) {
+	ir_ev_res x;
+	type *aty = stb_resolve_type(object->type, sco);
+	long bits = target_current->word * 8, shift, rel;
+	location *base, *val, *idx, *lb, *off, *sh, *wi, *mask, *res;
+	x = ir_visit_expr(object, blk, sco);
+	block_append(blk, x.block);
+	base = x.loc;
+	if(index->kind == EX_LIT && index->lit.lit->kind == LIT_INT) {
+		rel = index->lit.lit->ival - aty->lbound;
+		*bit = NULL;
+		*cbit = rel % bits;
+		res = ir_word_at(base, NULL, rel / bits);
+		loc_delete(base);
+		return res;
+	}
+	for(shift = 0; (1L << shift) < bits; shift++);
+	val = ir_visit_as(index, type_scalar(TP_INT), blk, sco);
+	idx = ir_value(val, blk);
+	if(aty->lbound) {
+		lb = ir_imm(aty->lbound, blk);
+		off = ir_binop(idx, OP_SUB, lb, blk);
+		loc_delete(lb);
+	} else {
+		off = loc_copy(idx);
+	}
+	sh = ir_imm(shift, blk);
+	wi = ir_binop(off, OP_BRSHIFT, sh, blk);
+	mask = ir_imm(bits - 1, blk);
+	*bit = ir_binop(off, OP_BAND, mask, blk);
+	res = ir_word_at(base, wi, 0);
+	loc_delete(val);
+	loc_delete(idx);
+	loc_delete(off);
+	loc_delete(sh);
+	loc_delete(wi);
+	loc_delete(mask);
+	loc_delete(base);
+	return res;
+}
+
+/* object[index] of a bitset: (word >> bit) & 1 */
+static location *ir_bit_get(expr_node *object, expr_node *index, block *blk, scope *sco) {
+	location *word, *bit, *val, *one, *res;
+	long cbit;
+	word = ir_bit_word(object, index, &bit, &cbit, blk, sco);
+	if(!bit && cbit) {
+		bit = ir_imm(cbit, blk);
+	}
+	val = bit ? ir_binop(word, OP_BRSHIFT, bit, blk) : ir_value(word, blk);
+	one = ir_imm(1, blk);
+	res = ir_binop(val, OP_BAND, one, blk);
+	if(bit) {
+		loc_delete(bit);
+	}
+	loc_delete(word);
+	loc_delete(val);
+	loc_delete(one);
+	return res;
+}
+
+/* object[index] := value on a bitset: word = (word & ~(1 << bit)) | (value << bit) */
+static location *ir_bit_set(expr_node *object, expr_node *index, expr_node *value, block *blk, scope *sco) {
+	location *word, *bit, *val, *zero, *one, *mask, *nmask, *kept, *put, *res;
+	long cbit;
+	word = ir_bit_word(object, index, &bit, &cbit, blk, sco);
+	val = ir_visit_word(value, blk, sco);
+	if(!value->type || value->type->kind != TP_BOOL) {
+		zero = ir_imm(0, blk);
+		res = ir_binop(val, OP_NEQ, zero, blk);
+		loc_delete(zero);
+		loc_delete(val);
+		val = res;
+	}
+	if(bit) {
+		one = ir_imm(1, blk);
+		mask = ir_binop(one, OP_BLSHIFT, bit, blk);
+		put = ir_binop(val, OP_BLSHIFT, bit, blk);
+		loc_delete(one);
+		loc_delete(bit);
+	} else {
+		mask = ir_imm((long) (1UL << cbit), blk);
+		if(cbit) {
+			bit = ir_imm(cbit, blk);
+			put = ir_binop(val, OP_BLSHIFT, bit, blk);
+			loc_delete(bit);
+		} else {
+			put = loc_copy(val);
+		}
+	}
+	nmask = loc_new_temp(NULL);
+	block_emit(blk, instr_new_unop(nmask, OP_BNOT, mask));
+	kept = ir_binop(word, OP_BAND, nmask, blk);
+	res = ir_binop(kept, OP_BOR, put, blk);
+	block_emit(blk, instr_new_set(word, res));
+	loc_delete(res);
+	loc_delete(kept);
+	loc_delete(nmask);
+	loc_delete(mask);
+	loc_delete(put);
+	loc_delete(word);
+	return val;
+}
+
+/* rel = x - lbound of a set's element x, and its word's index */
+static location *ir_set_rel(location *x, ssize_t lbound, location **wi, block *blk) {
+	long bits = target_current->word * 8, shift;
+	location *lb, *sh, *rel;
+	for(shift = 0; (1L << shift) < bits; shift++);
+	if(lbound) {
+		lb = ir_imm(lbound, blk);
+		rel = ir_binop(x, OP_SUB, lb, blk);
+		loc_delete(lb);
+	} else {
+		rel = loc_copy(x);
+	}
+	sh = ir_imm(shift, blk);
+	*wi = ir_binop(rel, OP_BRSHIFT, sh, blk);
+	loc_delete(sh);
+	return rel;
+}
+
+/* A set built with some elements that aren't constant: the words of the
+ * constant ones, then the word index and bit mask of each of the others.
+ */
+static void ir_set_locate(expr_node *ex, vector *bases, block *blk, scope *sco) {
+	expr_node *item;
+	literal *words;
+	location *val, *rel, *wi, *bit, *one, *mask;
+	long lo, hi;
 	size_t i;
-	vector amts;
-	location *gdbase;
-	vec_init(&amts);
-	prog->gdidx = (*gdidx)++;
-	gdbase = loc_new_ind(lr_calc_gdentry(prog->gdidx));
-	vec_insert(&amts, 0, loc_new_stride(loc_new_size(NULL), loc_new_mem(2))); /* For ret addr + pushed FP */
-	for(i = 0; i < prog->node->args.len; i++) {
-		symbol *sym = scope_resolve_name(prog->scope, vec_get(&prog->node->args, i, decl_node)->ident);
-		if(!sym) {
-			pass_error("Couldn't resolve argument %s (BUG)", vec_get(&prog->node->args, i, decl_node)->ident);
+	words = cf_set_words(ex);
+	vec_insert(bases, bases->len, ir_lit(words, blk));
+	lit_delete(words);
+	for(i = 0; i < ex->set.items.len; i++) {
+		item = vec_get(&ex->set.items, i, expr_node);
+		if(tr_set_bounds(item, &lo, &hi)) {
+			continue;
 		}
-		sym->loc = loc_new_off_vec(loc_new_reg(REG_FP), &amts);
-		vec_insert(&amts, amts.len, loc_new_size(sym->type));
+		val = ir_visit_word(item, blk, sco);
+		rel = ir_set_rel(val, ex->type->lbound, &wi, blk);
+		mask = ir_imm(target_current->word * 8 - 1, blk);
+		bit = ir_binop(rel, OP_BAND, mask, blk);
+		one = ir_imm(1, blk);
+		vec_insert(bases, bases->len, wi);
+		vec_insert(bases, bases->len, ir_binop(one, OP_BLSHIFT, bit, blk));
+		loc_delete(val);
+		loc_delete(rel);
+		loc_delete(mask);
+		loc_delete(bit);
+		loc_delete(one);
 	}
-	vec_clear(&amts);
-	for(i = 0; i < prog->node->decls.len; i++) {
-		decl_node *decl = vec_get(&prog->node->decls, i, decl_node);
-		symbol *sym = scope_resolve_name(prog->scope, decl->ident);
-		if(decl->kind == DECL_TYPE) continue;
-		if(!sym) {
-			pass_error("Couldn't resolve declaration %s (BUG)", decl->ident);
+}
+
+/* Word w of a set located by ir_set_locate: the constant word, or-ed with
+ * the mask of each element in it, selected without branching as
+ * mask & -(wi == w).
+ */
+static location *ir_set_word(expr_node *ex, vector *bases, size_t *k, location *w, size_t cw, block *blk) {
+	location *a, *at, *eq, *zero, *sel, *bit, *res;
+	long lo, hi;
+	size_t i;
+	a = ir_word_at(vec_get(bases, (*k)++, location), w, cw);
+	res = ir_value(a, blk);
+	loc_delete(a);
+	at = w ? loc_copy(w) : ir_imm(cw, blk);
+	zero = ir_imm(0, blk);
+	for(i = 0; i < ex->set.items.len; i++) {
+		if(tr_set_bounds(vec_get(&ex->set.items, i, expr_node), &lo, &hi)) {
+			continue;
 		}
-		switch(sym->kind) {
-			case SYM_PROG:
-				sym->loc = loc_new_sym(sym->init.prog->node->ident);
-				lr_visit_prog(sym->init.prog, gdidx);
+		eq = ir_binop(vec_get(bases, *k, location), OP_EQ, at, blk);
+		sel = ir_binop(zero, OP_SUB, eq, blk);
+		bit = ir_binop(vec_get(bases, *k + 1, location), OP_BAND, sel, blk);
+		block_emit(blk, instr_new_binop(res, res, OP_BOR, bit));
+		*k += 2;
+		loc_delete(eq);
+		loc_delete(sel);
+		loc_delete(bit);
+	}
+	loc_delete(at);
+	loc_delete(zero);
+	return res;
+}
+
+/* The bitsets a bitwise expression reads, located once ahead of its words */
+static void ir_bits_locate(expr_node *ex, vector *bases, block *blk, scope *sco) {
+	ir_ev_res x;
+	if(tr_is_bitwise(ex) && ex->kind == EX_SET) {
+		ir_set_locate(ex, bases, blk, sco);
+		return;
+	}
+	if(tr_is_bitwise(ex)) {
+		if(ex->kind == EX_UNOP) {
+			ir_bits_locate(ex->unop.expr, bases, blk, sco);
+		} else {
+			ir_bits_locate(ex->binop.left, bases, blk, sco);
+			ir_bits_locate(ex->binop.right, bases, blk, sco);
+		}
+		return;
+	}
+	x = ir_visit_expr(ex, blk, sco);
+	block_append(blk, x.block);
+	vec_insert(bases, bases->len, x.loc);
+}
+
+/* Whether ex complements anything, which would set the padding bits; so
+ * could an element out of a set's bounds.
+ */
+static int ir_bits_negates(expr_node *ex) {
+	if(!tr_is_bitwise(ex)) {
+		return 0;
+	}
+	if(ex->kind == EX_UNOP || ex->kind == EX_SET) {
+		return 1;
+	}
+	return ir_bits_negates(ex->binop.left) || ir_bits_negates(ex->binop.right);
+}
+
+/* A temp with word w (see ir_word_at) of ex; *k walks the located bases */
+static location *ir_bits_word(expr_node *ex, vector *bases, size_t *k, location *w, size_t cw, block *blk) {
+	location *a, *b, *res;
+	if(!tr_is_bitwise(ex)) {
+		a = ir_word_at(vec_get(bases, (*k)++, location), w, cw);
+		res = ir_value(a, blk);
+		loc_delete(a);
+		return res;
+	}
+	if(ex->kind == EX_SET) {
+		return ir_set_word(ex, bases, k, w, cw, blk);
+	}
+	if(ex->kind == EX_UNOP) {
+		a = ir_bits_word(ex->unop.expr, bases, k, w, cw, blk);
+		res = loc_new_temp(NULL);
+		block_emit(blk, instr_new_unop(res, OP_BNOT, a));
+		loc_delete(a);
+		return res;
+	}
+	a = ir_bits_word(ex->binop.left, bases, k, w, cw, blk);
+	b = ir_bits_word(ex->binop.right, bases, k, w, cw, blk);
+	switch(ex->binop.kind) {
+		case OP_AND:
+		case OP_MUL:
+			res = ir_binop(a, OP_BAND, b, blk);
+			break;
+
+		case OP_SUB:
+			/* a & ~b */
+			res = loc_new_temp(NULL);
+			block_emit(blk, instr_new_unop(res, OP_BNOT, b));
+			block_emit(blk, instr_new_binop(res, a, OP_BAND, res));
+			break;
+
+		default:
+			res = ir_binop(a, OP_BOR, b, blk);
+			break;
+	}
+	loc_delete(a);
+	loc_delete(b);
+	return res;
+}
+
+/* x in set. A literal set that cf couldn't fold is tested element by
+ * element; otherwise it's x's bit, branch-free: out of bounds, it's bit 0
+ * of word 0, and-ed with the bounds check.
+ */
+static location *ir_in(expr_node *ex, block *blk, scope *sco) {
+	ir_ev_res y;
+	expr_node *set = ex->binop.right, *item;
+	long bits = target_current->word * 8, nwords, lo, hi;
+	location *val, *res, *t, *u, *v, *rel, *wi, *ok, *bit, *word;
+	size_t i;
+	val = ir_visit_word(ex->binop.left, blk, sco);
+	if(set->kind == EX_SET) {
+		res = ir_imm(0, blk);
+		for(i = 0; i < set->set.items.len; i++) {
+			item = vec_get(&set->set.items, i, expr_node);
+			if(tr_set_bounds(item, &lo, &hi)) {
+				t = ir_imm(lo, blk);
+				u = ir_binop(val, OP_GEQ, t, blk);
+				loc_delete(t);
+				t = ir_imm(hi, blk);
+				v = ir_binop(val, OP_LESS, t, blk);
+				loc_delete(t);
+				t = ir_binop(u, OP_BAND, v, blk);
+				loc_delete(u);
+				loc_delete(v);
+			} else {
+				u = ir_visit_word(item, blk, sco);
+				t = ir_binop(val, OP_EQ, u, blk);
+				loc_delete(u);
+			}
+			block_emit(blk, instr_new_binop(res, res, OP_BOR, t));
+			loc_delete(t);
+		}
+		loc_delete(val);
+		return res;
+	}
+	y = ir_visit_expr(set, blk, sco);
+	block_append(blk, y.block);
+	nwords = layout_round(set->type->size, bits) / bits;
+	rel = ir_set_rel(val, set->type->lbound, &wi, blk);
+	/* ok = 0 <= rel && wi < nwords; one word needs only wi == 0 */
+	t = ir_imm(0, blk);
+	if(nwords == 1) {
+		ok = ir_binop(wi, OP_EQ, t, blk);
+	} else {
+		u = ir_binop(rel, OP_GEQ, t, blk);
+		loc_delete(t);
+		t = ir_imm(nwords, blk);
+		v = ir_binop(wi, OP_LESS, t, blk);
+		ok = ir_binop(u, OP_BAND, v, blk);
+		loc_delete(u);
+		loc_delete(v);
+	}
+	loc_delete(t);
+	t = ir_imm(0, blk);
+	u = ir_binop(t, OP_SUB, ok, blk);
+	loc_delete(t);
+	t = ir_imm(bits - 1, blk);
+	bit = ir_binop(rel, OP_BAND, t, blk);
+	block_emit(blk, instr_new_binop(bit, bit, OP_BAND, u));
+	if(nwords == 1) {
+		word = ir_word_at(y.loc, NULL, 0);
+	} else {
+		block_emit(blk, instr_new_binop(wi, wi, OP_BAND, u));
+		word = ir_word_at(y.loc, wi, 0);
+	}
+	v = ir_value(word, blk);
+	block_emit(blk, instr_new_binop(v, v, OP_BRSHIFT, bit));
+	res = ir_binop(v, OP_BAND, ok, blk);
+	loc_delete(t);
+	loc_delete(u);
+	loc_delete(v);
+	loc_delete(y.loc);
+	loc_delete(val);
+	loc_delete(rel);
+	loc_delete(wi);
+	loc_delete(ok);
+	loc_delete(bit);
+	loc_delete(word);
+	return res;
+}
+
+/* One word of ir_bits: stored into dst, or its popcount added to count */
+static void ir_bits_step(expr_node *ex, vector *bases, location *w, size_t cw, long tail, location *dst, location *count, block *blk) {
+	location *val, *mask, *bits, *slot;
+	size_t k = 0;
+	val = ir_bits_word(ex, bases, &k, w, cw, blk);
+	if(tail) {
+		mask = ir_imm((long) ((1UL << tail) - 1), blk);
+		block_emit(blk, instr_new_binop(val, val, OP_BAND, mask));
+		loc_delete(mask);
+	}
+	if(dst) {
+		slot = ir_word_at(dst, w, cw);
+		block_emit(blk, instr_new_set(slot, val));
+		loc_delete(slot);
+	} else {
+		bits = loc_new_temp(NULL);
+		block_emit(blk, instr_new_unop(bits, OP_CARD, val));
+		block_emit(blk, instr_new_binop(count, count, OP_ADD, bits));
+		loc_delete(bits);
+	}
+	loc_delete(val);
+}
+
+#define IR_BITS_UNROLL 4
+
+/* Evaluates the bitset ex a word at a time, into dst if it's given, and
+ * otherwise returns a temp with the number of its elements set. Small
+ * bitsets are unrolled; a complement masks the tail word so the padding
+ * bits stay clear.
+ */
+static location *ir_bits(expr_node *ex, location *dst, block *blk, scope *sco) {
+	vector bases;
+	location *count = NULL, *w, *end, *done;
+	size_t bits = target_current->word * 8, nwords, upto, i;
+	long tail;
+	instr *la, *lb;
+	nwords = layout_round(ex->type->size, bits) / bits;
+	tail = ir_bits_negates(ex) ? ex->type->size % bits : 0;
+	upto = tail ? nwords - 1 : nwords;
+	vec_init(&bases);
+	ir_bits_locate(ex, &bases, blk, sco);
+	if(!dst) {
+		count = ir_imm(0, blk);
+	}
+	if(upto <= IR_BITS_UNROLL) {
+		for(i = 0; i < upto; i++) {
+			ir_bits_step(ex, &bases, NULL, i, 0, dst, count, blk);
+		}
+	} else {
+		w = ir_imm(0, blk);
+		end = ir_imm(upto, blk);
+		done = loc_new_temp(NULL);
+		la = instr_new_label(NULL);
+		lb = instr_new_label(NULL);
+		block_emit(blk, la);
+		block_emit(blk, instr_new_binop(done, w, OP_GEQ, end));
+		block_emit(blk, instr_new_jumpif(lb, done));
+		ir_bits_step(ex, &bases, w, 0, 0, dst, count, blk);
+		loc_delete(end);
+		end = ir_imm(1, blk);
+		block_emit(blk, instr_new_binop(w, w, OP_ADD, end));
+		block_emit(blk, instr_new_jump(la));
+		block_emit(blk, lb);
+		loc_delete(w);
+		loc_delete(end);
+		loc_delete(done);
+	}
+	if(tail) {
+		ir_bits_step(ex, &bases, NULL, upto, tail, dst, count, blk);
+	}
+	vec_foreach(&bases, (vec_iter_f) loc_delete, NULL);
+	vec_clear(&bases);
+	return count;
+}
+
+/* A temp with the address of loc */
+static location *ir_addr(location *loc, block *blk) {
+	location *ta = loc_new_temp(NULL);
+	block_emit(blk, instr_new_laddr(ta, loc));
+	return ta;
+}
+
+/* Calls runtime function name with the n word arguments args, in
+ * registers; returns a temp with its result if ret, NULL otherwise. The
+ * runtime is C and never calls back, so this is all a call to it takes.
+ */
+static location *ir_rt_call(char *name, size_t n, location **args, int ret, block *blk) {
+	location *reg, *fn, *res;
+	size_t i;
+	assert(n <= target_current->arg_regs[RC_INT]);
+	for(i = 0; i < n; i++) {
+		reg = loc_new_reg_num(REG_ARG, i);
+		block_emit(blk, instr_new_set(reg, args[i]));
+		loc_delete(reg);
+	}
+	fn = loc_new_sym(name);
+	block_emit(blk, instr_new_call(fn));
+	loc_delete(fn);
+	if(!ret) {
+		return NULL;
+	}
+	reg = loc_new_reg(REG_RV);
+	res = ir_value(reg, blk);
+	loc_delete(reg);
+	return res;
+}
+
+/* The literal a string constant stands for, NULL if ex isn't one */
+static literal *ir_str_lit(expr_node *ex, scope *sco) {
+	symbol *sym;
+	if(ex->kind == EX_LIT) {
+		return ex->lit.lit;
+	}
+	if(ex->kind == EX_REF && (sym = scope_resolve_name(sco, ex->ref.ident)) && sym->kind == SYM_CONST) {
+		return sym->value;
+	}
+	return NULL;
+}
+
+/* Temps with where the bytes of string ex are (unless ptr is NULL) and how
+ * many there are: a literal's are in the data section, and a string's
+ * data pointer and length are its first two words (see rt_string.h).
+ */
+static void ir_str_view(expr_node *ex, location **ptr, location **len, block *blk, scope *sco) {
+	literal *lit = ir_str_lit(ex, sco);
+	location *ta;
+	ir_ev_res x;
+	if(lit) {
+		if(ptr) {
+			ta = ir_lit(lit, blk);
+			*ptr = ir_addr(ta, blk);
+			loc_delete(ta);
+		}
+		*len = ir_imm(lit->packed.len, blk);
+		return;
+	}
+	x = ir_visit_expr(ex, blk, sco);
+	block_append(blk, x.block);
+	if(ptr) {
+		*ptr = ir_value(x.loc, blk);
+	}
+	ta = ir_off(x.loc, target_current->word);
+	*len = ir_value(ta, blk);
+	loc_delete(ta);
+	loc_delete(x.loc);
+}
+
+/* The operands of a concatenation, left to right */
+static void ir_str_parts(expr_node *ex, vector *parts) {
+	if(tr_is_str_op(ex)) {
+		ir_str_parts(ex->binop.left, parts);
+		ir_str_parts(ex->binop.right, parts);
+		return;
+	}
+	vec_insert(parts, parts->len, ex);
+}
+
+/* dst := value, a string or a concatenation. Every part is located first,
+ * and the runtime copies them all at once into storage sized for the total
+ * (rt_str_concat), so no intermediate string is built; they're passed as an
+ * array of rt_view on the stack, the first lowest.
+ */
+static void ir_str_assign(location *dst, expr_node *value, block *blk, scope *sco) {
+	vector parts, ptrs, lens; /* of expr_node *; of location * */
+	location *args[3], *ptr, *len, *sp, *ta;
+	size_t i, n, word = target_current->word;
+	vec_init(&parts);
+	vec_init(&ptrs);
+	vec_init(&lens);
+	ir_str_parts(value, &parts);
+	n = parts.len;
+	for(i = 0; i < n; i++) {
+		ir_str_view(vec_get(&parts, i, expr_node), &ptr, &len, blk, sco);
+		vec_insert(&ptrs, i, ptr);
+		vec_insert(&lens, i, len);
+	}
+	args[0] = ir_addr(dst, blk);
+	if(n == 1) {
+		args[1] = loc_copy(vec_get(&ptrs, 0, location));
+		args[2] = loc_copy(vec_get(&lens, 0, location));
+		ir_rt_call("rt_str_set", 3, args, 0, blk);
+	} else {
+		for(i = n; i-- > 0;) {
+			block_emit(blk, instr_new_push(vec_get(&lens, i, location)));
+			block_emit(blk, instr_new_push(vec_get(&ptrs, i, location)));
+		}
+		args[1] = ir_imm(n, blk);
+		args[2] = loc_new_reg(REG_SP);
+		ir_rt_call("rt_str_concat", 3, args, 0, blk);
+		sp = loc_new_reg(REG_SP);
+		ta = ir_off(sp, 2 * n * word);
+		block_emit(blk, instr_new_laddr(sp, ta));
+		loc_delete(sp);
+		loc_delete(ta);
+	}
+	for(i = 0; i < 3; i++) {
+		loc_delete(args[i]);
+	}
+	vec_foreach(&ptrs, (vec_iter_f) loc_delete, NULL);
+	vec_foreach(&lens, (vec_iter_f) loc_delete, NULL);
+	vec_clear(&parts);
+	vec_clear(&ptrs);
+	vec_clear(&lens);
+}
+
+/* A relation between strings, from rt_str_eq's 1 or 0 for (in)equality
+ * (which compares lengths first), rt_str_cmp's sign for the others
+ */
+static location *ir_str_rel(expr_node *ex, block *blk, scope *sco) {
+	location *args[4], *rv, *k, *res;
+	int eq = ex->binop.kind == OP_EQ || ex->binop.kind == OP_NEQ;
+	size_t i;
+	ir_str_view(ex->binop.left, &args[0], &args[1], blk, sco);
+	ir_str_view(ex->binop.right, &args[2], &args[3], blk, sco);
+	rv = ir_rt_call(eq ? "rt_str_eq" : "rt_str_cmp", 4, args, 1, blk);
+	k = ir_imm(eq, blk);
+	res = ir_binop(rv, ex->binop.kind, k, blk);
+	for(i = 0; i < 4; i++) {
+		loc_delete(args[i]);
+	}
+	loc_delete(rv);
+	loc_delete(k);
+	return res;
+}
+
+/* c in s and t in s: whether the runtime finds it */
+static location *ir_str_in(expr_node *ex, block *blk, scope *sco) {
+	location *args[4], *rv, *zero, *res;
+	size_t i, n;
+	if(ex->binop.left->type->kind == TP_CHAR) {
+		args[2] = ir_visit_word(ex->binop.left, blk, sco);
+		ir_str_view(ex->binop.right, &args[0], &args[1], blk, sco);
+		n = 3;
+	} else {
+		ir_str_view(ex->binop.left, &args[2], &args[3], blk, sco);
+		ir_str_view(ex->binop.right, &args[0], &args[1], blk, sco);
+		n = 4;
+	}
+	rv = ir_rt_call(n == 3 ? "rt_str_findc" : "rt_str_find", n, args, 1, blk);
+	zero = ir_imm(0, blk);
+	res = ir_binop(rv, OP_GEQ, zero, blk);
+	for(i = 0; i < n; i++) {
+		loc_delete(args[i]);
+	}
+	loc_delete(rv);
+	loc_delete(zero);
+	return res;
+}
+
+/* A string argument is pushed as an rt_string with the value's data and
+ * length; the callee takes its own copy of the bytes (rt_str_own), so its
+ * inline bytes are left as they are. Returns what was pushed.
+ */
+static size_t ir_str_arg(expr_node *param, block *blk, scope *sco) {
+	location *ptr, *len, *sp, *ta;
+	size_t size = lay_size(param->type), word = target_current->word;
+	ir_str_view(param, &ptr, &len, blk, sco);
+	sp = loc_new_reg(REG_SP);
+	ta = ir_off(sp, -(ssize_t) (size - 2 * word));
+	block_emit(blk, instr_new_laddr(sp, ta));
+	block_emit(blk, instr_new_push(len));
+	block_emit(blk, instr_new_push(ptr));
+	loc_delete(sp);
+	loc_delete(ta);
+	loc_delete(ptr);
+	loc_delete(len);
+	return size;
+}
+
+/* Temps with where the elements ex is a view of start, the index of the
+ * first and how many there are (any of ptr, lb and len may be NULL if not
+ * wanted): an open array's descriptor (see rt_array.h), a fixed array's own
+ * bounds, the single variable @x points at. A slice narrows its object's
+ * view; nothing is copied.
+ */
+static void ir_arr_view(expr_node *ex, location **ptr, location **lb, location **len, block *blk, scope *sco) {
+	type *aty = stb_resolve_type(ex->type, sco);
+	size_t word = target_current->word;
+	location *p, *l, *lo, *hi, *rel, *esz, *amt, *base, *at;
+	ir_ev_res x;
+	switch(ex->kind) {
+		case EX_SLICE:
+			ir_arr_view(ex->slice.object, &p, &l, NULL, blk, sco);
+			at = ir_visit_as(ex->slice.lbound, type_scalar(TP_INT), blk, sco);
+			lo = ir_value(at, blk);
+			loc_delete(at);
+			at = ir_visit_as(ex->slice.ubound, type_scalar(TP_INT), blk, sco);
+			hi = ir_value(at, blk);
+			loc_delete(at);
+			if(ptr) {
+				rel = ir_binop(lo, OP_SUB, l, blk);
+				esz = loc_new_mem(lay_size(stb_resolve_type(aty->base, sco)));
+				amt = loc_new_stride(rel, esz);
+				base = loc_new_ind(p);
+				at = loc_new_off(base, amt);
+				*ptr = ir_addr(at, blk);
+				loc_delete(rel);
+				loc_delete(esz);
+				loc_delete(amt);
+				loc_delete(base);
+				loc_delete(at);
+			}
+			if(lb) {
+				*lb = loc_copy(lo);
+			}
+			if(len) {
+				*len = ir_binop(hi, OP_SUB, lo, blk);
+			}
+			loc_delete(p);
+			loc_delete(l);
+			loc_delete(lo);
+			loc_delete(hi);
+			return;
+
+		case EX_IND:
+			x = ir_visit_expr(ex->ind.lvalue, blk, sco);
+			block_append(blk, x.block);
+			if(ptr) *ptr = ir_addr(x.loc, blk);
+			if(lb) *lb = ir_imm(aty->lbound, blk);
+			if(len) *len = ir_imm(1, blk);
+			loc_delete(x.loc);
+			return;
+
+		default:
+			x = ir_visit_expr(ex, blk, sco);
+			block_append(blk, x.block);
+			if(!type_is_open(aty)) {
+				if(ptr) *ptr = ir_addr(x.loc, blk);
+				if(lb) *lb = ir_imm(aty->lbound, blk);
+				if(len) *len = ir_imm(aty->size, blk);
+				loc_delete(x.loc);
+				return;
+			}
+			if(ptr) {
+				*ptr = ir_value(x.loc, blk);
+			}
+			if(lb) {
+				at = ir_off(x.loc, word);
+				*lb = ir_value(at, blk);
+				loc_delete(at);
+			}
+			if(len) {
+				at = ir_off(x.loc, 2 * word);
+				*len = ir_value(at, blk);
+				loc_delete(at);
+			}
+			loc_delete(x.loc);
+			return;
+	}
+}
+
+/* dst := value for sym of open array type. A dynamic array copies the
+ * elements into its own storage (rt_arr_set), keeping its lbound; an open
+ * argument, being a view, is just pointed at them.
+ */
+static void ir_arr_assign(symbol *sym, location *dst, expr_node *value, block *blk, scope *sco) {
+	type *aty = stb_resolve_type(sym->type, sco);
+	location *desc[3], *args[4], *field; /* desc: as in rt_array */
+	size_t i, word = target_current->word;
+	ir_arr_view(value, &desc[0], &desc[1], &desc[2], blk, sco);
+	if(lay_is_arg(sym->scope->prog, sym)) {
+		for(i = 0; i < 3; i++) {
+			field = ir_off(dst, i * word);
+			block_emit(blk, instr_new_set(field, desc[i]));
+			loc_delete(field);
+		}
+	} else {
+		args[0] = ir_addr(dst, blk);
+		args[1] = desc[0];
+		args[2] = desc[2];
+		args[3] = ir_imm(lay_size(stb_resolve_type(aty->base, sco)), blk);
+		ir_rt_call("rt_arr_set", 4, args, 0, blk);
+		loc_delete(args[0]);
+		loc_delete(args[3]);
+	}
+	for(i = 0; i < 3; i++) {
+		loc_delete(desc[i]);
+	}
+}
+
+/* A dynamic array's descriptor before its first use: no storage, its
+ * type's lbound, then its initializer if it has one
+ */
+static void ir_arr_init(symbol *sym, scope *sco, block *blk) {
+	type *aty = stb_resolve_type(sym->type, sco);
+	location *zero = ir_imm(0, blk), *lb = ir_imm(aty->lbound, blk), *field;
+	size_t word = target_current->word;
+	block_emit(blk, instr_new_set(sym->loc, zero));
+	field = ir_off(sym->loc, word);
+	block_emit(blk, instr_new_set(field, lb));
+	loc_delete(field);
+	field = ir_off(sym->loc, 2 * word);
+	block_emit(blk, instr_new_set(field, zero));
+	loc_delete(field);
+	loc_delete(zero);
+	loc_delete(lb);
+	if(sym->init.expr) {
+		ir_arr_assign(sym, sym->loc, sym->init.expr, blk, sco);
+	}
+}
+
+/* length object := value: the runtime moves the elements if they outgrow
+ * their storage
+ */
+static location *ir_arr_resize(expr_node *ex, block *blk, scope *sco) {
+	type *aty = stb_resolve_type(ex->setlength.object->type, sco);
+	location *args[3], *len, *res;
+	ir_ev_res x;
+	size_t i;
+	x = ir_visit_expr(ex->setlength.object, blk, sco);
+	block_append(blk, x.block);
+	len = ir_visit_as(ex->setlength.value, type_scalar(TP_INT), blk, sco);
+	args[0] = ir_addr(x.loc, blk);
+	args[1] = ir_value(len, blk);
+	args[2] = ir_imm(lay_size(stb_resolve_type(aty->base, sco)), blk);
+	ir_rt_call("rt_arr_resize", 3, args, 0, blk);
+	res = loc_copy(args[1]);
+	for(i = 0; i < 3; i++) {
+		loc_delete(args[i]);
+	}
+	loc_delete(x.loc);
+	loc_delete(len);
+	return res;
+}
+
+/* An open argument is pushed as a descriptor of the elements it is given,
+ * which the callee shares, however they are held (see ir_arr_view).
+ * Returns what was pushed.
+ */
+static size_t ir_arr_arg(expr_node *param, block *blk, scope *sco) {
+	location *ptr, *lb, *len;
+	ir_arr_view(param, &ptr, &lb, &len, blk, sco);
+	block_emit(blk, instr_new_push(len));
+	block_emit(blk, instr_new_push(lb));
+	block_emit(blk, instr_new_push(ptr));
+	loc_delete(ptr);
+	loc_delete(lb);
+	loc_delete(len);
+	return 3 * target_current->word;
+}
+
+/* Pushes val, a value of type ty (NULL for an address), as a stack argument
+ * of callee (NULL if called through a value), or stores it where it goes in
+ * callee's static frame, at disp from the frame base. A record or fixed
+ * array is copied into room made for it below SP. Returns what was pushed.
+ */
+static size_t ir_pass_arg(program *callee, ssize_t disp, location *val, type *ty, block *blk, scope *sco) {
+	location *base, *slot, *sp;
+	size_t size = ty ? layout_round(lay_size(ty), target_current->word) : target_current->word;
+	if(callee && callee->static_frame) {
+		base = lay_base(callee);
+		slot = ir_off(base, disp);
+		ir_store(slot, ty ? ty : type_scalar(TP_INT), val, blk, sco);
+		loc_delete(base);
+		loc_delete(slot);
+		return 0;
+	}
+	if(!ty || type_reg_class(ty) >= 0) {
+		block_emit(blk, instr_new_push(val));
+		return size;
+	}
+	sp = loc_new_reg(REG_SP);
+	slot = ir_off(sp, -(ssize_t) size);
+	block_emit(blk, instr_new_laddr(sp, slot));
+	loc_delete(slot);
+	slot = loc_new_ind(sp);
+	block_emit(blk, instr_new_copy(slot, val, lay_size(ty)));
+	loc_delete(slot);
+	loc_delete(sp);
+	return size;
+}
+
+/* Passes what callee's capture needs below its declared arguments: the
+ * base of its parent's frame, or the addresses of its lifted variables.
+ * Returns the size pushed.
+ */
+static size_t ir_hidden(program *callee, block *blk, scope *sco) {
+	size_t k, res = 0;
+	location *loc, *ta;
+	switch(callee->capture) {
+		case CAP_LINK:
+			loc = lay_base(cap_parent(callee));
+			ta = loc_new_temp(NULL);
+			block_emit(blk, instr_new_laddr(ta, loc));
+			res = ir_pass_arg(callee, lay_hidden(callee, 0), ta, NULL, blk, sco);
+			loc_delete(loc);
+			loc_delete(ta);
+			return res;
+
+		case CAP_LIFT:
+			for(k = callee->lifted.len; k-- > 0;) {
+				loc = ir_sym_loc(vec_get(&callee->lifted, k, symbol), sco);
+				ta = loc_new_temp(NULL);
+				block_emit(blk, instr_new_laddr(ta, loc));
+				res += ir_pass_arg(callee, lay_hidden(callee, k), ta, NULL, blk, sco);
+				loc_delete(loc);
+				loc_delete(ta);
+			}
+			return res;
+
+		default:
+			return 0;
+	}
+}
+
+/* The type argument i of a call through fty is passed as: an integer for an
+ * address (a word), else its parameter's
+ */
+static type *ir_arg_type(program *callee, type *fty, size_t i, expr_node *param, scope *sco) {
+	if(callee && i < callee->node->args.len && lay_by_ref(callee, i)) {
+		return type_scalar(TP_INT);
+	}
+	return i < fty->args.len ? stb_resolve_type(vec_get(&fty->args, i, type), sco) : param->type;
+}
+
+/* The class argument i of a call through fty is passed in */
+static num_k ir_arg_num(program *callee, type *fty, size_t i, expr_node *param, scope *sco) {
+	return ir_num(stb_resolve_type(ir_arg_type(callee, fty, i, param, sco), sco));
+}
+
+/* Register arguments are evaluated into temps and only moved into their
+ * registers right before the call, since evaluating the others may call.
+ * The rest are pushed last first, so the first lands lowest (see lay); for
+ * a static frame, they wait in temps too and are stored in it last, since
+ * evaluating the others may enter the same frame. An argument passed by
+ * reference is its address, a word; only named programs take those. Any
+ * other is first converted to its parameter's type, which picked its
+ * register class.
+ */
+static location *ir_call(expr_node *ex, block *blk, scope *sco) {
+	type *fty = stb_resolve_type(ex->call.func->type, sco), *pty;
+	expr_node *param;
+	symbol *sa = NULL, *formal;
+	program *callee = NULL;
+	size_t i, args = 0, used[RC_NCLASSES] = {0};
+	int ref;
+	num_k num;
+	ir_ev_res x;
+	location *ta, *tb, *target, *sp, *rv;
+	vector regs, vals; /* of location *, NULL where pushed */
+	if(ex->call.func->kind == EX_REF) {
+		sa = scope_resolve_name(sco, ex->call.func->ref.ident);
+	}
+	if(sa && sa->kind == SYM_PROG) {
+		callee = sa->init.prog;
+	}
+	vec_init(&regs);
+	vec_init(&vals);
+	for(i = 0; i < ex->call.params.len; i++) {
+		param = vec_get(&ex->call.params, i, expr_node);
+		pty = i < fty->args.len ? stb_resolve_type(vec_get(&fty->args, i, type), sco) : param->type;
+		ref = callee && i < callee->node->args.len && lay_by_ref(callee, i);
+		vec_insert(&regs, i, lay_arg_reg(ref ? type_scalar(TP_INT) : pty, used));
+		vec_insert(&vals, i, NULL);
+	}
+	for(i = ex->call.params.len; i-- > 0;) {
+		param = vec_get(&ex->call.params, i, expr_node);
+		pty = i < fty->args.len ? stb_resolve_type(vec_get(&fty->args, i, type), sco) : param->type;
+		ref = callee && i < callee->node->args.len && lay_by_ref(callee, i);
+		if(pty->kind == TP_STRING && !ref) {
+			args += ir_str_arg(param, blk, sco);
+			continue;
+		}
+		if(type_is_open(pty)) {
+			args += ir_arr_arg(param, blk, sco);
+			continue;
+		}
+		x = ir_visit_expr(param, blk, sco);
+		block_append(blk, x.block);
+		ta = ref ? ir_addr(x.loc, blk) : ir_conv(x.loc, param->type, pty, blk, sco);
+		loc_delete(x.loc);
+		if((num = ir_arg_num(callee, fty, i, param, sco)) != NUM_WORD) {
+			tb = ir_load(ta, num, blk);
+			loc_delete(ta);
+			ta = tb;
+		}
+		if(vec_get(&regs, i) || (callee && callee->static_frame)) {
+			/* A record or array can't wait in a temp; it is copied from where it is */
+			vec_set(&vals, i, ref || type_reg_class(pty) >= 0 ? ir_value(ta, blk) : loc_copy(ta));
+		} else {
+			args += ir_pass_arg(callee, 0, ta, ref ? NULL : pty, blk, sco);
+		}
+		loc_delete(ta);
+	}
+	if(callee) {
+		for(i = 0; callee->static_frame && i < ex->call.params.len; i++) {
+			if(vec_get(&regs, i)) {
+				continue;
+			}
+			if(!(formal = scope_resolve_name(callee->scope, vec_get(&callee->node->args, i, decl_node)->ident))) {
+				pass_error("Couldn't resolve argument %s (BUG)", vec_get(&callee->node->args, i, decl_node)->ident);
+			}
+			param = vec_get(&ex->call.params, i, expr_node);
+			ir_store(lay_by_ref(callee, i) ? formal->loc->ind.addr : formal->loc, ir_arg_type(callee, fty, i, param, sco), vec_get(&vals, i, location), blk, sco);
+			loc_delete(vec_get(&vals, i, location));
+			vec_set(&vals, i, NULL);
+		}
+		args += ir_hidden(callee, blk, sco);
+		target = loc_copy(sa->loc);
+	} else {
+		x = ir_visit_expr(ex->call.func, blk, sco);
+		block_append(blk, x.block);
+		target = loc_new_ind(x.loc);
+		loc_delete(x.loc);
+	}
+	for(i = 0; i < regs.len; i++) {
+		if(vec_get(&regs, i)) {
+			param = vec_get(&ex->call.params, i, expr_node);
+			block_emit(blk, instr_new_set_num(vec_get(&regs, i, location), ir_arg_num(callee, fty, i, param, sco), vec_get(&vals, i, location)));
+			loc_delete(vec_get(&regs, i, location));
+			loc_delete(vec_get(&vals, i, location));
+		}
+	}
+	vec_clear(&regs);
+	vec_clear(&vals);
+	block_emit(blk, instr_new_call(target));
+	loc_delete(target);
+	if(args) {
+		sp = loc_new_reg(REG_SP);
+		ta = ir_off(sp, args);
+		block_emit(blk, instr_new_laddr(sp, ta));
+		loc_delete(ta);
+		loc_delete(sp);
+	}
+	if(!fty->ret) {
+		return NULL;
+	}
+	pty = stb_resolve_type(fty->ret, sco);
+	rv = loc_new_reg(lay_ret_reg(pty));
+	ta = ir_load(rv, ir_num(pty), blk);
+	loc_delete(rv);
+	return ta;
+}
+
+/* res.loc holds the value: a temp, or the memory it lives in (NULL for procedure calls) */
+ir_ev_res ir_visit_expr(expr_node *ex, block *pblk, scope *sco) {
+	location *ta, *tb, *args[2];
+	block *blk = block_new(pblk);
+	symbol *sa;
+	scope *lsco;
+	type *ty;
+	ir_ev_res res = {blk, NULL}, x;
+	switch(ex->kind) {
+		case EX_LIT:
+			res.loc = ir_lit(ex->lit.lit, blk);
+			break;
+
+		case EX_REF:
+			sa = scope_resolve_name(sco, ex->ref.ident);
+			if(!sa) {
+				pass_error("Unknown symbol %s", ex->ref.ident);
+			}
+			if(sa->kind == SYM_CONST && sa->value) {
+				res.loc = ir_lit(sa->value, blk);
+			} else if(sa->kind == SYM_PROG) {
+				res.loc = loc_new_temp(NULL);
+				block_emit(blk, instr_new_laddr(res.loc, sa->loc));
+			} else {
+				res.loc = ir_sym_loc(sa, sco);
+			}
+			break;
+
+		case EX_ASSIGN:
+			sa = scope_resolve_name(sco, ex->assign.ident);
+			if(!sa) {
+				pass_error("Unknown symbol %s", ex->assign.ident);
+			}
+			if(tr_is_bitwise(ex->assign.value)) {
+				res.loc = ir_sym_loc(sa, sco);
+				ir_bits(ex->assign.value, res.loc, blk, sco);
+				break;
+			}
+			if(ex->assign.value->type->kind == TP_STRING) {
+				res.loc = ir_sym_loc(sa, sco);
+				ir_str_assign(res.loc, ex->assign.value, blk, sco);
+				break;
+			}
+			if(type_is_open(stb_resolve_type(sa->type, sco))) {
+				res.loc = ir_sym_loc(sa, sco);
+				ir_arr_assign(sa, res.loc, ex->assign.value, blk, sco);
 				break;
+			}
+			ta = ir_visit_as(ex->assign.value, sa->type, blk, sco);
+			res.loc = ir_sym_loc(sa, sco);
+			ir_store(res.loc, sa->type, ta, blk, sco);
+			loc_delete(ta);
+			break;
 
-			case SYM_DATA:
-				vec_insert(&amts, amts.len, loc_new_stride(loc_new_size(sym->type), loc_new_mem(-1)));
-				sym->loc = loc_new_off_vec(gdbase, &amts);
+		case EX_INDEX:
+			if(type_is_bitset(ex->index.object->type)) {
+				res.loc = ir_bit_get(ex->index.object, ex->index.index, blk, sco);
 				break;
+			}
+			res.loc = ir_index(ex->index.object, ex->index.index, blk, sco);
+			break;
 
-			case SYM_TYPE:
+		case EX_SETINDEX:
+			if(type_is_bitset(ex->setindex.object->type)) {
+				res.loc = ir_bit_set(ex->setindex.object, ex->setindex.index, ex->setindex.value, blk, sco);
 				break;
+			}
+			ta = ir_index(ex->setindex.object, ex->setindex.index, blk, sco);
+			ty = stb_resolve_type(type_of_index(stb_resolve_type(ex->setindex.object->type, sco), ex->setindex.index->type), sco);
+			tb = ir_visit_as(ex->setindex.value, ty, blk, sco);
+			ir_store(ta, ty, tb, blk, sco);
+			res.loc = ta;
+			loc_delete(tb);
+			break;
 
-			default:
-				assert(0);
+		case EX_FIELD:
+			res.loc = ir_field(ex->field.object, ex->field.ident, blk, sco);
+			break;
+
+		case EX_SETFIELD:
+			ta = ir_field(ex->setfield.object, ex->setfield.ident, blk, sco);
+			ty = stb_resolve_type(ir_field_type(ex->setfield.object, ex->setfield.ident, sco), sco);
+			tb = ir_visit_as(ex->setfield.value, ty, blk, sco);
+			ir_store(ta, ty, tb, blk, sco);
+			res.loc = ta;
+			loc_delete(tb);
+			break;
+
+		case EX_CALL:
+			res.loc = ir_call(ex, blk, sco);
+			break;
+
+		case EX_UNOP:
+			if(ex->unop.kind == OP_CARD) {
+				res.loc = ir_bits(ex->unop.expr, NULL, blk, sco);
+				break;
+			}
+			if(ex->unop.kind == OP_LENGTH && ex->unop.expr->type->kind == TP_STRING) {
+				ir_str_view(ex->unop.expr, NULL, &res.loc, blk, sco);
+				break;
+			}
+			if(ex->unop.kind == OP_LENGTH) {
+				ir_arr_view(ex->unop.expr, NULL, NULL, &res.loc, blk, sco);
+				break;
+			}
+			ta = ir_visit_as(ex->unop.expr, ex->type, blk, sco);
+			res.loc = loc_new_temp(NULL);
+			block_emit(blk, instr_new_unop_num(res.loc, ir_num(stb_resolve_type(ex->type, sco)), ex->unop.kind, ta));
+			loc_delete(ta);
+			break;
+
+		case EX_BINOP:
+			if(ex->binop.kind == OP_IN && ex->binop.right->type->kind == TP_STRING) {
+				res.loc = ir_str_in(ex, blk, sco);
+				break;
+			}
+			if(ex->binop.kind == OP_IN) {
+				res.loc = ir_in(ex, blk, sco);
 				break;
+			}
+			if(ex->binop.left->type->kind == TP_STRING) {
+				res.loc = ir_str_rel(ex, blk, sco);
+				break;
+			}
+			ty = ir_binop_type(ex, sco);
+			ta = ir_visit_as(ex->binop.left, ty, blk, sco);
+			tb = ir_visit_as(ex->binop.right, ty, blk, sco);
+			res.loc = loc_new_temp(NULL);
+			block_emit(blk, instr_new_binop_num(res.loc, ir_num(stb_resolve_type(ty ? ty : ex->type, sco)), ta, ex->binop.kind, tb));
+			loc_delete(ta);
+			loc_delete(tb);
+			break;
+
+		case EX_RETURN:
+			for(lsco = sco; lsco && !(lsco->prog && lsco->prog->result); lsco = lsco->parent);
+			if(!lsco) {
+				pass_error("Function result assigned outside a function (BUG)");
+			}
+			res.loc = ir_visit_as(ex->return_.value, lsco->prog->node->ret, blk, sco);
+			ir_store(lsco->prog->result, lsco->prog->node->ret, res.loc, blk, sco);
+			break;
+
+		case EX_IND:
+			x = ir_visit_expr(ex->ind.lvalue, blk, sco);
+			block_append(blk, x.block);
+			res.loc = loc_new_temp(NULL);
+			block_emit(blk, instr_new_laddr(res.loc, x.loc));
+			loc_delete(x.loc);
+			break;
+
+		case EX_SET:
+			/* tr only lets these be assigned or counted (see ir_bits) */
+			pass_error("Set %s built outside an assignment (BUG)", pass_repr(ex->type));
+			break;
+
+		case EX_SLICE:
+			/* Used as a view where it's given (ir_arr_view); anywhere else, like
+			 * @x, it's where its elements start */
+			ir_arr_view(ex, &res.loc, NULL, NULL, blk, sco);
+			break;
+
+		case EX_SETLENGTH:
+			res.loc = ir_arr_resize(ex, blk, sco);
+			break;
+
+		case EX_DEREF:
+			x = ir_visit_expr(ex->deref.object, blk, sco);
+			block_append(blk, x.block);
+			ta = ir_value(x.loc, blk);
+			res.loc = loc_new_ind(ta);
+			loc_delete(x.loc);
+			loc_delete(ta);
+			break;
+
+		case EX_SETDEREF:
+			x = ir_visit_expr(ex->setderef.object, blk, sco);
+			block_append(blk, x.block);
+			ta = ir_value(x.loc, blk);
+			res.loc = loc_new_ind(ta);
+			ty = stb_resolve_type(stb_resolve_type(ex->setderef.object->type, sco)->base, sco);
+			tb = ir_visit_as(ex->setderef.value, ty, blk, sco);
+			ir_store(res.loc, ty, tb, blk, sco);
+			loc_delete(x.loc);
+			loc_delete(ta);
+			loc_delete(tb);
+			break;
+
+		/* The block's size goes back to rt_dispose, so it's the pointee's,
+		 * known here; new leaves the block as rt_new does, uninitialized */
+		case EX_NEW:
+			ty = stb_resolve_type(stb_resolve_type(ex->alloc.object->type, sco)->base, sco);
+			args[0] = ir_imm(lay_size(ty), blk);
+			ta = ir_rt_call("rt_new", 1, args, 1, blk);
+			x = ir_visit_expr(ex->alloc.object, blk, sco);
+			block_append(blk, x.block);
+			ir_store(x.loc, ex->alloc.object->type, ta, blk, sco);
+			res.loc = x.loc;
+			loc_delete(args[0]);
+			loc_delete(ta);
+			break;
+
+		case EX_DISPOSE:
+			ty = stb_resolve_type(stb_resolve_type(ex->alloc.object->type, sco)->base, sco);
+			x = ir_visit_expr(ex->alloc.object, blk, sco);
+			block_append(blk, x.block);
+			args[0] = ir_value(x.loc, blk);
+			args[1] = ir_imm(lay_size(ty), blk);
+			ir_rt_call("rt_dispose", 2, args, 0, blk);
+			loc_delete(x.loc);
+			loc_delete(args[0]);
+			loc_delete(args[1]);
+			break;
+
+		default:
+			assert(0);
+	}
+	return res;
+}
+
+/********** Address Modes **********/
+
+/* Rewrites every operand that isn't a bare register or temp into one
+ * LOC_ADDR, the memory at base + index*scale + disp, which a single machine
+ * operand can name. Whatever doesn't fit is computed into temps right before
+ * the instruction. Frame bases (display entry values) are the common case:
+ * the program's own is FP-relative and needs no load, and each enclosing
+ * one is loaded once, after the prologue, through the display or the static
+ * links as cap decided; they don't change while the program runs.
+ */
+
+typedef struct _am_parts {
+	location *base;
+	location *index;
+	size_t scale;
+	ssize_t disp;
+} am_parts;
+
+typedef struct _am_state {
+	program *prog;
+	block *blk;
+	size_t at; /* where computations for the current instruction go */
+	vector frames; /* of location * (temps), frame bases by display index; NULL until loaded */
+} am_state;
+
+int am_pass(ast_root *ast, object *obj) {
+	size_t i;
+	block *root = obj->block, *blk;
+	for(i = 0; i < root->children.len; i++) {
+		blk = vec_get(&root->children, i, block);
+		if(blk->kind == BLK_PROG) {
+			am_visit_prog(blk);
 		}
 	}
+	return 0;
 }
 
-location *lr_calc_gdentry(size_t idx) {
-	return loc_new_off(loc_new_sym(SYNAME_GDISP), loc_new_stride(loc_new_mem(idx), loc_new_size(NULL)));
+static void am_decompose(am_state *, location *, am_parts *);
+
+static void am_emit(am_state *st, instr *ins) {
+	block_insert(st->blk, st->at++, ins);
 }
 
-/********** Intermediate Representation Generation **********/
+static int am_is_scale(ssize_t n) {
+	return n == 1 || n == 2 || n == 4 || n == 8;
+}
 
-int ir_pass(ast_root *ast, object *obj) {
-	block *root = block_new(NULL);
-	block *main = ir_visit_prog(obj->root_prog, root);
-	block_append(root, main);
-	obj->block = block_copy(root);
-	return 0;
+/* A temp holding base + index*scale + disp */
+static location *am_lea(am_state *st, location *base, location *index, size_t scale, ssize_t disp) {
+	location *res = loc_new_temp(NULL), *addr = loc_new_addr(base, index, scale, disp);
+	am_emit(st, instr_new_laddr(res, addr));
+	loc_delete(addr);
+	return res;
 }
 
-block *ir_visit_prog(program *prog, block *superblk) {
-	block *blk = block_new_program(superblk, prog);
-	block *prologue = ir_make_prologue(prog, blk);
-	block *body = ir_visit_stmt(prog->node->body, blk, prog->scope);
-	block *epilogue = ir_make_epilogue(prog, blk);
-	block_append(blk, prologue);
-	block_append(blk, body);
-	block_append(blk, epilogue);
-	return blk;
+/* Adds term*scale to p; term is a register, temp or symbol */
+static void am_add(am_state *st, am_parts *p, location *term, ssize_t scale) {
+	location *t, *k;
+	if(term->kind == LOC_SYM && (p->base || p->index || scale != 1)) {
+		term = am_lea(st, term, NULL, 1, 0);
+	} else {
+		term = loc_copy(term);
+	}
+	if(!am_is_scale(scale)) {
+		k = am_lea(st, NULL, NULL, 1, scale);
+		t = loc_new_temp(NULL);
+		am_emit(st, instr_new_binop(t, term, OP_MUL, k));
+		loc_delete(term);
+		loc_delete(k);
+		term = t;
+		scale = 1;
+	}
+	if(scale == 1 && !p->base) {
+		p->base = term;
+		return;
+	}
+	if(p->index) {
+		/* Out of slots: what's there so far becomes the base */
+		t = am_lea(st, p->base, p->index, p->scale, 0);
+		if(p->base) {
+			loc_delete(p->base);
+		}
+		loc_delete(p->index);
+		p->base = t;
+	}
+	p->index = term;
+	p->scale = scale;
 }
 
-block *ir_make_prologue(program *prog, block *pblk) {
-	location *fralloc = loc_new_reg(REG_SP);
-	location *gdentry = lr_calc_gdentry(prog->gdidx);
-	block *blk = block_new(pblk);
-	size_t i;
-	for(i = 0; i < prog->node->decls.len; i++) {
-		decl_node *decl = vec_get(&prog->node->decls, i, decl_node);
-		symbol *sym = scope_resolve_name(prog->scope, decl->ident);
-		if(decl->kind != DECL_VAR) continue;
-		if(!sym) {
-			pass_error("Couldn't resolve variable %s (BUG)", decl->ident);
+/* A register or temp holding address(loc) */
+static location *am_value(am_state *st, location *loc) {
+	am_parts p = {NULL, NULL, 1, 0};
+	location *res;
+	if(loc->kind == LOC_REG || loc->kind == LOC_TEMP) {
+		return loc_copy(loc);
+	}
+	am_decompose(st, loc, &p);
+	if(p.base && p.base->kind != LOC_SYM && !p.index && !p.disp) {
+		return p.base;
+	}
+	res = am_lea(st, p.base, p.index, p.scale, p.disp);
+	if(p.base) {
+		loc_delete(p.base);
+	}
+	if(p.index) {
+		loc_delete(p.index);
+	}
+	return res;
+}
+
+/* The register the program's own frame base is relative to, and the
+ * offset from it: FP, less the saved display entry if there is one, or for a
+ * frameless leaf SP, less where FP would have been pushed (see ir); a static
+ * frame's is the overlay symbol
+ */
+static location *am_own(program *prog, ssize_t *disp) {
+	if(prog->static_frame) {
+		*disp = prog->static_off + prog->frame_size;
+		return loc_new_sym(SYNAME_OVERLAY);
+	}
+	if(prog->frameless) {
+		*disp = -(ssize_t) target_current->word;
+		return loc_new_reg(REG_SP);
+	}
+	*disp = prog->display ? -(ssize_t) target_current->word : 0;
+	return loc_new_reg(REG_FP);
+}
+
+/* A temp loaded from base + disp once, right after the prologue, holding
+ * the frame base of display index level from then on
+ */
+static location *am_hoist(am_state *st, size_t level, location *base, ssize_t disp) {
+	location *t = loc_new_temp(NULL), *addr = loc_new_addr(base, NULL, 1, disp);
+	block_insert(st->blk, st->blk->body, instr_new_set(t, addr));
+	if(st->blk->body <= st->at) {
+		st->at++;
+	}
+	st->blk->body++;
+	loc_delete(addr);
+	vec_set(&st->frames, level, t);
+	return t;
+}
+
+/* The frame base of display index level, an enclosing program's; cap made
+ * sure the way there exists: the display, or static links up to it, or up
+ * to a program that reads the display.
+ */
+static location *am_frame(am_state *st, size_t level) {
+	program *cur = st->prog, *parent;
+	location *t = NULL, *gdisp, *fp;
+	ssize_t disp;
+	while(st->frames.len <= level) {
+		vec_insert(&st->frames, st->frames.len, NULL);
+	}
+	if(vec_get(&st->frames, level)) {
+		return vec_get(&st->frames, level, location);
+	}
+	while(cur->capture == CAP_LINK) {
+		parent = cap_parent(cur);
+		while(st->frames.len <= parent->gdidx) {
+			vec_insert(&st->frames, st->frames.len, NULL);
 		}
-		fralloc = loc_new_off(fralloc, loc_new_stride(loc_new_size(sym->type), loc_new_mem(-1)));
+		if(vec_get(&st->frames, parent->gdidx)) {
+			t = vec_get(&st->frames, parent->gdidx, location);
+		} else if(t) {
+			t = am_hoist(st, parent->gdidx, t, lay_hidden(cur, 0));
+		} else {
+			fp = am_own(cur, &disp);
+			t = am_hoist(st, parent->gdidx, fp, lay_hidden(cur, 0) + disp);
+			loc_delete(fp);
+		}
+		if(parent->gdidx == level) {
+			return t;
+		}
+		cur = parent;
 	}
-	block_emit(blk, instr_new_push(loc_new_reg(REG_FP)));
-	block_emit(blk, instr_new_laddr(loc_new_reg(REG_FP), loc_new_reg(REG_SP)));
-	block_emit(blk, instr_new_push(gdentry));
-	block_emit(blk, instr_new_laddr(gdentry, loc_new_reg(REG_SP)));
-	block_emit(blk, instr_new_laddr(loc_new_reg(REG_SP), fralloc));
-	return blk;
+	if(cur->capture != CAP_DISPLAY) {
+		pass_error("%s can't reach the frame of display entry %ld (BUG)", st->prog->node->ident, level);
+	}
+	gdisp = loc_new_sym(SYNAME_GDISP);
+	t = am_hoist(st, level, gdisp, level * target_current->word);
+	loc_delete(gdisp);
+	return t;
 }
 
-block *ir_make_epilogue(program *prog, block *pblk) {
-	block *blk = block_new(pblk);
-	location *gdentry = lr_calc_gdentry(prog->gdidx);
-	block_emit(blk, instr_new_laddr(loc_new_reg(REG_SP), gdentry));
-	block_emit(blk, instr_new_pop(gdentry));
-	block_emit(blk, instr_new_pop(loc_new_reg(REG_FP)));
-	return blk;
+/* Adds address(IND(x)), the word stored at address(x), to p */
+static void am_load(am_state *st, location *x, am_parts *p) {
+	am_parts q = {NULL, NULL, 1, 0};
+	location *t, *addr, *fp;
+	size_t level, word = target_current->word;
+	ssize_t disp;
+	if(x->kind == LOC_REG || x->kind == LOC_TEMP) {
+		am_add(st, p, x, 1);
+		return;
+	}
+	am_decompose(st, x, &q);
+	if(q.base && q.base->kind == LOC_SYM && string_equal(q.base->sym.name, SYNAME_GDISP) && !q.index && q.disp >= 0 && !(q.disp % word)) {
+		level = q.disp / word;
+		if(level == st->prog->gdidx) {
+			fp = am_own(st->prog, &disp);
+			am_add(st, p, fp, 1);
+			p->disp += disp;
+			loc_delete(fp);
+		} else {
+			am_add(st, p, am_frame(st, level), 1);
+		}
+		loc_delete(q.base);
+		return;
+	}
+	t = loc_new_temp(NULL);
+	addr = loc_new_addr(q.base, q.index, q.scale, q.disp);
+	am_emit(st, instr_new_set(t, addr));
+	am_add(st, p, t, 1);
+	loc_delete(addr);
+	loc_delete(t);
+	if(q.base) {
+		loc_delete(q.base);
+	}
+	if(q.index) {
+		loc_delete(q.index);
+	}
 }
 
-block *ir_visit_stmt(stmt_node *st, block *pblk, scope *sco) {
-	size_t i;
-	block *blk = block_new(pblk), *a, *b, *c;
-	ir_ev_res x, y, z;
-	instr *la, *lb, *lc;
-	location *ta, *tb, *tc, *td, *te;
-	symbol *sa, *sb, *sc;
-	switch(st->kind) {
-		case ST_EXPR:
-			x = ir_visit_expr(st->expr.expr, blk, sco);
-			block_append(blk, x.block);
+/* Adds address(loc) to p; loc is folded */
+static void am_decompose(am_state *st, location *loc, am_parts *p) {
+	location *a, *b, *t;
+	ssize_t sz;
+	switch(loc->kind) {
+		case LOC_MEM:
+			p->disp += loc->mem.addr;
 			break;
 
-		case ST_WHILE:
-			x = ir_visit_expr(st->while_.cond, blk, sco);
-			la = instr_new_label(NULL);
-			lb = instr_new_label(NULL);
-			block_emit(blk, la);
-			block_append(blk, x.block);
-			ta = loc_new_temp(NULL);
-			block_emit(blk, instr_new_unop(ta, OP_NOT, x.loc));
-			block_emit(blk, instr_new_jumpif(lb, ta));
-			a = ir_visit_stmt(st->while_.body, blk, sco);
-			block_append(blk, a);
-			block_emit(blk, lb);
+		case LOC_SIZE:
+			sz = type_size(loc->size.type);
+			if(sz < 0) {
+				pass_error("Size of %s isn't known here (BUG)", pass_repr(loc->size.type));
+			}
+			p->disp += sz;
 			break;
 
-		case ST_IF:
-			x = ir_visit_expr(st->if_.cond, blk, sco);
-			la = instr_new_label(NULL);
-			block_append(x.block);
-			ta = loc_new_temp(NULL);
-			block_emit(blk, instr_new_unop(ta, OP_NOT, x.loc));
-			block_emit(blk, instr_new_jumpif(la, ta));
-			a = ir_visit_stmt(st->if_.iftrue, blk, sco);
-			block_append(blk, a);
-			block_emit(blk, la);
-			if(st->if_.iffalse) {
-				b = ir_visit_stmt(st->if_.iffalse, blk, sco);
-				block_append(blk, b);
-			}
+		case LOC_OFF:
+			am_decompose(st, loc->off.addr, p);
+			am_decompose(st, loc->off.amt, p);
 			break;
 
-		case ST_FOR:
-			a = ir_visit_stmt(st->for_.init, blk, sco);
-			block_append(blk, a);
-			la = instr_new_label(NULL);
-			lb = instr_new_label(NULL);
-			block_emit(blk, lb);
-			x = ir_visit_expr(st->for_.cond, blk, sco);
-			block_append(blk, x.block);
-			ta = loc_new_temp(NULL);
-			block_emit(blk, instr_new_unop(ta, OP_NOT, x.loc));
-			block_emit(blk, instr_new_jumpif(la, ta));
-			b = ir_visit_stmt(st->for_.body, blk, sco);
-			block_append(blk, b);
-			c = ir_visit_stmt(st->for_.post, blk, sco);
-			block_append(blk, c);
-			block_emit(blk, instr_new_jump(lb));
-			block_emit(blk, la);
+		case LOC_STRIDE:
+			a = loc->stride.loc;
+			b = loc->stride.stride;
+			if(b->kind == LOC_MEM || a->kind == LOC_MEM) {
+				if(a->kind == LOC_MEM) {
+					t = a;
+					a = b;
+					b = t;
+				}
+				t = am_value(st, a);
+				am_add(st, p, t, b->mem.addr);
+			} else {
+				a = am_value(st, a);
+				b = am_value(st, b);
+				t = loc_new_temp(NULL);
+				am_emit(st, instr_new_binop(t, a, OP_MUL, b));
+				am_add(st, p, t, 1);
+				loc_delete(a);
+				loc_delete(b);
+			}
+			loc_delete(t);
 			break;
 
-		case ST_ITER:
-			x = ir_visit_expr(st->iter.value, blk, sco);
-			block_append(blk, x.block);
-			ta = loc_new_temp(NULL);
-			tb = loc_new_temp(NULL);
-			tc = loc_new_temp(NULL);
-			block_emit(blk, instr_new_laddr(ta, loc_new_mem(st->iter.value->type->lbound)));
-			block_emit(blk, instr_new_laddr(tb, loc_new_mem(st->iter.value->type->lbound + st->iter.value->type->size)));
-			la = instr_new_label(NULL);
-			lb = instr_new_label(NULL);
-			block_emit(blk, la);
-			block_emit(blk, instr_new_binop(tc, ta, OP_GEQ, tb));
-			block_emit(blk, instr_new_jumpif(lb, tc));
-			sa = scope_resolve_name(sco, st->iter.ident);
-			block_emit(blk, instr_new_set(sa->loc, ta));
-			a = ir_visit_stmt(st->iter.body, blk, sco);
-			block_append(blk, a);
-			block_emit(blk, instr_new_laddr(ta, loc_new_off(ta, loc_new_mem(1))));
-			block_emit(blk, instr_new_jump(la));
-			block_emit(blk, lb);
+		case LOC_IND:
+			am_load(st, loc->ind.addr, p);
 			break;
 
-		case ST_RANGE:
-			x = ir_visit_expr(st->range.lbound, blk, sco);
-			y = ir_visit_expr(st->range.ubound, blk, sco);
-			z = ir_visit_expr(st->range.step, blk, sco);
-			block_append(blk, x.block);
-			block_append(blk, y.block);
-			block_append(blk, z.block);
-			ta = loc_new_temp(NULL);
-			tb = loc_new_temp(NULL);
-			tc = loc_new_temp(NULL);
-			td = loc_new_temp(NULL);
-			block_emit(blk, instr_new_set(ta, x.loc));
-			block_emit(blk, instr_new_set(tb, y.loc));
-			block_emit(blk, instr_new_set(tc, z.loc));
-			la = instr_new_label(NULL);
-			lb = instr_new_label(NULL);
-			block_emit(blk, la);
-			block_emit(blk, instr_new_binop(td, ta, OP_GREATER, tb));
-			block_emit(blk, instr_new_jumpif(lb, td));
-			sa = scope_resolve_name(sco, st->range.ident);
-			block_emit(blk, instr_new_set(sa->loc, ta));
-			a = ir_visit_stmt(st->iter.body, blk, sco);
-			block_append(blk, a);
-			block_emit(blk, instr_new_binop(te, ta, OP_ADD, tc));
-			block_emit(blk, instr_new_set(ta, te));
-			block_emit(blk, instr_new_jump(la));
-			block_emit(blk, lb);
+		case LOC_REG:
+		case LOC_TEMP:
+		case LOC_SYM:
+			am_add(st, p, loc, 1);
 			break;
 
-		case ST_COMPOUND:
-			for(i = 0; i < st->compound.stmts.len; i++) {
-				a = ir_visit_stmt(vec_get(&st->compound.stmts, i, stmt_node), blk, sco);
-				block_append(blk, a);
+		case LOC_ADDR:
+			if(loc->addr.base) {
+				am_add(st, p, loc->addr.base, 1);
 			}
+			if(loc->addr.index) {
+				am_add(st, p, loc->addr.index, loc->addr.scale);
+			}
+			p->disp += loc->addr.disp;
 			break;
 
 		default:
 			assert(0);
-			break;
 	}
-	return blk;
 }
 
-ir_ev_res ir_visit_expr(expr_node *ex, block *pblk, scope *sco) {
-	location *ta, *tb, *tc;
-	block *blk = block_new(pblk);
-	symbol *sa, *sb, *sc;
-	switch(ex->kind) {
-		case EX_LIT:
-			switch(ex->lit.lit->kind) {
-				case LIT_INT:
-					break;
-			}
-			break;
+static void am_operand(am_state *st, location **loc) {
+	am_parts p = {NULL, NULL, 1, 0};
+	location *f;
+	if(!*loc || (*loc)->kind == LOC_REG || (*loc)->kind == LOC_TEMP) {
+		return;
+	}
+	f = loc_fold(*loc);
+	am_decompose(st, f, &p);
+	loc_delete(f);
+	loc_delete(*loc);
+	*loc = loc_new_addr(p.base, p.index, p.scale, p.disp);
+	if(p.base) {
+		loc_delete(p.base);
+	}
+	if(p.index) {
+		loc_delete(p.index);
+	}
+}
+
+void am_visit_prog(block *blk) {
+	am_state st;
+	instr *ins;
+	size_t i;
+	st.prog = blk->prog;
+	st.blk = blk;
+	vec_init(&st.frames);
+	for(i = 0; i < blk->instrs.len; i++) {
+		ins = vec_get(&blk->instrs, i, instr);
+		st.at = i;
+		switch(ins->kind) {
+			case IN_SET:
+				am_operand(&st, &ins->set.value);
+				am_operand(&st, &ins->set.loc);
+				break;
+
+			case IN_LADDR:
+				am_operand(&st, &ins->laddr.value);
+				am_operand(&st, &ins->laddr.loc);
+				break;
+
+			case IN_BINOP:
+				am_operand(&st, &ins->binop.left);
+				am_operand(&st, &ins->binop.right);
+				am_operand(&st, &ins->binop.loc);
+				break;
+
+			case IN_UNOP:
+				am_operand(&st, &ins->unop.value);
+				am_operand(&st, &ins->unop.loc);
+				break;
+
+			case IN_CONV:
+				am_operand(&st, &ins->conv.value);
+				am_operand(&st, &ins->conv.loc);
+				break;
+
+			case IN_COPY:
+				am_operand(&st, &ins->copy.value);
+				am_operand(&st, &ins->copy.loc);
+				break;
+
+			case IN_PUSH:
+				am_operand(&st, &ins->push.value);
+				break;
+
+			case IN_POP:
+				am_operand(&st, &ins->pop.loc);
+				break;
+
+			case IN_CALL:
+				am_operand(&st, &ins->call.target);
+				break;
+
+			case IN_RETURN:
+				am_operand(&st, &ins->return_.value);
+				break;
+
+			case IN_JUMPIF:
+				am_operand(&st, &ins->jumpif.test);
+				break;
+
+			default:
+				break;
+		}
+		i = st.at;
+	}
+	for(i = 0; i < st.frames.len; i++) {
+		if(vec_get(&st.frames, i)) {
+			loc_delete(vec_get(&st.frames, i, location));
+		}
 	}
+	vec_clear(&st.frames);
 }
@@ -4,6 +4,9 @@
 #include "ast.h"
 #include "sem.h"
 #include "cg.h"
+#include "dump.h"
+#include "diag.h"
+#include "layout.h"
 
 typedef int (*pass_f)(ast_root *, object *);
 typedef void (*pass_print_f)(int);
@@ -12,18 +15,35 @@ typedef struct _pass {
 	pass_f run;
 	pass_print_f print;
 	char *name;
+	char *key;
 } pass;
 
 extern pass passes[];
 
-object *pass_do_all(ast_root *ast);
+typedef struct _pass_dump {
+	dumper *out;
+	unsigned int what; /* mask of dump_k */
+	const char *after; /* pass key, "all", or NULL for the final state only */
+} pass_dump;
+
+int pass_do_all(ast_root *ast, object *obj, diag_list *diags, pass_dump *dump);
+ssize_t pass_find(const char *key);
+void pass_dump_state(pass_dump *dump, const char *key, ast_root *ast, object *obj);
 void pass_error(const char *fmt,...);
 void pass_verror(const char *fmt,va_list va);
+void pass_record(const char *fmt,...);
+void pass_vrecord(const char *fmt,va_list va);
 void pass_warning(const char *fmt,...);
 void pass_vwarning(const char *fmt,va_list va);
+void pass_defer(void (*fn)(void *), void *arg);
+const char *pass_repr(type *ty);
 
 int stb_pass(ast_root *ast, object *obj);
 int stb_visit_prog(prog_node *node, program *prog);
+void stb_visit_all(program *prog);
+void stb_reach_prog(program *prog);
+void stb_reach_stmt(program *prog, stmt_node *st);
+void stb_reach_expr(program *prog, expr_node *ex);
 type *stb_resolve_type(type *ty, scope *sco);
 type *stb_resolve_prog_type(prog_node *prog, scope *sco);
 int stb_test_decl(program *prog, decl_node *decl, vector *decls, size_t idx);
@@ -33,11 +53,42 @@ int tr_pass(ast_root *, object *);
 int tr_visit_prog(program *);
 void tr_visit_stmt(stmt_node *, scope *);
 void tr_visit_expr(expr_node *, scope *);
+void tr_check_cast(cast_k kind, const char *fmt, ...);
+
+int cf_pass(ast_root *, object *);
+void cf_visit_prog(program *, size_t *);
+void cf_visit_stmt(stmt_node *, size_t *);
+expr_node *cf_visit_expr(expr_node *, size_t *);
+int cf_is_pure(expr_node *);
+
+#define CTFE_MAX_STEPS 1000000
+#define CTFE_MAX_DEPTH 256
+
+int ctfe_pass(ast_root *, object *);
+void ctfe_visit_prog(program *, size_t *);
+void ctfe_visit_stmt(stmt_node *, scope *, size_t *);
+expr_node *ctfe_visit_expr(expr_node *, scope *, size_t *);
+literal *ctfe_eval(expr_node *, scope *);
+
+int ef_pass(ast_root *, object *);
+void ef_visit_prog(program *, effect *, vector *);
+void ef_visit_stmt(stmt_node *, program *, effect *);
+void ef_visit_expr(expr_node *, program *, effect *);
+int ef_merge(program *, effect *, effect *);
+
+int sf_pass(ast_root *, object *);
+
+int cap_pass(ast_root *, object *);
+
+int esc_pass(ast_root *, object *);
 
 int lr_pass(ast_root *, object *);
 void lr_visit_prog(program *, size_t *);
 location *lr_calc_gdentry(size_t idx);
 
+int lay_pass(ast_root *, object *);
+void lay_visit_prog(program *, effect *);
+
 typedef struct _ir_ev_res {
 	block *block;
 	location *loc;
@@ -49,4 +100,7 @@ block *ir_make_prologue(program *prog,block *pblk);
 block *ir_make_epilogue(program *prog,block *pblk);
 block *ir_visit_stmt(stmt_node *st,block *pblk,scope *sco);
 ir_ev_res ir_visit_expr(expr_node *ex,block *pblk,scope *sco);
+
+int am_pass(ast_root *, object *);
+void am_visit_prog(block *);
 #endif
@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#include "rt_alloc.h"
+
+/* 16-byte steps up to 256, then 64 up to 512 and 128 up to RT_ALLOC_MAX:
+ * at most a quarter of a block is slack past the first classes. Every class
+ * is a multiple of 16, so blocks are as aligned as malloc's.
+ */
+#define RT_NCLASSES 24
+
+static const size_t rt_class_size[RT_NCLASSES] = {
+	16, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208, 224, 240, 256,
+	320, 384, 448, 512,
+	640, 768, 896, 1024,
+};
+
+static size_t rt_class(size_t size) {
+	if(size <= 256) {
+		return size ? (size - 1) / 16 : 0;
+	}
+	if(size <= 512) {
+		return 16 + (size - 257) / 64;
+	}
+	return 20 + (size - 513) / 128;
+}
+
+/* A free block holds the next one in its class's list */
+typedef struct _rt_free {
+	struct _rt_free *next;
+} rt_free;
+
+typedef struct _rt_counts {
+	size_t news;
+	size_t disposes;
+} rt_counts;
+
+/* A thread's heap. It is mapped, not thread-local storage, so the report
+ * can still read it after the thread is gone.
+ */
+typedef struct _rt_heap {
+	rt_free *free[RT_NCLASSES];
+	char *bump[RT_NCLASSES]; /* the rest of the class's newest slab */
+	char *end[RT_NCLASSES];
+	rt_counts counts[RT_NCLASSES];
+	rt_counts large;
+	size_t slabs;
+	struct _rt_heap *next; /* in rt_heaps */
+} rt_heap;
+
+static __thread rt_heap *rt_self;
+static rt_heap *rt_heaps; /* every thread's, newest first */
+static int rt_reporting;
+
+static void *rt_map(size_t size) {
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(p != MAP_FAILED);
+	return p;
+}
+
+static void rt_report_at_exit(void) {
+	if(getenv("RT_ALLOC_STATS")) {
+		rt_alloc_report(stderr);
+	}
+}
+
+/* The calling thread's first rt_new or rt_dispose */
+static rt_heap *rt_heap_new(void) {
+	rt_heap *h = rt_map(sizeof(rt_heap));
+	h->next = __atomic_load_n(&rt_heaps, __ATOMIC_ACQUIRE);
+	while(!__atomic_compare_exchange_n(&rt_heaps, &h->next, h, 1, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+	if(!__atomic_exchange_n(&rt_reporting, 1, __ATOMIC_ACQ_REL)) {
+		atexit(rt_report_at_exit);
+	}
+	rt_self = h;
+	return h;
+}
+
+/* A fresh slab for class c; whatever was left of the last one is dropped */
+static void rt_slab(rt_heap *h, size_t c) {
+	h->bump[c] = rt_map(RT_ALLOC_SLAB);
+	h->end[c] = h->bump[c] + RT_ALLOC_SLAB / rt_class_size[c] * rt_class_size[c];
+	h->slabs++;
+}
+
+void *rt_new(size_t size) {
+	rt_heap *h = rt_self ? rt_self : rt_heap_new();
+	rt_free *f;
+	void *p;
+	size_t c;
+	if(size > RT_ALLOC_MAX) {
+		h->large.news++;
+		p = malloc(size);
+		assert(p);
+		return p;
+	}
+	c = rt_class(size);
+	h->counts[c].news++;
+	if((f = h->free[c])) {
+		h->free[c] = f->next;
+		return f;
+	}
+	if(h->bump[c] == h->end[c]) {
+		rt_slab(h, c);
+	}
+	p = h->bump[c];
+	h->bump[c] += rt_class_size[c];
+	return p;
+}
+
+/* A block freed by another thread than the one that allocated it joins
+ * this thread's list; the two heaps just trade memory.
+ */
+void rt_dispose(void *p, size_t size) {
+	rt_heap *h = rt_self ? rt_self : rt_heap_new();
+	rt_free *f = p;
+	size_t c;
+	if(!p) {
+		return;
+	}
+	if(size > RT_ALLOC_MAX) {
+		h->large.disposes++;
+		free(p);
+		return;
+	}
+	c = rt_class(size);
+	h->counts[c].disposes++;
+	f->next = h->free[c];
+	h->free[c] = f;
+}
+
+/* Other threads' counts are read as they are; at exit they're settled */
+void rt_alloc_report(FILE *out) {
+	rt_counts total = {0, 0}, counts[RT_NCLASSES] = {{0, 0}}, large = {0, 0};
+	rt_heap *h;
+	size_t c, slabs = 0, threads = 0;
+	for(h = __atomic_load_n(&rt_heaps, __ATOMIC_ACQUIRE); h; h = h->next) {
+		for(c = 0; c < RT_NCLASSES; c++) {
+			counts[c].news += h->counts[c].news;
+			counts[c].disposes += h->counts[c].disposes;
+		}
+		large.news += h->large.news;
+		large.disposes += h->large.disposes;
+		slabs += h->slabs;
+		threads++;
+	}
+	for(c = 0; c < RT_NCLASSES; c++) {
+		total.news += counts[c].news;
+		total.disposes += counts[c].disposes;
+	}
+	fprintf(out, "rt_alloc: %zu threads, %zu slabs (%zu bytes) mapped\n", threads, slabs, slabs * RT_ALLOC_SLAB);
+	fprintf(out, "rt_alloc: %zu new, %zu disposed in size classes\n", total.news, total.disposes);
+	for(c = 0; c < RT_NCLASSES; c++) {
+		if(counts[c].news || counts[c].disposes) {
+			fprintf(out, "rt_alloc:   %4zu bytes: %zu new, %zu disposed, %zu live\n", rt_class_size[c], counts[c].news, counts[c].disposes, counts[c].news - counts[c].disposes);
+		}
+	}
+	fprintf(out, "rt_alloc: %zu new, %zu disposed over %d bytes (malloc)\n", large.news, large.disposes, RT_ALLOC_MAX);
+}
@@ -0,0 +1,32 @@
+#ifndef RT_ALLOC_H
+#define RT_ALLOC_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* The runtime's heap, linked into compiled programs: the storage of
+ * dynamic arrays and long strings, what new allocates, and variables that
+ * escape their frame (see esc in pass.c). Small blocks come in size
+ * classes, carved from slabs obtained with mmap and recycled through a free
+ * list per class and thread, so rt_new and rt_dispose are a handful of
+ * instructions and never lock.
+ * Slabs are never unmapped. Larger blocks are left to malloc. Callers give
+ * rt_dispose the size back, so blocks carry no header.
+ *
+ * A program's new and dispose call these directly, with the size of what
+ * the pointer points to. bench/ times them against malloc.
+ */
+
+#define RT_ALLOC_MAX 1024 /* largest block from a size class */
+#define RT_ALLOC_SLAB (64 * 1024)
+
+/* size bytes, uninitialized; never NULL */
+void *rt_new(size_t size);
+/* p came from rt_new(size), in any thread; NULL is ignored */
+void rt_dispose(void *p, size_t size);
+/* Counts over every thread's heap. Also written to stderr at exit when
+ * RT_ALLOC_STATS is set in the environment.
+ */
+void rt_alloc_report(FILE *out);
+
+#endif
@@ -0,0 +1,75 @@
+#include <string.h>
+
+#include "rt_array.h"
+#include "rt_alloc.h"
+
+/* Precedes a dynamic array's elements; sized so they stay as aligned as
+ * rt_new left the block */
+typedef union _rt_arr_header {
+	struct {
+		size_t cap; /* in elements */
+		size_t size; /* of the block, header included, for rt_dispose */
+	};
+	long double align;
+} rt_arr_header;
+
+#define RT_ARR_HEADER(data) ((rt_arr_header *) (data) - 1)
+
+static size_t rt_arr_cap(rt_array *a) {
+	return a->data ? RT_ARR_HEADER(a->data)->cap : 0;
+}
+
+/* Room for at least len elements, moving the first keep of them along */
+static void rt_arr_reserve(rt_array *a, size_t len, size_t keep, size_t elem) {
+	rt_arr_header *h;
+	size_t cap = rt_arr_cap(a);
+	if(len <= cap) {
+		return;
+	}
+	cap = len < 2 * cap ? 2 * cap : len;
+	h = rt_new(sizeof(rt_arr_header) + cap * elem);
+	h->cap = cap;
+	h->size = sizeof(rt_arr_header) + cap * elem;
+	if(keep) {
+		memcpy(h + 1, a->data, keep * elem);
+	}
+	if(a->data) {
+		rt_dispose(RT_ARR_HEADER(a->data), RT_ARR_HEADER(a->data)->size);
+	}
+	a->data = h + 1;
+}
+
+void rt_arr_resize(rt_array *a, size_t len, size_t elem) {
+	rt_arr_reserve(a, len, a->len < len ? a->len : len, elem);
+	if(len > a->len) {
+		memset((char *) a->data + a->len * elem, 0, (len - a->len) * elem);
+	}
+	a->len = len;
+}
+
+/* The source may be a view of a's own elements: it is copied before the
+ * old storage goes, or moved within it.
+ */
+void rt_arr_set(rt_array *a, const void *data, size_t len, size_t elem) {
+	rt_array old = *a;
+	if(len > rt_arr_cap(a)) {
+		a->data = NULL;
+		rt_arr_reserve(a, len, 0, elem);
+		memcpy(a->data, data, len * elem);
+		a->len = len;
+		rt_arr_free(&old);
+		return;
+	}
+	if(len) {
+		memmove(a->data, data, len * elem);
+	}
+	a->len = len;
+}
+
+void rt_arr_free(rt_array *a) {
+	if(a->data) {
+		rt_dispose(RT_ARR_HEADER(a->data), RT_ARR_HEADER(a->data)->size);
+	}
+	a->data = NULL;
+	a->len = 0;
+}
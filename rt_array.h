@@ -0,0 +1,29 @@
+#ifndef RT_ARRAY_H
+#define RT_ARRAY_H
+
+#include <stddef.h>
+
+/* Runtime support for open and dynamic arrays, linked into compiled
+ * programs. The compiler knows this layout (see layout.c): it reads all
+ * three words inline, to index and slice, and only calls in to resize. An
+ * open argument or a slice is a view of elements owned by something else;
+ * a dynamic array variable owns heap storage, preceded by a header holding
+ * its capacity. A view of a dynamic array is only good until it is resized.
+ */
+
+typedef struct _rt_array {
+	void *data; /* NULL while a dynamic array has no storage */
+	long lbound; /* index of the first element */
+	size_t len;
+} rt_array;
+
+/* Sets the length of a dynamic array, keeping the elements that remain;
+ * new ones are zeroed. Storage grows geometrically, so growing an array an
+ * element at a time is linear overall, and never shrinks until rt_arr_free.
+ */
+void rt_arr_resize(rt_array *a, size_t len, size_t elem);
+/* a := the len elements at data (which may be a's own), keeping its lbound */
+void rt_arr_set(rt_array *a, const void *data, size_t len, size_t elem);
+void rt_arr_free(rt_array *a);
+
+#endif
@@ -0,0 +1,118 @@
+#include <string.h>
+
+#include "rt_string.h"
+#include "rt_alloc.h"
+
+/* The byte loops are all left to memchr, memcmp and memcpy, which the C
+ * library vectorizes for the machine it runs on.
+ */
+
+static size_t rt_str_cap(rt_string *s) {
+	return s->data == s->small ? RT_STR_SMALL : s->cap;
+}
+
+void rt_str_own(rt_string *s) {
+	const char *from = s->data;
+	char *buf;
+	if(s->len <= RT_STR_SMALL) {
+		memmove(s->small, from, s->len);
+		s->data = s->small;
+		return;
+	}
+	buf = rt_new(s->len);
+	memcpy(buf, from, s->len);
+	s->data = buf;
+	s->cap = s->len;
+}
+
+void rt_str_free(rt_string *s) {
+	if(s->data != s->small) {
+		rt_dispose(s->data, s->cap);
+	}
+	s->data = s->small;
+	s->len = 0;
+}
+
+/* Appending to dst itself (s := s + t) fills its spare capacity in place,
+ * which grows geometrically, so building a string that way is linear.
+ * Anything else is built in fresh storage and then takes dst's place, since
+ * the parts may point into what dst holds now.
+ */
+void rt_str_concat(rt_string *dst, size_t n, const rt_view *parts) {
+	char tmp[RT_STR_SMALL], *buf;
+	size_t i, len = 0, off, cap;
+	for(i = 0; i < n; i++) {
+		len += parts[i].len;
+	}
+	if(n && parts[0].data == dst->data && parts[0].len == dst->len && len <= rt_str_cap(dst)) {
+		off = dst->len;
+		for(i = 1; i < n; i++) {
+			memcpy(dst->data + off, parts[i].data, parts[i].len);
+			off += parts[i].len;
+		}
+		dst->len = len;
+		return;
+	}
+	if(len <= RT_STR_SMALL) {
+		buf = tmp;
+		cap = RT_STR_SMALL;
+	} else {
+		cap = len;
+		if(n && parts[0].data == dst->data && cap < 2 * dst->len) {
+			cap = 2 * dst->len;
+		}
+		buf = rt_new(cap);
+	}
+	for(i = 0, off = 0; i < n; i++) {
+		memcpy(buf + off, parts[i].data, parts[i].len);
+		off += parts[i].len;
+	}
+	if(dst->data != dst->small) {
+		rt_dispose(dst->data, dst->cap);
+	}
+	if(buf == tmp) {
+		memcpy(dst->small, tmp, len);
+		dst->data = dst->small;
+	} else {
+		dst->data = buf;
+		dst->cap = cap;
+	}
+	dst->len = len;
+}
+
+void rt_str_set(rt_string *dst, const char *data, size_t len) {
+	rt_view part = {data, len};
+	rt_str_concat(dst, 1, &part);
+}
+
+long rt_str_eq(const char *a, size_t alen, const char *b, size_t blen) {
+	return alen == blen && !memcmp(a, b, alen);
+}
+
+long rt_str_cmp(const char *a, size_t alen, const char *b, size_t blen) {
+	int c = memcmp(a, b, alen < blen ? alen : blen);
+	if(c) {
+		return c;
+	}
+	return alen < blen ? -1 : alen > blen;
+}
+
+/* memchr finds each candidate for sub's first byte; memcmp checks the rest */
+long rt_str_find(const char *s, size_t len, const char *sub, size_t sublen) {
+	const char *p = s, *end = s + len;
+	if(!sublen) {
+		return 0;
+	}
+	while(sublen <= (size_t) (end - p) && (p = memchr(p, sub[0], end - p - sublen + 1))) {
+		if(!memcmp(p + 1, sub + 1, sublen - 1)) {
+			return p - s;
+		}
+		p++;
+	}
+	return -1;
+}
+
+long rt_str_findc(const char *s, size_t len, long c) {
+	const char *p = memchr(s, (unsigned char) c, len);
+	return p ? p - s : -1;
+}
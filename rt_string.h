@@ -0,0 +1,47 @@
+#ifndef RT_STRING_H
+#define RT_STRING_H
+
+#include <stddef.h>
+
+/* Runtime support for string, linked into compiled programs. The compiler
+ * knows this layout (see layout.c): it reads data and len inline, for
+ * indexing and length, and calls the rest. A string's bytes are in small
+ * while they fit, and data points there; longer ones are on the heap. Bytes
+ * aren't NUL-terminated.
+ */
+
+#define RT_STR_SMALL 16
+
+typedef struct _rt_string {
+	char *data;
+	size_t len;
+	union {
+		char small[RT_STR_SMALL];
+		size_t cap; /* of the heap buffer, when data isn't small */
+	};
+} rt_string;
+
+/* Bytes that are only read, where they are: a string's data and len, or a
+ * literal's */
+typedef struct _rt_view {
+	const char *data;
+	size_t len;
+} rt_view;
+
+/* A value argument arrives with the caller's data and len; this gives it
+ * its own bytes. The compiler inlines the empty string (data = small, len =
+ * 0) for other variables.
+ */
+void rt_str_own(rt_string *s);
+void rt_str_free(rt_string *s);
+/* dst := the parts, in order; any of them may be dst or point into it */
+void rt_str_concat(rt_string *dst, size_t n, const rt_view *parts);
+void rt_str_set(rt_string *dst, const char *data, size_t len);
+/* Results are longs: compiled code reads the whole register */
+long rt_str_eq(const char *a, size_t alen, const char *b, size_t blen);
+long rt_str_cmp(const char *a, size_t alen, const char *b, size_t blen);
+/* Offset of the first occurrence, -1 if none */
+long rt_str_find(const char *s, size_t len, const char *sub, size_t sublen);
+long rt_str_findc(const char *s, size_t len, long c);
+
+#endif
@@ -5,6 +5,7 @@
 #include "sem.h"
 #include "type.h"
 #include "loc.h"
+#include "cg.h"
 #include "vector.h"
 #include "util.h"
 
@@ -18,17 +19,18 @@ scope *scope_new_root(void) {
 	return res;
 }
 
+/* Scopes are owned by their programs; parent and children links are weak */
 scope *scope_new(scope *parent) {
 	scope *res = scope_new_root();
-	res->parent = scope_copy(parent);
-	vec_insert(&parent->children, 0, scope_copy(res));
+	res->parent = parent;
+	vec_insert(&parent->children, 0, res);
 	return res;
 }
 
 scope *scope_new_above(scope *child) {
 	scope *res = scope_new_root();
-	vec_insert(&res->children, 0, scope_copy(child));
-	child->parent = scope_copy(res);
+	vec_insert(&res->children, 0, child);
+	child->parent = res;
 	return res;
 }
 
@@ -64,30 +66,34 @@ symbol *scope_resolve_type(scope *sco, const char *name) {
 	return vec_get(&sco->types, idx, symbol);
 }
 
-void scope_add_name(scope *sco, symbol *sym) {
+/* Both take over the caller's reference, and return nonzero if sym replaced
+ * a symbol of the same name (the caller decides whether that is worth a
+ * diagnostic).
+ */
+int scope_add_name(scope *sco, symbol *sym) {
 	assert(sym->kind != SYM_TYPE);
 	ssize_t idx = vec_test(&sco->names, (vec_test_f) _scope_test_sym_name, (void *) sym->ident) - 1;
+	sym->scope = sco;
 	if(idx < 0 || idx >= sco->names.len) {
-		vec_insert(&sco->names, 0, sym_copy(sym));
-	} else {
-		fprintf(stderr, "\x1b[33;1mWarning: Attempting to add symbol %s (type %s) again\x1b[m\n", sym->ident, type_repr(sym->type));
-		sym_delete(vec_get(&sco->names, idx, symbol));
-		vec_set(&sco->names, idx, sym_copy(sym));
+		vec_insert(&sco->names, 0, sym);
+		return 0;
 	}
-	sym->scope = sco;
+	sym_delete(vec_get(&sco->names, idx, symbol));
+	vec_set(&sco->names, idx, sym);
+	return 1;
 }
 
-void scope_add_type(scope *sco, symbol *sym) {
+int scope_add_type(scope *sco, symbol *sym) {
 	assert(sym->kind == SYM_TYPE);
 	ssize_t idx = vec_test(&sco->types, (vec_test_f) _scope_test_sym_name, (void *) sym->ident) - 1;
+	sym->scope = sco;
 	if(idx < 0 || idx >= sco->types.len) {
-		vec_insert(&sco->types, 0, sym_copy(sym));
-	} else {
-		fprintf(stderr, "\x1b[33;1mWarning: Attempting to add type %s (%s) again\x1b[m\n", sym->ident, type_repr(sym->type));
-		sym_delete(vec_get(&sco->types, idx, symbol));
-		vec_set(&sco->types, idx, sym_copy(sym));
+		vec_insert(&sco->types, 0, sym);
+		return 0;
 	}
-	sym->scope = sco;
+	sym_delete(vec_get(&sco->types, idx, symbol));
+	vec_set(&sco->types, idx, sym);
+	return 1;
 }
 
 scope *scope_copy(scope *sco) {
@@ -102,9 +108,19 @@ void scope_delete(scope *sco) {
 }
 
 void scope_destroy(scope *sco) {
+	size_t i;
 	vec_foreach(&sco->names, (vec_iter_f) sym_delete, NULL);
-	vec_foreach(&sco->children, (vec_iter_f) scope_delete, NULL);
-	vec_remove(&sco->parent->children, vec_search(&sco->parent->children, sco));
+	vec_foreach(&sco->types, (vec_iter_f) sym_delete, NULL);
+	vec_clear(&sco->names);
+	vec_clear(&sco->types);
+	/* Children outliving us (they shouldn't) lose their parent */
+	for(i = 0; i < sco->children.len; i++) {
+		vec_get(&sco->children, i, scope)->parent = NULL;
+	}
+	vec_clear(&sco->children);
+	if(sco->parent) {
+		vec_remove(&sco->parent->children, vec_search(&sco->parent->children, sco));
+	}
 	free(sco);
 }
 
@@ -125,6 +141,30 @@ void scope_print(FILE *out, int lev, scope *sco) {
 	}
 }
 
+void scope_dump(dumper *d, scope *sco) {
+	size_t i;
+	if(!sco) {
+		dump_null(d);
+		return;
+	}
+	dump_begin_obj(d);
+	dump_key(d, "id");
+	dump_ptr(d, sco);
+	dump_key(d, "names");
+	dump_begin_arr(d);
+	for(i = 0; i < sco->names.len; i++) {
+		sym_dump(d, vec_get(&sco->names, i, symbol));
+	}
+	dump_end_arr(d);
+	dump_key(d, "types");
+	dump_begin_arr(d);
+	for(i = 0; i < sco->types.len; i++) {
+		sym_dump(d, vec_get(&sco->types, i, symbol));
+	}
+	dump_end_arr(d);
+	dump_end_obj(d);
+}
+
 symbol *sym_new_data(const char *ident, type *type, location *loc) {
 	symbol *res = malloc(sizeof(symbol));
 	res->refcnt = 1;
@@ -138,6 +178,10 @@ symbol *sym_new_data(const char *ident, type *type, location *loc) {
 		res->loc = NULL;
 	}
 	res->init.expr = NULL;
+	res->value = NULL;
+	res->effect.kind = 0;
+	vec_init(&res->effect.reads);
+	vec_init(&res->effect.writes);
 	return res;
 }
 
@@ -160,6 +204,12 @@ symbol *sym_new_type(const char *ident, type *type) {
 	return res;
 }
 
+symbol *sym_new_const(const char *ident, type *type, expr_node *expr) {
+	symbol *res = sym_new_data_init(ident, type, NULL, expr);
+	res->kind = SYM_CONST;
+	return res;
+}
+
 symbol *sym_copy(symbol *sym) {
 	sym->refcnt++;
 	return sym;
@@ -175,6 +225,8 @@ void sym_destroy(symbol *sym) {
 	switch(sym->kind) {
 		case SYM_PROG:
 			program_delete(sym->init.prog);
+			vec_clear(&sym->effect.reads);
+			vec_clear(&sym->effect.writes);
 			break;
 
 		case SYM_DATA:
@@ -183,9 +235,26 @@ void sym_destroy(symbol *sym) {
 			}
 			break;
 
+		case SYM_CONST:
+			ex_delete(sym->init.expr);
+			if(sym->value) {
+				lit_delete(sym->value);
+			}
+			break;
+
+		case SYM_TYPE:
+			break;
+
 		default:
 			assert(0);
 	}
+	free(sym->ident);
+	if(sym->type) {
+		type_delete(sym->type);
+	}
+	if(sym->loc) {
+		loc_delete(sym->loc);
+	}
 	free(sym);
 }
 
@@ -196,15 +265,108 @@ void sym_print(FILE *out, int lev, symbol *sym) {
 	}
 	wrlev(out, lev, "[SYM %s: %s in %s @%s]", sym->ident, type_repr(sym->type), sym->scope?(sym->scope->prog?sym->scope->prog->node->ident:"ANONYMOUS PROGRAM"):"NULL", loc_repr(sym->loc));
 	if(sym->kind == SYM_PROG) {
+		effect_print(out, lev + 1, &sym->effect);
 		program_print(out, lev + 1, sym->init.prog);
 	}
+	if(sym->kind == SYM_CONST) {
+		lit_print(out, lev + 1, sym->value);
+	}
 }
 
+void sym_dump(dumper *d, symbol *sym) {
+	if(!sym) {
+		dump_null(d);
+		return;
+	}
+	dump_begin_obj(d);
+	dump_key(d, "ident");
+	dump_str(d, sym->ident);
+	dump_key(d, "type");
+	type_dump(d, sym->type);
+	dump_key(d, "loc");
+	loc_dump(d, sym->loc);
+	if(sym->kind == SYM_PROG) {
+		dump_key(d, "effect");
+		effect_dump(d, &sym->effect);
+		dump_key(d, "program");
+		program_dump(d, sym->init.prog);
+	}
+	if(sym->kind == SYM_CONST) {
+		dump_key(d, "value");
+		lit_dump(d, sym->value);
+	}
+	dump_end_obj(d);
+}
+
+static const char *effect_class(effect *eff) {
+	if(eff->kind & (EFF_WRITE | EFF_UNKNOWN)) {
+		return "writes";
+	}
+	return eff->kind & EFF_READ ? "reads" : "pure";
+}
+
+void effect_print(FILE *out, int lev, effect *eff) {
+	size_t i;
+	wrlev(out, lev, "[EFFECT %s%s]", effect_class(eff), eff->kind & EFF_UNKNOWN ? " (unknown memory)" : "");
+	for(i = 0; i < eff->reads.len; i++) {
+		wrlev(out, lev + 1, "reads %s", vec_get(&eff->reads, i, symbol)->ident);
+	}
+	for(i = 0; i < eff->writes.len; i++) {
+		wrlev(out, lev + 1, "writes %s", vec_get(&eff->writes, i, symbol)->ident);
+	}
+}
+
+void effect_dump(dumper *d, effect *eff) {
+	size_t i;
+	dump_begin_obj(d);
+	dump_key(d, "class");
+	dump_str(d, effect_class(eff));
+	dump_key(d, "unknown");
+	dump_bool(d, eff->kind & EFF_UNKNOWN);
+	dump_key(d, "reads");
+	dump_begin_arr(d);
+	for(i = 0; i < eff->reads.len; i++) {
+		dump_str(d, vec_get(&eff->reads, i, symbol)->ident);
+	}
+	dump_end_arr(d);
+	dump_key(d, "writes");
+	dump_begin_arr(d);
+	for(i = 0; i < eff->writes.len; i++) {
+		dump_str(d, vec_get(&eff->writes, i, symbol)->ident);
+	}
+	dump_end_arr(d);
+	dump_end_obj(d);
+}
+
+static const char *capture_names[] = {
+	"none",
+	"display",
+	"link",
+	"lift",
+};
+
 program *program_new(prog_node *node, scope *scope) {
 	program *prog = malloc(sizeof(program));
 	prog->refcnt = 1;
 	prog->node = prog_copy(node);
 	prog->scope = scope;
+	vec_init(&prog->callees);
+	prog->escapes = 0;
+	vec_init(&prog->calls);
+	prog->scc = 0;
+	prog->recursive = 0;
+	prog->static_frame = 0;
+	prog->static_off = 0;
+	prog->args_size = 0;
+	prog->frame_size = 0;
+	prog->result = NULL;
+	prog->capture = CAP_DISPLAY;
+	vec_init(&prog->lifted);
+	vec_init(&prog->reaches);
+	prog->display = 1;
+	prog->frameless = 0;
+	prog->reached = 0;
+	vec_init(&prog->escaping);
 	if(scope) scope->prog = prog;
 	return prog;
 }
@@ -220,24 +382,112 @@ void program_delete(program *prog) {
 	}
 }
 
+/* The node stays: the AST is owned by its ast_root, not by the semantic tree */
 void program_destroy(program *prog) {
-	scope_delete(prog->scope);
-	prog_delete(prog->node);
+	vec_clear(&prog->callees);
+	vec_clear(&prog->calls);
+	vec_clear(&prog->lifted);
+	vec_clear(&prog->reaches);
+	vec_clear(&prog->escaping);
+	if(prog->result) {
+		loc_delete(prog->result);
+	}
+	if(prog->scope) {
+		scope_delete(prog->scope);
+	}
 	free(prog);
 }
 
 void program_print(FILE *out, int lev, program *prog) {
+	size_t i;
 	if(!prog) {
 		wrlev(out, lev, "[(NULL)]");
 		return;
 	}
-	wrlev(out, lev, "[PROGRAM: %s #%ld]", prog->node->ident, prog->gdidx);
+	wrlev(out, lev, "[PROGRAM: %s #%ld %s%s%s%s%s%s]", prog->node->ident, prog->gdidx, capture_names[prog->capture], prog->display ? " displayed" : "", prog->frameless ? " frameless" : "", prog->recursive ? " recursive" : "", prog->static_frame ? " static" : "", prog->reached ? "" : " (unreached)");
+	for(i = 0; i < prog->escaping.len; i++) {
+		wrlev(out, lev + 1, "escaping %s", vec_get(&prog->escaping, i, symbol)->ident);
+	}
 	scope_print(out, lev + 1, prog->scope);
 }
 
-object *obj_new(void) {
+void program_dump(dumper *d, program *prog) {
+	size_t i;
+	if(!prog) {
+		dump_null(d);
+		return;
+	}
+	dump_begin_obj(d);
+	dump_key(d, "ident");
+	dump_str(d, prog->node->ident);
+	dump_key(d, "gdidx");
+	dump_int(d, prog->gdidx);
+	dump_key(d, "args_size");
+	dump_int(d, prog->args_size);
+	dump_key(d, "frame_size");
+	dump_int(d, prog->frame_size);
+	dump_key(d, "result");
+	loc_dump(d, prog->result);
+	dump_key(d, "capture");
+	dump_str(d, capture_names[prog->capture]);
+	dump_key(d, "lifted");
+	dump_begin_arr(d);
+	for(i = 0; i < prog->lifted.len; i++) {
+		dump_str(d, vec_get(&prog->lifted, i, symbol)->ident);
+	}
+	dump_end_arr(d);
+	dump_key(d, "display");
+	dump_bool(d, prog->display);
+	dump_key(d, "frameless");
+	dump_bool(d, prog->frameless);
+	dump_key(d, "escapes");
+	dump_bool(d, prog->escapes);
+	dump_key(d, "scc");
+	dump_int(d, prog->scc);
+	dump_key(d, "recursive");
+	dump_bool(d, prog->recursive);
+	dump_key(d, "static_frame");
+	dump_bool(d, prog->static_frame);
+	if(prog->static_frame) {
+		dump_key(d, "static_off");
+		dump_int(d, prog->static_off);
+	}
+	dump_key(d, "reached");
+	dump_bool(d, prog->reached);
+	dump_key(d, "escaping");
+	dump_begin_arr(d);
+	for(i = 0; i < prog->escaping.len; i++) {
+		dump_str(d, vec_get(&prog->escaping, i, symbol)->ident);
+	}
+	dump_end_arr(d);
+	dump_key(d, "callees");
+	dump_begin_arr(d);
+	for(i = 0; i < prog->callees.len; i++) {
+		dump_str(d, vec_get(&prog->callees, i, symbol)->ident);
+	}
+	dump_end_arr(d);
+	dump_key(d, "calls");
+	dump_begin_arr(d);
+	for(i = 0; i < prog->calls.len; i++) {
+		dump_str(d, vec_get(&prog->calls, i, program)->node->ident);
+	}
+	dump_end_arr(d);
+	dump_key(d, "scope");
+	scope_dump(d, prog->scope);
+	dump_end_obj(d);
+}
+
+object *obj_new(unsigned int flags) {
 	object *res = malloc(sizeof(object));
+	res->flags = flags;
 	res->root_prog = NULL;
+	res->block = NULL;
+	res->folded = 0;
+	res->frameless = 0;
+	vec_init(&res->progs);
+	res->overlay = 0;
+	res->labels = 0;
+	res->data = 0;
 	return res;
 }
 
@@ -252,6 +502,10 @@ void obj_delete(object *obj) {
 	if(obj->root_prog) {
 		program_delete(obj->root_prog);
 	}
+	if(obj->block) {
+		block_delete(obj->block);
+	}
+	vec_clear(&obj->progs);
 	free(obj);
 }
 
@@ -260,6 +514,23 @@ void obj_print(FILE *out, int lev, object *obj) {
 		wrlev(out, lev, "[(NULL)]");
 		return;
 	}
-	wrlev(out, lev, "[OBJECT:]");
+	wrlev(out, lev, "[OBJECT: %ld folded, %ld frameless, %ld overlay bytes]", obj->folded, obj->frameless, obj->overlay);
 	program_print(out, lev + 1, obj->root_prog);
 }
+
+void obj_dump(dumper *d, object *obj) {
+	if(!obj) {
+		dump_null(d);
+		return;
+	}
+	dump_begin_obj(d);
+	dump_key(d, "root");
+	program_dump(d, obj->root_prog);
+	dump_key(d, "folded");
+	dump_int(d, obj->folded);
+	dump_key(d, "frameless");
+	dump_int(d, obj->frameless);
+	dump_key(d, "overlay");
+	dump_int(d, obj->overlay);
+	dump_end_obj(d);
+}
@@ -5,14 +5,42 @@
 #include "vector.h"
 #include "loc.h"
 #include "ast.h"
+#include "lit.h"
 
 typedef struct _scope scope;
 
+/* How a procedure gets at the enclosing frames its body (or a callee's
+ * hidden arguments) needs; see cap in pass.c
+ */
+typedef enum {
+	CAP_NONE, /* uses no enclosing frame */
+	CAP_DISPLAY, /* reads frame bases from the global display */
+	CAP_LINK, /* static link: its parent's frame base is a hidden first argument */
+	CAP_LIFT, /* lambda lifted: each captured variable's address is a hidden argument */
+} capture_k;
+
 typedef struct _program {
 	size_t refcnt;
 	scope *scope;
 	prog_node *node;
+	vector callees; /* of symbol * (SYM_PROG, unowned), called directly; set by ef */
+	int escapes; /* referenced other than by calling it, so callable through values; set by ef */
+	vector calls; /* of program * (unowned), what a call from it may enter, through values too; set by sf */
+	size_t scc; /* its strongly connected component of the call graph; set by sf */
+	int recursive; /* in a call cycle, so possibly active more than once at a time; set by sf */
+	int static_frame; /* its frame is in the static overlay (see sf) */
+	size_t static_off; /* where in the overlay; set by lay */
 	size_t gdidx;
+	size_t args_size; /* bytes of arguments above the saved FP; set by lay */
+	size_t frame_size; /* bytes of locals below the frame base, padded; set by lay */
+	location *result; /* functions: the slot assignments to the function's name write; set by lay */
+	capture_k capture; /* set by cap; display until then */
+	vector lifted; /* CAP_LIFT: of symbol * (unowned), in hidden argument order */
+	vector reaches; /* of program * (unowned), enclosing frames whose base it computes */
+	int display; /* maintains its display entry, because something reads it */
+	int frameless; /* a leaf emitted without FP or frame; set by ir */
+	int reached; /* body analyzed; in lazy objects, only once referenced from reached code */
+	vector escaping; /* of symbol * (unowned), its variables and open arguments that a view may outlive the frame of; set by esc */
 } program;
 
 program *program_new(prog_node *node, scope *scope);
@@ -20,13 +48,24 @@ program *program_copy(program *prog);
 void program_delete(program *prog);
 void program_destroy(program *prog);
 void program_print(FILE *, int, program *);
+void program_dump(dumper *, program *);
 
 typedef enum {
 	SYM_PROG,
 	SYM_DATA,
 	SYM_TYPE,
+	SYM_CONST,
 } symbol_k;
 
+typedef struct _effect {
+	unsigned int kind; /* of effect_k; 0 is pure */
+	vector reads; /* of symbol * (unowned), nonlocal data read */
+	vector writes; /* of symbol * (unowned), nonlocal data written */
+} effect;
+
+void effect_print(FILE *, int, effect *);
+void effect_dump(dumper *, effect *);
+
 typedef struct _symbol {
 	symbol_k kind;
 	size_t refcnt;
@@ -38,16 +77,20 @@ typedef struct _symbol {
 		expr_node *expr;
 		program *prog;
 	} init;
+	literal *value; /* SYM_CONST: the initializer, once evaluated at compile time */
+	effect effect; /* SYM_PROG: what a call may touch outside the callee's frame */
 } symbol;
 
 symbol *sym_new_data(const char *ident, type *type, location *loc);
 symbol *sym_new_data_init(const char *ident, type *type, location *loc, expr_node *expr);
 symbol *sym_new_prog(const char *ident, type *type, location *loc, program *prog);
 symbol *sym_new_type(const char *ident, type *type);
+symbol *sym_new_const(const char *ident, type *type, expr_node *expr);
 symbol *sym_copy(symbol *sym);
 void sym_delete(symbol *sym);
 void sym_destroy(symbol *sym);
 void sym_print(FILE *, int, symbol *);
+void sym_dump(dumper *, symbol *);
 
 typedef struct _scope {
 	size_t refcnt;
@@ -64,21 +107,33 @@ scope *scope_new_above(scope *child);
 int _scope_test_sym_name(const char *name, symbol *sym, vector *names, size_t idx);
 symbol *scope_resolve_name(scope *sco, const char *name);
 symbol *scope_resolve_type(scope *sco, const char *name);
-void scope_add_name(scope *sco, symbol *sym);
-void scope_add_type(scope *sco, symbol *sym);
+int scope_add_name(scope *sco, symbol *sym);
+int scope_add_type(scope *sco, symbol *sym);
 scope *scope_copy(scope *sco);
 void scope_delete(scope *sco);
 void scope_destroy(scope *sco);
 void scope_print(FILE *, int, scope *);
+void scope_dump(dumper *, scope *);
+
+typedef enum {
+	OBJ_LAZY = 1, /* only analyze procedures reachable from the main program */
+} obj_flag_k;
 
 typedef struct _object {
+	unsigned int flags; /* of obj_flag_k */
 	program *root_prog;
 	void *block; /* block * */
+	size_t folded; /* expression nodes removed by constant folding */
+	size_t frameless; /* programs emitted without a frame */
+	vector progs; /* of program * (unowned), the reached ones, callers before callees; set by sf */
+	size_t overlay; /* bytes of the static frame overlay; set by lay */
+	unsigned long labels, data; /* numbers of the generated __L and __D names; set by ir */
 } object;
 
-object *obj_new(void);
+object *obj_new(unsigned int flags);
 void obj_set_root_prog(object *obj, program *root_prog);
 void obj_delete(object *obj);
 void obj_print(FILE *, int, object *);
+void obj_dump(dumper *, object *);
 
 #endif
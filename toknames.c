@@ -9,20 +9,38 @@ const char *toknames[] = {
 	"TOK_COMMA",
 	"TOK_COLON",
 	"TOK_VAR",
+	"TOK_CONST",
 	"TOK_ASSIGN",
 	"TOK_FUNCTION",
 	"TOK_PROCEDURE",
+	"TOK_EQ",
 	"TOK_TYPE",
 	"TOK_INTEGER",
 	"TOK_REAL",
+	"TOK_INT8",
+	"TOK_INT16",
+	"TOK_INT32",
+	"TOK_INT64",
+	"TOK_SINGLE",
 	"TOK_CHARACTER",
+	"TOK_STRING",
+	"TOK_BOOLEAN",
 	"TOK_ARRAY",
 	"TOK_LBRACKET",
 	"TOK_LIT_INTEGER",
 	"TOK_DOTDOT",
 	"TOK_RBRACKET",
 	"TOK_OF",
+	"TOK_SOA",
+	"TOK_PACKED",
+	"TOK_SET",
+	"TOK_LIT_CHAR",
+	"TOK_RECORD",
+	"TOK_END",
 	"TOK_ARROW",
+	"TOK_BXOR",
+	"TOK_NEW",
+	"TOK_DISPOSE",
 	"TOK_WHILE",
 	"TOK_DO",
 	"TOK_IF",
@@ -31,11 +49,10 @@ const char *toknames[] = {
 	"TOK_FOR",
 	"TOK_IN",
 	"TOK_BEGIN",
-	"TOK_END",
+	"TOK_LENGTH",
 	"TOK_OR",
 	"TOK_AND",
 	"TOK_NOT",
-	"TOK_EQ",
 	"TOK_NEQ",
 	"TOK_LEQ",
 	"TOK_GEQ",
@@ -48,12 +65,15 @@ const char *toknames[] = {
 	"TOK_MOD",
 	"TOK_BOR",
 	"TOK_BAND",
-	"TOK_BXOR",
 	"TOK_BLSHIFT",
 	"TOK_BRSHIFT",
+	"TOK_CARD",
 	"TOK_BNOT",
 	"TOK_LIT_REAL",
-	"TOK_LIT_CHAR",
+	"TOK_LIT_STRING",
+	"TOK_TRUE",
+	"TOK_FALSE",
+	"TOK_NIL",
 	"TOK_LBRACE",
 	"TOK_RBRACE",
 	"TOK_INDIRECT",
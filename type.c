@@ -11,45 +11,79 @@ type *type_new(void) {
 	type *res = malloc(sizeof(struct _type));
 	assert(res);
 	res->refcnt = 1;
+	res->layout_target = NULL;
+	res->width = 0;
 	return res;
 }
 
-type *_type_simple_factory(type_k kind) {
-	type *res = type_new();
-	res->kind = kind;
-	return res;
-}
+/* The scalar types are immutable singletons; they start with a reference that
+ * is never released, so they are never destroyed. */
+static type _tp_int = {.kind = TP_INT, .refcnt = 1, .width = 8};
+static type _tp_real = {.kind = TP_REAL, .refcnt = 1, .width = 8};
+static type _tp_char = {.kind = TP_CHAR, .refcnt = 1};
+static type _tp_bool = {.kind = TP_BOOL, .refcnt = 1};
+static type _tp_string = {.kind = TP_STRING, .refcnt = 1};
+
+/* Narrower integers and reals; integer and real are the 8-byte ones */
+static type _tp_int8 = {.kind = TP_INT, .refcnt = 1, .width = 1};
+static type _tp_int16 = {.kind = TP_INT, .refcnt = 1, .width = 2};
+static type _tp_int32 = {.kind = TP_INT, .refcnt = 1, .width = 4};
+static type _tp_single = {.kind = TP_REAL, .refcnt = 1, .width = 4};
+
+static type *const scalar_types[TP_NKINDS] = {
+	[TP_INT] = &_tp_int,
+	[TP_REAL] = &_tp_real,
+	[TP_CHAR] = &_tp_char,
+	[TP_BOOL] = &_tp_bool,
+};
 
 type *type_new_int(void) {
-	static type *res = NULL;
-	if(!res) {
-		res = _type_simple_factory(TP_INT);
-	}
-	return type_copy(res);
+	return type_copy(&_tp_int);
 }
 
 type *type_new_real(void) {
-	static type *res = NULL;
-	if(!res) {
-		res = _type_simple_factory(TP_REAL);
-	}
-	return type_copy(res);
+	return type_copy(&_tp_real);
 }
 
 type *type_new_char(void) {
-	static type *res = NULL;
-	if(!res) {
-		res = _type_simple_factory(TP_CHAR);
-	}
-	return type_copy(res);
+	return type_copy(&_tp_char);
 }
 
 type *type_new_bool(void) {
-	static type *res = NULL;
-	if(!res) {
-		res = _type_simple_factory(TP_BOOL);
+	return type_copy(&_tp_bool);
+}
+
+type *type_new_string(void) {
+	return type_copy(&_tp_string);
+}
+
+/* The integer or real type of width bytes; NULL if there isn't one */
+type *type_new_sized(type_k kind, size_t width) {
+	switch(kind) {
+		case TP_INT:
+			switch(width) {
+				case 1: return type_copy(&_tp_int8);
+				case 2: return type_copy(&_tp_int16);
+				case 4: return type_copy(&_tp_int32);
+				case 8: return type_copy(&_tp_int);
+				default: return NULL;
+			}
+
+		case TP_REAL:
+			switch(width) {
+				case 4: return type_copy(&_tp_single);
+				case 8: return type_copy(&_tp_real);
+				default: return NULL;
+			}
+
+		default:
+			return NULL;
 	}
-	return type_copy(res);
+}
+
+/* Borrowed (not copied) singleton for a scalar kind, NULL otherwise */
+type *type_scalar(type_k kind) {
+	return scalar_types[kind];
 }
 
 type *type_new_array(type *base, ssize_t lbound, ssize_t size) {
@@ -58,6 +92,21 @@ type *type_new_array(type *base, ssize_t lbound, ssize_t size) {
 	res->base = type_copy(base);
 	res->lbound = lbound;
 	res->size = size;
+	res->store = AS_PLAIN;
+	res->open = 0;
+	return res;
+}
+
+/* array[lbound..] of base: an open argument, dynamic array or view */
+type *type_new_open_array(type *base, ssize_t lbound) {
+	type *res = type_new_array(base, lbound, -1);
+	res->open = 1;
+	return res;
+}
+
+type *type_new_stored_array(type *base, ssize_t lbound, ssize_t size, array_store_k store) {
+	type *res = type_new_array(base, lbound, size);
+	res->store = store;
 	return res;
 }
 
@@ -90,6 +139,14 @@ type *type_new_union(vector *names, vector *types) {
 	return res;
 }
 
+/* ^base; a NULL base is nil's type, which any pointer can be given */
+type *type_new_ptr(type *base) {
+	type *res = type_new();
+	res->kind = TP_PTR;
+	res->base = type_copy(base);
+	return res;
+}
+
 type *type_new_ref(const char *ref) {
 	type *res = type_new();
 	res->kind = TP_REF;
@@ -98,7 +155,7 @@ type *type_new_ref(const char *ref) {
 }
 
 type *type_copy(type *tp) {
-	tp->refcnt++;
+	if(tp) tp->refcnt++;
 	return tp;
 }
 
@@ -112,15 +169,25 @@ void type_destroy(type *tp) {
 	switch(tp->kind) {
 		case TP_INT:
 		case TP_REAL:
+		case TP_CHAR:
 		case TP_BOOL:
+		case TP_STRING:
 			break;
 
 		case TP_ARRAY:
 			type_delete(tp->base);
 			break;
 
+		case TP_PTR:
+			if(tp->base) {
+				type_delete(tp->base);
+			}
+			break;
+
 		case TP_FUNC:
-			type_delete(tp->ret);
+			if(tp->ret) {
+				type_delete(tp->ret);
+			}
 			vec_foreach(&tp->args, (vec_iter_f) type_delete, NULL);
 			vec_clear(&tp->args);
 			break;
@@ -156,11 +223,27 @@ int type_equal(type *tpa, type *tpb) {
 	switch(tpa->kind) {
 		case TP_INT:
 		case TP_REAL:
+			if(tpa->width != tpb->width) {
+				return 0;
+			}
+			break;
+
 		case TP_BOOL:
 		case TP_CHAR:
+		case TP_STRING:
 			break;
 
 		case TP_ARRAY:
+			if(tpa->store != tpb->store || !type_equal(tpa->base, tpb->base)) {
+				return 0;
+			}
+			/* Bits are only where the other expects them at the same size */
+			if(type_is_bitset(tpa) && (tpa->lbound != tpb->lbound || tpa->size != tpb->size)) {
+				return 0;
+			}
+			break;
+
+		case TP_PTR:
 			if(!type_equal(tpa->base, tpb->base)) {
 				return 0;
 			}
@@ -192,11 +275,49 @@ int type_equal(type *tpa, type *tpb) {
 	return 1;
 }
 
+/* Position of the field called ident in a record or union, -1 if none */
+ssize_t type_field_index(type *ty, const char *ident) {
+	size_t i;
+	if(!ty || (ty->kind != TP_STRUCT && ty->kind != TP_UNION)) {
+		return -1;
+	}
+	for(i = 0; i < ty->names.len; i++) {
+		if(string_equal(vec_get(&ty->names, i, char), ident)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Bitsets are whole values: they can be and-ed, or-ed, negated and counted */
+int type_is_bitset(type *ty) {
+	return ty && ty->kind == TP_ARRAY && (ty->store == AS_BITS || ty->store == AS_SET);
+}
+
+/* Bitsets whose bits stand for the values lbound.. of base, not positions */
+int type_is_set(type *ty) {
+	return ty && ty->kind == TP_ARRAY && ty->store == AS_SET;
+}
+
+/* Arrays whose bounds are only known at run time: arguments given any
+ * array of their element type, and dynamic arrays. Both are held as a
+ * descriptor of where the elements are, the first index and the length.
+ */
+int type_is_open(type *ty) {
+	return ty && ty->kind == TP_ARRAY && ty->open;
+}
+
+static const char *store_prefix[] = {
+	[AS_PLAIN] = "",
+	[AS_SOA] = "soa ",
+	[AS_BITS] = "packed ",
+};
+
 #define TREPR_SZ 1024
 
 const char *type_repr(type *ty) {
 	char tbuffer[TREPR_SZ] = {0};
-	char *trepr = malloc(sizeof(char) * TREPR_SZ);
+	char *trepr = malloc(sizeof(char) * TREPR_SZ), *inner = NULL, *part;
 	int chars;
 	size_t i;
 	if(!ty) {
@@ -205,11 +326,15 @@ const char *type_repr(type *ty) {
 	}
 	switch(ty->kind) {
 		case TP_INT:
-			chars = snprintf(tbuffer, TREPR_SZ, "integer");
+			if(ty->width == _tp_int.width) {
+				chars = snprintf(tbuffer, TREPR_SZ, "integer");
+			} else {
+				chars = snprintf(tbuffer, TREPR_SZ, "int%zu", ty->width * 8);
+			}
 			break;
 
 		case TP_REAL:
-			chars = snprintf(tbuffer, TREPR_SZ, "real");
+			chars = snprintf(tbuffer, TREPR_SZ, ty->width == _tp_real.width ? "real" : "single");
 			break;
 
 		case TP_CHAR:
@@ -217,25 +342,55 @@ const char *type_repr(type *ty) {
 			break;
 
 		case TP_ARRAY:
-			chars = snprintf(tbuffer, TREPR_SZ, "array[%ld..%ld] of %s", ty->lbound, ty->lbound + ty->size, type_repr(ty->base));
+			if(ty->store == AS_SET) {
+				if(ty->size < 0) {
+					inner = (char *) type_repr(ty->base);
+					chars = snprintf(tbuffer, TREPR_SZ, "set of %s", inner);
+				} else if(ty->base->kind == TP_CHAR && !ty->lbound && ty->size == 256) {
+					chars = snprintf(tbuffer, TREPR_SZ, "set of character");
+				} else {
+					chars = snprintf(tbuffer, TREPR_SZ, "set of %ld..%ld", ty->lbound, ty->lbound + ty->size);
+				}
+				break;
+			}
+			inner = (char *) type_repr(ty->base);
+			if(ty->open) {
+				chars = snprintf(tbuffer, TREPR_SZ, "%sarray[%ld..] of %s", store_prefix[ty->store], ty->lbound, inner);
+				break;
+			}
+			/* Rows of a multi-dimensional array: array[lb..ub, ...] of T */
+			if(ty->store == AS_PLAIN && ty->base->kind == TP_ARRAY && ty->base->store == AS_PLAIN && !ty->base->open) {
+				chars = snprintf(tbuffer, TREPR_SZ, "array[%ld..%ld, %s", ty->lbound, ty->lbound + ty->size, inner + strlen("array["));
+				break;
+			}
+			chars = snprintf(tbuffer, TREPR_SZ, "%sarray[%ld..%ld] of %s", store_prefix[ty->store], ty->lbound, ty->lbound + ty->size, inner);
 			break;
 
 		case TP_BOOL:
-			chars = snprintf(tbuffer, TREPR_SZ, "(bool)");
+			chars = snprintf(tbuffer, TREPR_SZ, "boolean");
+			break;
+
+		case TP_STRING:
+			chars = snprintf(tbuffer, TREPR_SZ, "string");
 			break;
 
 		case TP_FUNC:
 			chars = snprintf(tbuffer, TREPR_SZ, "(");
 			for(i = 0; i < ty->args.len; i++) {
-				chars += snprintf(tbuffer + chars, TREPR_SZ - chars, "%s,", type_repr(vec_get(&ty->args, i, type)));
+				part = (char *) type_repr(vec_get(&ty->args, i, type));
+				chars += snprintf(tbuffer + chars, TREPR_SZ - chars, "%s,", part);
+				free(part);
 			}
-			chars += snprintf(tbuffer + chars, TREPR_SZ - chars, ")->%s", type_repr(ty->ret));
+			inner = (char *) type_repr(ty->ret);
+			chars += snprintf(tbuffer + chars, TREPR_SZ - chars, ")->%s", inner);
 			break;
 
 		case TP_STRUCT:
 			chars = snprintf(tbuffer, TREPR_SZ, "struct (");
 			for(i = 0; i < ty->types.len; i++) {
-				chars += snprintf(tbuffer + chars, TREPR_SZ - chars, "%s: %s,", vec_get(&ty->names, i, char), type_repr(vec_get(&ty->types, i, type)));
+				part = (char *) type_repr(vec_get(&ty->types, i, type));
+				chars += snprintf(tbuffer + chars, TREPR_SZ - chars, "%s: %s,", vec_get(&ty->names, i, char), part);
+				free(part);
 			}
 			chars += snprintf(tbuffer + chars, TREPR_SZ - chars, ")");
 			break;
@@ -243,11 +398,27 @@ const char *type_repr(type *ty) {
 		case TP_UNION:
 			chars = snprintf(tbuffer, TREPR_SZ, "union (");
 			for(i = 0; i < ty->types.len; i++) {
-				chars += snprintf(tbuffer + chars, TREPR_SZ - chars, "%s: %s,", vec_get(&ty->names, i, char), type_repr(vec_get(&ty->types, i, type)));
+				part = (char *) type_repr(vec_get(&ty->types, i, type));
+				chars += snprintf(tbuffer + chars, TREPR_SZ - chars, "%s: %s,", vec_get(&ty->names, i, char), part);
+				free(part);
 			}
 			chars += snprintf(tbuffer + chars, TREPR_SZ - chars, ")");
 			break;
 
+		case TP_PTR:
+			if(!ty->base) {
+				chars = snprintf(tbuffer, TREPR_SZ, "nil");
+				break;
+			}
+			/* A named pointee is shown by name, as it is usually declared */
+			if(ty->base->kind == TP_REF) {
+				chars = snprintf(tbuffer, TREPR_SZ, "^%s", ty->base->ref);
+				break;
+			}
+			inner = (char *) type_repr(ty->base);
+			chars = snprintf(tbuffer, TREPR_SZ, "^%s", inner);
+			break;
+
 		case TP_REF:
 			chars = snprintf(tbuffer, TREPR_SZ, "(ref: %s)", ty->ref);
 			break;
@@ -256,42 +427,185 @@ const char *type_repr(type *ty) {
 			chars = snprintf(tbuffer, TREPR_SZ, "!!!UNKNOWN TYPE!!!");
 			break;
 	}
+	free(inner);
 	memcpy(trepr, tbuffer, chars + 1);
 	return trepr;
 }
 
-int num_rank[] = {
-	2,					/*TP_INT*/
-	3,					/*TP_REAL*/
-	1,					/*TP_CHAR*/
-	-1,					/*TP_ARRAY*/
-	0,					/*TP_BOOL*/
-	-1,					/*TP_FUNC*/
-	-1,					/*TP_STRUCT*/
-	-1,					/*TP_UNION*/
-	-1,					/*TP_REF*/
+void type_dump(dumper *d, type *ty) {
+	if(!ty) {
+		dump_null(d);
+		return;
+	}
+	dump_str_free(d, type_repr(ty));
+}
+
+int num_rank[TP_NKINDS] = {
+	[TP_INT] = 2,
+	[TP_REAL] = 3,
+	[TP_CHAR] = 1,
+	[TP_ARRAY] = -1,
+	[TP_BOOL] = 0,
+	[TP_FUNC] = -1,
+	[TP_STRUCT] = -1,
+	[TP_UNION] = -1,
+	[TP_STRING] = -1,
+	[TP_PTR] = -1,
+	[TP_REF] = -1,
+};
+
+/* The scalar typing rules, precomputed from num_rank so that checking a
+ * scalar expression is a table load with no allocation. Only arrays,
+ * functions and records go through the generic paths below.
+ */
+
+#define I CAST_IMPLICIT
+#define U CAST_UNINTENDED
+
+/* [from][to]: widening (by num_rank) is implicit, narrowing unintended */
+#define CAST_ROWS \
+	[TP_BOOL] = {[TP_BOOL] = I, [TP_CHAR] = I, [TP_INT] = I, [TP_REAL] = I}, \
+	[TP_CHAR] = {[TP_BOOL] = U, [TP_CHAR] = I, [TP_INT] = I, [TP_REAL] = I}, \
+	[TP_INT] = {[TP_BOOL] = U, [TP_CHAR] = U, [TP_INT] = I, [TP_REAL] = I}, \
+	[TP_REAL] = {[TP_BOOL] = U, [TP_CHAR] = U, [TP_INT] = U, [TP_REAL] = I},
+
+/* min(cast(left, bool), cast(left, right)) */
+#define LOGIC_ROWS \
+	[TP_BOOL] = {[TP_BOOL] = I, [TP_CHAR] = I, [TP_INT] = I, [TP_REAL] = I}, \
+	[TP_CHAR] = {[TP_BOOL] = U, [TP_CHAR] = U, [TP_INT] = U, [TP_REAL] = U}, \
+	[TP_INT] = {[TP_BOOL] = U, [TP_CHAR] = U, [TP_INT] = U, [TP_REAL] = U}, \
+	[TP_REAL] = {[TP_BOOL] = U, [TP_CHAR] = U, [TP_INT] = U, [TP_REAL] = U},
+
+/* min(cast(left, integer), cast(left, right)) */
+#define BITWISE_ROWS \
+	[TP_BOOL] = {[TP_BOOL] = I, [TP_CHAR] = I, [TP_INT] = I, [TP_REAL] = I}, \
+	[TP_CHAR] = {[TP_BOOL] = U, [TP_CHAR] = I, [TP_INT] = I, [TP_REAL] = I}, \
+	[TP_INT] = {[TP_BOOL] = U, [TP_CHAR] = U, [TP_INT] = I, [TP_REAL] = I}, \
+	[TP_REAL] = {[TP_BOOL] = U, [TP_CHAR] = U, [TP_INT] = U, [TP_REAL] = U},
+
+#define ALL_ROWS(v) \
+	[TP_BOOL] = {[TP_BOOL] = v, [TP_CHAR] = v, [TP_INT] = v, [TP_REAL] = v}, \
+	[TP_CHAR] = {[TP_BOOL] = v, [TP_CHAR] = v, [TP_INT] = v, [TP_REAL] = v}, \
+	[TP_INT] = {[TP_BOOL] = v, [TP_CHAR] = v, [TP_INT] = v, [TP_REAL] = v}, \
+	[TP_REAL] = {[TP_BOOL] = v, [TP_CHAR] = v, [TP_INT] = v, [TP_REAL] = v},
+
+/* type_num_promote: the operand of higher num_rank */
+#define PROMOTE_ROWS \
+	[TP_BOOL] = {[TP_BOOL] = &_tp_bool, [TP_CHAR] = &_tp_char, [TP_INT] = &_tp_int, [TP_REAL] = &_tp_real}, \
+	[TP_CHAR] = {[TP_BOOL] = &_tp_char, [TP_CHAR] = &_tp_char, [TP_INT] = &_tp_int, [TP_REAL] = &_tp_real}, \
+	[TP_INT] = {[TP_BOOL] = &_tp_int, [TP_CHAR] = &_tp_int, [TP_INT] = &_tp_int, [TP_REAL] = &_tp_real}, \
+	[TP_REAL] = {[TP_BOOL] = &_tp_real, [TP_CHAR] = &_tp_real, [TP_INT] = &_tp_real, [TP_REAL] = &_tp_real},
+
+static const cast_k cast_table[TP_NKINDS][TP_NKINDS] = {
+	CAST_ROWS
 };
 
+static type *const promote_table[TP_NKINDS][TP_NKINDS] = {
+	PROMOTE_ROWS
+};
+
+static const cast_k binop_cast_table[NBINOPS][TP_NKINDS][TP_NKINDS] = {
+	[OP_ADD] = {CAST_ROWS},
+	[OP_SUB] = {CAST_ROWS},
+	[OP_MUL] = {CAST_ROWS},
+	[OP_DIV] = {CAST_ROWS},
+	[OP_MOD] = {CAST_ROWS},
+	[OP_EQ] = {ALL_ROWS(I)},
+	[OP_NEQ] = {ALL_ROWS(I)},
+	[OP_LEQ] = {CAST_ROWS},
+	[OP_GEQ] = {CAST_ROWS},
+	[OP_LESS] = {CAST_ROWS},
+	[OP_GREATER] = {CAST_ROWS},
+	[OP_AND] = {LOGIC_ROWS},
+	[OP_OR] = {LOGIC_ROWS},
+	[OP_BAND] = {BITWISE_ROWS},
+	[OP_BOR] = {BITWISE_ROWS},
+	[OP_BXOR] = {BITWISE_ROWS},
+	[OP_BLSHIFT] = {BITWISE_ROWS},
+	[OP_BRSHIFT] = {BITWISE_ROWS},
+};
+
+static type *const binop_type_table[NBINOPS][TP_NKINDS][TP_NKINDS] = {
+	[OP_ADD] = {PROMOTE_ROWS},
+	[OP_SUB] = {PROMOTE_ROWS},
+	[OP_MUL] = {PROMOTE_ROWS},
+	[OP_DIV] = {PROMOTE_ROWS},
+	[OP_MOD] = {PROMOTE_ROWS},
+	[OP_EQ] = {ALL_ROWS(&_tp_bool)},
+	[OP_NEQ] = {ALL_ROWS(&_tp_bool)},
+	[OP_LEQ] = {ALL_ROWS(&_tp_bool)},
+	[OP_GEQ] = {ALL_ROWS(&_tp_bool)},
+	[OP_LESS] = {ALL_ROWS(&_tp_bool)},
+	[OP_GREATER] = {ALL_ROWS(&_tp_bool)},
+	[OP_AND] = {ALL_ROWS(&_tp_bool)},
+	[OP_OR] = {ALL_ROWS(&_tp_bool)},
+	[OP_BAND] = {ALL_ROWS(&_tp_int)},
+	[OP_BOR] = {ALL_ROWS(&_tp_int)},
+	[OP_BXOR] = {ALL_ROWS(&_tp_int)},
+	[OP_BLSHIFT] = {ALL_ROWS(&_tp_int)},
+	[OP_BRSHIFT] = {ALL_ROWS(&_tp_int)},
+};
+
+/* [kind][operand]; OP_CARD only applies to bitsets */
+static const cast_k unop_cast_table[NUNOPS][TP_NKINDS] = {
+	[OP_NEG] = {[TP_BOOL] = I, [TP_CHAR] = I, [TP_INT] = I, [TP_REAL] = I},
+	[OP_NOT] = {[TP_BOOL] = I, [TP_CHAR] = U, [TP_INT] = U, [TP_REAL] = U},
+	[OP_BNOT] = {[TP_BOOL] = I, [TP_CHAR] = I, [TP_INT] = I, [TP_REAL] = U},
+	[OP_IDENT] = {[TP_BOOL] = I, [TP_CHAR] = I, [TP_INT] = I, [TP_REAL] = I},
+};
+
+static type *const unop_type_table[NUNOPS][TP_NKINDS] = {
+	[OP_NEG] = {[TP_BOOL] = &_tp_bool, [TP_CHAR] = &_tp_char, [TP_INT] = &_tp_int, [TP_REAL] = &_tp_real},
+	[OP_NOT] = {[TP_BOOL] = &_tp_bool, [TP_CHAR] = &_tp_bool, [TP_INT] = &_tp_bool, [TP_REAL] = &_tp_bool},
+	[OP_BNOT] = {[TP_BOOL] = &_tp_int, [TP_CHAR] = &_tp_int, [TP_INT] = &_tp_int, [TP_REAL] = &_tp_int},
+	[OP_IDENT] = {[TP_BOOL] = &_tp_bool, [TP_CHAR] = &_tp_char, [TP_INT] = &_tp_int, [TP_REAL] = &_tp_real},
+	[OP_CARD] = {[TP_BOOL] = &_tp_int, [TP_CHAR] = &_tp_int, [TP_INT] = &_tp_int, [TP_REAL] = &_tp_int},
+};
+
+#undef CAST_ROWS
+#undef LOGIC_ROWS
+#undef BITWISE_ROWS
+#undef ALL_ROWS
+#undef PROMOTE_ROWS
+#undef I
+#undef U
+
+/* Whether a value of from may not fit to, of the same or of a lower rank:
+ * a narrower integer or real, or a single from an integer of 32 bits or
+ * more (an 8-byte real is as exact as it ever was).
+ */
+static int type_narrows(type *from, type *to) {
+	if(from->kind == to->kind && (to->kind == TP_INT || to->kind == TP_REAL)) {
+		return to->width < from->width;
+	}
+	return from->kind == TP_INT && to->kind == TP_REAL && to->width < _tp_real.width && from->width >= to->width;
+}
+
 cast_k type_can_cast(type *from, type *to) {
 	if(!from) return CAST_NONE;
+	if(type_is_scalar(to)) {
+		if(type_is_scalar(from)) {
+			return type_narrows(from, to) ? min(cast_table[from->kind][to->kind], CAST_UNINTENDED) : cast_table[from->kind][to->kind];
+		}
+		return CAST_NONE;
+	}
 	switch(to->kind) {
-		case TP_INT:
-		case TP_REAL:
-		case TP_CHAR:
-		case TP_BOOL:
-			if(from->kind == TP_INT || from->kind == TP_REAL || from->kind == TP_CHAR || from->kind == TP_BOOL) {
-				int flev = num_rank[from->kind], tlev = num_rank[to->kind];
-				assert(flev >= 0 && tlev >= 0);
-				if(tlev >= flev) {
-					return CAST_IMPLICIT;
-				}
-				return CAST_UNINTENDED;
-			}
-			return CAST_NONE;
-			break;
-
 		case TP_ARRAY:
-			if(to->size >= 0) {
+			if(from->kind == TP_STRING) {
+				return CAST_NONE;
+			}
+			/* The elements aren't where the other layout looks for them */
+			if(from->kind == TP_ARRAY && from->store != to->store) {
+				return CAST_EXPLICIT;
+			}
+			if(from->kind == TP_ARRAY && type_is_bitset(to)) {
+				return type_equal(from, to) ? CAST_IMPLICIT : CAST_NONE;
+			}
+			if(!to->open) {
+				/* How many elements there are isn't known until run time */
+				if(type_is_open(from)) {
+					return CAST_NONE;
+				}
 				if(!type_equal(from->base, to->base)) {
 					return CAST_UNINTENDED;
 				}
@@ -315,25 +629,57 @@ cast_k type_can_cast(type *from, type *to) {
 			return CAST_EXPLICIT;
 			break;
 
+		case TP_STRING:
+			return from->kind == TP_STRING ? CAST_IMPLICIT : CAST_NONE;
+			break;
+
+		case TP_PTR:
+			if(from->kind != TP_PTR) {
+				return CAST_NONE;
+			}
+			if(!from->base || type_equal(from->base, to->base)) {
+				return CAST_IMPLICIT;
+			}
+			return CAST_EXPLICIT;
+			break;
+
 		default: /* case TYPE_REF */
 			assert(0);
 			break;
 	}
 }
 
-type *type_num_promote(type *ta, type *tb) {
-	int alev = num_rank[ta->kind], blev = num_rank[tb->kind];
-	assert(alev >= 0 && blev >= 0);
-	if(alev > blev) {
-		return ta;
+/* The widest of left and right (which may be NULL) with res's kind, if
+ * either has it; res otherwise. A real result is as wide as its operands,
+ * so singles stay singles; integers are promoted to the word, as in Pascal,
+ * and only narrowed again when they are stored.
+ */
+static type *type_sized(type *res, type *left, type *right) {
+	if(!res || res->kind != TP_REAL) {
+		return res;
+	}
+	if(left && left->kind == res->kind && (!right || right->kind != res->kind || left->width >= right->width)) {
+		return left;
 	}
-	return tb;
+	if(right && right->kind == res->kind) {
+		return right;
+	}
+	return res;
+}
+
+type *type_num_promote(type *ta, type *tb) {
+	assert(type_is_scalar(ta) && type_is_scalar(tb));
+	return type_sized(promote_table[ta->kind][tb->kind], ta, tb);
 }
 
 cast_k type_can_index(type *object, type *index) {
+	if(type_is_set(object)) {
+		return CAST_NONE;
+	}
 	switch(object->kind) {
 		case TP_ARRAY:
-			return type_can_cast(index, type_new_int());
+		case TP_STRING:
+			return type_can_cast(index, &_tp_int);
 			break;
 
 		default:
@@ -348,6 +694,10 @@ type *type_of_index(type *object, type *index) {
 			return object->base;
 			break;
 
+		case TP_STRING:
+			return &_tp_char;
+			break;
+
 		default:
 			assert(0);
 			break;
@@ -355,14 +705,24 @@ type *type_of_index(type *object, type *index) {
 }
 
 cast_k type_can_setindex(type *object, type *index, type *value) {
+	if(type_is_set(object)) {
+		return CAST_NONE;
+	}
 	switch(object->kind) {
 		case TP_ARRAY:
-			if(type_can_cast(index, type_new_int()) >= CAST_UNINTENDED) {
+			if(type_can_cast(index, &_tp_int) >= CAST_UNINTENDED) {
 				return type_can_cast(value, object->base);
 			}
 			return CAST_NONE;
 			break;
 
+		case TP_STRING:
+			if(type_can_cast(index, &_tp_int) >= CAST_UNINTENDED) {
+				return type_can_cast(value, &_tp_char);
+			}
+			return CAST_NONE;
+			break;
+
 		default:
 			return CAST_NONE;
 			break;
@@ -372,17 +732,16 @@ cast_k type_can_setindex(type *object, type *index, type *value) {
 /* params of type * */
 cast_k type_can_call(type *func, vector *params) {
 	size_t i;
-	cast_k c = CAST_UNINTENDED;
+	cast_k c = CAST_IMPLICIT;
 	switch(func->kind) {
 		case TP_FUNC:
-			if(type_equal(func, type_new_func(func->ret, params))) {
-				return CAST_IMPLICIT;
-			}
 			if(params->len != func->args.len) {
 				return CAST_NONE;
 			}
 			for(i = 0; i < params->len; i++) {
-				c = min(c, type_can_cast(vec_get(params, i, type), vec_get(&func->args, i, type)));
+				if(!type_equal(vec_get(params, i, type), vec_get(&func->args, i, type))) {
+					c = min(c, min(CAST_UNINTENDED, type_can_cast(vec_get(params, i, type), vec_get(&func->args, i, type))));
+				}
 			}
 			return c;
 			break;
@@ -405,18 +764,36 @@ type *type_of_call(type *func, vector *params) {
 	}
 }
 
+int type_is_scalar(type *ty) {
+	return ty && num_rank[ty->kind] >= 0;
+}
+
 cast_k type_can_unop(type *value, int kind) {
+	if(type_is_scalar(value)) {
+		return unop_cast_table[kind][value->kind];
+	}
 	switch(kind) {
 		case OP_NEG:
-			return type_can_cast(value, type_new_real());
+			return type_can_cast(value, &_tp_real);
 			break;
 
 		case OP_NOT:
-			return type_can_cast(value, type_new_bool());
+			if(type_is_bitset(value)) {
+				return CAST_IMPLICIT;
+			}
+			return type_can_cast(value, &_tp_bool);
+			break;
+
+		case OP_CARD:
+			return type_is_bitset(value) ? CAST_IMPLICIT : CAST_NONE;
+			break;
+
+		case OP_LENGTH:
+			return value && (value->kind == TP_STRING || (value->kind == TP_ARRAY && !type_is_set(value))) ? CAST_IMPLICIT : CAST_NONE;
 			break;
 
 		case OP_BNOT:
-			return type_can_cast(value, type_new_int());
+			return type_can_cast(value, &_tp_int);
 			break;
 
 		case OP_IDENT:
@@ -429,7 +806,11 @@ cast_k type_can_unop(type *value, int kind) {
 	}
 }
 
+/* Like the other type_of_* functions, the result is borrowed. */
 type *type_of_unop(type *value, int kind) {
+	if(type_is_scalar(value)) {
+		return type_sized(unop_type_table[kind][value->kind], value, NULL);
+	}
 	switch(kind) {
 		case OP_NEG:
 		case OP_IDENT:
@@ -437,11 +818,13 @@ type *type_of_unop(type *value, int kind) {
 			break;
 
 		case OP_NOT:
-			return type_new_bool();
+			return type_is_bitset(value) ? value : &_tp_bool;
 			break;
 
 		case OP_BNOT:
-			return type_new_int();
+		case OP_CARD:
+		case OP_LENGTH:
+			return &_tp_int;
 			break;
 
 		default:
@@ -451,13 +834,55 @@ type *type_of_unop(type *value, int kind) {
 }
 
 cast_k type_can_binop(type *left, int kind, type *right) {
+	if(type_is_scalar(left) && type_is_scalar(right)) {
+		return binop_cast_table[kind][left->kind][right->kind];
+	}
+	if(!left || !right) {
+		return CAST_NONE;
+	}
+	/* Union, difference and intersection; membership */
+	if(type_is_set(left) || type_is_set(right)) {
+		switch(kind) {
+			case OP_ADD:
+			case OP_SUB:
+			case OP_MUL:
+			case OP_AND:
+			case OP_OR:
+				return type_equal(left, right) ? CAST_IMPLICIT : CAST_NONE;
+
+			case OP_IN:
+				return type_is_set(right) && type_is_scalar(left) && left->kind != TP_REAL ? type_can_cast(left, right->base) : CAST_NONE;
+
+			default:
+				return CAST_NONE;
+		}
+	}
+	/* Concatenation and comparison; a character or substring of a string */
+	if(left->kind == TP_STRING || right->kind == TP_STRING) {
+		switch(kind) {
+			case OP_ADD:
+			case OP_EQ:
+			case OP_NEQ:
+			case OP_LESS:
+			case OP_GREATER:
+			case OP_LEQ:
+			case OP_GEQ:
+				return left->kind == right->kind ? CAST_IMPLICIT : CAST_NONE;
+
+			case OP_IN:
+				return right->kind == TP_STRING && (left->kind == TP_STRING || left->kind == TP_CHAR) ? CAST_IMPLICIT : CAST_NONE;
+
+			default:
+				return CAST_NONE;
+		}
+	}
 	switch(kind) {
 		case OP_ADD:
 		case OP_SUB:
 		case OP_MUL:
 		case OP_DIV:
 		case OP_MOD:
-			return min(type_can_cast(left, type_new_real()), type_can_cast(left, right));
+			return min(type_can_cast(left, &_tp_real), type_can_cast(left, right));
 			break;
 
 		case OP_EQ:
@@ -469,12 +894,15 @@ cast_k type_can_binop(type *left, int kind, type *right) {
 		case OP_GREATER:
 		case OP_LEQ:
 		case OP_GEQ:
-			return min(type_can_cast(left, type_new_real()), type_can_cast(left, right));
+			return min(type_can_cast(left, &_tp_real), type_can_cast(left, right));
 			break;
 
 		case OP_AND:
 		case OP_OR:
-			return min(type_can_cast(left, type_new_bool()), type_can_cast(left, right));
+			if(type_is_bitset(left) || type_is_bitset(right)) {
+				return type_equal(left, right) && left->size == right->size ? CAST_IMPLICIT : CAST_NONE;
+			}
+			return min(type_can_cast(left, &_tp_bool), type_can_cast(left, right));
 			break;
 
 		case OP_BAND:
@@ -482,7 +910,7 @@ cast_k type_can_binop(type *left, int kind, type *right) {
 		case OP_BXOR:
 		case OP_BLSHIFT:
 		case OP_BRSHIFT:
-			return min(type_can_cast(left, type_new_int()), type_can_cast(left, right));
+			return min(type_can_cast(left, &_tp_int), type_can_cast(left, right));
 			break;
 
 		default:
@@ -492,6 +920,15 @@ cast_k type_can_binop(type *left, int kind, type *right) {
 }
 
 type *type_of_binop(type *left, int kind, type *right) {
+	if(type_is_scalar(left) && type_is_scalar(right)) {
+		return type_sized(binop_type_table[kind][left->kind][right->kind], left, right);
+	}
+	if(kind == OP_IN) {
+		return &_tp_bool;
+	}
+	if(type_is_set(left) || (left && left->kind == TP_STRING && kind == OP_ADD)) {
+		return left;
+	}
 	switch(kind) {
 		case OP_ADD:
 		case OP_SUB:
@@ -507,9 +944,12 @@ type *type_of_binop(type *left, int kind, type *right) {
 		case OP_GREATER:
 		case OP_LEQ:
 		case OP_GEQ:
+			return &_tp_bool;
+			break;
+
 		case OP_AND:
 		case OP_OR:
-			return type_new_bool();
+			return type_is_bitset(left) ? left : &_tp_bool;
 			break;
 
 		case OP_BAND:
@@ -517,7 +957,7 @@ type *type_of_binop(type *left, int kind, type *right) {
 		case OP_BXOR:
 		case OP_BLSHIFT:
 		case OP_BRSHIFT:
-			return type_new_int();
+			return &_tp_int;
 			break;
 
 		default:
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 
 #include "vector.h"
+#include "dump.h"
 
 typedef enum {
 	TP_INT,
@@ -15,19 +16,38 @@ typedef enum {
 	TP_FUNC,
 	TP_STRUCT,
 	TP_UNION,
+	TP_STRING,
+	TP_PTR, /* base is what it points to; NULL for nil's type */
 	TP_REF,
 } type_k;
 
+#define TP_NKINDS (TP_REF + 1)
+
 typedef struct _type type;
 
+/* How an array's elements are laid out */
+typedef enum {
+	AS_PLAIN,
+	AS_SOA, /* of records, stored as one array per field */
+	AS_BITS, /* of booleans, packed a bit each into words */
+	AS_SET, /* a bit per possible element of base; size -1 for literals */
+} array_store_k;
+
 typedef struct _type {
 	type_k kind;
 	size_t refcnt;
+	/* Cached by type_size/type_align (layout.c) for layout_target */
+	const struct _target *layout_target;
+	ssize_t layout_size;
+	size_t layout_align;
+	size_t width; /* TP_INT, TP_REAL: bytes of storage */
 	union {
 		struct {
-			type *base;
+			type *base; /* also TP_PTR's */
 			ssize_t lbound;
-			ssize_t size;
+			ssize_t size; /* -1 when open */
+			array_store_k store;
+			int open; /* bounds only known at run time (see type_is_open) */
 		};
 		struct {
 			type *ret;
@@ -36,7 +56,7 @@ typedef struct _type {
 		struct {
 			vector names; /* of char * */
 			vector types; /* of type * */
-		};
+		}; /* TP_STRUCT (records) and TP_UNION */
 		char *ref;
 	};
 } type;
@@ -46,16 +66,27 @@ type *type_new_int(void);
 type *type_new_real(void);
 type *type_new_char(void);
 type *type_new_bool(void);
+type *type_new_sized(type_k kind, size_t width);
+type *type_new_string(void);
 type *type_new_array(type *base, ssize_t lbound, ssize_t size);
+type *type_new_open_array(type *base, ssize_t lbound);
+type *type_new_stored_array(type *base, ssize_t lbound, ssize_t size, array_store_k store);
 type *type_new_func(type *ret, vector *args);
 type *type_new_struct(vector *names, vector *types);
 type *type_new_union(vector *names, vector *types);
+type *type_new_ptr(type *base);
 type *type_new_ref(const char *ref);
+type *type_scalar(type_k kind);
 type *type_copy(type *tp);
 void type_delete(type *tp);
 void type_destroy(type *tp);
 int type_equal(type *tpa, type *tpb);
+ssize_t type_field_index(type *ty, const char *ident);
+int type_is_bitset(type *ty);
+int type_is_set(type *ty);
+int type_is_open(type *ty);
 const char *type_repr(type *ty);
+void type_dump(dumper *, type *);
 
 typedef enum {
 	CAST_NONE,
@@ -64,6 +95,7 @@ typedef enum {
 	CAST_IMPLICIT,
 } cast_k;
 
+int type_is_scalar(type *ty);
 cast_k type_can_cast(type *from,type *to);
 type *type_num_promote(type *ta,type *tb);
 cast_k type_can_index(type *object,type *index);